@@ -0,0 +1,890 @@
+/**
+ * @file load_generator.cpp
+ * @brief http_load: closed- and open-loop load generator for HTTP/1.1, HTTPS and WebSocket endpoints.
+ *
+ * Each connection is a session on one of --threads event loops. In closed-loop mode a session keeps
+ * --pipeline requests in flight and sends the next one as soon as a response arrives. In open-loop
+ * mode (--rate) requests are sent on a fixed schedule whatever the server does, and latency is
+ * measured from the time a request was due rather than from when it went out, so a stalled server
+ * shows up in the percentiles instead of silently lowering the offered load.
+ *
+ * Only requests due inside the measurement window (after --warmup, for --duration) are counted.
+ * The result is one JSON object on stdout (or --output), so runs can be compared between builds.
+ *
+ * The tool only depends on Boost.Asio, OpenSSL and nlohmann_json, not on the server sources, so
+ * one binary can measure any build.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using tcp = boost::asio::ip::tcp;
+using SslStream = boost::asio::ssl::stream<tcp::socket>;
+
+constexpr auto RECONNECT_DELAY = std::chrono::milliseconds(100);
+constexpr size_t REPORTED_ERRORS = 5;
+constexpr size_t READ_SIZE = 64 * 1024;
+
+enum class Mode { HTTP, WEBSOCKET };
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;
+    std::string path = "/";
+    std::vector<std::string> headers;
+    Mode mode = Mode::HTTP;
+    bool tls = false;
+    bool keep_alive = true;
+    size_t connections = 50;
+    size_t threads = 1;
+    size_t pipeline = 1;
+    double rate = 0;  // Requests per second over all connections; 0 for closed loop
+    std::chrono::milliseconds duration{10000};
+    std::chrono::milliseconds warmup{1000};
+    std::chrono::milliseconds grace{2000};  // Wait for responses still due after the window
+    size_t message_size = 128;
+    std::string output;
+};
+
+struct Window {
+    Clock::time_point start;    // Sessions connect from here
+    Clock::time_point measure;  // Requests due from here on are counted
+    Clock::time_point end;      // Nothing is sent from here on
+
+    bool counts(Clock::time_point due) const noexcept { return due >= measure && due < end; }
+};
+
+// Misconfigured runs fail the same way on every connection; the first few
+// say why, the counts say the rest
+void report(const std::string& message) {
+    static std::atomic<size_t> reported{0};
+    if (reported.fetch_add(1, std::memory_order_relaxed) < REPORTED_ERRORS) {
+        std::cerr << message << std::endl;
+    }
+}
+
+// Per event loop; only touched by its thread
+struct Stats {
+    std::vector<uint32_t> latencies_us;
+    uint64_t bytes_received = 0;
+    uint64_t non_2xx = 0;
+    uint64_t connect_errors = 0;
+    uint64_t io_errors = 0;
+    uint64_t incomplete = 0;
+    uint64_t connections = 0;
+};
+
+void usage(const char* program) {
+    std::cerr
+        << "Usage: " << program << " [options]\n"
+        << "\n"
+        << "Target:\n"
+        << "  --host HOST          Server address (default 127.0.0.1)\n"
+        << "  --port PORT          Server port (default 8080)\n"
+        << "  --path PATH          Request path, or the WebSocket route (default /)\n"
+        << "  --header 'N: V'      Extra request header; repeatable\n"
+        << "  --tls                Connect with TLS (certificates are not verified)\n"
+        << "  --websocket          Send --message-size text messages to an echo route instead\n"
+        << "\n"
+        << "Load:\n"
+        << "  --connections N      Concurrent connections (default 50)\n"
+        << "  --threads N          Event loops driving them (default 1)\n"
+        << "  --pipeline N         Requests in flight per connection, closed loop (default 1)\n"
+        << "  --rate R             Open loop: R requests per second over all connections\n"
+        << "  --no-keepalive       One request per connection, connect time included\n"
+        << "  --message-size N     WebSocket message size in bytes (default 128)\n"
+        << "\n"
+        << "Timing:\n"
+        << "  --duration SECONDS   Measurement window (default 10)\n"
+        << "  --warmup SECONDS     Load before the window that is not counted (default 1)\n"
+        << "  --output FILE        Write the JSON result to FILE instead of stdout\n";
+}
+
+template <typename T>
+std::optional<T> to_number(std::string_view text, int base = 10) {
+    T value{};
+    std::from_chars_result parsed;
+    if constexpr (std::is_floating_point_v<T>) {
+        parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+    } else {
+        parsed = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    }
+    if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size() || text.empty()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+template <typename T>
+T parse_number(std::string_view name, std::string_view text) {
+    auto value = to_number<T>(text);
+    if (!value) {
+        throw std::invalid_argument("invalid value for " + std::string(name) + ": " + std::string(text));
+    }
+    return *value;
+}
+
+std::chrono::milliseconds parse_seconds(std::string_view name, std::string_view text) {
+    return std::chrono::milliseconds(static_cast<int64_t>(parse_number<double>(name, text) * 1000));
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto value = [&]() -> std::string_view {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + std::string(arg));
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--host") options.host = value();
+        else if (arg == "--port") options.port = parse_number<uint16_t>(arg, value());
+        else if (arg == "--path") options.path = value();
+        else if (arg == "--header") options.headers.emplace_back(value());
+        else if (arg == "--tls") options.tls = true;
+        else if (arg == "--websocket") options.mode = Mode::WEBSOCKET;
+        else if (arg == "--connections") options.connections = parse_number<size_t>(arg, value());
+        else if (arg == "--threads") options.threads = parse_number<size_t>(arg, value());
+        else if (arg == "--pipeline") options.pipeline = parse_number<size_t>(arg, value());
+        else if (arg == "--rate") options.rate = parse_number<double>(arg, value());
+        else if (arg == "--no-keepalive") options.keep_alive = false;
+        else if (arg == "--message-size") options.message_size = parse_number<size_t>(arg, value());
+        else if (arg == "--duration") options.duration = parse_seconds(arg, value());
+        else if (arg == "--warmup") options.warmup = parse_seconds(arg, value());
+        else if (arg == "--output") options.output = value();
+        else if (arg == "--help" || arg == "-h") {
+            usage(argv[0]);
+            std::exit(0);
+        } else {
+            throw std::invalid_argument("unknown option " + std::string(arg));
+        }
+    }
+
+    if (options.connections == 0 || options.threads == 0 || options.pipeline == 0) {
+        throw std::invalid_argument("--connections, --threads and --pipeline must be at least 1");
+    }
+    if (options.rate < 0 || options.duration.count() <= 0) {
+        throw std::invalid_argument("--rate must not be negative and --duration must be positive");
+    }
+    if (!options.keep_alive && (options.mode == Mode::WEBSOCKET || options.rate > 0 || options.pipeline > 1)) {
+        throw std::invalid_argument("--no-keepalive only works in closed-loop HTTP mode without --pipeline");
+    }
+    options.threads = std::min(options.threads, options.connections);
+    return options;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+constexpr size_t INCOMPLETE = 0;
+constexpr size_t MALFORMED = std::string_view::npos;
+
+// Size of the chunked body at the front of data, including the trailers
+size_t chunked_body_size(std::string_view data) {
+    size_t position = 0;
+    while (true) {
+        size_t line_end = data.find("\r\n", position);
+        if (line_end == std::string_view::npos) {
+            return INCOMPLETE;
+        }
+        // Chunk extensions are not used by the server
+        auto chunk = to_number<size_t>(data.substr(position, line_end - position), 16);
+        if (!chunk) {
+            return MALFORMED;
+        }
+        position = line_end + 2;
+        if (*chunk == 0) {
+            // Trailers end with an empty line
+            while (true) {
+                size_t trailer_end = data.find("\r\n", position);
+                if (trailer_end == std::string_view::npos) {
+                    return INCOMPLETE;
+                }
+                bool empty = trailer_end == position;
+                position = trailer_end + 2;
+                if (empty) {
+                    return position;
+                }
+            }
+        }
+        if (data.size() < position + *chunk + 2) {
+            return INCOMPLETE;
+        }
+        position += *chunk + 2;
+    }
+}
+
+// Size of the HTTP response at the front of data
+size_t http_response_size(std::string_view data, int& status) {
+    size_t header_end = data.find("\r\n\r\n");
+    if (header_end == std::string_view::npos) {
+        return INCOMPLETE;
+    }
+    std::string_view head = data.substr(0, header_end);
+    if (head.size() < 12 || head.substr(0, 5) != "HTTP/") {
+        return MALFORMED;
+    }
+    auto code = to_number<int>(head.substr(9, 3));
+    if (!code) {
+        return MALFORMED;
+    }
+    status = *code;
+
+    std::optional<size_t> content_length;
+    bool chunked = false;
+    size_t line_start = head.find("\r\n");
+    while (line_start != std::string_view::npos) {
+        line_start += 2;
+        size_t line_end = head.find("\r\n", line_start);
+        std::string_view line = head.substr(line_start, line_end - line_start);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) {
+            std::string_view name = line.substr(0, colon);
+            std::string_view value = line.substr(colon + 1);
+            value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+            if (iequals(name, "content-length")) {
+                content_length = to_number<size_t>(value);
+                if (!content_length) {
+                    return MALFORMED;
+                }
+            } else if (iequals(name, "transfer-encoding") && value.find("chunked") != std::string_view::npos) {
+                chunked = true;
+            }
+        }
+        line_start = line_end;
+    }
+
+    size_t body_start = header_end + 4;
+    if (chunked) {
+        size_t body = chunked_body_size(data.substr(body_start));
+        return body == INCOMPLETE || body == MALFORMED ? body : body_start + body;
+    }
+    // Responses without a length are taken as empty: the server always sends one
+    size_t length = content_length.value_or(0);
+    return data.size() < body_start + length ? INCOMPLETE : body_start + length;
+}
+
+// Size of the server-to-client WebSocket frame at the front of data, and of its header
+size_t websocket_frame_size(std::string_view data, uint8_t& opcode, size_t& header) {
+    if (data.size() < 2) {
+        return INCOMPLETE;
+    }
+    auto byte = [&](size_t i) { return static_cast<uint8_t>(data[i]); };
+    opcode = byte(0) & 0x0F;
+    uint64_t length = byte(1) & 0x7F;
+    header = 2;
+    if (length == 126) {
+        header = 4;
+        if (data.size() < header) return INCOMPLETE;
+        length = (uint64_t{byte(2)} << 8) | byte(3);
+    } else if (length == 127) {
+        header = 10;
+        if (data.size() < header) return INCOMPLETE;
+        length = 0;
+        for (size_t i = 2; i < 10; ++i) {
+            length = (length << 8) | byte(i);
+        }
+    }
+    if (byte(1) & 0x80) {
+        header += 4;
+    }
+    return data.size() < header + length ? INCOMPLETE : header + static_cast<size_t>(length);
+}
+
+// Client frames must be masked; the key is fixed, which the protocol allows
+std::string masked_frame(uint8_t opcode, std::string_view payload) {
+    const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    std::string frame;
+    frame.push_back(static_cast<char>(0x80 | opcode));
+    if (payload.size() < 126) {
+        frame.push_back(static_cast<char>(0x80 | payload.size()));
+    } else if (payload.size() <= 0xFFFF) {
+        frame.push_back(static_cast<char>(0x80 | 126));
+        frame.push_back(static_cast<char>(payload.size() >> 8));
+        frame.push_back(static_cast<char>(payload.size() & 0xFF));
+    } else {
+        frame.push_back(static_cast<char>(0x80 | 127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame.push_back(static_cast<char>((static_cast<uint64_t>(payload.size()) >> shift) & 0xFF));
+        }
+    }
+    frame.append(reinterpret_cast<const char*>(key), 4);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        frame.push_back(static_cast<char>(payload[i] ^ key[i % 4]));
+    }
+    return frame;
+}
+
+class SessionBase {
+public:
+    virtual ~SessionBase() = default;
+    virtual void start() = 0;
+    // At the end of the grace period: responses still missing never came
+    virtual void finish() = 0;
+};
+
+/**
+ * @brief One load-generating connection, reconnecting after errors
+ *
+ * Handlers hold the stream they were started on; a handler for a stream
+ * that has since been replaced does nothing.
+ */
+template <typename Stream>
+class Session : public SessionBase {
+public:
+    Session(boost::asio::io_context& io_context, boost::asio::ssl::context& ssl_context, const Options& options,
+            const tcp::resolver::results_type& endpoints, const Window& window, Stats& stats,
+            Clock::duration send_interval, Clock::time_point first_send)
+        : io_context_(io_context)
+        , ssl_context_(ssl_context)
+        , options_(options)
+        , endpoints_(endpoints)
+        , window_(window)
+        , stats_(stats)
+        , send_interval_(send_interval)
+        , next_send_(first_send)
+        , send_timer_(io_context)
+        , retry_timer_(io_context) {
+        if (options_.mode == Mode::WEBSOCKET) {
+            request_ = masked_frame(0x1, std::string(options_.message_size, 'x'));
+        } else {
+            request_ = "GET " + options_.path + " HTTP/1.1\r\nHost: " + options_.host + ":" +
+                       std::to_string(options_.port) + "\r\n";
+            for (const auto& header : options_.headers) {
+                request_ += header + "\r\n";
+            }
+            if (!options_.keep_alive) {
+                request_ += "Connection: close\r\n";
+            }
+            request_ += "\r\n";
+        }
+    }
+
+    void start() override {
+        connect();
+        if (open_loop()) {
+            schedule_send();
+        }
+    }
+
+    void finish() override {
+        for (auto due : outstanding_) {
+            if (window_.counts(due)) {
+                ++stats_.incomplete;
+            }
+        }
+        outstanding_.clear();
+    }
+
+private:
+    boost::asio::io_context& io_context_;
+    boost::asio::ssl::context& ssl_context_;
+    const Options& options_;
+    const tcp::resolver::results_type& endpoints_;
+    const Window& window_;
+    Stats& stats_;
+    Clock::duration send_interval_;
+    Clock::time_point next_send_;
+    boost::asio::steady_timer send_timer_;
+    boost::asio::steady_timer retry_timer_;
+
+    std::shared_ptr<Stream> stream_;
+    bool ready_{false};          // Connected, and upgraded in WebSocket mode
+    bool writing_{false};
+    Clock::time_point connect_started_;
+    std::string request_;
+    std::string pending_;        // Requests not yet handed to a write
+    std::string writing_buffer_;
+    std::string read_buffer_;
+    std::deque<Clock::time_point> outstanding_;  // When each request in flight was due
+
+    bool open_loop() const noexcept { return options_.rate > 0; }
+
+    tcp::socket::lowest_layer_type& socket(Stream& stream) { return stream.lowest_layer(); }
+
+    void connect() {
+        if constexpr (std::is_same_v<Stream, SslStream>) {
+            stream_ = std::make_shared<Stream>(io_context_, ssl_context_);
+            SSL_set_tlsext_host_name(stream_->native_handle(), options_.host.c_str());
+        } else {
+            stream_ = std::make_shared<Stream>(io_context_);
+        }
+        ready_ = false;
+        writing_ = false;
+        read_buffer_.clear();
+        connect_started_ = Clock::now();
+
+        auto stream = stream_;
+        boost::asio::async_connect(socket(*stream), endpoints_,
+            [this, stream](const boost::system::error_code& error, const tcp::endpoint&) {
+                if (stream != stream_) {
+                    return;
+                }
+                if (error) {
+                    fail(true);
+                    return;
+                }
+                socket(*stream).set_option(tcp::no_delay(true));
+                ++stats_.connections;
+                if constexpr (std::is_same_v<Stream, SslStream>) {
+                    stream->async_handshake(boost::asio::ssl::stream_base::client,
+                        [this, stream](const boost::system::error_code& error) {
+                            if (stream != stream_) {
+                                return;
+                            }
+                            if (error) {
+                                fail(true);
+                                return;
+                            }
+                            connected();
+                        });
+                } else {
+                    connected();
+                }
+            });
+    }
+
+    void connected() {
+        if (options_.mode == Mode::WEBSOCKET) {
+            upgrade();
+            return;
+        }
+        ready();
+    }
+
+    void upgrade() {
+        auto stream = stream_;
+        auto handshake = std::make_shared<std::string>(
+            "GET " + options_.path + " HTTP/1.1\r\nHost: " + options_.host + ":" + std::to_string(options_.port) +
+            "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Version: 13\r\n\r\n");
+        boost::asio::async_write(*stream, boost::asio::buffer(*handshake),
+            [this, stream, handshake](const boost::system::error_code& error, size_t) {
+                if (stream != stream_) {
+                    return;
+                }
+                if (error) {
+                    fail(false);
+                    return;
+                }
+                read_upgrade();
+            });
+    }
+
+    void read_upgrade() {
+        auto stream = stream_;
+        size_t size = read_buffer_.size();
+        read_buffer_.resize(size + READ_SIZE);
+        stream->async_read_some(boost::asio::buffer(read_buffer_.data() + size, READ_SIZE),
+            [this, stream, size](const boost::system::error_code& error, size_t bytes) {
+                if (stream != stream_) {
+                    return;
+                }
+                read_buffer_.resize(size + bytes);
+                if (error) {
+                    fail(false);
+                    return;
+                }
+                size_t header_end = read_buffer_.find("\r\n\r\n");
+                if (header_end == std::string::npos) {
+                    read_upgrade();
+                    return;
+                }
+                if (read_buffer_.compare(0, 12, "HTTP/1.1 101") != 0) {
+                    report("WebSocket upgrade refused: " + read_buffer_.substr(0, read_buffer_.find("\r\n")));
+                    fail(true);
+                    return;
+                }
+                read_buffer_.erase(0, header_end + 4);
+                ready();
+            });
+    }
+
+    void ready() {
+        ready_ = true;
+        read();
+        if (open_loop()) {
+            // Requests that fell due while connecting go out now
+            flush();
+            return;
+        }
+        if (!options_.keep_alive) {
+            send(connect_started_);
+            return;
+        }
+        while (outstanding_.size() < options_.pipeline && Clock::now() < window_.end) {
+            send(Clock::now());
+        }
+    }
+
+    void schedule_send() {
+        send_timer_.expires_at(next_send_);
+        send_timer_.async_wait([this](const boost::system::error_code& error) {
+            if (error) {
+                return;
+            }
+            // Catches up on every send the loop was too late for
+            auto now = Clock::now();
+            while (next_send_ <= now && next_send_ < window_.end) {
+                send(next_send_);
+                next_send_ += send_interval_;
+            }
+            if (next_send_ < window_.end) {
+                schedule_send();
+            }
+        });
+    }
+
+    void send(Clock::time_point due) {
+        outstanding_.push_back(due);
+        pending_ += request_;
+        flush();
+    }
+
+    void flush() {
+        if (!ready_ || writing_ || pending_.empty()) {
+            return;
+        }
+        writing_ = true;
+        writing_buffer_.swap(pending_);
+        pending_.clear();
+        auto stream = stream_;
+        boost::asio::async_write(*stream, boost::asio::buffer(writing_buffer_),
+            [this, stream](const boost::system::error_code& error, size_t) {
+                if (stream != stream_) {
+                    return;
+                }
+                writing_ = false;
+                writing_buffer_.clear();
+                if (error) {
+                    fail(false);
+                    return;
+                }
+                flush();
+            });
+    }
+
+    void read() {
+        auto stream = stream_;
+        size_t size = read_buffer_.size();
+        read_buffer_.resize(size + READ_SIZE);
+        stream->async_read_some(boost::asio::buffer(read_buffer_.data() + size, READ_SIZE),
+            [this, stream, size](const boost::system::error_code& error, size_t bytes) {
+                if (stream != stream_) {
+                    return;
+                }
+                read_buffer_.resize(size + bytes);
+                if (error) {
+                    // An idle connection the server closed is simply replaced
+                    fail(false, outstanding_.empty());
+                    return;
+                }
+                if (!consume()) {
+                    return;
+                }
+                read();
+            });
+    }
+
+    // Takes every complete response off the front of the read buffer; false
+    // if the session reconnected instead
+    bool consume() {
+        size_t position = 0;
+        while (position < read_buffer_.size()) {
+            std::string_view data(read_buffer_.data() + position, read_buffer_.size() - position);
+            size_t size;
+            int status = 200;
+            if (options_.mode == Mode::WEBSOCKET) {
+                uint8_t opcode = 0;
+                size_t header = 0;
+                size = websocket_frame_size(data, opcode, header);
+                if (size != INCOMPLETE && opcode == 0x9) {
+                    // Answer pings so the server keeps the connection
+                    pending_ += masked_frame(0xA, data.substr(header, size - header));
+                    position += size;
+                    flush();
+                    continue;
+                }
+                if (size != INCOMPLETE && opcode == 0x8) {
+                    fail(false);
+                    return false;
+                }
+                if (size != INCOMPLETE && opcode == 0xA) {
+                    position += size;
+                    continue;
+                }
+            } else {
+                size = http_response_size(data, status);
+            }
+            if (size == MALFORMED || (size != INCOMPLETE && outstanding_.empty())) {
+                report("Unexpected data from the server");
+                fail(false);
+                return false;
+            }
+            if (size == INCOMPLETE) {
+                break;
+            }
+            position += size;
+            complete(size, status);
+            if (!options_.keep_alive) {
+                reconnect_now();
+                return false;
+            }
+        }
+        read_buffer_.erase(0, position);
+        return true;
+    }
+
+    void complete(size_t size, int status) {
+        auto now = Clock::now();
+        auto due = outstanding_.front();
+        outstanding_.pop_front();
+        if (window_.counts(due)) {
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - due).count();
+            stats_.latencies_us.push_back(static_cast<uint32_t>(std::max<int64_t>(latency, 0)));
+            stats_.bytes_received += size;
+            if (status < 200 || status >= 300) {
+                ++stats_.non_2xx;
+            }
+        }
+        if (!open_loop() && options_.keep_alive && now < window_.end) {
+            send(now);
+        }
+    }
+
+    void reconnect_now() {
+        close();
+        if (Clock::now() < window_.end) {
+            connect();
+        }
+    }
+
+    // quiet: the connection was idle, so losing it is not an error
+    void fail(bool connecting, bool quiet = false) {
+        if (connecting) {
+            ++stats_.connect_errors;
+        } else if (!quiet) {
+            ++stats_.io_errors;
+        }
+        // Requests in flight are lost. In open loop the ones that fall due
+        // while reconnecting queue up and go out on the next connection.
+        for (auto due : outstanding_) {
+            if (window_.counts(due)) {
+                ++stats_.io_errors;
+            }
+        }
+        outstanding_.clear();
+        pending_.clear();
+        close();
+        if (Clock::now() >= window_.end) {
+            return;
+        }
+        if (quiet) {
+            connect();
+            return;
+        }
+        retry_timer_.expires_after(RECONNECT_DELAY);
+        retry_timer_.async_wait([this](const boost::system::error_code& error) {
+            if (!error) {
+                reconnect_now();
+            }
+        });
+    }
+
+    void close() {
+        if (stream_) {
+            boost::system::error_code ignored;
+            socket(*stream_).close(ignored);
+        }
+        stream_.reset();
+        ready_ = false;
+        writing_ = false;
+        writing_buffer_.clear();
+        read_buffer_.clear();
+    }
+};
+
+// One event loop and its thread; sessions go before the io_context
+struct Loop {
+    boost::asio::io_context io_context{1};
+    Stats stats;
+    std::vector<std::unique_ptr<SessionBase>> sessions;
+};
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+nlohmann::json run(const Options& options) {
+    boost::asio::io_context resolver_context;
+    tcp::resolver resolver(resolver_context);
+    auto endpoints = resolver.resolve(options.host, std::to_string(options.port));
+
+    boost::asio::ssl::context ssl_context(boost::asio::ssl::context::tls_client);
+    ssl_context.set_verify_mode(boost::asio::ssl::verify_none);
+
+    Window window;
+    window.start = Clock::now();
+    window.measure = window.start + options.warmup;
+    window.end = window.measure + options.duration;
+    // Open-loop sessions are staggered over one send interval so that they
+    // do not send in lockstep
+    Clock::duration interval{};
+    if (options.rate > 0) {
+        interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(options.connections) / options.rate));
+    }
+
+    std::vector<std::unique_ptr<Loop>> loops;
+    for (size_t i = 0; i < options.threads; ++i) {
+        loops.push_back(std::make_unique<Loop>());
+    }
+    for (size_t i = 0; i < options.connections; ++i) {
+        Loop& loop = *loops[i % loops.size()];
+        auto offset = options.rate > 0 ? interval * static_cast<int64_t>(i) / static_cast<int64_t>(options.connections)
+                                       : Clock::duration{};
+        std::unique_ptr<SessionBase> session;
+        if (options.tls) {
+            session = std::make_unique<Session<SslStream>>(loop.io_context, ssl_context, options, endpoints, window,
+                                                           loop.stats, interval, window.start + offset);
+        } else {
+            session = std::make_unique<Session<tcp::socket>>(loop.io_context, ssl_context, options, endpoints,
+                                                             window, loop.stats, interval, window.start + offset);
+        }
+        boost::asio::post(loop.io_context, [started = session.get()] { started->start(); });
+        loop.sessions.push_back(std::move(session));
+    }
+
+    std::vector<std::thread> threads;
+    for (auto& loop : loops) {
+        threads.emplace_back([&window, &options, loop = loop.get()] {
+            boost::asio::steady_timer stop(loop->io_context);
+            stop.expires_at(window.end + options.grace);
+            stop.async_wait([loop](const boost::system::error_code&) {
+                for (auto& session : loop->sessions) {
+                    session->finish();
+                }
+                loop->io_context.stop();
+            });
+            loop->io_context.run();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Stats total;
+    for (auto& loop : loops) {
+        const Stats& stats = loop->stats;
+        total.latencies_us.insert(total.latencies_us.end(), stats.latencies_us.begin(), stats.latencies_us.end());
+        total.bytes_received += stats.bytes_received;
+        total.non_2xx += stats.non_2xx;
+        total.connect_errors += stats.connect_errors;
+        total.io_errors += stats.io_errors;
+        total.incomplete += stats.incomplete;
+        total.connections += stats.connections;
+    }
+    std::sort(total.latencies_us.begin(), total.latencies_us.end());
+
+    double seconds = std::chrono::duration<double>(options.duration).count();
+    double sum = 0;
+    for (uint32_t latency : total.latencies_us) {
+        sum += latency;
+    }
+    size_t count = total.latencies_us.size();
+
+    nlohmann::json result;
+    result["target"] = std::string(options.tls ? (options.mode == Mode::WEBSOCKET ? "wss" : "https")
+                                               : (options.mode == Mode::WEBSOCKET ? "ws" : "http")) +
+                       "://" + options.host + ":" + std::to_string(options.port) + options.path;
+    result["mode"] = options.mode == Mode::WEBSOCKET ? "websocket" : "http";
+    result["loop"] = options.rate > 0 ? "open" : "closed";
+    result["tls"] = options.tls;
+    result["keep_alive"] = options.keep_alive;
+    result["connections"] = options.connections;
+    result["threads"] = options.threads;
+    if (options.rate > 0) {
+        result["target_rate"] = options.rate;
+    } else {
+        result["pipeline"] = options.pipeline;
+    }
+    result["duration_s"] = seconds;
+    result["warmup_s"] = std::chrono::duration<double>(options.warmup).count();
+    if (options.mode == Mode::WEBSOCKET) {
+        result["message_size"] = options.message_size;
+    }
+    result["requests"] = count;
+    result["requests_per_second"] = static_cast<double>(count) / seconds;
+    result["bytes_received"] = total.bytes_received;
+    result["connections_opened"] = total.connections;
+    result["errors"] = {
+        {"connect", total.connect_errors},
+        {"io", total.io_errors},
+        {"non_2xx", total.non_2xx},
+        {"incomplete", total.incomplete},
+    };
+    result["latency_us"] = {
+        {"min", count ? total.latencies_us.front() : 0},
+        {"mean", count ? sum / static_cast<double>(count) : 0.0},
+        {"p50", percentile(total.latencies_us, 0.50)},
+        {"p90", percentile(total.latencies_us, 0.90)},
+        {"p99", percentile(total.latencies_us, 0.99)},
+        {"p999", percentile(total.latencies_us, 0.999)},
+        {"max", count ? total.latencies_us.back() : 0},
+    };
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n\n";
+        usage(argv[0]);
+        return 2;
+    }
+
+    try {
+        nlohmann::json result = run(options);
+        if (options.output.empty()) {
+            std::cout << result.dump(2) << std::endl;
+        } else {
+            std::ofstream(options.output) << result.dump(2) << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "http_load: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,266 @@
+/**
+ * @file micro_benchmarks.cpp
+ * @brief Google Benchmark microbenchmarks for the request, response, compression, WebSocket, routing and
+ *        rate limiting hot paths.
+ *
+ * Run through the bench target, which writes the results as JSON for comparison between builds, or
+ * directly with the usual --benchmark_* flags.
+ */
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "compression.hpp"
+#include "rate_limiter.hpp"
+#include "request.hpp"
+#include "response.hpp"
+#include "router.hpp"
+#include "websocket.hpp"
+
+using namespace http_server;
+
+namespace {
+
+const std::string SIMPLE_REQUEST =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "\r\n";
+
+// Roughly what a browser sends
+const std::string BROWSER_REQUEST =
+    "GET /api/users/42/orders?page=2&limit=50&sort=desc HTTP/1.1\r\n"
+    "Host: api.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:121.0) Gecko/20100101 Firefox/121.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=4f6b9c2e1a7d3f8b0c5e9a2d6f1b4c8e; theme=dark; consent=1\r\n"
+    "If-None-Match: \"5d8c72a5edda8d6a\"\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "\r\n";
+
+const std::string POST_REQUEST =
+    "POST /api/echo HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 27\r\n"
+    "\r\n"
+    "{\"name\":\"test\",\"value\":42}\n";
+
+// Repetitive JSON compresses like typical API responses do
+std::string json_payload(size_t size) {
+    std::string payload = "[";
+    for (size_t i = 0; payload.size() < size; ++i) {
+        payload += "{\"id\":" + std::to_string(i) + ",\"name\":\"user" + std::to_string(i) +
+                   "\",\"active\":true,\"roles\":[\"reader\",\"writer\"]},";
+    }
+    payload.resize(size - 1);
+    payload += "]";
+    return payload;
+}
+
+void BM_RequestParse(benchmark::State& state, const std::string& raw) {
+    for (auto _ : state) {
+        auto request = HttpRequest::parse(raw);
+        benchmark::DoNotOptimize(request);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * raw.size()));
+}
+BENCHMARK_CAPTURE(BM_RequestParse, simple, SIMPLE_REQUEST);
+BENCHMARK_CAPTURE(BM_RequestParse, browser, BROWSER_REQUEST);
+BENCHMARK_CAPTURE(BM_RequestParse, post, POST_REQUEST);
+
+// The connection path: one request object reused, as on a keep-alive
+// connection. Parsing lowercases header names in place, which leaves the
+// buffer parseable the same way again.
+void BM_RequestParseInPlace(benchmark::State& state, const std::string& raw) {
+    std::pmr::unsynchronized_pool_resource resource;
+    HttpRequest request(&resource);
+    std::vector<char> buffer(raw.begin(), raw.end());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(request.parse_in_place(buffer));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * raw.size()));
+}
+BENCHMARK_CAPTURE(BM_RequestParseInPlace, simple, SIMPLE_REQUEST);
+BENCHMARK_CAPTURE(BM_RequestParseInPlace, browser, BROWSER_REQUEST);
+
+void BM_ResponseToHttpString(benchmark::State& state) {
+    std::string body(static_cast<size_t>(state.range(0)), 'x');
+    HttpResponse response(HttpStatus::OK);
+    response.set_header("Content-Type", "text/html; charset=utf-8");
+    response.set_header("Cache-Control", "public, max-age=3600");
+    response.set_header("ETag", "\"5d8c72a5edda8d6a\"");
+    response.set_header("Last-Modified", "Wed, 21 Oct 2015 07:28:00 GMT");
+    response.set_body(body);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(response.to_http_string());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+BENCHMARK(BM_ResponseToHttpString)->Arg(0)->Arg(1024)->Arg(64 * 1024);
+
+void BM_GzipCompress(benchmark::State& state) {
+    std::string payload = json_payload(static_cast<size_t>(state.range(0)));
+    int level = static_cast<int>(state.range(1));
+    size_t compressed = 0;
+    for (auto _ : state) {
+        std::string output = compression::gzip_compress(payload, level);
+        compressed = output.size();
+        benchmark::DoNotOptimize(output);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * payload.size()));
+    state.counters["ratio"] = static_cast<double>(payload.size()) / static_cast<double>(compressed);
+}
+BENCHMARK(BM_GzipCompress)->ArgsProduct({{1024, 16 * 1024, 256 * 1024}, {1, 6, 9}});
+
+WebSocketFrame masked_frame(size_t size) {
+    WebSocketFrame frame;
+    frame.opcode = WebSocketOpcode::TEXT;
+    frame.masked = true;
+    frame.masking_key = 0x37fa213d;
+    frame.payload.assign(size, 'a');
+    frame.payload_length = size;
+    return frame;
+}
+
+void BM_WebSocketSerialize(benchmark::State& state) {
+    WebSocketFrame frame = masked_frame(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(frame.serialize());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * frame.payload.size()));
+}
+BENCHMARK(BM_WebSocketSerialize)->Arg(16)->Arg(1024)->Arg(64 * 1024);
+
+void BM_WebSocketEncode(benchmark::State& state) {
+    std::vector<uint8_t> payload(static_cast<size_t>(state.range(0)), 'a');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(WebSocketFrame::encode(WebSocketOpcode::TEXT, payload));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * payload.size()));
+}
+BENCHMARK(BM_WebSocketEncode)->Arg(16)->Arg(1024)->Arg(64 * 1024);
+
+void BM_WebSocketParse(benchmark::State& state) {
+    std::vector<uint8_t> data = masked_frame(static_cast<size_t>(state.range(0))).serialize();
+    for (auto _ : state) {
+        size_t consumed = 0;
+        benchmark::DoNotOptimize(WebSocketFrame::parse(data, consumed));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_WebSocketParse)->Arg(16)->Arg(1024)->Arg(64 * 1024);
+
+// The receive path. The payload is unmasked in place, so it flips between
+// masked and unmasked, which costs the same either way.
+void BM_WebSocketFrameParser(benchmark::State& state) {
+    std::vector<uint8_t> buffer = masked_frame(static_cast<size_t>(state.range(0))).serialize();
+    WebSocketFrameParser parser(1024 * 1024);
+    for (auto _ : state) {
+        parser.reset();
+        benchmark::DoNotOptimize(parser.feed(buffer));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * buffer.size()));
+}
+BENCHMARK(BM_WebSocketFrameParser)->Arg(16)->Arg(1024)->Arg(64 * 1024);
+
+// A route table the size of a small API
+Router make_router() {
+    Router router;
+    const char* resources[] = {"users", "orders", "products", "invoices", "carts", "reviews", "sessions", "tags"};
+    size_t id = 0;
+    for (const char* resource : resources) {
+        std::string base = std::string("/api/v1/") + resource;
+        router.insert(HttpMethod::GET, base, id++);
+        router.insert(HttpMethod::POST, base, id++);
+        router.insert(HttpMethod::GET, base + "/:id", id++);
+        router.insert(HttpMethod::PUT, base + "/:id", id++);
+        router.insert(HttpMethod::DELETE, base + "/:id", id++);
+        router.insert(HttpMethod::GET, base + "/:id/history", id++);
+    }
+    router.insert(HttpMethod::GET, "/", id++);
+    router.insert(HttpMethod::GET, "/health", id++);
+    router.insert(HttpMethod::GET, "/static/*path", id++);
+    return router;
+}
+
+void BM_RouterMatch(benchmark::State& state, HttpMethod method, std::string path) {
+    Router router = make_router();
+    std::pmr::unsynchronized_pool_resource resource;
+    Router::Params params(&resource);
+    for (auto _ : state) {
+        params.clear();
+        benchmark::DoNotOptimize(router.match(method, path, params));
+    }
+}
+BENCHMARK_CAPTURE(BM_RouterMatch, literal, HttpMethod::GET, std::string("/health"));
+BENCHMARK_CAPTURE(BM_RouterMatch, param, HttpMethod::GET, std::string("/api/v1/orders/12345"));
+BENCHMARK_CAPTURE(BM_RouterMatch, nested_param, HttpMethod::GET, std::string("/api/v1/tags/98765/history"));
+BENCHMARK_CAPTURE(BM_RouterMatch, wildcard, HttpMethod::GET, std::string("/static/css/site/main.css"));
+BENCHMARK_CAPTURE(BM_RouterMatch, miss, HttpMethod::GET, std::string("/api/v2/users/1"));
+
+// Limits high enough that every check takes the allowing path, which does
+// the most work
+std::unique_ptr<RateLimitAlgorithm> make_algorithm(RateLimitStrategy strategy) {
+    constexpr size_t LIMIT = 1000000000;
+    constexpr std::chrono::seconds WINDOW(60);
+    switch (strategy) {
+        case RateLimitStrategy::FIXED_WINDOW:
+            return std::make_unique<FixedWindowLimiter>(LIMIT, WINDOW);
+        case RateLimitStrategy::SLIDING_WINDOW:
+            // Keeps a timestamp per request, so a smaller limit keeps memory bounded
+            return std::make_unique<SlidingWindowLimiter>(10000, WINDOW);
+        case RateLimitStrategy::SLIDING_WINDOW_COUNTER:
+            return std::make_unique<SlidingWindowCounterLimiter>(LIMIT, WINDOW);
+        case RateLimitStrategy::LEAKY_BUCKET:
+            return std::make_unique<LeakyBucketLimiter>(LIMIT, WINDOW, LIMIT);
+        case RateLimitStrategy::TOKEN_BUCKET:
+        default:
+            return std::make_unique<TokenBucketLimiter>(LIMIT, LIMIT, WINDOW);
+    }
+}
+
+// Every thread checks keys of a shared limiter: range(0) keys in all, so 1
+// is a single hot client and larger values spread over the shards
+void BM_RateLimit(benchmark::State& state, RateLimitStrategy strategy) {
+    static std::unique_ptr<RateLimitAlgorithm> algorithm;
+    static std::vector<std::string> keys;
+    if (state.thread_index() == 0) {
+        algorithm = make_algorithm(strategy);
+        keys.clear();
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            keys.push_back("10." + std::to_string(i >> 16) + "." + std::to_string((i >> 8) & 255) + "." +
+                           std::to_string(i & 255));
+        }
+    }
+    // Google Benchmark starts the timed loops of all threads together, after the setup above
+    size_t index = static_cast<size_t>(state.thread_index()) * 7919;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(algorithm->check_rate_limit(keys[index++ % keys.size()]));
+    }
+    if (state.thread_index() == 0) {
+        state.counters["keys"] = static_cast<double>(algorithm->active_keys());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void rate_limit_args(benchmark::internal::Benchmark* benchmark) {
+    benchmark->Arg(1)->Arg(4096)->ThreadRange(1, 8)->UseRealTime();
+}
+BENCHMARK_CAPTURE(BM_RateLimit, token_bucket, RateLimitStrategy::TOKEN_BUCKET)->Apply(rate_limit_args);
+BENCHMARK_CAPTURE(BM_RateLimit, fixed_window, RateLimitStrategy::FIXED_WINDOW)->Apply(rate_limit_args);
+BENCHMARK_CAPTURE(BM_RateLimit, sliding_window, RateLimitStrategy::SLIDING_WINDOW)->Apply(rate_limit_args);
+BENCHMARK_CAPTURE(BM_RateLimit, sliding_window_counter, RateLimitStrategy::SLIDING_WINDOW_COUNTER)
+    ->Apply(rate_limit_args);
+BENCHMARK_CAPTURE(BM_RateLimit, leaky_bucket, RateLimitStrategy::LEAKY_BUCKET)->Apply(rate_limit_args);
+
+} // namespace
+
+BENCHMARK_MAIN();
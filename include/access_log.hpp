@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "request.hpp"
+
+namespace http_server {
+
+/**
+ * @brief What log() does when the ring is full
+ */
+enum class LogOverflowPolicy {
+    DROP,   // Discard the record and count it
+    BLOCK   // Wait for the writer to make room
+};
+
+/**
+ * @brief Access log written by a background thread
+ *
+ * Request threads copy a fixed-size record into a bounded lock-free ring
+ * (multiple producers, one consumer) and return. The writer thread drains
+ * the ring, formats records in batches and writes them to a descriptor it
+ * keeps open. It writes when a batch is large or once per flush interval.
+ * reopen() may be called from a signal handler, so a SIGHUP can make the
+ * log follow logrotate.
+ *
+ * An empty path logs to standard output.
+ */
+class AccessLog {
+public:
+    AccessLog(std::string path, size_t capacity, LogOverflowPolicy overflow,
+              std::chrono::milliseconds flush_interval);
+    // Writes out every record logged before it
+    ~AccessLog();
+
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    // bytes is unset when the body's length is not known up front (a
+    // chunked stream), and is then logged as "-"
+    void log(HttpMethod method, std::string_view path, int status, std::optional<uint64_t> bytes);
+
+    // Asks the writer to reopen the file; async-signal-safe
+    void reopen() noexcept { reopen_requested_.store(true, std::memory_order_relaxed); }
+
+    uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    // Longer paths are truncated
+    static constexpr size_t PATH_CAPACITY = 200;
+
+    static constexpr uint64_t UNKNOWN_BYTES = UINT64_MAX;
+
+    struct Record {
+        std::time_t time;
+        uint64_t bytes;  // UNKNOWN_BYTES when not given
+        uint16_t status;
+        uint16_t path_length;
+        HttpMethod method;
+        char path[PATH_CAPACITY];
+    };
+
+    // The sequence tells producers and the consumer whose turn a slot is
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    std::string path_;
+    LogOverflowPolicy overflow_;
+    std::chrono::milliseconds flush_interval_;
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_position_{0};
+    alignas(64) size_t dequeue_position_{0};  // Writer thread only
+
+    std::atomic<bool> running_{true};
+    std::atomic<bool> reopen_requested_{false};
+    std::atomic<uint64_t> dropped_{0};
+
+    // Writer thread state
+    int fd_{-1};
+    std::string batch_;
+    std::time_t formatted_second_{-1};
+    char timestamp_[32]{};
+    std::thread writer_;
+
+    bool try_push(const Record& record);
+    bool pop(Record& record);
+    void open_file();
+    void format(const Record& record);
+    void write_batch();
+    void run();
+};
+
+} // namespace http_server
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace http_server {
+
+/**
+ * @brief Overload detection and load shedding in the manner of CoDel
+ *
+ * A request's queue delay is the time between being read and its handler
+ * starting: how far behind its reactor is running, which timer probes
+ * measure, plus whatever it waited for a worker. When even the smallest
+ * delay seen over an interval stays above the target there is a standing
+ * queue rather than a burst, and the server counts as overloaded. Until an
+ * interval sees a request under the target again, requests that have
+ * already waited longer than the target are shed. A burst that drains
+ * within an interval never sheds anything.
+ *
+ * Everything is relaxed atomics, so recording never takes a lock; the
+ * signals are estimates, not exact figures.
+ */
+class AdmissionControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // More reactors than slots share them
+    static constexpr size_t REACTOR_SLOTS = 64;
+
+    struct Signals {
+        std::chrono::microseconds reactor_delay{0};   // Latest probe of the worst reactor
+        std::chrono::microseconds queue_delay{0};     // Smallest delay of the last interval
+        std::chrono::microseconds handler_latency{0}; // Moving average
+        bool overloaded{false};
+    };
+
+    AdmissionControl(bool enabled, std::chrono::microseconds target, std::chrono::microseconds interval);
+
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    // Forgets earlier probes; called before the reactors run
+    void set_reactor_count(size_t count) noexcept;
+    void record_reactor_delay(size_t reactor, Clock::duration delay) noexcept;
+
+    // Records the delay of a request whose handler is about to start; true
+    // if the request should be shed instead
+    bool should_shed(Clock::duration waited, Clock::time_point now) noexcept;
+    void record_handler(Clock::duration elapsed) noexcept;
+
+    bool overloaded() const noexcept { return overloaded_.load(std::memory_order_relaxed); }
+    Signals signals() const noexcept;
+
+private:
+    static constexpr int64_t NO_SAMPLE = INT64_MAX;
+
+    bool enabled_;
+    int64_t target_us_;
+    int64_t interval_ns_;
+
+    std::array<std::atomic<int64_t>, REACTOR_SLOTS> reactor_delays_us_{};
+    std::atomic<size_t> reactor_count_{1};
+    std::atomic<int64_t> reactor_delay_us_{0};
+
+    std::atomic<int64_t> interval_end_ns_{0};
+    std::atomic<int64_t> interval_min_us_{NO_SAMPLE};
+    std::atomic<int64_t> queue_delay_us_{0};
+    std::atomic<bool> overloaded_{false};
+
+    std::atomic<int64_t> handler_latency_us_{0};
+
+    void finish_interval(int64_t now_ns) noexcept;
+};
+
+} // namespace http_server
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace http_server {
+
+/**
+ * @brief Monotonic memory for the requests a connection is working on
+ *
+ * Allocation is a pointer bump into a block inside the arena, and into
+ * heap blocks once that is used up; deallocation does nothing. The
+ * connection resets the arena whenever every request it parsed has been
+ * answered, which frees the heap blocks and starts over at the inline one.
+ */
+class RequestArena {
+public:
+    static constexpr size_t INLINE_SIZE = 4096;  // Headers of a few requests
+
+    RequestArena() : resource_(inline_.data(), inline_.size()) {}
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    std::pmr::memory_resource* resource() noexcept { return &resource_; }
+
+    // Nothing allocated from resource() may be used afterwards
+    void reset() noexcept { resource_.release(); }
+
+private:
+    alignas(std::max_align_t) std::array<std::byte, INLINE_SIZE> inline_;
+    std::pmr::monotonic_buffer_resource resource_;
+};
+
+/**
+ * @brief Process-wide free list of equally sized blocks
+ *
+ * Like BufferPool, a block can be released on any thread.
+ */
+class BlockPool {
+public:
+    static constexpr size_t MAX_POOLED = 256;
+
+    explicit BlockPool(size_t block_size);
+
+    void* allocate();
+    void deallocate(void* block) noexcept;
+
+private:
+    size_t block_size_;
+    std::mutex mutex_;
+    std::vector<void*> free_;
+};
+
+/**
+ * @brief Allocator that recycles single objects through a BlockPool
+ *
+ * Meant for std::allocate_shared, where the object and its control block
+ * share one allocation: connections are created and destroyed at the
+ * accept rate, and their blocks are reused instead of going back to malloc.
+ */
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        if (n != 1) {
+            return std::allocator<T>().allocate(n);
+        }
+        return static_cast<T*>(pool().allocate());
+    }
+
+    void deallocate(T* object, size_t n) noexcept {
+        if (n != 1) {
+            std::allocator<T>().deallocate(object, n);
+            return;
+        }
+        pool().deallocate(object);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+
+private:
+    static BlockPool& pool() {
+        // Never destroyed: objects may be released while other statics are torn down
+        static BlockPool* pool = new BlockPool(sizeof(T));
+        return *pool;
+    }
+};
+
+} // namespace http_server
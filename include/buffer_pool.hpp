@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace http_server {
+
+/**
+ * @brief Process-wide pool of large I/O buffers
+ *
+ * Used where file and stream bodies have to be copied through user space
+ * (TLS, or platforms without sendfile). A buffer goes back to the pool when
+ * the last reference to it is dropped, on whichever thread that happens.
+ */
+class BufferPool {
+public:
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+    static constexpr size_t MAX_POOLED = 64;
+
+    using Buffer = std::shared_ptr<std::vector<char>>;
+
+    static BufferPool& instance();
+
+    Buffer acquire();
+
+private:
+    BufferPool() = default;
+
+    void release(std::vector<char>* buffer);
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<std::vector<char>>> free_;
+};
+
+} // namespace http_server
@@ -1,15 +1,110 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace http_server {
 namespace compression {
 
-std::string gzip_compress(const std::string& data);
+/**
+ * @brief Content codings the server can produce or serve precompressed
+ */
+enum class Encoding {
+    IDENTITY,
+    GZIP,
+    BROTLI,
+    ZSTD
+};
+
+constexpr unsigned encoding_bit(Encoding encoding) {
+    return 1u << static_cast<unsigned>(encoding);
+}
+
+// Token used in Accept-Encoding / Content-Encoding ("gzip", "br", "zstd")
+std::string_view encoding_name(Encoding encoding);
+// Suffix of a precompressed sibling file (".gz", ".br", ".zst")
+std::string_view encoding_extension(Encoding encoding);
+// Encodings this build can compress to on the fly
+unsigned available_encoders();
+
+// Picks the client's most preferred coding among those in available (a mask
+// of encoding_bit values), honouring q-values; IDENTITY if none is acceptable
+Encoding negotiate_encoding(std::string_view accept_encoding, unsigned available);
+
+// level follows zlib (1-9, -1 for the library default) and is mapped onto
+// the other encoders' ranges. Returns an empty string on failure.
+std::string compress(std::string_view data, Encoding encoding, int level = -1);
+
+/**
+ * @brief Incremental encoder for bodies that are produced piece by piece
+ *
+ * Encoded bytes are appended to the caller's string as they become
+ * available; an encoder may hold input back until flush() or finish(). All
+ * calls return false once the underlying library reports an error.
+ */
+class StreamCompressor {
+public:
+    virtual ~StreamCompressor() = default;
+    
+    // nullptr for IDENTITY and for encodings this build cannot produce
+    static std::unique_ptr<StreamCompressor> create(Encoding encoding, int level = -1);
+    // Raw deflate (RFC 1951) with a 2^window_bits byte window (9-15), as
+    // WebSocket permessage-deflate uses it. Not an HTTP content coding, so
+    // encoding() reports IDENTITY.
+    static std::unique_ptr<StreamCompressor> create_raw_deflate(int window_bits, int level = -1);
+    
+    virtual bool write(std::string_view data, std::string& out) = 0;
+    // Emits everything written so far without ending the stream
+    virtual bool flush(std::string& out) = 0;
+    // Emits the remaining output and the stream trailer; no writes after it
+    virtual bool finish(std::string& out) = 0;
+    // Starts over with an empty history; false if the encoder cannot
+    virtual bool reset() { return false; }
+    
+    Encoding encoding() const noexcept { return encoding_; }
+
+protected:
+    explicit StreamCompressor(Encoding encoding) : encoding_(encoding) {}
+
+private:
+    Encoding encoding_;
+};
+
+/**
+ * @brief Incremental raw deflate (RFC 1951) decoder
+ *
+ * The window carries over from one write() to the next until reset(), which
+ * is what WebSocket permessage-deflate needs under context takeover.
+ */
+class RawInflater {
+public:
+    enum class Status {
+        OK,
+        CORRUPT,    // Not valid deflate data; the stream is unusable
+        TOO_LARGE   // The output would pass max_size
+    };
+    
+    explicit RawInflater(int window_bits = 15);
+    ~RawInflater();
+    
+    RawInflater(const RawInflater&) = delete;
+    RawInflater& operator=(const RawInflater&) = delete;
+    
+    // Appends the decoded bytes to out, which may not grow past max_size
+    Status write(std::string_view data, std::string& out, size_t max_size);
+    bool reset();
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+std::string gzip_compress(const std::string& data, int level = -1);
 std::string gzip_decompress(const std::string& compressed_data);
-bool supports_gzip(const std::string& accept_encoding);
-std::vector<std::string> parse_accept_encoding(const std::string& accept_encoding);
+bool supports_gzip(std::string_view accept_encoding);
+std::vector<std::string> parse_accept_encoding(std::string_view accept_encoding);
 
 } // namespace compression
 } // namespace http_server
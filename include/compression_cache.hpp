@@ -0,0 +1,57 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "compression.hpp"
+
+namespace http_server {
+
+/**
+ * @brief Bounded LRU of compressed response bodies
+ *
+ * Bodies that carry an ETag are keyed by the resource they were served as,
+ * their ETag, size and encoding: an ETag only identifies a body among the
+ * versions of one resource. Bodies without one are keyed by a hash of their
+ * content, and a hit is only used after comparing against the stored
+ * original, so identical dynamic bodies (repeated JSON, error pages) are
+ * compressed once, whatever URL they come from.
+ */
+class CompressionCache {
+public:
+    explicit CompressionCache(size_t max_bytes);
+
+    CompressionCache(const CompressionCache&) = delete;
+    CompressionCache& operator=(const CompressionCache&) = delete;
+
+    // Returns body compressed with encoding, compressing on a miss; nullptr
+    // when compression does not make the body smaller. etag may be empty;
+    // resource is the request target the body answers, and scopes the etag.
+    std::shared_ptr<const std::string> get_or_compress(std::string_view resource, std::string_view etag,
+                                                       std::string_view body, compression::Encoding encoding,
+                                                       int level);
+
+    void clear();
+    size_t bytes() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const std::string> compressed;  // nullptr: not worth compressing
+        std::string source;                             // Only for bodies without an ETag
+    };
+
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_;  // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t max_bytes_;
+    size_t bytes_{0};
+
+    static size_t entry_size(const Entry& entry);
+    void insert(Entry entry);
+};
+
+} // namespace http_server
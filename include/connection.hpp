@@ -1,12 +1,22 @@
 #pragma once
 
+#include <deque>
 #include <memory>
+#include <optional>
 #include <string>
 #include <functional>
 #include <chrono>
 #include <boost/asio.hpp>
+#include "arena.hpp"
+#include "buffer_pool.hpp"
+#include "metrics.hpp"
 #include "request.hpp"
+#include "request_body.hpp"
+#include "request_parser.hpp"
 #include "response.hpp"
+#include "stream_body.hpp"
+#include "timer_wheel.hpp"
+#include "tls_session.hpp"
 
 namespace http_server {
 
@@ -14,16 +24,43 @@ class HttpServer; // Forward declaration
 
 class Connection : public std::enable_shared_from_this<Connection> {
 public:
-    using RequestHandler = std::function<HttpResponse(const HttpRequest&)>;
+    using ResponseCallback = std::function<void(HttpResponse)>;
+    // The handler may complete the callback from any thread; the response is
+    // always written from the connection's own executor.
+    using RequestHandler = std::function<void(const HttpRequest&, ResponseCallback)>;
+    // Takes over the socket once a 101 response has been written; buffered
+    // holds the bytes that followed the upgrade request
+    using UpgradeHandler = std::function<void(boost::asio::ip::tcp::socket socket, const HttpRequest& request,
+                                              std::string_view buffered)>;
+    // Takes a request whose body is read as it arrives, given its head
+    using BodyHandler = std::function<void(const HttpRequest&, std::shared_ptr<RequestBody>, ResponseCallback)>;
+    // Looks at the head of every request with a body: returns the handler
+    // that streams it, or null to collect the body for RequestHandler
+    using BodyRouter = std::function<BodyHandler(const HttpRequest&)>;
     
+    // metrics and counters, when given, must outlive the connection
     explicit Connection(boost::asio::ip::tcp::socket socket, RequestHandler handler, 
-                       std::function<void()> cleanup_callback = nullptr);
+                       std::function<void()> cleanup_callback = nullptr, ServerMetrics* metrics = nullptr,
+                       ServerCounters* counters = nullptr);
     ~Connection();
     
     Connection(const Connection&) = delete;
     Connection& operator=(const Connection&) = delete;
     
     void start();
+    // Without one, 101 responses are written like any other
+    void on_upgrade(UpgradeHandler handler) { upgrade_handler_ = std::move(handler); }
+    // Streams the bodies router picks, up to max_body_size bytes each; call
+    // before start(). Without it every body is collected.
+    void on_request_body(BodyRouter router, uint64_t max_body_size);
+    // Limit on a request collected in full, header block included; call
+    // before start()
+    void set_max_request_size(size_t max_request_size) { parser_.set_max_request_size(max_request_size); }
+    // Serves the connection over an established TLS session; call before start()
+    void set_tls(std::unique_ptr<TlsSession> session) { tls_ = std::move(session); }
+    // Closes the connection once it has waited this long for a request;
+    // call before start(). Without it the connection never times out.
+    void set_idle_timeout(TimerWheel& timers, std::chrono::steady_clock::duration timeout);
     
     std::string client_address() const;
     std::string client_port() const;
@@ -37,31 +74,92 @@ public:
 
 private:
     boost::asio::ip::tcp::socket socket_;
+    std::unique_ptr<TlsSession> tls_;  // Null for plain HTTP
+    RequestArena arena_;  // Backs every request below; declared first so it goes last
     RequestHandler request_handler_;
     std::function<void()> cleanup_callback_;
+    UpgradeHandler upgrade_handler_;
+    std::optional<HttpRequest> upgrade_request_;  // Set once its 101 response is in flight
+    BodyRouter body_router_;
+    uint64_t max_body_size_{0};
+    std::shared_ptr<RequestBody> body_;  // The body being streamed, if any
+    std::string body_buffer_;            // What arrived after its header block
+    uint64_t body_sequence_{0};          // Its request
     std::array<char, 8192> buffer_;
     std::string request_data_;
+    RequestParser parser_;  // Frames requests in request_data_ as bytes arrive
+    size_t parse_offset_{0};  // Start of the bytes not yet framed
+    
+    // Requests in arrival order; responses are written in the same order
+    struct PendingRequest {
+        HttpRequest request;
+        std::optional<HttpResponse> response;
+        bool keep_alive;
+        std::chrono::steady_clock::time_point handled_at;  // Only kept with metrics
+    };
+    std::deque<PendingRequest> pipeline_;
+    uint64_t pipeline_base_{0};  // Sequence number of pipeline_.front()
+    bool dispatching_{false};
+    bool writing_{false};
+    bool closing_{false};            // Stop reading further requests
+    bool close_after_write_{false};
+    
+    // The gather write in flight: its responses own the bodies referenced by
+    // write_buffers_, and write_heads_ holds every status line and header block
+    std::vector<HttpResponse> in_flight_;
+    std::string write_heads_;
+    std::vector<size_t> head_ends_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
+    
+    // Latency of the responses in the write in flight, reported once written
+    struct ResponseTiming {
+        int status;
+        std::chrono::steady_clock::time_point received_at;
+        std::chrono::steady_clock::time_point handled_at;
+    };
+    ServerMetrics* metrics_;
+    ServerCounters* counters_;  // Server-wide byte totals
+    std::vector<ResponseTiming> in_flight_timings_;
+    bool first_request_{true};
     std::chrono::steady_clock::time_point creation_time_;
     size_t bytes_received_{0};
     size_t bytes_sent_{0};
     
-    static constexpr size_t MAX_REQUEST_SIZE = 1024 * 1024; // 1MB
-    static constexpr std::chrono::seconds TIMEOUT{30}; // 30 seconds
+    static constexpr size_t DEFAULT_MAX_REQUEST_SIZE = 1024 * 1024; // 1MB
+    static constexpr size_t MAX_PIPELINE_DEPTH = 16; // Requests in flight per connection
+    static constexpr size_t SENDFILE_TURN_LIMIT = 4 * 1024 * 1024; // Bytes per reactor turn
     
     void read_request();
     void handle_read(const boost::system::error_code& error, size_t bytes_transferred);
-    void process_request();
-    void send_response(const HttpResponse& response);
-    void write_body_chunk(const HttpResponse& response, std::shared_ptr<std::istream> body_stream);
-    void handle_write(const boost::system::error_code& error, size_t bytes_transferred, 
-                     std::shared_ptr<std::string> response_data);
+    void process_requests();
+    // Queues the request the parser holds; returns its sequence number
+    uint64_t queue_request();
+    ResponseCallback respond_to(uint64_t sequence);
+    void dispatch_request();
+    // Hands the request to a BodyHandler if the router has one for it
+    void stream_request();
+    // Answers the read body is waiting on from the buffer or the socket
+    void read_body(RequestBody& body);
+    void complete_request(uint64_t sequence, HttpResponse response);
+    void write_responses();
+    void write_body(const HttpResponse& response);
+    void write_body_chunk(std::shared_ptr<StreamBody> body);
+    void write_file_chunk(std::shared_ptr<FileBody> file, BufferPool::Buffer buffer);
+    void send_file(std::shared_ptr<FileBody> file);
+    // Writes through the TLS session unless the kernel encrypts for us
+    template <typename Buffers, typename Handler>
+    void async_write_all(const Buffers& buffers, Handler handler);
+    void handle_write(const boost::system::error_code& error);
+    void record_written(size_t count);
+    void count_received(size_t bytes);
+    void count_sent(size_t bytes);
     
-    bool is_request_complete() const;
     void handle_error(const boost::system::error_code& error);
     void setup_timeout();
     
-    boost::asio::steady_timer timeout_timer_;
-    void handle_timeout(const boost::system::error_code& error);
+    TimerWheel::Entry timeout_;
+    std::chrono::steady_clock::duration idle_timeout_{};
+    void handle_timeout();
 };
 
 using ConnectionPtr = std::shared_ptr<Connection>;
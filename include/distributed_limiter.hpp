@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+#include "rate_limiter.hpp"
+
+namespace http_server {
+
+/**
+ * @brief Sliding window counter whose limit holds across a cluster of nodes
+ *
+ * Decisions are made from local counters only: a request is admitted when
+ * what this node admitted plus what its peers reported fits the limit. Every
+ * sync interval the requests admitted since the last sync are sent to each
+ * peer as per-key deltas in batched UDP datagrams, and deltas received from
+ * peers are folded into the same counters. The cluster can overshoot the
+ * limit by what the other nodes admit within one sync interval, but no
+ * decision ever waits on the network.
+ *
+ * Windows are aligned to the system clock so that nodes agree on them, which
+ * assumes the nodes' clocks are kept in sync (NTP). Datagrams are only
+ * accepted from the configured peer addresses (IPv4).
+ */
+class DistributedLimiter : public RateLimitAlgorithm {
+public:
+    explicit DistributedLimiter(const RateLimitConfig& config);
+    ~DistributedLimiter() override;
+
+    DistributedLimiter(const DistributedLimiter&) = delete;
+    DistributedLimiter& operator=(const DistributedLimiter&) = delete;
+
+    RateLimitResult check_rate_limit(const std::string& key) override;
+    void cleanup_shard(size_t shard) override;
+    size_t active_keys() const override;
+    void reset() override;
+
+    // False when the sync socket could not be set up; the limiter then only
+    // counts this node's requests
+    bool is_syncing() const noexcept { return socket_ >= 0; }
+
+private:
+    struct KeyState {
+        int64_t window = -1;        // Index of the current fixed window
+        uint32_t local_current = 0;
+        uint32_t local_previous = 0;
+        uint32_t remote_current = 0;
+        uint32_t remote_previous = 0;
+        uint32_t unsent_current = 0;   // Admitted here, not yet sent to peers
+        uint32_t unsent_previous = 0;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, KeyState> entries;
+        std::vector<std::string> dirty;  // Keys with unsent deltas
+    };
+
+    struct Delta {
+        std::string key;
+        int64_t window;
+        uint32_t count;
+    };
+
+    static constexpr size_t SHARD_COUNT = RATE_LIMIT_SHARDS;
+
+    size_t max_requests_;
+    std::chrono::system_clock::duration window_duration_;
+    std::chrono::milliseconds sync_interval_;
+    std::array<Shard, SHARD_COUNT> shards_;
+
+    uint64_t node_id_;  // Drops our own datagrams when we are in the peer list
+    int socket_{-1};
+    std::vector<sockaddr_in> peers_;
+    std::thread sync_thread_;
+    std::atomic<bool> running_{false};
+
+    Shard& shard_for(std::string_view key);
+    int64_t current_window() const;
+    static void advance(KeyState& state, int64_t window);
+
+    bool open_socket(const RateLimitConfig& config);
+    void sync_loop();
+    void send_deltas();
+    void receive_deltas();
+    void apply_delta(std::string_view key, int64_t window, uint32_t count);
+};
+
+} // namespace http_server
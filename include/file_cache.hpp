@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace http_server {
+
+/**
+ * @brief A static file resolved, read and described once
+ *
+ * Entries are immutable once published; the content is shared with every
+ * response that serves it.
+ */
+struct CachedFile {
+    std::filesystem::path path;                  // Canonical path on disk
+    std::shared_ptr<const std::string> content;
+    std::string mime_type;
+    std::string etag;                            // Quoted, ready for the header
+    std::string last_modified;                   // RFC 1123
+    std::vector<std::pair<std::string, std::string>> headers; // Prebuilt 200 headers
+    std::filesystem::file_time_type write_time;
+
+    // Precompressed siblings (index.html.gz, ...) by compression::Encoding
+    std::array<std::shared_ptr<const std::string>, 4> precompressed;
+    unsigned precompressed_mask{0};  // compression::encoding_bit of each sibling
+
+    size_t footprint() const;
+
+    // Last time the file was checked on disk (steady_clock ticks)
+    mutable std::atomic<std::chrono::steady_clock::rep> validated_at{0};
+};
+
+/**
+ * @brief Bounded, sharded LRU cache of static files keyed by request path
+ *
+ * Precompressed siblings of a file (.gz, .br, .zst next to it) are loaded
+ * with it. Entries are invalidated through inotify when watching is
+ * available. When it is not, an entry is re-stat'ed at most once per
+ * revalidation interval (an interval of zero trusts entries until they are
+ * evicted).
+ */
+class StaticFileCache {
+public:
+    StaticFileCache(size_t max_bytes, size_t max_file_size, std::chrono::seconds revalidate_interval,
+                    bool load_precompressed = true);
+    ~StaticFileCache();
+
+    StaticFileCache(const StaticFileCache&) = delete;
+    StaticFileCache& operator=(const StaticFileCache&) = delete;
+
+    std::shared_ptr<const CachedFile> get(std::string_view key);
+
+    // Reads the file and caches it under key; nullptr when the file is too
+    // large to cache, cannot be read, or changed while it was read
+    std::shared_ptr<const CachedFile> load(std::string_view key, const std::filesystem::path& path);
+
+    // Drops every entry whose file lives at or below path
+    void invalidate(const std::filesystem::path& path);
+    void clear();
+
+    // Starts invalidating through inotify; false when that is unavailable
+    bool watch(const std::filesystem::path& root);
+    void stop_watching();
+    bool is_watching() const noexcept { return watching_.load(); }
+
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const noexcept {
+            return std::hash<std::string_view>{}(key);
+        }
+    };
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CachedFile> file;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // Most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator, KeyHash, std::equal_to<>> index;
+        size_t bytes{0};
+        // Bumped by every invalidation; a load that saw another value when
+        // it started may have read the file mid-write, and is not kept
+        uint64_t generation{0};
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+    std::array<Shard, SHARD_COUNT> shards_;
+    size_t shard_capacity_;
+    size_t max_file_size_;
+    std::chrono::seconds revalidate_interval_;
+    bool load_precompressed_;
+
+    // inotify state; watch descriptors are only touched by the watcher thread
+    // once it is running
+    int inotify_fd_{-1};
+    std::unordered_map<int, std::filesystem::path> watch_dirs_;
+    std::thread watch_thread_;
+    std::atomic<bool> watching_{false};
+
+    Shard& shard_for(std::string_view key);
+    bool still_valid(const CachedFile& file);
+    void erase(std::string_view key);
+    void add_watches(const std::filesystem::path& directory);
+    void watch_loop();
+};
+
+} // namespace http_server
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace http_server {
+
+/**
+ * @brief One header field of an HTTP/2 header block
+ */
+struct HpackField {
+    std::string name;
+    std::string value;
+};
+
+/**
+ * @brief Dynamic table shared by the HPACK encoder and decoder (RFC 7541 §2.3)
+ *
+ * Entries are numbered from the newest, as the wire format does; the
+ * static table comes first, so dynamic entry 0 is index 62.
+ */
+class HpackTable {
+public:
+    explicit HpackTable(size_t max_size) : max_size_(max_size) {}
+
+    void insert(std::string_view name, std::string_view value);
+    void resize(size_t max_size);
+
+    size_t max_size() const noexcept { return max_size_; }
+    size_t entries() const noexcept { return fields_.size(); }
+    const HpackField& at(size_t index) const { return fields_[index]; }
+
+private:
+    std::deque<HpackField> fields_;  // Newest first
+    size_t size_{0};                 // Per RFC 7541: name + value + 32 per entry
+    size_t max_size_;
+
+    void evict_to(size_t size);
+};
+
+/**
+ * @brief Decodes HTTP/2 header blocks (RFC 7541)
+ *
+ * One decoder serves a whole connection: every block has to be decoded in
+ * the order received, including those of streams that are then refused,
+ * or the dynamic table goes out of step with the peer's.
+ */
+class HpackDecoder {
+public:
+    enum class Status {
+        OK,
+        CORRUPT,   // Compression error; the connection cannot continue
+        TOO_LARGE  // Over max_list_size; decoded anyway to keep the table in step
+    };
+
+    // max_table_size is the SETTINGS_HEADER_TABLE_SIZE we advertise
+    explicit HpackDecoder(size_t max_table_size = 4096) : table_(max_table_size), limit_(max_table_size) {}
+
+    // Appends the fields of one complete block. max_list_size bounds the
+    // decoded size the way SETTINGS_MAX_HEADER_LIST_SIZE does.
+    Status decode(std::string_view block, std::vector<HpackField>& fields, size_t max_list_size);
+
+private:
+    HpackTable table_;
+    size_t limit_;
+
+    bool lookup(uint64_t index, std::string_view& name, std::string_view& value) const;
+};
+
+/**
+ * @brief Encodes HTTP/2 header blocks (RFC 7541)
+ *
+ * Fields are indexed into the dynamic table unless their values tend to
+ * differ from one response to the next; string literals are Huffman coded
+ * whenever that makes them shorter.
+ */
+class HpackEncoder {
+public:
+    explicit HpackEncoder(size_t max_table_size = 4096) : table_(max_table_size), limit_(max_table_size) {}
+
+    // The peer's SETTINGS_HEADER_TABLE_SIZE; announced at the next block
+    void set_max_table_size(size_t size);
+
+    // Blocks are start_block() followed by one encode() per field; names
+    // must be lowercase
+    void start_block(std::string& out);
+    void encode(std::string_view name, std::string_view value, std::string& out);
+
+private:
+    HpackTable table_;
+    size_t limit_;
+    size_t pending_size_{0};
+    bool size_changed_{false};
+
+    // Index of an exact match, or 0; name_index gets the first name match
+    size_t find(std::string_view name, std::string_view value, size_t& name_index) const;
+};
+
+} // namespace http_server
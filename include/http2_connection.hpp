@@ -0,0 +1,247 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include "buffer_pool.hpp"
+#include "hpack.hpp"
+#include "metrics.hpp"
+#include "request.hpp"
+#include "request_body.hpp"
+#include "response.hpp"
+#include "stream_body.hpp"
+#include "timer_wheel.hpp"
+
+namespace http_server {
+
+/**
+ * @brief HTTP/2 (RFC 9113) over a TLS stream that negotiated ALPN "h2"
+ *
+ * Each stream becomes one HttpRequest for the same handler HTTP/1.1
+ * connections use, so routes work unchanged. Responses go out as they
+ * complete, in any order. Every write carries the pending control frames
+ * and headers, then DATA taken a frame at a time from each stream with
+ * something to send, within the peer's flow control windows. The write is
+ * a single buffer: the TLS stream would turn each piece of a gather write
+ * into a record of its own. Server push and stream priorities are not used.
+ */
+class Http2Connection : public std::enable_shared_from_this<Http2Connection> {
+public:
+    using SslSocket = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+    using ResponseCallback = std::function<void(HttpResponse)>;
+    // The handler may complete the callback from any thread; the response is
+    // always written from the connection's own executor.
+    using RequestHandler = std::function<void(const HttpRequest&, ResponseCallback)>;
+    // As for Connection: takes a stream whose body is read as it arrives
+    using BodyHandler = std::function<void(const HttpRequest&, std::shared_ptr<RequestBody>, ResponseCallback)>;
+    using BodyRouter = std::function<BodyHandler(const HttpRequest&)>;
+
+    // socket has completed its handshake; metrics and counters, when given,
+    // must outlive the connection
+    Http2Connection(SslSocket socket, RequestHandler handler, std::function<void()> cleanup_callback,
+                    ServerMetrics* metrics = nullptr, ServerCounters* counters = nullptr);
+    ~Http2Connection();
+
+    Http2Connection(const Http2Connection&) = delete;
+    Http2Connection& operator=(const Http2Connection&) = delete;
+
+    // Sends GOAWAY once no stream has been open for this long; call before
+    // start(). Without it the connection never times out.
+    void set_idle_timeout(TimerWheel& timers, std::chrono::steady_clock::duration timeout);
+    // Limit on the body of each stream; call before start()
+    void set_max_request_size(size_t max_request_size) noexcept { max_request_size_ = max_request_size; }
+    // Streams the bodies router picks, up to max_body_size bytes each; call
+    // before start(). The stream window is only reopened as the body is
+    // read, so each one buffers at most STREAM_WINDOW bytes.
+    void on_request_body(BodyRouter router, uint64_t max_body_size);
+    void start();
+    void close();
+    bool is_open() const;
+
+    size_t bytes_sent() const noexcept { return bytes_sent_; }
+    size_t bytes_received() const noexcept { return bytes_received_; }
+
+private:
+    enum class FrameType : uint8_t {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9
+    };
+
+    enum ErrorCode : uint32_t {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb
+    };
+
+    struct Stream {
+        uint32_t id;
+        std::vector<HpackField> fields;  // Request headers until dispatch
+        std::string body;                // Request body until dispatch, or what is unread of a streamed one
+        int64_t receive_window;
+        int64_t send_window;
+        bool remote_closed{false};  // END_STREAM received
+        bool dispatched{false};
+        bool headers_sent{false};
+        bool local_closed{false};   // END_STREAM queued
+        bool head_request{false};
+
+        // Set while a streaming route reads the body
+        std::shared_ptr<RequestBody> request_body;
+        std::optional<uint64_t> body_length;  // Content-Length, if declared
+        uint64_t body_received{0};
+        RequestBody::Status body_status{RequestBody::Status::DATA};  // Failure still to be delivered
+
+        // The response and where its next DATA comes from: pending views the
+        // in-memory body, the stream's last piece or file_buffer
+        std::optional<HttpResponse> response;
+        std::string_view pending;
+        std::unique_ptr<StreamBody> stream_body;
+        std::optional<FileBody> file;
+        BufferPool::Buffer file_buffer;
+        bool body_done{false};  // Nothing beyond pending
+
+        std::chrono::steady_clock::time_point received_at;
+        std::chrono::steady_clock::time_point handled_at;
+    };
+
+    static constexpr size_t BUFFER_SIZE = 16384;
+    static constexpr size_t DEFAULT_MAX_REQUEST_SIZE = 1024 * 1024; // 1MB body per stream
+    static constexpr uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static constexpr uint32_t MAX_FRAME_SIZE = 16384;  // What we accept; the protocol minimum
+    static constexpr size_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+    static constexpr int64_t STREAM_WINDOW = 1024 * 1024;
+    static constexpr int64_t CONNECTION_WINDOW = 16 * 1024 * 1024;
+    static constexpr int64_t DEFAULT_WINDOW = 65535;
+    static constexpr int64_t MAX_WINDOW = 0x7fffffff;
+    static constexpr size_t MAX_WRITE_DATA = 256 * 1024;  // DATA bytes per write
+    static constexpr size_t MAX_PENDING_OUTPUT = 1024 * 1024;  // Control frames the peer has not read
+
+    SslSocket socket_;
+    RequestHandler request_handler_;
+    std::function<void()> cleanup_callback_;
+    ServerMetrics* metrics_;
+    ServerCounters* counters_;
+
+    std::array<char, BUFFER_SIZE> buffer_;
+    std::string input_;
+    size_t input_offset_{0};
+    bool preface_received_{false};
+    bool settings_received_{false};
+
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    std::string header_block_;           // Fragments until END_HEADERS
+    uint32_t continuation_stream_{0};    // Stream whose block is incomplete
+    bool continuation_end_stream_{false};
+
+    std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+    uint32_t last_stream_id_{0};    // Highest stream the peer opened
+    uint32_t next_stream_turn_{0};  // Where the next DATA round starts
+
+    // Flow control and the peer's settings
+    int64_t send_window_{DEFAULT_WINDOW};
+    int64_t receive_window_{CONNECTION_WINDOW};
+    int64_t peer_initial_window_{DEFAULT_WINDOW};
+    uint32_t peer_max_frame_size_{16384};
+
+    // output_ collects frames until the next write; frames_ is the write in flight
+    std::string output_;
+    std::string frames_;
+    bool processing_{false};  // Frames of one read are handled before writing
+    bool writing_{false};
+    bool goaway_sent_{false};
+    bool close_after_write_{false};
+
+    struct ResponseTiming {
+        int status;
+        std::chrono::steady_clock::time_point received_at;
+        std::chrono::steady_clock::time_point handled_at;
+    };
+    std::vector<ResponseTiming> timings_;  // Responses whose END_STREAM is queued
+    std::vector<ResponseTiming> in_flight_timings_;
+    bool first_request_{true};
+    std::chrono::steady_clock::time_point creation_time_;
+    size_t bytes_sent_{0};
+    size_t bytes_received_{0};
+    TimerWheel::Entry timeout_;  // Reset by every read
+    std::chrono::steady_clock::duration idle_timeout_{};
+    size_t max_request_size_{DEFAULT_MAX_REQUEST_SIZE};
+    BodyRouter body_router_;
+    uint64_t max_body_size_{0};
+
+    void read_frames();
+    void handle_read(const boost::system::error_code& error, size_t bytes_transferred);
+    // Returns false once the connection has failed
+    bool process_input();
+    bool handle_frame(FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+    bool handle_headers(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    bool handle_continuation(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    bool finish_headers(uint32_t stream_id, bool end_stream);
+    bool handle_data(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    bool handle_settings(uint8_t flags, uint32_t stream_id, std::string_view payload);
+    bool handle_window_update(uint32_t stream_id, std::string_view payload);
+    bool handle_rst_stream(uint32_t stream_id, std::string_view payload);
+    // Queues GOAWAY and closes once it is written; returns false
+    bool go_away(ErrorCode code);
+    void reset_stream(uint32_t stream_id, ErrorCode code);
+    // Forgets the stream; a read its body is waiting on completes as CLOSED
+    void erase_stream(uint32_t stream_id);
+
+    void dispatch(Stream& stream);
+    // Hands the stream to a BodyHandler, before its body, if the router has one
+    void stream_request(Stream& stream);
+    void start_request(Stream& stream, HttpRequest& request);
+    ResponseCallback respond_to(uint32_t stream_id);
+    bool receive_body(Stream& stream, std::string_view data, bool end_stream);
+    void read_body(uint32_t stream_id, RequestBody& body);
+    // Answers the read the body is waiting on, if it can be yet; the stream
+    // may be gone once this returns
+    void feed_body(Stream& stream);
+    void complete_stream(uint32_t stream_id, HttpResponse response);
+    void respond(Stream& stream, HttpResponse response);
+    // With head_only the body is still to come and not checked against
+    // Content-Length
+    static bool build_request(Stream& stream, HttpRequest& request, bool head_only = false);
+
+    void queue_frame(FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+    void queue_headers(Stream& stream);
+    void append_frame_header(std::string& out, size_t length, FrameType type, uint8_t flags, uint32_t stream_id);
+    // Produces the stream's next piece of body; false if its source failed
+    bool refill(Stream& stream);
+    void end_stream(Stream& stream);
+    void queue_data();
+    void flush();
+    void handle_write(const boost::system::error_code& error);
+
+    void count_received(size_t bytes);
+    void count_sent(size_t bytes);
+    void handle_error(const boost::system::error_code& error);
+    void setup_timeout();
+    void handle_timeout();
+};
+
+} // namespace http_server
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace http_server {
+
+// Small dense index of the calling thread, assigned on first use
+size_t thread_slot() noexcept;
+
+/**
+ * @brief Server-wide counters kept in per-thread, cache-line-sized slabs
+ *
+ * Writers add to the slab of their own thread, so counters bumped on every
+ * request never bounce a cache line between cores; readers sum the slabs on
+ * demand. Gauges may go up on one thread and down on another: single slabs
+ * then wrap around, but the sum is exact.
+ */
+class ServerCounters {
+public:
+    enum Counter : size_t {
+        TOTAL_REQUESTS,
+        ACTIVE_CONNECTIONS,
+        TOTAL_CONNECTIONS,
+        ACTIVE_WEBSOCKETS,
+        TOTAL_WEBSOCKETS,
+        BYTES_SENT,
+        BYTES_RECEIVED,
+        RATE_LIMITED_REQUESTS,
+        TLS_HANDSHAKES,
+        TLS_RESUMED,
+        HTTP2_CONNECTIONS,
+        REJECTED_CONNECTIONS,
+        SHED_REQUESTS,
+        COUNTER_COUNT
+    };
+
+    // More threads than slabs share them, which stays correct, only slower
+    static constexpr size_t SLABS = 64;
+
+    void add(Counter counter, size_t amount = 1) noexcept {
+        slab().values[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+    void subtract(Counter counter, size_t amount = 1) noexcept {
+        slab().values[counter].fetch_sub(amount, std::memory_order_relaxed);
+    }
+    size_t sum(Counter counter) const noexcept;
+
+private:
+    struct alignas(64) Slab {
+        std::array<std::atomic<size_t>, COUNTER_COUNT> values{};
+    };
+
+    std::array<Slab, SLABS> slabs_;
+
+    Slab& slab() noexcept { return slabs_[thread_slot() % SLABS]; }
+};
+
+/**
+ * @brief Lock-free latency histogram with HDR-style log-linear buckets
+ *
+ * Values are microseconds. Each power of two is split into 8 linear
+ * sub-buckets, so a recorded value is known to within 12.5% from 1us to
+ * beyond a day. Recording is a few relaxed atomic adds on one of several
+ * stripes, picked per thread, so threads recording the same latency do not
+ * fight over one cache line.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BUCKETS = 8;
+    static constexpr size_t BUCKET_COUNT = SUB_BUCKETS * 35;
+    static constexpr size_t STRIPES = 4;
+
+    struct Snapshot {
+        std::array<uint64_t, BUCKET_COUNT> counts{};
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+
+        // Upper bound of the bucket holding the q-th value (0 when empty)
+        uint64_t quantile_us(double q) const;
+        // Values at or below limit_us, to bucket precision
+        uint64_t count_at_or_below(uint64_t limit_us) const;
+    };
+
+    void record(std::chrono::steady_clock::duration elapsed) noexcept;
+    Snapshot snapshot() const;
+
+    static size_t bucket_index(uint64_t value_us) noexcept;
+    static uint64_t bucket_upper_bound(size_t index) noexcept;
+
+private:
+    struct alignas(64) Stripe {
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts{};
+        std::atomic<uint64_t> sum_us{0};
+    };
+
+    std::array<Stripe, STRIPES> stripes_;
+};
+
+/**
+ * @brief Request latency broken down by route, status class and phase
+ *
+ * A request is timed from the moment it is parsed. Queue time runs until
+ * its handler starts, handler time until the handler returns, and write
+ * time until the last byte of the response has been handed to the socket.
+ * Queue and handler time are kept per route; write and total time per
+ * status class (1xx-5xx).
+ */
+class ServerMetrics {
+public:
+    struct RouteMetrics {
+        std::string label;  // "GET /user/:id"
+        LatencyHistogram queue;
+        LatencyHistogram handler;
+    };
+
+    ServerMetrics();
+
+    ServerMetrics(const ServerMetrics&) = delete;
+    ServerMetrics& operator=(const ServerMetrics&) = delete;
+
+    // Same object for the same label, so re-registering a route keeps its history
+    std::shared_ptr<RouteMetrics> route(const std::string& label);
+    // Requests that matched no route (static files and 404s)
+    RouteMetrics& unrouted() noexcept { return *unrouted_; }
+
+    void record_handler(RouteMetrics& route, std::chrono::steady_clock::time_point received,
+                        std::chrono::steady_clock::time_point started,
+                        std::chrono::steady_clock::time_point finished) noexcept;
+    void record_response(int status, std::chrono::steady_clock::time_point received,
+                         std::chrono::steady_clock::time_point handled,
+                         std::chrono::steady_clock::time_point written) noexcept;
+    // Accept to the first request being parsed
+    void record_first_request(std::chrono::steady_clock::duration elapsed) noexcept;
+
+    // Prometheus text exposition format (version 0.0.4)
+    void append_prometheus(std::string& out) const;
+    nlohmann::json to_json() const;
+
+private:
+    struct StatusMetrics {
+        LatencyHistogram write;
+        LatencyHistogram total;
+    };
+
+    std::array<StatusMetrics, 5> status_classes_;
+    LatencyHistogram first_request_;
+    std::shared_ptr<RouteMetrics> unrouted_;
+
+    mutable std::mutex routes_mutex_;
+    std::map<std::string, std::shared_ptr<RouteMetrics>> routes_;
+
+    std::vector<std::shared_ptr<RouteMetrics>> route_list() const;
+};
+
+} // namespace http_server
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string>
 #include <chrono>
+#include <cstdint>
 #include <unordered_map>
 #include <mutex>
 #include <condition_variable>
@@ -10,6 +12,7 @@
 #include <atomic>
 #include <deque>
 #include <functional>
+#include <vector>
 #include "request.hpp"
 #include "response.hpp"
 
@@ -33,7 +36,8 @@ enum class RateLimitStrategy {
     TOKEN_BUCKET,
     FIXED_WINDOW,
     SLIDING_WINDOW,
-    LEAKY_BUCKET
+    LEAKY_BUCKET,            // GCRA: one timestamp per key
+    SLIDING_WINDOW_COUNTER   // Weighted current + previous window: two counters per key
 };
 
 /**
@@ -46,6 +50,14 @@ struct RateLimitConfig {
     RateLimitStrategy strategy = RateLimitStrategy::TOKEN_BUCKET;
     bool enabled = true;
     
+    // Cluster-wide limiting (see DistributedLimiter): the limit is shared with
+    // the peers and applied as a sliding window counter whatever the strategy
+    bool distributed = false;
+    std::string sync_address = "0.0.0.0";        // Local UDP endpoint for deltas
+    uint16_t sync_port = 0;
+    std::vector<std::string> peers{};            // "host:port" of the other nodes
+    std::chrono::milliseconds sync_interval{100};
+    
     // Custom key extractor (default: IP address)
     std::function<std::string(const HttpRequest&)> key_extractor;
     
@@ -53,6 +65,69 @@ struct RateLimitConfig {
     std::function<HttpResponse()> rate_limit_response;
 };
 
+// Shards of every limiter's key space
+constexpr size_t RATE_LIMIT_SHARDS = 64;
+
+/**
+ * @brief Per-key limiter state spread over independently locked shards
+ *
+ * Each shard has its own lock and cache lines, so requests for different
+ * keys rarely contend. Sweeps visit one shard at a time and never hold more
+ * than one shard lock.
+ */
+template <typename State>
+class ShardedKeyMap {
+public:
+    static constexpr size_t SHARD_COUNT = RATE_LIMIT_SHARDS;
+    
+    // Runs fn on the state for key (default-constructed or made by create
+    // when absent) under the shard lock and returns its result
+    template <typename Create, typename Fn>
+    auto with(const std::string& key, Create&& create, Fn&& fn) {
+        auto& shard = shards_[std::hash<std::string>{}(key) % SHARD_COUNT];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) {
+            it = shard.entries.emplace(key, create()).first;
+        }
+        return fn(it->second);
+    }
+    
+    // Erases the entries of one shard for which expired(state) holds
+    template <typename Predicate>
+    void sweep(size_t shard_index, Predicate&& expired) {
+        auto& shard = shards_[shard_index % SHARD_COUNT];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            it = expired(it->second) ? shard.entries.erase(it) : std::next(it);
+        }
+    }
+    
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.entries.size();
+        }
+        return total;
+    }
+    
+    void clear() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.entries.clear();
+        }
+    }
+
+private:
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, State> entries;
+    };
+    
+    std::array<Shard, SHARD_COUNT> shards_;
+};
+
 /**
  * @brief Abstract base class for rate limiting algorithms
  */
@@ -60,7 +135,12 @@ class RateLimitAlgorithm {
 public:
     virtual ~RateLimitAlgorithm() = default;
     virtual RateLimitResult check_rate_limit(const std::string& key) = 0;
-    virtual void cleanup_expired() = 0;
+    // Drops idle state from one shard of the key space
+    virtual void cleanup_shard(size_t shard) = 0;
+    // Sweeps the whole key space, one shard at a time
+    virtual void cleanup_expired();
+    virtual size_t active_keys() const = 0;
+    virtual void reset() = 0;
 };
 
 /**
@@ -80,15 +160,16 @@ private:
     size_t capacity_;
     size_t refill_rate_;
     std::chrono::seconds refill_interval_;
-    mutable std::mutex mutex_;
-    std::unordered_map<std::string, BucketState> buckets_;
+    ShardedKeyMap<BucketState> buckets_;
     
 public:
     TokenBucketLimiter(size_t capacity, size_t refill_rate, 
                       std::chrono::seconds refill_interval);
     
     RateLimitResult check_rate_limit(const std::string& key) override;
-    void cleanup_expired() override;
+    void cleanup_shard(size_t shard) override;
+    size_t active_keys() const override { return buckets_.size(); }
+    void reset() override { buckets_.clear(); }
 };
 
 /**
@@ -105,14 +186,15 @@ private:
     
     size_t max_requests_;
     std::chrono::seconds window_duration_;
-    mutable std::mutex mutex_;
-    std::unordered_map<std::string, WindowState> windows_;
+    ShardedKeyMap<WindowState> windows_;
     
 public:
     FixedWindowLimiter(size_t max_requests, std::chrono::seconds window_duration);
     
     RateLimitResult check_rate_limit(const std::string& key) override;
-    void cleanup_expired() override;
+    void cleanup_shard(size_t shard) override;
+    size_t active_keys() const override { return windows_.size(); }
+    void reset() override { windows_.clear(); }
 };
 
 /**
@@ -128,14 +210,69 @@ private:
     
     size_t max_requests_;
     std::chrono::seconds window_duration_;
-    mutable std::mutex mutex_;
-    std::unordered_map<std::string, std::vector<RequestRecord>> request_logs_;
+    ShardedKeyMap<std::vector<RequestRecord>> request_logs_;
     
 public:
     SlidingWindowLimiter(size_t max_requests, std::chrono::seconds window_duration);
     
     RateLimitResult check_rate_limit(const std::string& key) override;
-    void cleanup_expired() override;
+    void cleanup_shard(size_t shard) override;
+    size_t active_keys() const override { return request_logs_.size(); }
+    void reset() override { request_logs_.clear(); }
+};
+
+/**
+ * @brief Sliding window approximated from two fixed-window counters
+ *
+ * The previous window's count is weighted by how much of it still overlaps
+ * the sliding window. Memory and work per check are constant, whatever the
+ * limit.
+ */
+class SlidingWindowCounterLimiter : public RateLimitAlgorithm {
+private:
+    struct CounterState {
+        int64_t window = -1;  // Index of the current fixed window
+        size_t current = 0;
+        size_t previous = 0;
+    };
+    
+    size_t max_requests_;
+    std::chrono::steady_clock::duration window_duration_;
+    ShardedKeyMap<CounterState> counters_;
+    
+public:
+    SlidingWindowCounterLimiter(size_t max_requests, std::chrono::seconds window_duration);
+    
+    RateLimitResult check_rate_limit(const std::string& key) override;
+    void cleanup_shard(size_t shard) override;
+    size_t active_keys() const override { return counters_.size(); }
+    void reset() override { counters_.clear(); }
+};
+
+/**
+ * @brief Leaky bucket as the generic cell rate algorithm (GCRA)
+ *
+ * Requests drain at max_requests per window; up to burst_capacity may arrive
+ * back to back. Each key only stores its theoretical arrival time.
+ */
+class LeakyBucketLimiter : public RateLimitAlgorithm {
+private:
+    struct ArrivalState {
+        std::chrono::steady_clock::time_point tat{};  // Theoretical arrival time
+    };
+    
+    std::chrono::steady_clock::duration emission_interval_;
+    std::chrono::steady_clock::duration burst_tolerance_;
+    size_t burst_capacity_;
+    ShardedKeyMap<ArrivalState> arrivals_;
+    
+public:
+    LeakyBucketLimiter(size_t max_requests, std::chrono::seconds window_duration, size_t burst_capacity);
+    
+    RateLimitResult check_rate_limit(const std::string& key) override;
+    void cleanup_shard(size_t shard) override;
+    size_t active_keys() const override { return arrivals_.size(); }
+    void reset() override { arrivals_.clear(); }
 };
 
 /**
@@ -147,7 +284,9 @@ private:
     std::unique_ptr<RateLimitAlgorithm> algorithm_;
     mutable std::mutex config_mutex_;
     
-    // Cleanup thread
+    // Cleanup thread; sweeps one shard per tick so a full pass takes
+    // CLEANUP_PERIOD without ever walking the whole key space at once
+    static constexpr std::chrono::seconds CLEANUP_PERIOD{300};
     std::thread cleanup_thread_;
     std::atomic<bool> stop_cleanup_{false};
     std::condition_variable cleanup_cv_;
@@ -196,9 +335,11 @@ public:
     static std::function<bool(const HttpRequest&, HttpResponse&)> 
     create_user_limiter(const RateLimitConfig& config);
     
-    // Create adaptive rate limiter (adjusts based on server load)
+    // Create adaptive rate limiter (adjusts based on server load): clients
+    // get a quarter of base_config's allowance while overloaded() holds,
+    // e.g. [&server] { return server.admission().overloaded(); }
     static std::function<bool(const HttpRequest&, HttpResponse&)> 
-    create_adaptive_limiter(const RateLimitConfig& base_config);
+    create_adaptive_limiter(const RateLimitConfig& base_config, std::function<bool()> overloaded);
 };
 
 /**
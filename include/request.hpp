@@ -1,9 +1,13 @@
 #pragma once
 
+#include <chrono>
 #include <string>
-#include <unordered_map>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <string_view>
 
 namespace http_server {
@@ -19,65 +23,130 @@ enum class HttpMethod {
     UNKNOWN
 };
 
+/**
+ * @brief Parsed HTTP request
+ *
+ * All accessors return views. A request produced by parse() owns a private
+ * copy of the raw bytes that is shared between copies of the request. A
+ * request produced by parse_in_place() points straight into the caller's
+ * buffer, which must stay untouched for as long as the request is used.
+ */
 class HttpRequest {
 public:
+    struct Header {
+        std::string_view name;  // Always lowercase
+        std::string_view value;
+    };
+
+    struct QueryParam {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // Captured by a ":name" or "*name" route segment; the name points into
+    // the server's route table
+    struct PathParam {
+        std::string_view name;
+        std::string_view value;
+    };
+
     HttpRequest() = default;
+    // The header and parameter lists allocate from resource, which has to
+    // outlive the request. Copies allocate from the default resource, so a
+    // copy may outlive the original's resource.
+    explicit HttpRequest(std::pmr::memory_resource* resource);
+    HttpRequest(const HttpRequest& other, std::pmr::memory_resource* resource);
+    HttpRequest(const HttpRequest&) = default;
+    HttpRequest(HttpRequest&&) = default;
+    HttpRequest& operator=(const HttpRequest&) = default;
+    HttpRequest& operator=(HttpRequest&&) = default;
     ~HttpRequest() = default;
-    
+
     static std::optional<HttpRequest> parse(std::string_view raw_request);
-    
+
+    // Zero-copy parse over a mutable buffer. Header names are lowercased and
+    // chunked bodies are decoded in place. Reusing the same HttpRequest keeps
+    // its header storage, so steady-state parsing does not allocate.
+    bool parse_in_place(std::span<char> buffer);
+
     HttpMethod method() const noexcept { return method_; }
-    const std::string& path() const noexcept { return path_; }
-    const std::string& version() const noexcept { return version_; }
-    const std::string& body() const noexcept { return body_; }
-    const std::unordered_map<std::string, std::string>& headers() const noexcept { return headers_; }
-    const std::unordered_map<std::string, std::string>& query_params() const noexcept { return query_params_; }
-    
-    std::optional<std::string> get_header(const std::string& name) const;
-    bool has_header(const std::string& name) const;
+    std::string_view path() const noexcept { return path_; }
+    std::string_view version() const noexcept { return version_; }
+    std::string_view body() const noexcept { return body_; }
+    std::string_view query_string() const noexcept { return query_string_; }
+    const std::pmr::vector<Header>& headers() const noexcept { return headers_; }
+    const std::pmr::vector<QueryParam>& query_params() const;
+
+    std::optional<std::string_view> get_header(std::string_view name) const;
+    bool has_header(std::string_view name) const;
     size_t content_length() const;
-    std::string content_type() const;
-    
-    std::optional<std::string> get_query_param(const std::string& name) const;
-    bool has_query_param(const std::string& name) const;
-    
+    std::string_view content_type() const;
+
+    std::optional<std::string_view> get_query_param(std::string_view name) const;
+    bool has_query_param(std::string_view name) const;
+
+    // Filled in when the request is routed
+    const std::pmr::vector<PathParam>& path_params() const noexcept { return path_params_; }
+    std::optional<std::string_view> get_path_param(std::string_view name) const;
+
     // Conditional request support
-    std::optional<std::string> get_if_none_match() const;
-    std::optional<std::string> get_if_modified_since() const;
-    std::optional<std::string> get_if_match() const;
-    std::optional<std::string> get_if_unmodified_since() const;
+    std::optional<std::string_view> get_if_none_match() const;
+    std::optional<std::string_view> get_if_modified_since() const;
+    std::optional<std::string_view> get_if_match() const;
+    std::optional<std::string_view> get_if_unmodified_since() const;
     bool is_conditional_request() const;
-    
+
     bool is_valid() const noexcept { return is_valid_; }
+
+    // When the connection finished reading the request (unset for requests
+    // built by hand)
+    std::chrono::steady_clock::time_point received_at() const noexcept { return received_at_; }
+    void set_received_at(std::chrono::steady_clock::time_point time) noexcept { received_at_ = time; }
     bool is_keep_alive() const;
-    
+
     // Testing helper methods
     void set_header(const std::string& name, const std::string& value);
     void set_path(const std::string& path);
     void set_method(HttpMethod method);
-    
+
     std::string to_string() const;
     static std::string method_to_string(HttpMethod method);
     static HttpMethod string_to_method(std::string_view method_str);
-    
-    bool is_valid_header_name(const std::string& name);
-    bool is_valid_header_value(const std::string& value);
-    static bool is_valid_http_version(const std::string& version);
+
+    static bool is_valid_header_name(std::string_view name);
+    static bool is_valid_header_value(std::string_view value);
+    static bool is_valid_http_version(std::string_view version);
 
 private:
     HttpMethod method_{HttpMethod::UNKNOWN};
-    std::string path_;
-    std::string version_;
-    std::unordered_map<std::string, std::string> headers_;
-    std::unordered_map<std::string, std::string> query_params_;
-    std::string body_;
+    std::string_view path_;
+    std::string_view version_;
+    std::string_view query_string_;
+    std::string_view body_;
+    std::pmr::vector<Header> headers_;
+    mutable std::pmr::vector<QueryParam> query_params_;
+    mutable bool query_parsed_{false};
+    // Routing only sees the request as const
+    mutable std::pmr::vector<PathParam> path_params_;
     bool is_valid_{false};
-    
-    void parse_request_line(std::string_view line);
-    void parse_header_line(std::string_view line);
-    void parse_query_string(std::string_view query);
-    void normalize_header_name(std::string& name) const;
-    bool parse_chunked_body(std::string_view body_view);
+    std::chrono::steady_clock::time_point received_at_{};
+
+    // Backing store for parse() and for values set through the helpers
+    std::shared_ptr<std::string> storage_;
+    std::shared_ptr<std::deque<std::string>> owned_strings_;
+
+    friend class RequestParser;
+    friend class HttpServer;
+    friend class Http2Connection;  // Builds requests from decoded header blocks
+
+    void reset();
+    bool parse_head(std::span<char> head);
+    void rebase(const char* old_base, const char* new_base);
+    bool parse_request_line(std::string_view line);
+    void parse_header_line(char* line, size_t length);
+    void parse_query_string() const;
+    std::string_view own(std::string value);
+    bool parse_chunked_body(char* body, size_t length);
 };
 
 } // namespace http_server
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <boost/asio.hpp>
+
+namespace http_server {
+
+/**
+ * @brief Body of a request to a streaming route, read as it arrives
+ *
+ * The handler pulls the body a piece at a time with read(). The connection
+ * only reads the socket while a read is waiting, so a handler that is slow
+ * to ask holds the client back through TCP flow control instead of making
+ * the server buffer: memory per upload stays at one receive buffer. Chunked
+ * bodies come out de-chunked.
+ *
+ * Like the request itself, the body may only be read until the response is
+ * sent. A response sent before the body has been read to the end closes the
+ * connection once it is written.
+ */
+class RequestBody : public std::enable_shared_from_this<RequestBody> {
+public:
+    enum class Status {
+        DATA,       // data holds the next piece
+        END,        // The whole body has been read
+        TOO_LARGE,  // The body exceeds the upload limit
+        INVALID,    // Malformed chunk framing
+        CLOSED      // The connection went away
+    };
+
+    // Runs on the connection's executor; data is only valid until it returns
+    using ReadHandler = std::function<void(Status status, std::string_view data)>;
+    // Runs on executor whenever a read is waiting; it has to answer it with
+    // deliver(), now or later
+    using Source = std::function<void(RequestBody& body)>;
+
+    RequestBody(boost::asio::any_io_executor executor, std::optional<uint64_t> length, Source source);
+
+    // A body that was received in full before the handler ran (HTTP/2, or a
+    // request without one); data must outlive the reads
+    static std::shared_ptr<RequestBody> buffered(boost::asio::any_io_executor executor, std::string_view data);
+
+    // Asks for the next piece; callable from any thread, one read at a time.
+    // The handler never runs inline. Once the body has ended or failed every
+    // read completes with the same status.
+    void read(ReadHandler handler);
+
+    // Content-Length of the body; unset when it is chunked
+    std::optional<uint64_t> length() const noexcept { return length_; }
+
+    // Source side, on the executor: answers the waiting read, if any. A
+    // status other than DATA is final and also answers every later read.
+    void deliver(Status status, std::string_view data = {});
+    bool waiting() const noexcept { return static_cast<bool>(handler_); }
+
+private:
+    boost::asio::any_io_executor executor_;
+    std::optional<uint64_t> length_;
+    Source source_;
+    ReadHandler handler_;
+    Status status_{Status::DATA};  // DATA while the body lasts
+};
+
+} // namespace http_server
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include "request.hpp"
+
+namespace http_server {
+
+/**
+ * @brief Resumable HTTP/1.x request framer
+ *
+ * Fed with the receive buffer after every read, it only looks at bytes it
+ * has not seen before. The header block is parsed once, in place, as soon as
+ * its terminator arrives; afterwards only the body framing (Content-Length
+ * or chunk boundaries) is tracked. Chunked bodies are decoded in place as
+ * the chunks arrive.
+ *
+ * The buffer may grow (and move) between calls as long as the bytes already
+ * fed stay where they are relative to its start.
+ *
+ * A body can also be streamed instead of collected: with pause_after_head()
+ * the parser stops once the header block of a request with a body is
+ * parsed. After stream_body() it is fed a buffer of its own holding what
+ * follows the header block, and each feed() hands out the body bytes that
+ * arrived since, which the caller then drops; only the bytes of one read
+ * are ever buffered.
+ *
+ * Requests are built on the given memory resource; a connection passes its
+ * RequestArena so that parsing a request does not reach malloc.
+ */
+class RequestParser {
+public:
+    enum class Status {
+        INCOMPLETE,  // Need more bytes
+        COMPLETE,    // request() is ready
+        INVALID,     // Malformed request
+        TOO_LARGE,   // Request exceeds the size limit
+        HEAD,        // The header block is parsed and a body follows
+        BODY         // Streaming: body_data() holds more of the body
+    };
+
+    explicit RequestParser(size_t max_request_size,
+                           std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    Status feed(std::span<char> buffer);
+    void reset();
+    void set_max_request_size(size_t max_request_size) noexcept { max_request_size_ = max_request_size; }
+    // Report HEAD before the body of each request that has one. Feeding on
+    // after HEAD collects the body as usual.
+    void pause_after_head(bool pause) noexcept { pause_after_head_ = pause; }
+    // Call on HEAD, once consumed() has given the length of the header
+    // block, to stream this request's body instead, up to max_body_size
+    // bytes. feed() is then given the bytes after the header block in a
+    // buffer of their own, and returns BODY or, with the last of the body,
+    // COMPLETE; discard_body() must follow each of those.
+    void stream_body(uint64_t max_body_size) noexcept;
+    // Decoded body bytes handed out since the last discard_body()
+    std::string_view body_data() const noexcept {
+        return std::string_view(base_ + body_start_, body_end_ - body_start_);
+    }
+    // Forgets the bytes behind body_data(): returns how many the caller has
+    // to erase from the front of its buffer, framing included
+    size_t discard_body() noexcept;
+    // Whether the body of the request is chunked; known from HEAD on
+    bool chunked() const noexcept { return chunked_; }
+    // Call before the memory resource is released: a request whose header
+    // block is parsed but whose body is still arriving is copied off it
+    void detach();
+
+    HttpRequest& request() noexcept { return *request_; }
+    const HttpRequest& request() const noexcept { return *request_; }
+
+    // Bytes of the buffer that make up the completed request
+    size_t consumed() const noexcept { return scan_offset_; }
+
+private:
+    enum class State {
+        HEADERS,
+        HEAD,  // Paused after the header block
+        BODY,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILERS,
+        DONE
+    };
+
+    static constexpr size_t MAX_CHUNK_LINE = 1024;
+
+    std::pmr::memory_resource* resource_;
+    std::optional<HttpRequest> request_;  // Rebuilt rather than assigned: the resource sticks to it
+    size_t max_request_size_;
+    State state_{State::HEADERS};
+    const char* base_{nullptr};  // Where the buffer lived on the last feed
+    size_t scan_offset_{0};      // First byte not examined yet
+    size_t body_start_{0};
+    size_t body_end_{0};         // End of the (decoded) body
+    size_t remaining_{0};        // Bytes left in the body or current chunk
+    bool chunked_{false};
+    bool pause_after_head_{false};
+    bool streaming_{false};
+    uint64_t max_body_size_{0};  // While streaming
+    uint64_t streamed_{0};       // Body bytes discarded so far
+
+    Status parse_headers(std::span<char> buffer);
+    Status begin_body(std::span<char> buffer);
+    Status stream_content(std::span<char> buffer);
+    Status incomplete() const noexcept;
+    Status parse_chunks(std::span<char> buffer);
+    bool read_line(std::span<char> buffer, std::string_view& line);
+    Status finish(std::span<char> buffer);
+};
+
+} // namespace http_server
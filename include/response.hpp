@@ -1,11 +1,15 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <chrono>
 #include <string_view>
 #include <memory>
 #include <istream>
+#include <optional>
+#include <cstdint>
+#include <functional>
+#include "compression.hpp"
 
 namespace http_server {
 
@@ -17,6 +21,7 @@ enum class HttpStatus {
     CREATED = 201,
     ACCEPTED = 202,
     NO_CONTENT = 204,
+    PARTIAL_CONTENT = 206,
     MOVED_PERMANENTLY = 301,
     FOUND = 302,
     NOT_MODIFIED = 304,
@@ -28,6 +33,7 @@ enum class HttpStatus {
     CONFLICT = 409,
     LENGTH_REQUIRED = 411,
     PAYLOAD_TOO_LARGE = 413,
+    RANGE_NOT_SATISFIABLE = 416,
     TOO_MANY_REQUESTS = 429,
     INTERNAL_SERVER_ERROR = 500,
     NOT_IMPLEMENTED = 501,
@@ -36,10 +42,31 @@ enum class HttpStatus {
     SERVICE_UNAVAILABLE = 503
 };
 
+/**
+ * @brief Byte range of an open file used as a response body
+ *
+ * Connection hands it to sendfile(2); SslConnection copies it through pooled
+ * buffers. The descriptor is closed when the last copy is dropped.
+ */
+struct FileBody {
+    std::shared_ptr<const int> fd;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    
+    // Opens the whole file read-only; nullopt if it cannot be opened
+    static std::optional<FileBody> open(const std::string& path);
+};
+
 class HttpResponse {
 public:
     HttpResponse();
     explicit HttpResponse(HttpStatus status);
+    // Spelled out: the declared destructor would otherwise turn every move
+    // of a response (handler to connection, across threads) into a copy
+    HttpResponse(const HttpResponse&) = default;
+    HttpResponse(HttpResponse&&) noexcept = default;
+    HttpResponse& operator=(const HttpResponse&) = default;
+    HttpResponse& operator=(HttpResponse&&) noexcept = default;
     ~HttpResponse() = default;
     
     HttpResponse& set_status(HttpStatus status);
@@ -53,8 +80,19 @@ public:
     
     HttpResponse& set_body(const std::string& body);
     HttpResponse& set_body(std::string&& body);
-    const std::string& body() const noexcept { return body_content_; }
+    // Serve an immutable buffer shared with other responses (cached files)
+    HttpResponse& set_shared_body(std::shared_ptr<const std::string> body);
+    const std::string& body() const noexcept { return shared_body_ ? *shared_body_ : body_content_; }
     std::shared_ptr<std::istream> body_stream() const { return body_stream_; }
+    // Body read from a stream as it is sent; chunked unless length is known
+    HttpResponse& set_body_stream(std::shared_ptr<std::istream> stream, std::optional<uint64_t> length = std::nullopt);
+    // Compresses the body stream on the way out; the length is then unknown
+    HttpResponse& set_stream_encoding(compression::Encoding encoding, int level = -1);
+    compression::Encoding stream_encoding() const noexcept { return stream_encoding_; }
+    int stream_compression_level() const noexcept { return stream_level_; }
+    bool is_chunked() const;
+    HttpResponse& set_file_body(FileBody body);
+    const std::optional<FileBody>& file_body() const noexcept { return file_body_; }
 
     HttpResponse& set_content_type(const std::string& content_type);
     HttpResponse& set_json(const std::string& json_data);
@@ -63,6 +101,8 @@ public:
     HttpResponse& set_file_content(const std::string& file_path);
     
     HttpResponse& set_keep_alive(bool keep_alive = true);
+    // True when the Connection header lists the "close" token, in any case
+    bool closes_connection() const;
     HttpResponse& set_cache_control(const std::string& cache_control);
     HttpResponse& set_cors_headers(const std::string& origin = "*");
     
@@ -74,11 +114,16 @@ public:
     std::chrono::system_clock::time_point get_last_modified() const;
     
     HttpResponse& set_compressed_body(const std::string& body, const std::string& encoding = "gzip");
-    HttpResponse& compress_body_if_supported(const std::string& accept_encoding);
+    HttpResponse& compress_body_if_supported(std::string_view accept_encoding);
     bool is_compressed() const;
     
     std::string to_string() const;
     std::string to_http_string() const;
+    // Appends the status line and headers (through the blank line) to out;
+    // the body is sent from body() without being copied
+    void serialize_head(std::string& out) const;
+    // Visits every header serialize_head() would write, implicit ones included
+    void for_each_header(const std::function<void(std::string_view name, std::string_view value)>& visit) const;
     
     static HttpResponse ok(const std::string& body = "");
     static HttpResponse not_found(const std::string& message = "Not Found");
@@ -93,21 +138,50 @@ public:
     static std::string generate_file_etag(const std::string& file_path);
     static std::string format_http_time(const std::chrono::system_clock::time_point& time);
     static std::chrono::system_clock::time_point parse_http_time(const std::string& time_str);
-    static bool etag_matches(const std::string& etag, const std::string& if_none_match);
+    static bool etag_matches(std::string_view etag, std::string_view if_none_match);
     
     static std::string get_mime_type(const std::string& file_extension);
     static std::string get_status_message(HttpStatus status);
+    static std::string_view status_reason(HttpStatus status);
+    // Current time as an RFC 1123 date, formatted at most once per second
+    // per thread; valid until the thread's next call
+    static std::string_view current_http_date();
 
 private:
+    // A response carries a handful of headers: a flat list in insertion
+    // order finds them faster than a hash map and costs one allocation, not
+    // a node (and usually two strings) per header
+    struct Header {
+        std::string name;  // Normalized to Title-Case
+        std::string value;
+    };
+
     HttpStatus status_{HttpStatus::OK};
-    std::unordered_map<std::string, std::string> headers_;
+    std::vector<Header> headers_;
     std::string body_content_;
+    std::shared_ptr<const std::string> shared_body_;
     std::shared_ptr<std::istream> body_stream_;
-    std::string version_{"HTTP/1.1"};
+    compression::Encoding stream_encoding_{compression::Encoding::IDENTITY};
+    int stream_level_{-1};
+    std::optional<FileBody> file_body_;
+    
+    // Server, Date and "Content-Length: 0" are written by serialize_head()
+    // from constants until a handler sets or removes them, so constructing
+    // a response does no formatting and no map inserts
+    enum ImplicitHeader : uint8_t {
+        IMPLICIT_SERVER = 1,
+        IMPLICIT_DATE = 2,
+        IMPLICIT_CONTENT_LENGTH = 4
+    };
+    uint8_t implicit_headers_{IMPLICIT_SERVER | IMPLICIT_DATE | IMPLICIT_CONTENT_LENGTH};
     
-    void set_default_headers();
+    static uint8_t implicit_header_bit(std::string_view name);
+    std::string implicit_header_value(uint8_t bit) const;
+    void reset_body_stream();
     void normalize_header_name(std::string& name) const;
-    std::string format_timestamp() const;
+    // Lookups compare names case-insensitively instead of normalizing a copy
+    Header* find_header(std::string_view name);
+    const Header* find_header(std::string_view name) const;
 };
 
 } // namespace http_server
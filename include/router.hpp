@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "request.hpp"
+
+namespace http_server {
+
+/**
+ * @brief Radix tree mapping a method and a path to a route id
+ *
+ * Patterns are literal paths with two kinds of placeholder: ":name" at the
+ * start of a segment matches one non-empty segment, and a trailing "*"
+ * (or "*name") matches the rest of the path, possibly nothing. A literal
+ * beats a parameter, which beats a wildcard; the lookup backtracks, so the
+ * most specific pattern that matches the whole path wins.
+ *
+ * A tree is only read once it is built, so any number of threads can call
+ * match() on it concurrently.
+ */
+class Router {
+public:
+    static constexpr size_t NO_ROUTE = static_cast<size_t>(-1);
+    using Params = std::pmr::vector<HttpRequest::PathParam>;
+
+    Router();
+    ~Router();
+    Router(const Router& other);
+    Router& operator=(const Router& other);
+    Router(Router&&) noexcept;
+    Router& operator=(Router&&) noexcept;
+
+    // Registers pattern for method and returns its id: id itself, or the id
+    // already registered for the same method and pattern. Throws
+    // std::invalid_argument for a malformed pattern, or for a parameter whose
+    // name differs from another pattern's at the same position.
+    size_t insert(HttpMethod method, std::string_view pattern, size_t id);
+
+    // Id of the best match or NO_ROUTE. params receives the captures; they
+    // view into path and into this router.
+    size_t match(HttpMethod method, std::string_view path, Params& params) const;
+
+private:
+    struct Node;
+    std::unique_ptr<Node> root_;
+};
+
+} // namespace http_server
@@ -6,29 +6,70 @@
 #include <atomic>
 #include <unordered_map>
 #include <filesystem>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
 #include <boost/asio/ssl.hpp>
 #include <nlohmann/json.hpp>
+#include "admission.hpp"
 #include "connection.hpp"
 #include "ssl_connection.hpp"
+#include "http2_connection.hpp"
+#include "tls_session.hpp"
 #include "websocket.hpp"
+#include "websocket_hub.hpp"
 #include "rate_limiter.hpp"
 #include "request.hpp"
+#include "request_body.hpp"
 #include "response.hpp"
 #include "thread_pool.hpp"
+#include "timer_wheel.hpp"
+#include "file_cache.hpp"
+#include "compression_cache.hpp"
+#include "router.hpp"
+#include "access_log.hpp"
+#include "metrics.hpp"
 
 namespace http_server {
 
+/**
+ * @brief How I/O work is spread across threads
+ *
+ * SHARED runs one io_context from thread_pool_size threads, serializing each
+ * connection on its own strand. PER_CORE creates one io_context and acceptor
+ * per thread, bound with SO_REUSEPORT so the kernel balances new connections.
+ */
+enum class ReactorMode {
+    SHARED,
+    PER_CORE
+};
+
 struct ServerConfig {
     std::string host{"0.0.0.0"};
     uint16_t port{8080};
     size_t thread_pool_size{std::thread::hardware_concurrency()};
+    size_t worker_pool_size{std::thread::hardware_concurrency()}; // Threads for offloaded routes
+    ReactorMode reactor_mode{ReactorMode::SHARED};
+    bool pin_reactor_threads{false}; // Bind reactor thread i to CPU i (Linux only)
     std::string document_root{"./public"};
-    size_t max_connections{1000};
-    std::chrono::seconds keep_alive_timeout{30};
-    size_t max_request_size{1024 * 1024}; // 1MB
+    size_t max_connections{1000};  // Open HTTP(S) connections; 0 for no limit
+    std::chrono::seconds keep_alive_timeout{30};  // Idle HTTP/1.1 and HTTP/2 connections are closed after it
+    size_t max_request_size{1024 * 1024}; // 1MB, header block and collected body
+    uint64_t max_upload_size{1024 * 1024 * 1024}; // 1GB body on a streaming route; 0 for no limit
     bool enable_logging{true};
     std::string log_file{"server.log"};
+    size_t log_buffer_records{8192};                 // Capacity of the access log ring
+    LogOverflowPolicy log_overflow{LogOverflowPolicy::DROP};
+    std::chrono::milliseconds log_flush_interval{1000};
+    bool enable_metrics{true};  // Latency histograms for stats_json() and metrics_text()
+    
+    // Load shedding (see AdmissionControl)
+    bool enable_load_shedding{true};
+    std::chrono::milliseconds load_shedding_target{5};     // Acceptable queue delay
+    std::chrono::milliseconds load_shedding_interval{100}; // How long it may be exceeded
     
     // HTTPS Configuration
     bool enable_https{false};
@@ -39,10 +80,23 @@ struct ServerConfig {
     std::string ssl_dh_file; // Optional: for DHE ciphers
     bool ssl_verify_client{false};
     std::string ssl_cipher_list{"HIGH:!aNULL:!MD5"};
+    size_t ssl_session_cache_size{20480};            // Sessions kept for resumption by ID; 0 disables the cache
+    std::chrono::seconds ssl_session_timeout{300};   // Lifetime of cached sessions and tickets
+    bool ssl_session_tickets{true};                  // Stateless resumption (RFC 5077)
+    std::chrono::seconds ssl_ticket_key_rotation{3600};
+    bool ssl_ktls{false};  // Kernel TLS offload, which lets HTTPS use sendfile (Linux 4.13+)
+    bool enable_http2{true};  // Offer HTTP/2 over ALPN on the HTTPS listener
     
     bool serve_static_files{true};
     std::vector<std::string> index_files{"index.html", "index.htm"};
     
+    // In-memory static file cache
+    bool enable_file_cache{true};
+    size_t file_cache_size{64 * 1024 * 1024};       // Bytes across all entries
+    size_t file_cache_max_file_size{1024 * 1024};   // Larger files are read per request
+    bool file_cache_watch{true};                    // Invalidate through inotify (Linux)
+    std::chrono::seconds file_cache_revalidate_interval{5}; // Re-stat interval without inotify
+    
     bool enable_compression{true};
     size_t compression_min_size{1024};
     int compression_level{6};
@@ -50,9 +104,21 @@ struct ServerConfig {
         "text/plain", "text/html", "text/css", "application/javascript", 
         "application/json", "application/xml", "text/xml"
     };
+    size_t compression_cache_size{16 * 1024 * 1024}; // Compressed bodies kept for reuse
+    bool serve_precompressed{true};  // Serve file.gz / file.br / file.zst when present
     
     std::unordered_map<std::string, std::string> mime_types;
     
+    std::chrono::seconds websocket_ping_interval{30};  // 0 for no pings
+    std::chrono::seconds websocket_timeout{60};        // Without a pong
+    
+    // WebSocket broadcast (publish())
+    size_t websocket_high_water_mark{1024 * 1024};  // Per-connection send queue limit; subscribers past it are too slow
+    SlowConsumerPolicy websocket_slow_consumer{SlowConsumerPolicy::SKIP};
+    
+    // WebSocket permessage-deflate; the level is compression_level
+    WebSocketDeflateOptions websocket_deflate;
+    
     // Rate limiting configuration
     bool enable_rate_limiting{false};
     RateLimitConfig global_rate_limit{
@@ -68,11 +134,27 @@ struct ServerConfig {
     nlohmann::json to_json() const;
 };
 
+/**
+ * @brief Per-route dispatch options
+ */
+struct RouteOptions {
+    // Run the handler on the work-stealing pool instead of the I/O thread.
+    // Use this for handlers that block or burn CPU.
+    bool offload = false;
+};
+
 class HttpServer {
 public:
     using RequestHandler = std::function<HttpResponse(const HttpRequest&)>;
+    using ResponseCallback = std::function<void(HttpResponse)>;
     using MiddlewareHandler = std::function<bool(const HttpRequest&, HttpResponse&)>;
     using WebSocketHandler = std::function<void(std::shared_ptr<WebSocketConnection>)>;
+    // Gets the request head and reads the body itself; done may be called
+    // from any thread, and may come before the body has been read
+    using StreamingHandler = std::function<void(const HttpRequest&, std::shared_ptr<RequestBody>, ResponseCallback)>;
+    // A coroutine on the connection's executor; the request stays valid
+    // until it returns
+    using AsyncHandler = std::function<boost::asio::awaitable<HttpResponse>(const HttpRequest&)>;
     
     explicit HttpServer(const ServerConfig& config = ServerConfig{});
     ~HttpServer();
@@ -83,17 +165,35 @@ public:
     void start();
     void stop();
     bool is_running() const noexcept { return running_.load(); }
+    // Reopens the access log file (after logrotate); safe in a signal handler
+    void reopen_log() noexcept;
     
-    void add_route(const std::string& path, HttpMethod method, RequestHandler handler);
-    void add_get_route(const std::string& path, RequestHandler handler);
-    void add_post_route(const std::string& path, RequestHandler handler);
-    void add_put_route(const std::string& path, RequestHandler handler);
-    void add_delete_route(const std::string& path, RequestHandler handler);
-    void add_patch_route(const std::string& path, RequestHandler handler);
+    void add_route(const std::string& path, HttpMethod method, RequestHandler handler,
+                   RouteOptions options = {});
+    void add_get_route(const std::string& path, RequestHandler handler, RouteOptions options = {});
+    void add_post_route(const std::string& path, RequestHandler handler, RouteOptions options = {});
+    void add_put_route(const std::string& path, RequestHandler handler, RouteOptions options = {});
+    void add_delete_route(const std::string& path, RequestHandler handler, RouteOptions options = {});
+    void add_patch_route(const std::string& path, RequestHandler handler, RouteOptions options = {});
+    // The body is not collected but read as it arrives, up to max_upload_size
+    // instead of max_request_size; see RequestBody
+    void add_streaming_route(const std::string& path, HttpMethod method, StreamingHandler handler,
+                             RouteOptions options = {});
+    // The handler can co_await timers and sockets without holding up the I/O
+    // thread; offload does not apply, since a suspended handler uses none
+    void add_async_route(const std::string& path, HttpMethod method, AsyncHandler handler,
+                         RouteOptions options = {});
     
     // WebSocket support
     void add_websocket_route(const std::string& path, WebSocketHandler handler);
     
+    // Topic broadcast to WebSocket connections; see WebSocketHub
+    void subscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection);
+    void unsubscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection);
+    // Returns the number of subscribers the message was handed to
+    size_t publish(const std::string& topic, std::string_view message);
+    size_t publish_binary(const std::string& topic, std::span<const uint8_t> data);
+    
     void add_middleware(MiddlewareHandler middleware);
     
     // Rate limiting
@@ -108,53 +208,93 @@ public:
     const ServerConfig& config() const noexcept { return config_; }
     void update_config(const ServerConfig& new_config);
     
+    // A point-in-time sum of the server counters
     struct Statistics {
-        std::atomic<size_t> total_requests{0};
-        std::atomic<size_t> active_connections{0};
-        std::atomic<size_t> total_connections{0};
-        std::atomic<size_t> active_websockets{0};
-        std::atomic<size_t> total_websockets{0};
-        std::atomic<size_t> bytes_sent{0};
-        std::atomic<size_t> bytes_received{0};
+        size_t total_requests{0};
+        size_t active_connections{0};
+        size_t total_connections{0};
+        size_t active_websockets{0};
+        size_t total_websockets{0};
+        size_t bytes_sent{0};
+        size_t bytes_received{0};
+        size_t tls_handshakes{0};
+        size_t tls_resumed{0};  // Handshakes that resumed a session
+        size_t http2_connections{0};  // HTTPS connections that negotiated h2
+        size_t rejected_connections{0};  // Closed at accept, over max_connections
+        size_t shed_requests{0};  // Answered 503 by admission control
         std::chrono::steady_clock::time_point start_time;
         
         // Rate limiting stats
-        std::atomic<size_t> rate_limited_requests{0};
-        
-        Statistics() : start_time(std::chrono::steady_clock::now()) {}
+        size_t rate_limited_requests{0};
     };
     
-    const Statistics& stats() const noexcept { return stats_; }
+    Statistics stats() const noexcept;
+    // Queue delay and handler latency, e.g. for RateLimitMiddleware::create_adaptive_limiter()
+    const AdmissionControl& admission() const noexcept { return admission_; }
     std::string stats_json() const;
+    // Counters and latency histograms in the Prometheus text format
+    std::string metrics_text() const;
 
 private:
+    /**
+     * @brief One event loop with its own listening sockets
+     *
+     * In SHARED mode there is a single reactor run by every I/O thread; in
+     * PER_CORE mode each I/O thread owns one reactor exclusively.
+     */
+    struct Reactor {
+        Reactor(int concurrency_hint, size_t index)
+            : io_context(concurrency_hint), index(index), load_probe(io_context), timers(io_context) {}
+        
+        boost::asio::io_context io_context;
+        size_t index;
+        boost::asio::steady_timer load_probe;  // Measures how far behind the loop runs
+        TimerWheel timers;  // Timeouts of the connections on this loop
+        std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor;
+        std::unique_ptr<boost::asio::ip::tcp::acceptor> https_acceptor;
+    };
+    
     ServerConfig config_;
-    boost::asio::io_context io_context_;
-    boost::asio::ip::tcp::acceptor acceptor_;
-    std::unique_ptr<boost::asio::ip::tcp::acceptor> https_acceptor_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    std::vector<std::thread> io_threads_;
+    std::mutex reactors_mutex_;
+    std::unique_ptr<SessionTicketKeys> ticket_keys_;  // Declared first: ssl_context_ points at it
     std::unique_ptr<boost::asio::ssl::context> ssl_context_;
-    std::unique_ptr<ThreadPool> thread_pool_;
+    bool ktls_{false};  // HTTPS connections go through TlsSession
+    std::unique_ptr<WorkStealingPool> work_pool_;
+    std::unique_ptr<StaticFileCache> file_cache_;
+    std::unique_ptr<CompressionCache> compression_cache_;
+    std::unique_ptr<AccessLog> access_log_;
+    std::unique_ptr<ServerMetrics> metrics_;
+    WebSocketHub websocket_hub_;
+    AdmissionControl admission_;
     std::atomic<bool> running_{false};
-    mutable Statistics stats_;
+    ServerCounters counters_;
+    std::chrono::steady_clock::time_point start_time_{std::chrono::steady_clock::now()};
     
-    struct RouteKey {
-        std::string path;
-        HttpMethod method;
-        
-        bool operator==(const RouteKey& other) const {
-            return path == other.path && method == other.method;
-        }
+    struct Route {
+        RequestHandler handler{};
+        RouteOptions options{};
+        std::shared_ptr<ServerMetrics::RouteMetrics> metrics{};  // Null without metrics
+        StreamingHandler streaming_handler{};  // Set instead of handler on a streaming route
+        AsyncHandler async_handler{};          // Set instead of handler on an async route
     };
     
-    struct RouteKeyHash {
-        size_t operator()(const RouteKey& key) const {
-            return std::hash<std::string>{}(key.path) ^ 
-                   std::hash<int>{}(static_cast<int>(key.method));
-        }
+    // Compiled routes. Lookups read an immutable snapshot without locking;
+    // registration edits pending_routes_, and the next lookup publishes a
+    // fresh snapshot of it.
+    struct RouteTable {
+        Router router;
+        std::vector<Route> routes;  // Indexed by router id
+        bool streaming{false};      // Whether any route streams its body
+        Router websocket_router;
+        std::vector<WebSocketHandler> websocket_handlers;
     };
     
-    std::unordered_map<RouteKey, RequestHandler, RouteKeyHash> routes_;
-    std::unordered_map<std::string, WebSocketHandler> websocket_routes_;
+    RouteTable pending_routes_;  // Guarded by routes_mutex_
+    mutable std::mutex routes_mutex_;
+    mutable std::atomic<bool> routes_changed_{true};
+    mutable std::atomic<std::shared_ptr<const RouteTable>> route_table_;
     std::vector<MiddlewareHandler> middleware_;
     
     // Rate limiting
@@ -162,27 +302,71 @@ private:
     std::unordered_map<std::string, std::unique_ptr<RateLimiter>> endpoint_rate_limiters_;
     mutable RateLimitStats rate_limit_stats_;
     
-    void accept_connections();
-    void handle_accept(const boost::system::error_code& error, 
+    void create_reactors();
+    void open_acceptor(boost::asio::ip::tcp::acceptor& acceptor, uint16_t port, bool reuse_port);
+    void run_reactors();
+    boost::asio::any_io_executor connection_executor(Reactor& reactor);
+    void probe_reactor(Reactor& reactor);
+    // False once max_connections are open
+    bool admit_connection() const noexcept;
+    
+    void accept_connections(Reactor& reactor);
+    void handle_accept(Reactor& reactor, const boost::system::error_code& error, 
                       boost::asio::ip::tcp::socket socket);
     
-    void accept_ssl_connections();
-    void handle_ssl_accept(const boost::system::error_code& error, 
+    void accept_ssl_connections(Reactor& reactor);
+    void handle_ssl_accept(Reactor& reactor, const boost::system::error_code& error, 
                           std::shared_ptr<SslConnection::SslSocket> socket);
+    void handle_http2(Reactor& reactor, SslConnection::SslSocket socket);
+    
+    void accept_ktls_connections(Reactor& reactor);
+    void handle_ktls_handshake(Reactor& reactor, const boost::system::error_code& error,
+                               boost::asio::ip::tcp::socket socket, std::unique_ptr<TlsSession> session);
     
     void initialize_ssl_context();
     std::string get_password() const;
     
+    // executor is the connection's: it runs async handlers and the reads of a
+    // body that is handed to a streaming route in full
+    void dispatch_request(const HttpRequest& request, ResponseCallback done, boost::asio::any_io_executor executor);
+    // For on_request_body() of Connection and Http2Connection
+    Connection::BodyHandler body_handler(const HttpRequest& head);
+    void dispatch_streaming(const HttpRequest& request, std::shared_ptr<const RouteTable> routes, const Route* route,
+                            std::shared_ptr<RequestBody> body, ResponseCallback done);
+    void dispatch_async(const HttpRequest& request, std::shared_ptr<const RouteTable> routes, const Route* route,
+                        boost::asio::any_io_executor executor, ResponseCallback done);
+    // Sheds the request or runs the middleware; true once either answered it
+    bool screen_request(const HttpRequest& request, std::chrono::steady_clock::time_point started,
+                        ResponseCallback& done);
+    // Wraps done for a handler that answers later: compresses, records and
+    // logs the response on the way out
+    ResponseCallback deferred_response(std::shared_ptr<const HttpRequest> request,
+                                       std::shared_ptr<const RouteTable> routes, const Route* route,
+                                       std::chrono::steady_clock::time_point started, ResponseCallback done);
+    uint64_t upload_limit() const noexcept;
+    std::shared_ptr<const RouteTable> route_table() const;
+    const Route* find_route(const RouteTable& table, const HttpRequest& request) const;
     HttpResponse handle_request(const HttpRequest& request);
+    HttpResponse handle_request(const HttpRequest& request, const Route* route);
+    // handle_request() timed into the route's histograms, unless admission
+    // control sheds the request
+    HttpResponse run_handler(const HttpRequest& request, const Route* route);
     HttpResponse handle_websocket_upgrade_response(const HttpRequest& request);
-    bool handle_websocket_upgrade(const HttpRequest& request, boost::asio::ip::tcp::socket& socket);
+    void handle_websocket_upgrade(Reactor& reactor, boost::asio::ip::tcp::socket socket,
+                                  const HttpRequest& request, std::string_view buffered);
     HttpResponse handle_static_file(const HttpRequest& request);
+    HttpResponse serve_file(const HttpRequest& request, const std::filesystem::path& path);
+    HttpResponse cached_file_response(const CachedFile& file, const HttpRequest& request);
+    void configure_file_cache();
+    void compress_response(const HttpRequest& request, HttpResponse& response);
+    bool is_compressible_type(std::string_view content_type) const;
+    std::optional<std::filesystem::path> precompressed_sibling(const std::filesystem::path& path,
+                                                              const HttpRequest& request,
+                                                              compression::Encoding& encoding) const;
     HttpResponse create_error_response(HttpStatus status, const std::string& message = "");
     
     void initialize_mime_types();
     void log_request(const HttpRequest& request, const HttpResponse& response);
-    std::string get_current_timestamp() const;
-    bool path_matches(const std::string& pattern, const std::string& path) const;
 };
 
 } // namespace http_server
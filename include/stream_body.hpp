@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "buffer_pool.hpp"
+#include "compression.hpp"
+#include "response.hpp"
+
+namespace http_server {
+
+/**
+ * @brief Turns a response's body stream into pieces ready for the socket
+ *
+ * Each call reads at most one pooled buffer from the stream, compresses it
+ * when the response has a stream encoding and frames it as a chunk when the
+ * response is chunked. Memory per response therefore stays bounded by the
+ * buffer size, however long the body is.
+ */
+class StreamBody {
+public:
+    // Without chunk framing (HTTP/2, where DATA frames delimit the body) a
+    // chunked response comes out as bare, possibly compressed, bytes
+    explicit StreamBody(const HttpResponse& response, bool chunk_framing = true);
+
+    // Next piece to send, valid until the following call; empty once the
+    // body (including the last chunk) has been produced
+    std::string_view next();
+
+    // The stream broke or ended short of its Content-Length: what was sent
+    // cannot be terminated cleanly and the connection has to be closed
+    bool failed() const noexcept { return failed_; }
+
+private:
+    std::shared_ptr<std::istream> stream_;
+    std::unique_ptr<compression::StreamCompressor> compressor_;
+    BufferPool::Buffer buffer_;
+    std::string encoded_;
+    std::optional<uint64_t> remaining_;  // Bytes still owed under Content-Length
+    bool chunked_;
+    bool framed_;
+    bool done_{false};
+    bool failed_{false};
+
+    size_t frame_chunk();  // Returns where the framed chunk starts in encoded_
+};
+
+} // namespace http_server
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -66,4 +67,56 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     return result;
 }
 
+/**
+ * @brief Work-stealing executor for fire-and-forget tasks
+ *
+ * Each worker owns a deque guarded by its own lock. Submissions from outside
+ * the pool are spread round-robin over the deques; submissions from a worker
+ * go to that worker's deque. An idle worker steals from the back of its
+ * siblings' deques before parking, waiting for their locks only on its last
+ * pass. Unlike ThreadPool::enqueue() there is no packaged_task or future per
+ * task, so completion must be signalled by the task itself.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+    
+    explicit WorkStealingPool(size_t thread_count = std::thread::hardware_concurrency());
+    ~WorkStealingPool();
+    
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    
+    void submit(Task task);
+    void shutdown();
+    
+    size_t size() const noexcept { return queues_.size(); }
+    size_t pending_tasks() const noexcept { return pending_.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    
+    alignas(64) std::atomic<size_t> next_queue_{0};
+    alignas(64) std::atomic<size_t> pending_{0};
+    std::atomic<size_t> idle_workers_{0};
+    std::atomic<bool> stop_{false};
+    
+    // Only touched when a worker runs out of work
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+    
+    void worker_loop(size_t index);
+    bool try_pop(size_t index, Task& task);
+    // Skips victims whose lock is held unless wait_for_lock, which the last
+    // pass before parking sets: a task counted in pending_ would otherwise
+    // keep the worker from parking while it loses every race for it
+    bool try_steal(size_t thief, Task& task, bool wait_for_lock);
+};
+
 } // namespace http_server
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace http_server {
+
+/**
+ * @brief Coarse timeouts for every connection of one reactor
+ *
+ * A hierarchical wheel (4 levels of 64 slots, TICK apart at the bottom)
+ * driven by a single steady_timer. Arming, re-arming and cancelling a
+ * timeout unlinks and links an intrusive list node, whatever the number of
+ * connections, and each tick expires a whole slot in one go; entries in the
+ * upper levels move down as their turn comes, as in the classic kernel
+ * timer wheel. Timeouts fire up to a tick late, never early, and at most
+ * about 48 days out.
+ *
+ * The wheel is shared by the reactor's threads. An entry belongs to an
+ * object managed by a shared_ptr and is only touched from that object's
+ * executor; it keeps no reference, so it never keeps its owner alive.
+ */
+class TimerWheel {
+    struct Core;
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto TICK = std::chrono::milliseconds(250);
+    static constexpr size_t LEVELS = 4;
+    static constexpr size_t SLOT_BITS = 6;
+    static constexpr size_t SLOTS = size_t{1} << SLOT_BITS;
+
+    struct Link {
+        Link* prev{this};
+        Link* next{this};
+    };
+
+    class Entry : private Link {
+    public:
+        Entry() = default;
+        ~Entry() { cancel(); }
+
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        // Once, before schedule(). On expiry callback runs on executor with
+        // owner alive, unless the entry was scheduled or cancelled since.
+        // Until then schedule() and cancel() do nothing.
+        void bind(TimerWheel& wheel, std::weak_ptr<void> owner, boost::asio::any_io_executor executor,
+                  std::function<void()> callback);
+
+        // Arms the entry to expire after timeout, replacing any earlier expiry
+        void schedule(Clock::duration timeout);
+        void cancel();
+
+    private:
+        friend class TimerWheel;
+        friend struct Core;
+
+        std::shared_ptr<Core> core_;  // Outlives the wheel until the entry goes
+        std::weak_ptr<void> owner_;
+        boost::asio::any_io_executor executor_;
+        std::function<void()> callback_;
+        uint64_t expiry_{0};      // In ticks
+        uint64_t generation_{0};  // Bumped by schedule() and cancel()
+
+        bool linked() const noexcept { return next != this; }
+        void unlink() noexcept;
+    };
+
+    explicit TimerWheel(boost::asio::io_context& io_context);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Ticks until the io_context stops
+    void start();
+    // Entries currently armed
+    size_t size() const;
+
+private:
+    struct Core {
+        Clock::time_point origin{Clock::now()};
+        mutable std::mutex mutex;
+        std::array<std::array<Link, SLOTS>, LEVELS> slots;
+        uint64_t next_tick{1};  // The next slot to expire
+        size_t size{0};
+
+        uint64_t tick_at(Clock::time_point time) const noexcept;
+        void insert(Entry& entry) noexcept;  // By its expiry, relative to next_tick
+        void cascade(size_t level, size_t slot) noexcept;
+    };
+
+    struct Expired {
+        std::shared_ptr<void> owner;
+        Entry* entry;
+        uint64_t generation;
+    };
+
+    boost::asio::steady_timer timer_;
+    std::shared_ptr<Core> core_;
+    std::vector<Expired> expired_;  // Reused by every tick
+
+    void wait();
+    void advance(Clock::time_point now);
+};
+
+} // namespace http_server
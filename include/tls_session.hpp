@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
+#include <openssl/ssl.h>
+
+namespace http_server {
+
+/**
+ * @brief Session ticket keys (RFC 5077) that rotate on a fixed interval
+ *
+ * New tickets are sealed with the current key. Tickets sealed with the
+ * previous key are still accepted, and are reissued under the current one,
+ * so a ticket stays valid between one and two rotation intervals. Keys
+ * live only in memory: a restart invalidates every outstanding ticket.
+ */
+class SessionTicketKeys {
+public:
+    explicit SessionTicketKeys(std::chrono::seconds rotation_interval);
+
+    SessionTicketKeys(const SessionTicketKeys&) = delete;
+    SessionTicketKeys& operator=(const SessionTicketKeys&) = delete;
+
+    // Installs the ticket callback on context; the keys must outlive it
+    void install(SSL_CTX* context);
+
+    uint64_t rotations() const;
+
+private:
+    struct Key {
+        std::array<unsigned char, 16> name;
+        std::array<unsigned char, 32> aes_key;
+        std::array<unsigned char, 32> hmac_key;
+    };
+
+    std::chrono::seconds rotation_interval_;
+    mutable std::mutex mutex_;
+    Key current_;
+    Key previous_;
+    bool has_previous_{false};
+    std::chrono::steady_clock::time_point rotated_at_;
+    uint64_t rotations_{0};
+
+    static Key generate();
+    void rotate_if_due();
+
+    friend struct TicketCallback;
+};
+
+/**
+ * @brief Server-side TLS over the socket itself, for kernel TLS offload
+ *
+ * Asio's ssl::stream runs OpenSSL over memory BIOs, where
+ * SSL_OP_ENABLE_KTLS has no effect. This runs the handshake on the socket
+ * instead, so that OpenSSL can hand the record layer of each direction to
+ * the kernel. Directions the kernel took over are plain socket I/O,
+ * sendfile(2) included; the others go through SSL_read / SSL_write.
+ */
+class TlsSession {
+public:
+    using HandshakeHandler = std::function<void(const boost::system::error_code& error,
+                                                boost::asio::ip::tcp::socket socket,
+                                                std::unique_ptr<TlsSession> session)>;
+    using IoHandler = std::function<void(const boost::system::error_code& error, size_t bytes_transferred)>;
+
+    // Whether this kernel and OpenSSL build can do TLS offload at all
+    static bool kernel_supported();
+    // Accepts the handshake within timeout and hands the socket back with
+    // the session; context needs SSL_OP_ENABLE_KTLS for the offload
+    static void async_accept(boost::asio::ip::tcp::socket socket, SSL_CTX* context,
+                             std::chrono::steady_clock::duration timeout, HandshakeHandler handler);
+
+    ~TlsSession();
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    bool kernel_send() const noexcept { return kernel_send_; }
+    bool kernel_receive() const noexcept { return kernel_receive_; }
+    bool resumed() const noexcept;
+
+    // Userspace record layer for directions the kernel does not handle.
+    // Same completion contract as the Asio operations: handlers never run
+    // inline, and the buffers must stay valid until they do.
+    void async_read_some(boost::asio::ip::tcp::socket& socket, boost::asio::mutable_buffer buffer,
+                         IoHandler handler);
+    void async_write(boost::asio::ip::tcp::socket& socket, std::vector<boost::asio::const_buffer> buffers,
+                     IoHandler handler);
+    // Sends close_notify if that can be done without blocking
+    void shutdown() noexcept;
+
+private:
+    struct WriteOperation;
+
+    explicit TlsSession(SSL* ssl);
+
+    SSL* ssl_;
+    bool kernel_send_{false};
+    bool kernel_receive_{false};
+
+    void write_some(boost::asio::ip::tcp::socket& socket, std::shared_ptr<WriteOperation> operation);
+    // Waits for the socket as SSL_get_error() asks, or completes with the error
+    template <typename Retry>
+    void wait_or_fail(boost::asio::ip::tcp::socket& socket, int result, Retry retry, const IoHandler& handler,
+                      size_t transferred);
+
+    friend struct HandshakeOperation;
+};
+
+} // namespace http_server
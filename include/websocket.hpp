@@ -1,13 +1,19 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <functional>
 #include <cstdint>
+#include <optional>
 #include <boost/asio.hpp>
+#include "compression.hpp"
 #include "request.hpp"
 #include "response.hpp"
+#include "timer_wheel.hpp"
 
 namespace http_server {
 
@@ -23,6 +29,26 @@ enum class WebSocketOpcode : uint8_t {
     PONG = 0xA
 };
 
+/**
+ * @brief permessage-deflate (RFC 7692) settings
+ *
+ * As server configuration these are upper bounds and preferences; after
+ * negotiation they are what both sides agreed on for one connection.
+ */
+struct WebSocketDeflateOptions {
+    bool enabled = false;
+    // Keep the compression history from one message to the next. Better
+    // ratios on repetitive traffic, at the cost of a zlib stream that lives
+    // as long as the connection.
+    bool server_context_takeover = true;
+    bool client_context_takeover = true;
+    // LZ77 window of 2^bits bytes, 9-15
+    int server_max_window_bits = 15;
+    int client_max_window_bits = 15;
+    int level = -1;           // zlib level
+    size_t min_size = 256;    // Smaller messages are sent uncompressed
+};
+
 /**
  * @brief WebSocket frame structure
  */
@@ -38,9 +64,67 @@ struct WebSocketFrame {
     std::vector<uint8_t> payload;
     
     std::vector<uint8_t> serialize() const;
+    // An unmasked (server-to-client) frame, header and payload in one buffer
+    // compressed sets RSV1, marking a permessage-deflate message
+    static std::vector<uint8_t> encode(WebSocketOpcode opcode, std::span<const uint8_t> payload, bool fin = true,
+                                       bool compressed = false);
+    // Copying wrapper around WebSocketFrameParser; throws std::runtime_error
+    // on incomplete or invalid data. The receive path uses the parser directly.
     static WebSocketFrame parse(const std::vector<uint8_t>& data, size_t& bytes_consumed);
 };
 
+/**
+ * @brief Resumable, non-throwing WebSocket frame decoder
+ *
+ * Fed with the unconsumed front of the receive buffer after every read. The
+ * frame header is decoded once, as soon as it is complete; after that only
+ * the payload length is checked until the whole frame is there. The payload
+ * is then unmasked where it lies and exposed as a span into the buffer,
+ * valid until the buffer is next modified.
+ *
+ * Like RequestParser, the buffer may move between calls as long as the
+ * frame keeps its position relative to the start of the span passed in.
+ */
+class WebSocketFrameParser {
+public:
+    enum class Status {
+        INCOMPLETE,  // Need more bytes
+        COMPLETE,    // frame() is ready
+        INVALID,     // Protocol error (RFC 6455 close code 1002)
+        TOO_LARGE    // Payload exceeds the size limit (close code 1009)
+    };
+
+    struct Frame {
+        bool fin = true;
+        bool rsv1 = false;
+        bool rsv2 = false;
+        bool rsv3 = false;
+        WebSocketOpcode opcode = WebSocketOpcode::TEXT;
+        bool masked = false;
+        uint32_t masking_key = 0;
+        std::span<uint8_t> payload;  // Already unmasked
+    };
+
+    explicit WebSocketFrameParser(uint64_t max_payload_size);
+
+    Status feed(std::span<uint8_t> buffer);
+    void reset() noexcept;
+
+    const Frame& frame() const noexcept { return frame_; }
+    // Bytes of the buffer taken by the completed frame
+    size_t consumed() const noexcept { return static_cast<size_t>(header_size_ + payload_length_); }
+    // Size of the whole frame once its header is in, otherwise 0
+    size_t frame_size() const noexcept { return header_size_ ? consumed() : 0; }
+
+private:
+    uint64_t max_payload_size_;
+    Frame frame_;
+    size_t header_size_{0};  // 0 until the header has been decoded
+    uint64_t payload_length_{0};
+
+    Status parse_header(std::span<uint8_t> buffer);
+};
+
 /**
  * @brief WebSocket connection state
  */
@@ -60,32 +144,70 @@ public:
     using BinaryHandler = std::function<void(const std::vector<uint8_t>&)>;
     using CloseHandler = std::function<void(uint16_t code, const std::string& reason)>;
     using ErrorHandler = std::function<void(const std::string& error)>;
+    // The payload points into the receive buffer and is only valid during the call
+    using MessageViewHandler = std::function<void(WebSocketOpcode opcode, std::span<const uint8_t> payload)>;
+    using DrainHandler = std::function<void()>;
+    
+    // A serialized frame shared by every connection it is sent to
+    using SharedFrame = std::shared_ptr<const std::vector<uint8_t>>;
     
-    explicit WebSocketConnection(boost::asio::ip::tcp::socket socket);
+    explicit WebSocketConnection(boost::asio::ip::tcp::socket socket,
+                                 std::function<void()> cleanup_callback = nullptr);
     ~WebSocketConnection();
     
     // Connection management
-    bool handshake(const HttpRequest& request);
+    bool handshake(const HttpRequest& request, const WebSocketDeflateOptions& deflate = {});
     void start();
+    // For a socket whose 101 response was already written by the HTTP
+    // connection; buffered holds bytes the client sent right after it
+    void start_upgraded(std::span<const uint8_t> buffered = {});
+    // Turns on permessage-deflate with parameters from negotiate_deflate();
+    // call before start
+    void enable_deflate(const WebSocketDeflateOptions& negotiated);
+    // Pings every ping_interval (zero: never) and fails the connection when
+    // timeout passes without a pong; call before start. Without it the
+    // connection never times out, and a close waits for the peer.
+    void set_timeouts(TimerWheel& timers, std::chrono::steady_clock::duration ping_interval,
+                      std::chrono::steady_clock::duration timeout);
     void close(uint16_t code = 1000, const std::string& reason = "");
     
-    // Message sending
-    void send_text(const std::string& message);
-    void send_binary(const std::vector<uint8_t>& data);
+    // Message sending. Safe from any thread: frames are queued in order on
+    // the connection's executor and written in batches. The message sends
+    // return false once the queue is at the high-water mark; the message is
+    // still sent, and on_drain fires when the queue has emptied.
+    bool send_text(const std::string& message);
+    bool send_binary(const std::vector<uint8_t>& data);
     void send_ping(const std::vector<uint8_t>& data = {});
     void send_pong(const std::vector<uint8_t>& data = {});
+    // Queues a frame serialized once for many connections, without copying it
+    bool send_shared(SharedFrame frame);
+    // Window of a connection that takes frames deflated without context
+    // (server_no_context_takeover); 0 if it takes uncompressed frames only
+    int shared_deflate_window_bits() const noexcept;
+    
+    // Flow control
+    void set_high_water_mark(size_t bytes) noexcept { high_water_mark_.store(bytes, std::memory_order_relaxed); }
+    size_t high_water_mark() const noexcept { return high_water_mark_.load(std::memory_order_relaxed); }
     
     // Event handlers
     void on_message(MessageHandler handler) { text_handler_ = std::move(handler); }
     void on_binary(BinaryHandler handler) { binary_handler_ = std::move(handler); }
     void on_close(CloseHandler handler) { close_handler_ = std::move(handler); }
     void on_error(ErrorHandler handler) { error_handler_ = std::move(handler); }
+    // Takes the place of on_message/on_binary and saves copying each message
+    void on_message_view(MessageViewHandler handler) { view_handler_ = std::move(handler); }
+    // Runs on the connection's executor
+    void on_drain(DrainHandler handler) { drain_handler_ = std::move(handler); }
     
     // State queries
     WebSocketState state() const noexcept { return state_; }
     bool is_open() const noexcept { return state_ == WebSocketState::OPEN; }
     std::string client_address() const;
     std::string client_port() const;
+    boost::asio::any_io_executor get_executor() { return socket_.get_executor(); }
+    // Bytes queued for sending and not yet written
+    size_t queued_bytes() const noexcept { return queued_bytes_.load(std::memory_order_relaxed); }
+    bool deflate_enabled() const noexcept { return deflater_ != nullptr; }
     
     // Statistics
     size_t bytes_sent() const noexcept { return bytes_sent_; }
@@ -95,22 +217,58 @@ public:
     std::chrono::steady_clock::time_point creation_time() const noexcept { return creation_time_; }
 
 private:
-    static constexpr size_t BUFFER_SIZE = 8192;
-    static constexpr auto PING_INTERVAL = std::chrono::seconds(30);
-    static constexpr auto TIMEOUT = std::chrono::seconds(60);
+    static constexpr size_t BUFFER_SIZE = 8192;  // Minimum free space offered to each read
+    static constexpr size_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+    static constexpr auto CLOSE_LINGER = std::chrono::milliseconds(100);  // For our close frame to go out
+    static constexpr size_t DEFAULT_HIGH_WATER_MARK = 1024 * 1024;
+    // Frames per vectored write; Asio hands the kernel at most 64 buffers
+    static constexpr size_t MAX_WRITE_BUFFERS = 64;
+    // Frames up to this size are copied together into one write buffer
+    static constexpr size_t SMALL_FRAME_SIZE = 512;
+    static constexpr size_t MAX_BATCH_SIZE = 64 * 1024;
     
     boost::asio::ip::tcp::socket socket_;
-    WebSocketState state_;
+    std::atomic<WebSocketState> state_;
+    std::function<void()> cleanup_callback_;
     
-    std::array<char, BUFFER_SIZE> buffer_;
+    // Reads land straight in frame_buffer_; [frame_begin_, frame_end_) has not
+    // been consumed yet. Frames are decoded and unmasked in place.
     std::vector<uint8_t> frame_buffer_;
+    size_t frame_begin_{0};
+    size_t frame_end_{0};
+    WebSocketFrameParser parser_;
+    // Payload of a fragmented message so far
     std::vector<uint8_t> message_buffer_;
+    WebSocketOpcode message_opcode_{WebSocketOpcode::CONTINUATION};  // CONTINUATION when none is open
+    
+    // permessage-deflate; both streams are only touched on the executor.
+    // A compressed message is inflated fragment by fragment into inflated_.
+    WebSocketDeflateOptions deflate_;
+    std::unique_ptr<compression::StreamCompressor> deflater_;
+    std::unique_ptr<compression::RawInflater> inflater_;
+    bool message_compressed_{false};
+    std::string inflated_;
+    std::string deflated_;
+    
+    // Frames go out in order, one write at a time. A write takes everything
+    // queued when it starts; the first frame after an idle spell waits for
+    // the current handler to return, so a burst of sends becomes one write.
+    std::deque<SharedFrame> send_queue_;
+    std::atomic<size_t> queued_bytes_{0};  // Counted when send is called
+    std::atomic<size_t> high_water_mark_{DEFAULT_HIGH_WATER_MARK};
+    std::atomic<bool> drain_pending_{false};
+    bool writing_{false};  // A write is in flight or about to start
+    size_t frames_in_flight_{0};
+    std::vector<boost::asio::const_buffer> write_buffers_;
+    std::vector<uint8_t> batch_buffer_;  // Small frames of the current write
     
     // Event handlers
     MessageHandler text_handler_;
     BinaryHandler binary_handler_;
     CloseHandler close_handler_;
     ErrorHandler error_handler_;
+    MessageViewHandler view_handler_;
+    DrainHandler drain_handler_;
     
     // Statistics
     size_t bytes_sent_{0};
@@ -119,35 +277,49 @@ private:
     size_t messages_received_{0};
     std::chrono::steady_clock::time_point creation_time_;
     
-    // Timers
-    boost::asio::steady_timer ping_timer_;
-    boost::asio::steady_timer timeout_timer_;
+    // Timers; timeout_ also ends the close handshake
+    TimerWheel::Entry ping_timer_;
+    TimerWheel::Entry timeout_;
+    std::chrono::steady_clock::duration ping_interval_{};
+    std::chrono::steady_clock::duration idle_timeout_{};
     
     // Frame processing
     void read_frame();
     void handle_read(const boost::system::error_code& error, size_t bytes_transferred);
     void process_frames();
-    void handle_frame(const WebSocketFrame& frame);
+    void handle_frame(const WebSocketFrameParser::Frame& frame);
+    void deliver_message(WebSocketOpcode opcode, std::span<const uint8_t> payload);
+    bool inflate(std::span<const uint8_t> data);
+    
+    bool send_message(WebSocketOpcode opcode, std::span<const uint8_t> payload);
+    SharedFrame deflate_frame(WebSocketOpcode opcode, std::span<const uint8_t> payload);
     
     void send_frame(const WebSocketFrame& frame);
-    void handle_write(const boost::system::error_code& error, size_t bytes_transferred,
-                     std::shared_ptr<std::vector<uint8_t>> data);
+    // Counts the frame against the queue and hands it to the executor;
+    // returns whether the queue is still below the high-water mark
+    bool submit(SharedFrame frame, bool is_message);
+    bool count_queued(size_t bytes) noexcept;
+    void enqueue(SharedFrame frame, bool is_message);
+    void do_close(uint16_t code, const std::string& reason);
+    void write_queued();
+    void handle_write(const boost::system::error_code& error, size_t bytes_transferred);
     
     // Protocol handling
-    void handle_ping(const std::vector<uint8_t>& data);
-    void handle_pong(const std::vector<uint8_t>& data);
-    void handle_close_frame(const std::vector<uint8_t>& data);
+    void handle_ping(std::span<const uint8_t> data);
+    void handle_pong(std::span<const uint8_t> data);
+    void handle_close_frame(std::span<const uint8_t> data);
+    void fail(uint16_t code, const std::string& reason);
     
     // Timers
     void setup_ping_timer();
-    void handle_ping_timer(const boost::system::error_code& error);
+    void handle_ping_timer();
     void setup_timeout();
-    void handle_timeout(const boost::system::error_code& error);
+    void handle_timeout();
     
     // Utilities
     void handle_error(const std::string& error);
+    void close_socket();
     std::string generate_accept_key(const std::string& key);
-    void apply_mask(std::vector<uint8_t>& data, uint32_t mask);
 };
 
 /**
@@ -165,8 +337,26 @@ public:
     static bool validate_websocket_key(const std::string& key);
     
     // Response generation
-    static HttpResponse create_handshake_response(const HttpRequest& request);
+    // Accepts permessage-deflate when deflate is enabled and the client offers it
+    static HttpResponse create_handshake_response(const HttpRequest& request,
+                                                  const WebSocketDeflateOptions& deflate = {});
     static HttpResponse create_handshake_rejection(const std::string& reason = "");
+    
+    // permessage-deflate: the first offer in Sec-WebSocket-Extensions that
+    // fits the server's options, as the parameters in effect, with the
+    // response header value stored in response_header
+    static std::optional<WebSocketDeflateOptions> negotiate_deflate(const HttpRequest& request,
+                                                                   const WebSocketDeflateOptions& server,
+                                                                   std::string* response_header = nullptr);
+    // Compresses one message as permessage-deflate payload (without the
+    // trailing 00 00 ff ff) and appends it to out
+    static bool deflate_message(compression::StreamCompressor& deflater, std::span<const uint8_t> payload,
+                                std::string& out);
+    
+    // XORs data with the masking key (first key byte in the high bits), in
+    // place, using the widest vector unit available. Masking and unmasking
+    // are the same operation.
+    static void apply_mask(std::span<uint8_t> data, uint32_t masking_key) noexcept;
 };
 
 } // namespace http_server
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include "websocket.hpp"
+
+namespace http_server {
+
+/**
+ * @brief What a broadcast does for a subscriber that is not keeping up
+ */
+enum class SlowConsumerPolicy {
+    SKIP,       // Leave the message out for that subscriber
+    DISCONNECT  // Close the subscriber (code 1008)
+};
+
+/**
+ * @brief Topic-based publish/subscribe for WebSocket connections
+ *
+ * publish() serializes the frame once into an immutable shared buffer.
+ * Subscribers are grouped by the event loop their socket runs on, and each
+ * group is handed the buffer in a single task on that loop, so a message to
+ * ten thousand subscribers costs one serialization and one post per
+ * reactor. A subscriber whose send queue would pass the high-water mark is
+ * skipped or disconnected, depending on the policy.
+ *
+ * With permessage-deflate configured without server context takeover, a
+ * deflated copy of the frame is made once as well, for the subscribers
+ * that negotiated it; the rest get the plain frame.
+ *
+ * Subscriptions are held weakly; closed connections are pruned as
+ * messages are published.
+ */
+class WebSocketHub {
+public:
+    WebSocketHub(size_t high_water_mark, SlowConsumerPolicy policy, const WebSocketDeflateOptions& deflate = {});
+
+    WebSocketHub(const WebSocketHub&) = delete;
+    WebSocketHub& operator=(const WebSocketHub&) = delete;
+
+    void subscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection);
+    void unsubscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection);
+
+    // Returns the number of subscribers the message was handed to
+    size_t publish(const std::string& topic, std::span<const uint8_t> payload,
+                   WebSocketOpcode opcode = WebSocketOpcode::TEXT);
+    size_t publish(const std::string& topic, std::string_view message);
+
+    size_t subscriber_count(const std::string& topic) const;
+    // Drops every subscription; called before the event loops go away
+    void clear();
+    // Messages left out, and subscribers closed, for being too slow
+    uint64_t skipped() const noexcept { return skipped_.load(std::memory_order_relaxed); }
+    uint64_t disconnected() const noexcept { return disconnected_.load(std::memory_order_relaxed); }
+
+private:
+    // The subscribers of a topic that live on one event loop
+    struct Group {
+        // A strand of the loop: deliveries run in the order they were
+        // published even when several threads drive the loop
+        boost::asio::any_io_executor executor;
+        std::vector<std::weak_ptr<WebSocketConnection>> subscribers;
+    };
+    using Topic = std::unordered_map<const boost::asio::execution_context*, Group>;
+
+    size_t high_water_mark_;
+    SlowConsumerPolicy policy_;
+    
+    // Deflates published frames when shareable; reset after each message
+    WebSocketDeflateOptions deflate_;
+    std::mutex deflate_mutex_;
+    std::unique_ptr<compression::StreamCompressor> deflater_;
+    std::string deflated_;
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, Topic> topics_;
+
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<uint64_t> disconnected_{0};
+
+    void deliver(const std::string& topic, const boost::asio::execution_context* context,
+                 const WebSocketConnection::SharedFrame& frame, const WebSocketConnection::SharedFrame& deflated);
+    WebSocketConnection::SharedFrame deflate_frame(WebSocketOpcode opcode, std::span<const uint8_t> payload);
+    void prune(const std::string& topic, const boost::asio::execution_context* context);
+    template <typename Predicate>
+    void remove_subscribers(const std::string& topic, const boost::asio::execution_context* context,
+                            Predicate predicate);
+};
+
+} // namespace http_server
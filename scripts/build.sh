@@ -3,7 +3,7 @@
 # HTTP Server Build Script
 # Usage: ./scripts/build.sh [build_type] [options]
 # Build types: debug, release, relwithdebinfo
-# Options: --clean, --tests, --install, --help
+# Options: --clean, --tests, --bench, --install, --help
 
 set -e  # Exit on any error
 
@@ -19,6 +19,7 @@ BUILD_TYPE="Release"
 BUILD_DIR="build"
 CLEAN_BUILD=false
 BUILD_TESTS=false
+BUILD_BENCH=false
 INSTALL_BUILD=false
 VERBOSE=false
 
@@ -53,6 +54,7 @@ show_usage() {
     echo "Options:"
     echo "  --clean        Clean build directory before building"
     echo "  --tests        Build and run unit tests"
+    echo "  --bench        Build the load generator and run the microbenchmarks"
     echo "  --install      Install the built executable"
     echo "  --verbose      Enable verbose output"
     echo "  --help         Show this help message"
@@ -169,6 +171,10 @@ parse_arguments() {
                 BUILD_TESTS=true
                 shift
                 ;;
+            --bench)
+                BUILD_BENCH=true
+                shift
+                ;;
             --install)
                 INSTALL_BUILD=true
                 shift
@@ -218,6 +224,10 @@ configure_build() {
         cmake_args+=("-DBUILD_TESTING=ON")
     fi
     
+    if [ "$BUILD_BENCH" = true ]; then
+        cmake_args+=("-DBUILD_BENCHMARKS=ON")
+    fi
+    
     # Add verbose flag if requested
     if [ "$VERBOSE" = true ]; then
         cmake_args+=("-DCMAKE_VERBOSE_MAKEFILE=ON")
@@ -306,6 +316,20 @@ run_tests() {
     fi
 }
 
+# Run the microbenchmarks if requested
+run_benchmarks() {
+    if [ "$BUILD_BENCH" = true ]; then
+        print_status "Running microbenchmarks..."
+        
+        if cmake --build "$BUILD_DIR" --target bench; then
+            print_success "Results written to $BUILD_DIR/bench_results.json"
+        else
+            print_error "Benchmarks failed"
+            exit 1
+        fi
+    fi
+}
+
 # Install the binary if requested
 install_binary() {
     if [ "$INSTALL_BUILD" = true ]; then
@@ -330,6 +354,7 @@ show_build_info() {
     echo "  Build Type: $BUILD_TYPE"
     echo "  Build Directory: $BUILD_DIR"
     echo "  Tests: $([ "$BUILD_TESTS" = true ] && echo "enabled" || echo "disabled")"
+    echo "  Benchmarks: $([ "$BUILD_BENCH" = true ] && echo "enabled" || echo "disabled")"
     echo "  Clean Build: $([ "$CLEAN_BUILD" = true ] && echo "yes" || echo "no")"
     
     if [ -f "$BUILD_DIR/http_server" ]; then
@@ -356,6 +381,7 @@ main() {
     configure_build
     build_project
     run_tests
+    run_benchmarks
     install_binary
     
     echo ""
@@ -0,0 +1,200 @@
+/**
+ * @file access_log.cpp
+ * @brief Implementation of the AccessLog class for logging requests off the I/O threads.
+ *
+ * The ring is a bounded multi-producer queue in the style of Vyukov's: each slot carries a
+ * sequence number, so producers claim slots with one compare-and-swap and never take a lock.
+ */
+#include "access_log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace http_server {
+
+namespace {
+
+// Batches are written out once they reach this size, even between flushes
+constexpr size_t BATCH_BYTES = 64 * 1024;
+// How long the writer naps when the ring is empty
+constexpr std::chrono::milliseconds IDLE_WAIT{5};
+
+size_t round_up_to_power_of_two(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+AccessLog::AccessLog(std::string path, size_t capacity, LogOverflowPolicy overflow,
+                     std::chrono::milliseconds flush_interval)
+    : path_(std::move(path))
+    , overflow_(overflow)
+    , flush_interval_(std::max(flush_interval, std::chrono::milliseconds(1)))
+    , slots_(std::make_unique<Slot[]>(round_up_to_power_of_two(capacity)))
+    , mask_(round_up_to_power_of_two(capacity) - 1) {
+    for (size_t i = 0; i <= mask_; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    batch_.reserve(BATCH_BYTES + 1024);
+    open_file();
+    writer_ = std::thread([this] { run(); });
+}
+
+AccessLog::~AccessLog() {
+    running_.store(false);
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (fd_ > STDERR_FILENO) {
+        ::close(fd_);
+    }
+}
+
+void AccessLog::log(HttpMethod method, std::string_view path, int status, std::optional<uint64_t> bytes) {
+    Record record;
+    record.time = std::time(nullptr);
+    record.bytes = bytes.value_or(UNKNOWN_BYTES);
+    record.status = static_cast<uint16_t>(status);
+    record.method = method;
+    record.path_length = static_cast<uint16_t>(std::min(path.size(), PATH_CAPACITY));
+    std::memcpy(record.path, path.data(), record.path_length);
+
+    while (!try_push(record)) {
+        if (overflow_ == LogOverflowPolicy::DROP || !running_.load(std::memory_order_relaxed)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+bool AccessLog::try_push(const Record& record) {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = slots_[position & mask_];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (difference == 0) {
+            if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.record = record;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;  // Full
+        } else {
+            position = enqueue_position_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool AccessLog::pop(Record& record) {
+    Slot& slot = slots_[dequeue_position_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeue_position_ + 1) {
+        return false;
+    }
+    record = slot.record;
+    slot.sequence.store(dequeue_position_ + mask_ + 1, std::memory_order_release);
+    ++dequeue_position_;
+    return true;
+}
+
+void AccessLog::open_file() {
+    if (path_.empty()) {
+        fd_ = STDOUT_FILENO;
+        return;
+    }
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Cannot open log file " << path_ << ": " << std::strerror(errno) << std::endl;
+    }
+}
+
+void AccessLog::format(const Record& record) {
+    if (record.time != formatted_second_) {
+        std::tm local{};
+        localtime_r(&record.time, &local);
+        std::strftime(timestamp_, sizeof(timestamp_), "%Y-%m-%d %H:%M:%S", &local);
+        formatted_second_ = record.time;
+    }
+
+    char number[24];
+    batch_.push_back('[');
+    batch_.append(timestamp_);
+    batch_.append("] ");
+    batch_.append(HttpRequest::method_to_string(record.method));
+    batch_.push_back(' ');
+    batch_.append(record.path, record.path_length);
+    batch_.push_back(' ');
+    batch_.append(number, std::to_chars(number, number + sizeof(number), record.status).ptr);
+    batch_.push_back(' ');
+    if (record.bytes == UNKNOWN_BYTES) {
+        batch_.append("-\n");
+        return;
+    }
+    batch_.append(number, std::to_chars(number, number + sizeof(number), record.bytes).ptr);
+    batch_.append(" bytes\n");
+}
+
+void AccessLog::write_batch() {
+    const char* data = batch_.data();
+    size_t left = batch_.size();
+    while (left > 0 && fd_ >= 0) {
+        ssize_t written = ::write(fd_, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;  // Nowhere to put it; keep the ring moving
+        }
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+    batch_.clear();
+}
+
+void AccessLog::run() {
+    auto last_write = std::chrono::steady_clock::now();
+    Record record;
+
+    for (;;) {
+        bool stopping = !running_.load();
+
+        if (reopen_requested_.exchange(false, std::memory_order_relaxed) && !path_.empty()) {
+            write_batch();
+            if (fd_ > STDERR_FILENO) {
+                ::close(fd_);
+            }
+            open_file();
+        }
+
+        while (pop(record)) {
+            format(record);
+            if (batch_.size() >= BATCH_BYTES) {
+                write_batch();
+                last_write = std::chrono::steady_clock::now();
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (!batch_.empty() && (stopping || now - last_write >= flush_interval_)) {
+            write_batch();
+            last_write = now;
+        }
+        if (stopping) {
+            return;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(IDLE_WAIT, flush_interval_));
+    }
+}
+
+} // namespace http_server
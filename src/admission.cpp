@@ -0,0 +1,91 @@
+/**
+ * @file admission.cpp
+ * @brief Implementation of the AdmissionControl class: queue delay tracking and CoDel-style load shedding.
+ */
+#include "admission.hpp"
+#include <algorithm>
+
+namespace http_server {
+
+namespace {
+
+int64_t to_microseconds(AdmissionControl::Clock::duration elapsed) {
+    return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+} // namespace
+
+AdmissionControl::AdmissionControl(bool enabled, std::chrono::microseconds target,
+                                   std::chrono::microseconds interval)
+    : enabled_(enabled)
+    , target_us_(target.count())
+    , interval_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count()) {
+}
+
+void AdmissionControl::set_reactor_count(size_t count) noexcept {
+    for (auto& delay : reactor_delays_us_) {
+        delay.store(0, std::memory_order_relaxed);
+    }
+    reactor_count_.store(std::clamp<size_t>(count, 1, REACTOR_SLOTS), std::memory_order_relaxed);
+    reactor_delay_us_.store(0, std::memory_order_relaxed);
+}
+
+void AdmissionControl::record_reactor_delay(size_t reactor, Clock::duration delay) noexcept {
+    reactor_delays_us_[reactor % REACTOR_SLOTS].store(to_microseconds(delay), std::memory_order_relaxed);
+
+    // Requests do not know their reactor, so they all see the worst one
+    int64_t worst = 0;
+    size_t count = reactor_count_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+        worst = std::max(worst, reactor_delays_us_[i].load(std::memory_order_relaxed));
+    }
+    reactor_delay_us_.store(worst, std::memory_order_relaxed);
+}
+
+bool AdmissionControl::should_shed(Clock::duration waited, Clock::time_point now) noexcept {
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    if (now_ns >= interval_end_ns_.load(std::memory_order_relaxed)) {
+        finish_interval(now_ns);
+    }
+
+    int64_t delay = reactor_delay_us_.load(std::memory_order_relaxed) + to_microseconds(waited);
+    int64_t smallest = interval_min_us_.load(std::memory_order_relaxed);
+    while (delay < smallest &&
+           !interval_min_us_.compare_exchange_weak(smallest, delay, std::memory_order_relaxed)) {
+    }
+
+    return enabled_ && delay > target_us_ && overloaded_.load(std::memory_order_relaxed);
+}
+
+void AdmissionControl::finish_interval(int64_t now_ns) noexcept {
+    int64_t end = interval_end_ns_.load(std::memory_order_relaxed);
+    if (now_ns < end ||
+        !interval_end_ns_.compare_exchange_strong(end, now_ns + interval_ns_, std::memory_order_relaxed)) {
+        return;  // Another thread finished it
+    }
+
+    int64_t smallest = interval_min_us_.exchange(NO_SAMPLE, std::memory_order_relaxed);
+    // With no request for a whole interval since, nothing was queued
+    bool idle = now_ns - end >= interval_ns_;
+    queue_delay_us_.store(smallest == NO_SAMPLE || idle ? 0 : smallest, std::memory_order_relaxed);
+    overloaded_.store(!idle && smallest != NO_SAMPLE && smallest > target_us_, std::memory_order_relaxed);
+}
+
+void AdmissionControl::record_handler(Clock::duration elapsed) noexcept {
+    // Exponential moving average over about 8 requests; concurrent updates
+    // may lose one another, which only makes the average a little coarser
+    int64_t sample = to_microseconds(elapsed);
+    int64_t average = handler_latency_us_.load(std::memory_order_relaxed);
+    handler_latency_us_.store(average + (sample - average) / 8, std::memory_order_relaxed);
+}
+
+AdmissionControl::Signals AdmissionControl::signals() const noexcept {
+    Signals signals;
+    signals.reactor_delay = std::chrono::microseconds(reactor_delay_us_.load(std::memory_order_relaxed));
+    signals.queue_delay = std::chrono::microseconds(queue_delay_us_.load(std::memory_order_relaxed));
+    signals.handler_latency = std::chrono::microseconds(handler_latency_us_.load(std::memory_order_relaxed));
+    signals.overloaded = overloaded();
+    return signals;
+}
+
+} // namespace http_server
@@ -0,0 +1,36 @@
+/**
+ * @file arena.cpp
+ * @brief Implementation of the BlockPool class for recycling connection-sized allocations.
+ */
+#include "arena.hpp"
+
+namespace http_server {
+
+BlockPool::BlockPool(size_t block_size) : block_size_(block_size) {
+    free_.reserve(MAX_POOLED);  // Releasing never allocates
+}
+
+void* BlockPool::allocate() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            void* block = free_.back();
+            free_.pop_back();
+            return block;
+        }
+    }
+    return ::operator new(block_size_);
+}
+
+void BlockPool::deallocate(void* block) noexcept {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < MAX_POOLED) {
+            free_.push_back(block);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+} // namespace http_server
@@ -0,0 +1,41 @@
+/**
+ * @file buffer_pool.cpp
+ * @brief Implementation of the BufferPool class for recycling large I/O buffers.
+ */
+#include "buffer_pool.hpp"
+
+namespace http_server {
+
+BufferPool& BufferPool::instance() {
+    // Never destroyed: buffers may come back while other statics are torn down
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+BufferPool::Buffer BufferPool::acquire() {
+    std::unique_ptr<std::vector<char>> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            buffer = std::move(free_.back());
+            free_.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer = std::make_unique<std::vector<char>>(BUFFER_SIZE);
+    }
+
+    return Buffer(buffer.release(), [this](std::vector<char>* released) {
+        release(released);
+    });
+}
+
+void BufferPool::release(std::vector<char>* buffer) {
+    std::unique_ptr<std::vector<char>> owned(buffer);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < MAX_POOLED) {
+        free_.push_back(std::move(owned));
+    }
+}
+
+} // namespace http_server
@@ -1,17 +1,32 @@
 /**
  * @file compression.cpp
- * @brief Implementation of compression utilities for HTTP responses using ZLIB
+ * @brief Implementation of compression utilities for HTTP responses using ZLIB (plus brotli and zstd when available)
  */
 #include "compression.hpp"
 #include <zlib.h>
 #include <cstring>
 #include <sstream>
 #include <algorithm>
+#include <cctype>
+#include <charconv>
+
+#ifdef HTTP_SERVER_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef HTTP_SERVER_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 namespace http_server {
 namespace compression {
 
-std::string gzip_compress(const std::string& data) {
+namespace {
+
+int zlib_level(int level) {
+    return (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) ? Z_DEFAULT_COMPRESSION : level;
+}
+
+std::string deflate_gzip(std::string_view data, int level) {
     if (data.empty()) {
         return "";
     }
@@ -19,7 +34,7 @@ std::string gzip_compress(const std::string& data) {
     z_stream zs;
     memset(&zs, 0, sizeof(zs));
     
-    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 
+    if (deflateInit2(&zs, zlib_level(level), Z_DEFLATED, 
                     15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
         return "";
     }
@@ -30,6 +45,7 @@ std::string gzip_compress(const std::string& data) {
     int ret;
     char outbuffer[32768];
     std::string outstring;
+    outstring.reserve(deflateBound(&zs, data.size()));
     
     do {
         zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
@@ -51,6 +67,428 @@ std::string gzip_compress(const std::string& data) {
     return outstring;
 }
 
+// gzip (window_bits 15 + 16) or raw deflate (negative window_bits)
+class ZlibStreamCompressor : public StreamCompressor {
+public:
+    ZlibStreamCompressor(Encoding encoding, int window_bits, int level) : StreamCompressor(encoding) {
+        memset(&zs_, 0, sizeof(zs_));
+        initialized_ = deflateInit2(&zs_, zlib_level(level), Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        ok_ = initialized_;
+    }
+    
+    ~ZlibStreamCompressor() override {
+        if (initialized_) {
+            deflateEnd(&zs_);
+        }
+    }
+    
+    bool write(std::string_view data, std::string& out) override {
+        return data.empty() || run(data, Z_NO_FLUSH, out);
+    }
+    
+    bool flush(std::string& out) override {
+        return run({}, Z_SYNC_FLUSH, out);
+    }
+    
+    bool finish(std::string& out) override {
+        bool finished = run({}, Z_FINISH, out);
+        ok_ = false;
+        return finished;
+    }
+    
+    bool reset() override {
+        ok_ = initialized_ && deflateReset(&zs_) == Z_OK;
+        return ok_;
+    }
+
+private:
+    bool run(std::string_view data, int mode, std::string& out) {
+        if (!ok_) {
+            return false;
+        }
+        zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        zs_.avail_in = static_cast<uInt>(data.size());
+        
+        // deflate() is done once it leaves output space unused; Z_FINISH
+        // is done when it reports the end of the stream
+        int ret;
+        do {
+            size_t used = out.size();
+            size_t room = std::max<size_t>(deflateBound(&zs_, zs_.avail_in), 4096);
+            out.resize(used + room);
+            zs_.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+            zs_.avail_out = static_cast<uInt>(room);
+            ret = deflate(&zs_, mode);
+            out.resize(used + room - zs_.avail_out);
+            if (ret == Z_STREAM_ERROR) {
+                ok_ = false;
+                return false;
+            }
+        } while (mode == Z_FINISH ? ret != Z_STREAM_END : zs_.avail_out == 0);
+        return true;
+    }
+    
+    z_stream zs_;
+    bool initialized_{false};
+    bool ok_{false};  // Cleared on error and once the stream is finished
+};
+
+#ifdef HTTP_SERVER_HAVE_BROTLI
+// zlib levels 1-9 spread over brotli qualities 1-11; the default maps to a
+// quality that is still cheap enough for on-the-fly use
+int brotli_quality(int level) {
+    return level < 0 ? 5 : std::clamp(level + level / 4, 1, BROTLI_MAX_QUALITY);
+}
+
+class BrotliStreamCompressor : public StreamCompressor {
+public:
+    explicit BrotliStreamCompressor(int level)
+        : StreamCompressor(Encoding::BROTLI)
+        , state_(BrotliEncoderCreateInstance(nullptr, nullptr, nullptr)) {
+        if (state_) {
+            BrotliEncoderSetParameter(state_, BROTLI_PARAM_QUALITY, static_cast<uint32_t>(brotli_quality(level)));
+        }
+    }
+    
+    ~BrotliStreamCompressor() override {
+        if (state_) {
+            BrotliEncoderDestroyInstance(state_);
+        }
+    }
+    
+    bool write(std::string_view data, std::string& out) override {
+        return data.empty() || run(data, BROTLI_OPERATION_PROCESS, out);
+    }
+    
+    bool flush(std::string& out) override {
+        return run({}, BROTLI_OPERATION_FLUSH, out);
+    }
+    
+    bool finish(std::string& out) override {
+        return run({}, BROTLI_OPERATION_FINISH, out);
+    }
+
+private:
+    bool run(std::string_view data, BrotliEncoderOperation operation, std::string& out) {
+        if (!state_) {
+            return false;
+        }
+        size_t available_in = data.size();
+        const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.data());
+        do {
+            size_t available_out = 0;
+            if (!BrotliEncoderCompressStream(state_, operation, &available_in, &next_in,
+                                             &available_out, nullptr, nullptr)) {
+                return false;
+            }
+            // Let the encoder hand over its internal buffer instead of copying twice
+            size_t size = 0;
+            const uint8_t* output = BrotliEncoderTakeOutput(state_, &size);
+            out.append(reinterpret_cast<const char*>(output), size);
+        } while (available_in > 0 || BrotliEncoderHasMoreOutput(state_) ||
+                 (operation == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(state_)));
+        return true;
+    }
+    
+    BrotliEncoderState* state_;
+};
+
+std::string encode_brotli(std::string_view data, int level) {
+    int quality = brotli_quality(level);
+    size_t encoded_size = BrotliEncoderMaxCompressedSize(data.size());
+    if (data.empty() || encoded_size == 0) {
+        return "";
+    }
+    std::string encoded(encoded_size, '\0');
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+                               data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+                               &encoded_size, reinterpret_cast<uint8_t*>(encoded.data()))) {
+        return "";
+    }
+    encoded.resize(encoded_size);
+    return encoded;
+}
+#endif
+
+#ifdef HTTP_SERVER_HAVE_ZSTD
+int zstd_level(int level) {
+    return level < 0 ? 3 : std::clamp(level * 2, 1, 19);
+}
+
+class ZstdStreamCompressor : public StreamCompressor {
+public:
+    explicit ZstdStreamCompressor(int level)
+        : StreamCompressor(Encoding::ZSTD)
+        , context_(ZSTD_createCCtx()) {
+        if (context_) {
+            ZSTD_CCtx_setParameter(context_, ZSTD_c_compressionLevel, zstd_level(level));
+        }
+    }
+    
+    ~ZstdStreamCompressor() override {
+        ZSTD_freeCCtx(context_);
+    }
+    
+    bool write(std::string_view data, std::string& out) override {
+        return data.empty() || run(data, ZSTD_e_continue, out);
+    }
+    
+    bool flush(std::string& out) override {
+        return run({}, ZSTD_e_flush, out);
+    }
+    
+    bool finish(std::string& out) override {
+        return run({}, ZSTD_e_end, out);
+    }
+
+private:
+    bool run(std::string_view data, ZSTD_EndDirective directive, std::string& out) {
+        if (!context_) {
+            return false;
+        }
+        ZSTD_inBuffer input{data.data(), data.size(), 0};
+        size_t remaining;
+        do {
+            size_t used = out.size();
+            size_t room = ZSTD_CStreamOutSize();
+            out.resize(used + room);
+            ZSTD_outBuffer output{out.data() + used, room, 0};
+            remaining = ZSTD_compressStream2(context_, &output, &input, directive);
+            out.resize(used + output.pos);
+            if (ZSTD_isError(remaining)) {
+                return false;
+            }
+        } while (directive == ZSTD_e_continue ? input.pos < input.size : remaining != 0);
+        return true;
+    }
+    
+    ZSTD_CCtx* context_;
+};
+
+std::string encode_zstd(std::string_view data, int level) {
+    if (data.empty()) {
+        return "";
+    }
+    std::string encoded(ZSTD_compressBound(data.size()), '\0');
+    size_t encoded_size = ZSTD_compress(encoded.data(), encoded.size(), data.data(), data.size(), zstd_level(level));
+    if (ZSTD_isError(encoded_size)) {
+        return "";
+    }
+    encoded.resize(encoded_size);
+    return encoded;
+}
+#endif
+
+std::string_view trim(std::string_view value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    size_t last = value.find_last_not_of(" \t");
+    return value.substr(first, last - first + 1);
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+} // namespace
+
+std::string_view encoding_name(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::GZIP: return "gzip";
+        case Encoding::BROTLI: return "br";
+        case Encoding::ZSTD: return "zstd";
+        default: return "identity";
+    }
+}
+
+std::string_view encoding_extension(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::GZIP: return ".gz";
+        case Encoding::BROTLI: return ".br";
+        case Encoding::ZSTD: return ".zst";
+        default: return "";
+    }
+}
+
+unsigned available_encoders() {
+    unsigned encoders = encoding_bit(Encoding::GZIP);
+#ifdef HTTP_SERVER_HAVE_BROTLI
+    encoders |= encoding_bit(Encoding::BROTLI);
+#endif
+#ifdef HTTP_SERVER_HAVE_ZSTD
+    encoders |= encoding_bit(Encoding::ZSTD);
+#endif
+    return encoders;
+}
+
+Encoding negotiate_encoding(std::string_view accept_encoding, unsigned available) {
+    // Server preference breaks ties between equal q-values
+    constexpr Encoding preference[] = {Encoding::BROTLI, Encoding::ZSTD, Encoding::GZIP};
+    double quality[4] = {-1, -1, -1, -1};  // -1: not mentioned
+    double wildcard = -1;
+    
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view{} : accept_encoding.substr(comma + 1);
+        
+        std::string_view token = trim(item.substr(0, item.find(';')));
+        double q = 1.0;
+        size_t q_pos = item.find("q=");
+        if (q_pos != std::string_view::npos) {
+            std::string_view q_text = trim(item.substr(q_pos + 2));
+            if (std::from_chars(q_text.data(), q_text.data() + q_text.size(), q).ec != std::errc()) {
+                q = 0;  // Unparseable weight: treat the coding as unacceptable
+            }
+        }
+        
+        if (token == "*") {
+            wildcard = q;
+            continue;
+        }
+        for (Encoding encoding : preference) {
+            if (iequals(token, encoding_name(encoding)) ||
+                (encoding == Encoding::GZIP && iequals(token, "x-gzip"))) {
+                quality[static_cast<int>(encoding)] = q;
+            }
+        }
+    }
+    
+    Encoding best = Encoding::IDENTITY;
+    double best_quality = 0;
+    for (Encoding encoding : preference) {
+        if (!(available & encoding_bit(encoding))) {
+            continue;
+        }
+        double q = quality[static_cast<int>(encoding)];
+        if (q < 0) {
+            q = wildcard < 0 ? 0 : wildcard;
+        }
+        if (q > best_quality) {
+            best = encoding;
+            best_quality = q;
+        }
+    }
+    return best;
+}
+
+std::string compress(std::string_view data, Encoding encoding, int level) {
+    switch (encoding) {
+        case Encoding::GZIP:
+            return deflate_gzip(data, level);
+#ifdef HTTP_SERVER_HAVE_BROTLI
+        case Encoding::BROTLI:
+            return encode_brotli(data, level);
+#endif
+#ifdef HTTP_SERVER_HAVE_ZSTD
+        case Encoding::ZSTD:
+            return encode_zstd(data, level);
+#endif
+        default:
+            return "";
+    }
+}
+
+std::unique_ptr<StreamCompressor> StreamCompressor::create(Encoding encoding, int level) {
+    switch (encoding) {
+        case Encoding::GZIP:
+            return std::make_unique<ZlibStreamCompressor>(Encoding::GZIP, 15 + 16, level);
+#ifdef HTTP_SERVER_HAVE_BROTLI
+        case Encoding::BROTLI:
+            return std::make_unique<BrotliStreamCompressor>(level);
+#endif
+#ifdef HTTP_SERVER_HAVE_ZSTD
+        case Encoding::ZSTD:
+            return std::make_unique<ZstdStreamCompressor>(level);
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+std::unique_ptr<StreamCompressor> StreamCompressor::create_raw_deflate(int window_bits, int level) {
+    // zlib cannot produce raw streams with a 256-byte window
+    if (window_bits < 9 || window_bits > 15) {
+        return nullptr;
+    }
+    return std::make_unique<ZlibStreamCompressor>(Encoding::IDENTITY, -window_bits, level);
+}
+
+// RawInflater implementation
+struct RawInflater::State {
+    z_stream zs;
+    bool ok = false;
+};
+
+RawInflater::RawInflater(int window_bits) : state_(std::make_unique<State>()) {
+    memset(&state_->zs, 0, sizeof(state_->zs));
+    state_->ok = inflateInit2(&state_->zs, -std::clamp(window_bits, 8, 15)) == Z_OK;
+}
+
+RawInflater::~RawInflater() {
+    if (state_->ok) {
+        inflateEnd(&state_->zs);
+    }
+}
+
+RawInflater::Status RawInflater::write(std::string_view data, std::string& out, size_t max_size) {
+    if (!state_->ok) {
+        return Status::CORRUPT;
+    }
+    auto& zs = state_->zs;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    
+    for (;;) {
+        size_t used = out.size();
+        size_t room = std::min<size_t>(std::max<size_t>(size_t{zs.avail_in} * 4, 4096), max_size - used);
+        if (room == 0) {
+            return Status::TOO_LARGE;
+        }
+        out.resize(used + room);
+        zs.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+        zs.avail_out = static_cast<uInt>(room);
+        int ret = inflate(&zs, Z_SYNC_FLUSH);
+        out.resize(used + room - zs.avail_out);
+        
+        if (ret == Z_STREAM_END) {
+            // The sender ended the stream with a final block; whatever comes
+            // next is a new stream that may still refer to the same window
+            Bytef window[32768];
+            uInt window_size = sizeof(window);
+            if (inflateGetDictionary(&zs, window, &window_size) != Z_OK || inflateReset(&zs) != Z_OK ||
+                inflateSetDictionary(&zs, window, window_size) != Z_OK) {
+                state_->ok = false;
+                return Status::CORRUPT;
+            }
+        } else if (ret == Z_BUF_ERROR) {
+            // No progress possible: either all input is used or out is full
+            if (zs.avail_in == 0 && zs.avail_out != 0) {
+                return Status::OK;
+            }
+        } else if (ret != Z_OK) {
+            state_->ok = false;
+            return Status::CORRUPT;
+        }
+        if (zs.avail_in == 0 && zs.avail_out != 0) {
+            return Status::OK;
+        }
+    }
+}
+
+bool RawInflater::reset() {
+    return state_->ok && inflateReset(&state_->zs) == Z_OK;
+}
+
+std::string gzip_compress(const std::string& data, int level) {
+    return deflate_gzip(data, level);
+}
+
 std::string gzip_decompress(const std::string& compressed_data) {
     if (compressed_data.empty()) {
         return "";
@@ -90,16 +528,16 @@ std::string gzip_decompress(const std::string& compressed_data) {
     return outstring;
 }
 
-bool supports_gzip(const std::string& accept_encoding) {
-    std::string lower_encoding = accept_encoding;
+bool supports_gzip(std::string_view accept_encoding) {
+    std::string lower_encoding{accept_encoding};
     std::transform(lower_encoding.begin(), lower_encoding.end(), 
                    lower_encoding.begin(), ::tolower);
     return lower_encoding.find("gzip") != std::string::npos;
 }
 
-std::vector<std::string> parse_accept_encoding(const std::string& accept_encoding) {
+std::vector<std::string> parse_accept_encoding(std::string_view accept_encoding) {
     std::vector<std::string> encodings;
-    std::istringstream stream(accept_encoding);
+    std::istringstream stream{std::string(accept_encoding)};
     std::string token;
     
     while (std::getline(stream, token, ',')) {
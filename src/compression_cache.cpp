@@ -0,0 +1,99 @@
+/**
+ * @file compression_cache.cpp
+ * @brief Implementation of the CompressionCache class for reusing compressed response bodies.
+ */
+#include "compression_cache.hpp"
+#include <functional>
+
+namespace http_server {
+
+CompressionCache::CompressionCache(size_t max_bytes)
+    : max_bytes_(max_bytes) {
+}
+
+size_t CompressionCache::entry_size(const Entry& entry) {
+    return entry.key.size() + entry.source.size() + (entry.compressed ? entry.compressed->size() : 0);
+}
+
+std::shared_ptr<const std::string> CompressionCache::get_or_compress(std::string_view resource, std::string_view etag,
+                                                                     std::string_view body,
+                                                                     compression::Encoding encoding, int level) {
+    std::string key;
+    if (!etag.empty()) {
+        // Handler ETags such as "1" repeat across resources; the size makes
+        // a stale hit at least the right length
+        key.append(resource);
+        key.push_back(' ');
+        key.append(etag);
+        key.push_back(':');
+        key.append(std::to_string(body.size()));
+    } else {
+        key.append(std::to_string(std::hash<std::string_view>{}(body)));
+        key.push_back(':');
+        key.append(std::to_string(body.size()));
+    }
+    key.push_back('|');
+    key.append(compression::encoding_name(encoding));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end() && (!etag.empty() || it->second->source == body)) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->compressed;
+        }
+    }
+
+    // Compress outside the lock; a concurrent miss on the same key just does
+    // the work twice
+    std::string compressed = compression::compress(body, encoding, level);
+    Entry entry;
+    entry.key = std::move(key);
+    if (!compressed.empty() && compressed.size() < body.size()) {
+        entry.compressed = std::make_shared<const std::string>(std::move(compressed));
+    }
+    if (etag.empty()) {
+        entry.source.assign(body);
+    }
+
+    auto result = entry.compressed;
+    if (entry_size(entry) <= max_bytes_) {
+        insert(std::move(entry));
+    }
+    return result;
+}
+
+void CompressionCache::insert(Entry entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(entry.key);
+    if (it != index_.end()) {
+        bytes_ -= entry_size(*it->second);
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    bytes_ += entry_size(entry);
+    lru_.push_front(std::move(entry));
+    index_.emplace(lru_.front().key, lru_.begin());
+
+    while (bytes_ > max_bytes_ && lru_.size() > 1) {
+        auto& victim = lru_.back();
+        bytes_ -= entry_size(victim);
+        index_.erase(victim.key);
+        lru_.pop_back();
+    }
+}
+
+void CompressionCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+size_t CompressionCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+} // namespace http_server
@@ -5,17 +5,27 @@
  * Handles asynchronous reading, writing, timeouts, and request/response processing for each client connection.
  */
 #include "connection.hpp"
+#include <algorithm>
 #include <iostream>
+#include <vector>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 namespace http_server {
 
 Connection::Connection(boost::asio::ip::tcp::socket socket, RequestHandler handler, 
-                       std::function<void()> cleanup_callback)
+                       std::function<void()> cleanup_callback, ServerMetrics* metrics,
+                       ServerCounters* counters)
     : socket_(std::move(socket))
     , request_handler_(std::move(handler))
     , cleanup_callback_(std::move(cleanup_callback))
-    , creation_time_(std::chrono::steady_clock::now())
-    , timeout_timer_(socket_.get_executor()) {
+    , parser_(DEFAULT_MAX_REQUEST_SIZE, arena_.resource())
+    , metrics_(metrics)
+    , counters_(counters)
+    , creation_time_(std::chrono::steady_clock::now()) {
 }
 
 Connection::~Connection() {
@@ -24,6 +34,17 @@ Connection::~Connection() {
     }
 }
 
+void Connection::set_idle_timeout(TimerWheel& timers, std::chrono::steady_clock::duration timeout) {
+    idle_timeout_ = timeout;
+    timeout_.bind(timers, weak_from_this(), socket_.get_executor(), [this] { handle_timeout(); });
+}
+
+void Connection::on_request_body(BodyRouter router, uint64_t max_body_size) {
+    body_router_ = std::move(router);
+    max_body_size_ = max_body_size;
+    parser_.pause_after_head(static_cast<bool>(body_router_));
+}
+
 void Connection::start() {
     setup_timeout();
     read_request();
@@ -50,8 +71,17 @@ bool Connection::is_open() const {
 }
 
 void Connection::close() {
-    timeout_timer_.cancel();
+    timeout_.cancel();
+    if (body_) {
+        // A read waiting on the socket learns that it is gone
+        boost::asio::post(socket_.get_executor(), [body = std::move(body_)] {
+            body->deliver(RequestBody::Status::CLOSED);
+        });
+    }
     
+    if (tls_ && socket_.is_open()) {
+        tls_->shutdown();
+    }
     if (socket_.is_open()) {
         boost::system::error_code ec;
         socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
@@ -61,12 +91,25 @@ void Connection::close() {
 
 void Connection::read_request() {
     auto self = shared_from_this();
-    socket_.async_read_some(
-        boost::asio::buffer(buffer_),
-        [self](const boost::system::error_code& error, size_t bytes_transferred) {
-            self->handle_read(error, bytes_transferred);
-        }
-    );
+    auto on_read = [self](const boost::system::error_code& error, size_t bytes_transferred) {
+        self->handle_read(error, bytes_transferred);
+    };
+    if (tls_ && !tls_->kernel_receive()) {
+        tls_->async_read_some(socket_, boost::asio::buffer(buffer_), std::move(on_read));
+    } else {
+        socket_.async_read_some(boost::asio::buffer(buffer_), std::move(on_read));
+    }
+}
+
+template <typename Buffers, typename Handler>
+void Connection::async_write_all(const Buffers& buffers, Handler handler) {
+    if (tls_ && !tls_->kernel_send()) {
+        std::vector<boost::asio::const_buffer> pieces(boost::asio::buffer_sequence_begin(buffers),
+                                                      boost::asio::buffer_sequence_end(buffers));
+        tls_->async_write(socket_, std::move(pieces), std::move(handler));
+    } else {
+        boost::asio::async_write(socket_, buffers, std::move(handler));
+    }
 }
 
 void Connection::handle_read(const boost::system::error_code& error, size_t bytes_transferred) {
@@ -75,67 +118,330 @@ void Connection::handle_read(const boost::system::error_code& error, size_t byte
         return;
     }
     
-    bytes_received_ += bytes_transferred;
-    request_data_.append(buffer_.data(), bytes_transferred);
-    
-    if (request_data_.size() > MAX_REQUEST_SIZE) {
-        auto response = HttpResponse(HttpStatus::PAYLOAD_TOO_LARGE);
-        response.set_text("Request entity too large");
-        send_response(response);
+    count_received(bytes_transferred);
+    if (body_) {
+        // Only read because the handler is waiting for more of the body
+        body_buffer_.append(buffer_.data(), bytes_transferred);
+        timeout_.cancel();
+        auto body = body_;  // Outlives the read, which may end the stream
+        read_body(*body);
         return;
     }
-    
-    if (is_request_complete()) {
-        timeout_timer_.cancel();
-        process_request();
-    } else {
-        read_request();
-    }
+    request_data_.append(buffer_.data(), bytes_transferred);
+    process_requests();
 }
 
-void Connection::process_request() {
-    try {
-        auto request_opt = HttpRequest::parse(request_data_);
-        
-        if (!request_opt) {
-            auto response = HttpResponse(HttpStatus::BAD_REQUEST);
-            response.set_text("Invalid HTTP request");
-            send_response(response);
-            return;
+void Connection::process_requests() {
+    // Dispatch every complete request already buffered before writing, so
+    // pipelined requests are handled back to back and their responses can
+    // share one write.
+    dispatching_ = true;
+    while (!closing_ && !body_ && pipeline_.size() < MAX_PIPELINE_DEPTH) {
+        // The parser resumes where the previous read left off
+        auto status = parser_.feed(std::span<char>(request_data_.data() + parse_offset_,
+                                                   request_data_.size() - parse_offset_));
+        if (status == RequestParser::Status::INCOMPLETE) {
+            break;
         }
         
-        auto request = *request_opt;
-        auto response = request_handler_(request);
-        
-        if (request.is_keep_alive() && response.get_header("Connection").empty()) {
-            response.set_keep_alive(true);
+        if (status == RequestParser::Status::HEAD) {
+            // Unless a handler takes the body, feeding on collects it
+            stream_request();
+            continue;
         }
         
-        send_response(response);
+        if (status == RequestParser::Status::COMPLETE) {
+            parse_offset_ += parser_.consumed();
+            dispatch_request();
+            parser_.reset();
+            continue;
+        }
         
+        auto response = status == RequestParser::Status::TOO_LARGE
+            ? HttpResponse(HttpStatus::PAYLOAD_TOO_LARGE)
+            : HttpResponse(HttpStatus::BAD_REQUEST);
+        response.set_text(status == RequestParser::Status::TOO_LARGE
+            ? "Request entity too large" : "Invalid HTTP request");
+        pipeline_.push_back(PendingRequest{HttpRequest(), std::move(response), false,
+                                           std::chrono::steady_clock::now()});
+        closing_ = true;
+    }
+    dispatching_ = false;
+    
+    if (pipeline_.empty()) {
+        read_request();
+        return;
+    }
+    timeout_.cancel();
+    write_responses();
+}
+
+uint64_t Connection::queue_request() {
+    // request_data_ is left alone until every queued response has been
+    // written, so the views held by queued requests stay valid for handlers.
+    pipeline_.push_back(PendingRequest{std::move(parser_.request()), std::nullopt, false, {}});
+    PendingRequest& pending = pipeline_.back();
+    // Admission control measures queue delay from here, metrics or not
+    auto now = std::chrono::steady_clock::now();
+    pending.request.set_received_at(now);
+    if (metrics_) {
+        if (first_request_) {
+            first_request_ = false;
+            metrics_->record_first_request(now - creation_time_);
+        }
+    }
+    pending.keep_alive = pending.request.is_keep_alive();
+    if (upgrade_handler_ && pending.request.has_header("Upgrade")) {
+        // Either the protocol switches or the connection ends with this request
+        pending.keep_alive = false;
+    }
+    if (!pending.keep_alive) {
+        closing_ = true;  // Requests after this one are not answered
+    }
+    return pipeline_base_ + pipeline_.size() - 1;
+}
+
+Connection::ResponseCallback Connection::respond_to(uint64_t sequence) {
+    return [self = shared_from_this(), sequence](HttpResponse response) {
+        // Handlers may finish on a worker thread; hop back before writing
+        boost::asio::dispatch(self->socket_.get_executor(),
+            [self, sequence, response = std::move(response)]() mutable {
+                self->complete_request(sequence, std::move(response));
+            }
+        );
+    };
+}
+
+void Connection::dispatch_request() {
+    uint64_t sequence = queue_request();
+    try {
+        request_handler_(pipeline_.back().request, respond_to(sequence));
     } catch (const std::exception& e) {
         auto response = HttpResponse(HttpStatus::INTERNAL_SERVER_ERROR);
         response.set_text("Internal server error: " + std::string(e.what()));
-        send_response(response);
+        complete_request(sequence, std::move(response));
     }
 }
 
-void Connection::send_response(const HttpResponse& response) {
+void Connection::stream_request() {
+    BodyHandler handler = body_router_(parser_.request());
+    if (!handler) {
+        return;
+    }
+    
+    // The body goes through a buffer of its own: request_data_ must not
+    // move under the views held by queued requests, so it keeps the header
+    // block and nothing more until they have all been answered
+    size_t head_end = parse_offset_ + parser_.consumed();
+    body_buffer_.assign(request_data_, head_end);
+    request_data_.resize(head_end);
+    parse_offset_ = head_end;
+    parser_.stream_body(max_body_size_);
+    std::optional<uint64_t> length;
+    if (!parser_.chunked()) {
+        length = parser_.request().content_length();
+    }
+    uint64_t sequence = queue_request();
+    body_ = std::make_shared<RequestBody>(socket_.get_executor(), length,
+        [weak = weak_from_this()](RequestBody& body) {
+            if (auto self = weak.lock()) {
+                self->read_body(body);
+            } else {
+                body.deliver(RequestBody::Status::CLOSED);
+            }
+        });
+    body_sequence_ = sequence;
+    try {
+        handler(pipeline_.back().request, body_, respond_to(sequence));
+    } catch (const std::exception& e) {
+        auto response = HttpResponse(HttpStatus::INTERNAL_SERVER_ERROR);
+        response.set_text("Internal server error: " + std::string(e.what()));
+        complete_request(sequence, std::move(response));
+    }
+}
+
+void Connection::read_body(RequestBody& body) {
+    if (body_.get() != &body) {
+        body.deliver(RequestBody::Status::CLOSED);  // Closed while the read was on its way
+        return;
+    }
+    
+    // What is buffered already goes first; the socket is only read when the
+    // parser has nothing more to hand out
+    auto status = parser_.feed(std::span<char>(body_buffer_.data(), body_buffer_.size()));
+    if (status == RequestParser::Status::INCOMPLETE) {
+        setup_timeout();
+        read_request();
+        return;
+    }
+    
+    // A response given from within the read is written after the bytes go
+    dispatching_ = true;
+    if (status == RequestParser::Status::BODY || status == RequestParser::Status::COMPLETE) {
+        std::string_view data = parser_.body_data();
+        if (!data.empty()) {
+            body.deliver(RequestBody::Status::DATA, data);
+        }
+        body_buffer_.erase(0, parser_.discard_body());
+        if (status == RequestParser::Status::COMPLETE) {
+            // What is left belongs to requests pipelined behind this one;
+            // they are parsed once everything ahead of them is answered
+            parser_.reset();
+            body_.reset();
+            body.deliver(RequestBody::Status::END);
+        }
+    } else {
+        // The rest of the stream cannot be framed; the handler still answers
+        if (body_sequence_ >= pipeline_base_ && body_sequence_ - pipeline_base_ < pipeline_.size()) {
+            pipeline_[body_sequence_ - pipeline_base_].keep_alive = false;
+        }
+        closing_ = true;
+        body_.reset();
+        body_buffer_.clear();
+        body.deliver(status == RequestParser::Status::TOO_LARGE
+            ? RequestBody::Status::TOO_LARGE : RequestBody::Status::INVALID);
+    }
+    dispatching_ = false;
+    write_responses();
+}
+
+void Connection::complete_request(uint64_t sequence, HttpResponse response) {
+    if (sequence < pipeline_base_ || sequence - pipeline_base_ >= pipeline_.size()) {
+        return;  // Connection was torn down while the handler ran
+    }
+    
+    PendingRequest& pending = pipeline_[sequence - pipeline_base_];
+    if (body_ && sequence == body_sequence_) {
+        // Answered before its body was read to the end: the rest is never
+        // read, so the connection ends with this response
+        pending.keep_alive = false;
+        closing_ = true;
+        response.set_keep_alive(false);
+    }
+    if (response.closes_connection()) {
+        pending.keep_alive = false;
+    } else if (pending.keep_alive && response.get_header("Connection").empty()) {
+        response.set_keep_alive(true);
+    }
+    pending.response = std::move(response);
+    if (metrics_) {
+        pending.handled_at = std::chrono::steady_clock::now();
+    }
+    
+    write_responses();
+}
+
+void Connection::write_responses() {
+    if (dispatching_ || writing_) {
+        return;
+    }
+    
+    // Coalesce every ready response at the head of the queue, in request
+    // order, into a single gather write. Heads are serialized into
+    // write_heads_, which keeps its capacity from one write to the next, and
+    // bodies are referenced where they live. A stream or file body ends the
+    // batch and is sent after its headers.
+    write_heads_.clear();
+    head_ends_.clear();
+    bool streamed = false;
+    bool close_after_write = false;
+    while (!pipeline_.empty() && pipeline_.front().response) {
+        PendingRequest& front = pipeline_.front();
+        front.response->serialize_head(write_heads_);
+        head_ends_.push_back(write_heads_.size());
+        if (metrics_) {
+            auto received_at = front.request.received_at();
+            in_flight_timings_.push_back({static_cast<int>(front.response->status()),
+                                          received_at == std::chrono::steady_clock::time_point{}
+                                              ? front.handled_at : received_at,
+                                          front.handled_at});
+        }
+        close_after_write = !front.keep_alive;
+        if (upgrade_handler_ && front.response->status() == HttpStatus::SWITCHING_PROTOCOLS) {
+            // Nothing after the upgrade request is HTTP any more
+            upgrade_request_ = std::move(front.request);
+            close_after_write = true;
+        }
+        streamed = front.response->body_stream() || front.response->file_body();
+        in_flight_.push_back(std::move(*front.response));
+        pipeline_.pop_front();
+        ++pipeline_base_;
+        if (close_after_write || streamed) {
+            break;
+        }
+    }
+    if (in_flight_.empty()) {
+        return;  // Head of the queue is still being handled
+    }
+    if (close_after_write) {
+        pipeline_.clear();
+    }
+    
+    // Only now that in_flight_ has stopped growing are its bodies stable
+    write_buffers_.clear();
+    size_t head_start = 0;
+    for (size_t i = 0; i < in_flight_.size(); ++i) {
+        write_buffers_.push_back(boost::asio::buffer(write_heads_.data() + head_start, head_ends_[i] - head_start));
+        head_start = head_ends_[i];
+        const std::string& body = in_flight_[i].body();
+        if (!body.empty()) {
+            write_buffers_.push_back(boost::asio::buffer(body));
+            count_sent(body.size());
+        }
+    }
+    count_sent(write_heads_.size());
+    
+    writing_ = true;
+    close_after_write_ = close_after_write;
     auto self = shared_from_this();
-    auto response_headers = std::make_shared<std::string>(response.to_http_string());
-    bytes_sent_ += response_headers->size();
+    async_write_all(
+        write_buffers_,
+        [self, streamed](const boost::system::error_code& error, size_t /*bytes_transferred*/) {
+            // Release the batch first: the body write may complete
+            // synchronously and start the next batch
+            if (!error && streamed) {
+                HttpResponse response = std::move(self->in_flight_.back());
+                self->in_flight_.clear();
+                // Everything ahead of the body is out already
+                if (!self->in_flight_timings_.empty()) {
+                    self->record_written(self->in_flight_timings_.size() - 1);
+                }
+                self->write_body(response);
+            } else {
+                self->in_flight_.clear();
+                self->handle_write(error);
+            }
+        }
+    );
+}
 
-    boost::asio::async_write(
-        socket_,
-        boost::asio::buffer(*response_headers),
-        [self, response_headers, response](const boost::system::error_code& error, size_t bytes_transferred) {
+void Connection::write_body(const HttpResponse& response) {
+    if (const auto& file = response.file_body()) {
+        send_file(std::make_shared<FileBody>(*file));
+    } else {
+        write_body_chunk(std::make_shared<StreamBody>(response));
+    }
+}
+
+void Connection::write_body_chunk(std::shared_ptr<StreamBody> body) {
+    std::string_view piece = body->next();
+    if (piece.empty()) {
+        if (body->failed()) {
+            // Part of the body is already out; only closing tells the client
+            handle_error(boost::asio::error::make_error_code(boost::asio::error::eof));
+        } else {
+            handle_write(boost::system::error_code());
+        }
+        return;
+    }
+
+    count_sent(piece.size());
+    auto self = shared_from_this();
+    async_write_all(
+        boost::asio::buffer(piece.data(), piece.size()),
+        [self, body](const boost::system::error_code& error, size_t /*bytes_transferred*/) {
             if (!error) {
-                auto body_stream = response.body_stream();
-                if (body_stream) {
-                    self->write_body_chunk(response, body_stream);
-                } else {
-                    self->handle_write(error, bytes_transferred, nullptr);
-                }
+                self->write_body_chunk(body);
             } else {
                 self->handle_error(error);
             }
@@ -143,91 +449,169 @@ void Connection::send_response(const HttpResponse& response) {
     );
 }
 
-void Connection::write_body_chunk(const HttpResponse& response, std::shared_ptr<std::istream> body_stream) {
+void Connection::write_file_chunk(std::shared_ptr<FileBody> file, BufferPool::Buffer buffer) {
+    if (file->length == 0) {
+        handle_write(boost::system::error_code());
+        return;
+    }
+
+    size_t wanted = static_cast<size_t>(std::min<uint64_t>(file->length, buffer->size()));
+    ssize_t bytes_read = ::pread(*file->fd, buffer->data(), wanted, static_cast<off_t>(file->offset));
+    if (bytes_read <= 0) {
+        // A short file means it was truncated under us; the framing is lost
+        handle_error(bytes_read < 0
+            ? boost::system::error_code(errno, boost::system::system_category())
+            : boost::asio::error::make_error_code(boost::asio::error::eof));
+        return;
+    }
+
+    file->offset += static_cast<uint64_t>(bytes_read);
+    file->length -= static_cast<uint64_t>(bytes_read);
+    count_sent(static_cast<size_t>(bytes_read));
+
     auto self = shared_from_this();
-    auto chunk_buffer = std::make_shared<std::vector<char>>(8192);
-
-    body_stream->read(chunk_buffer->data(), chunk_buffer->size());
-    std::streamsize bytes_read = body_stream->gcount();
-
-    if (bytes_read > 0) {
-        bytes_sent_ += bytes_read;
-        boost::asio::async_write(
-            socket_,
-            boost::asio::buffer(chunk_buffer->data(), bytes_read),
-            [self, response, body_stream, chunk_buffer](const boost::system::error_code& error, size_t /*bytes_transferred*/) {
-                if (!error) {
-                    self->write_body_chunk(response, body_stream);
-                } else {
-                    self->handle_error(error);
-                }
+    async_write_all(
+        boost::asio::buffer(buffer->data(), static_cast<size_t>(bytes_read)),
+        [self, file, buffer](const boost::system::error_code& error, size_t /*bytes_transferred*/) {
+            if (!error) {
+                self->write_file_chunk(file, buffer);
+            } else {
+                self->handle_error(error);
             }
-        );
-    } else {
-        // End of body stream
-        handle_write(boost::system::error_code(), 0, nullptr);
-    }
+        }
+    );
 }
 
-void Connection::handle_write(const boost::system::error_code& error, size_t /*bytes_transferred*/,
-                             std::shared_ptr<std::string> /*response_data*/) {
-    if (error) {
-        handle_error(error);
+void Connection::send_file(std::shared_ptr<FileBody> file) {
+#ifdef __linux__
+    // sendfile(2) straight from the page cache on the non-blocking socket;
+    // when the socket buffer fills up, wait for it to drain. The work done
+    // per turn is capped so one large download cannot starve the reactor.
+    // Under TLS this needs the kernel to encrypt the records.
+    boost::system::error_code ec;
+    socket_.native_non_blocking(true, ec);
+    if (ec || (tls_ && !tls_->kernel_send())) {
+        write_file_chunk(std::move(file), BufferPool::instance().acquire());
         return;
     }
-    
-    bool keep_alive = false;
-    try {
-        auto request_opt = HttpRequest::parse(request_data_);
-        if (request_opt && request_opt->is_keep_alive()) {
-            keep_alive = true;
+
+    size_t sent_this_turn = 0;
+    while (file->length > 0 && sent_this_turn < SENDFILE_TURN_LIMIT) {
+        off_t offset = static_cast<off_t>(file->offset);
+        size_t count = static_cast<size_t>(std::min<uint64_t>(file->length, SENDFILE_TURN_LIMIT));
+        ssize_t sent = ::sendfile(socket_.native_handle(), *file->fd, &offset, count);
+        if (sent > 0) {
+            file->offset += static_cast<uint64_t>(sent);
+            file->length -= static_cast<uint64_t>(sent);
+            count_sent(static_cast<size_t>(sent));
+            sent_this_turn += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
         }
-    } catch (...) {
-        // If we can't parse the request, don't keep alive
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS) && sent_this_turn == 0) {
+            // File system without sendfile support
+            write_file_chunk(std::move(file), BufferPool::instance().acquire());
+            return;
+        }
+        handle_error(sent < 0
+            ? boost::system::error_code(errno, boost::system::system_category())
+            : boost::asio::error::make_error_code(boost::asio::error::eof));
+        return;
     }
-    
-    if (keep_alive) {
-        request_data_.clear();
-        bytes_received_ = 0;
-        bytes_sent_ = 0;
-        setup_timeout();
-        read_request();
-    } else {
-        close();
+
+    if (file->length == 0) {
+        handle_write(boost::system::error_code());
+        return;
     }
-}
 
-bool Connection::is_request_complete() const {
-    // Find the end of the headers first
-    size_t header_end_pos = request_data_.find("\r\n\r\n");
-    if (header_end_pos == std::string::npos) {
-        header_end_pos = request_data_.find("\n\n");
-        if (header_end_pos == std::string::npos) {
-            return false; // Headers not fully received yet
+    auto self = shared_from_this();
+    socket_.async_wait(boost::asio::ip::tcp::socket::wait_write,
+        [self, file](const boost::system::error_code& error) {
+            if (!error) {
+                self->send_file(file);
+            } else {
+                self->handle_error(error);
+            }
         }
+    );
+#else
+    write_file_chunk(std::move(file), BufferPool::instance().acquire());
+#endif
+}
+
+void Connection::record_written(size_t count) {
+    if (!metrics_ || count == 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        const auto& timing = in_flight_timings_[i];
+        metrics_->record_response(timing.status, timing.received_at, timing.handled_at, now);
     }
+    in_flight_timings_.erase(in_flight_timings_.begin(), in_flight_timings_.begin() + static_cast<std::ptrdiff_t>(count));
+}
 
-    // Temporarily parse headers to check for Content-Length or Transfer-Encoding
-    auto temp_request = HttpRequest::parse(request_data_.substr(0, header_end_pos));
-    if (!temp_request) {
-        // This could be a malformed request, but we might not have all of it yet.
-        // Let more data arrive unless it exceeds max size.
-        return false;
+void Connection::count_received(size_t bytes) {
+    bytes_received_ += bytes;
+    if (counters_) {
+        counters_->add(ServerCounters::BYTES_RECEIVED, bytes);
     }
+}
 
-    auto transfer_encoding = temp_request->get_header("transfer-encoding");
-    if (transfer_encoding && transfer_encoding->find("chunked") != std::string::npos) {
-        // For chunked encoding, the request is complete when we see the final chunk "0\r\n\r\n"
-        return request_data_.find("\r\n0\r\n\r\n") != std::string::npos || request_data_.find("\n0\r\n\r\n") != std::string::npos;
-    } else {
-        // For Content-Length, check if we have received the full body
-        size_t content_length = temp_request->content_length();
-        size_t body_start_pos = request_data_.find("\r\n\r\n") != std::string::npos ? header_end_pos + 4 : header_end_pos + 2;
-        size_t current_body_size = request_data_.length() - body_start_pos;
-        return current_body_size >= content_length;
+void Connection::count_sent(size_t bytes) {
+    bytes_sent_ += bytes;
+    if (counters_) {
+        counters_->add(ServerCounters::BYTES_SENT, bytes);
     }
 }
 
+void Connection::handle_write(const boost::system::error_code& error) {
+    writing_ = false;
+    if (error) {
+        in_flight_timings_.clear();
+        handle_error(error);
+        return;
+    }
+    record_written(in_flight_timings_.size());
+    
+    if (upgrade_request_) {
+        timeout_.cancel();
+        std::string_view buffered(request_data_.data() + parse_offset_, request_data_.size() - parse_offset_);
+        upgrade_handler_(std::move(socket_), *upgrade_request_, buffered);
+        return;
+    }
+    
+    if (close_after_write_) {
+        close();
+        return;
+    }
+    
+    if (!pipeline_.empty()) {
+        write_responses();
+        return;
+    }
+    
+    // Everything queued has been answered; drop the consumed bytes, keep
+    // any pipelined leftovers and carry on with them. No request is left on
+    // the arena either, bar one still arriving, which detach() copies off.
+    parser_.detach();
+    arena_.reset();
+    request_data_.erase(0, parse_offset_);
+    parse_offset_ = 0;
+    // Requests pipelined behind a streamed body waited in its buffer
+    request_data_.append(body_buffer_);
+    body_buffer_.clear();
+    bytes_received_ = 0;
+    bytes_sent_ = 0;
+    setup_timeout();
+    process_requests();
+}
+
 void Connection::handle_error(const boost::system::error_code& error) {
     if (error != boost::asio::error::operation_aborted &&
         error != boost::asio::error::eof &&
@@ -238,21 +622,12 @@ void Connection::handle_error(const boost::system::error_code& error) {
 }
 
 void Connection::setup_timeout() {
-    timeout_timer_.expires_after(TIMEOUT);
-    
-    auto self = shared_from_this();
-    timeout_timer_.async_wait(
-        [self](const boost::system::error_code& error) {
-            self->handle_timeout(error);
-        }
-    );
+    timeout_.schedule(idle_timeout_);
 }
 
-void Connection::handle_timeout(const boost::system::error_code& error) {
-    if (error != boost::asio::error::operation_aborted) {
-        std::cerr << "Connection timeout for " << client_address() << std::endl;
-        close();
-    }
+void Connection::handle_timeout() {
+    std::cerr << "Connection timeout for " << client_address() << std::endl;
+    close();
 }
 
 } // namespace http_server 
\ No newline at end of file
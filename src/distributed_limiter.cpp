@@ -0,0 +1,361 @@
+/**
+ * @file distributed_limiter.cpp
+ * @brief Implementation of the DistributedLimiter class for sharing rate limits between nodes.
+ *
+ * Datagram layout (big endian): a 4 byte magic and the sender's 8 byte node id,
+ * followed by entries of a 2 byte key length, the key, the 8 byte window index
+ * and a 4 byte count.
+ */
+#include "distributed_limiter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace http_server {
+
+namespace {
+
+constexpr uint32_t SYNC_MAGIC = 0x524C4431;  // "RLD1"
+constexpr size_t HEADER_SIZE = 4 + 8;
+constexpr size_t ENTRY_OVERHEAD = 2 + 8 + 4;
+// Stays below common path MTUs so datagrams are not fragmented
+constexpr size_t MAX_DATAGRAM = 1400;
+
+template <typename T>
+void put(std::string& out, T value) {
+    for (int shift = static_cast<int>(sizeof(T) * 8) - 8; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((static_cast<uint64_t>(value) >> shift) & 0xff));
+    }
+}
+
+template <typename T>
+T get(const unsigned char* p) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value = (value << 8) | p[i];
+    }
+    return static_cast<T>(value);
+}
+
+uint32_t saturating_add(uint32_t a, uint32_t b) {
+    return static_cast<uint32_t>(std::min<uint64_t>(uint64_t(a) + b, UINT32_MAX));
+}
+
+bool resolve(const std::string& host, uint16_t port, sockaddr_in& address) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (::getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        return false;
+    }
+    std::memcpy(&address, result->ai_addr, sizeof(sockaddr_in));
+    address.sin_port = htons(port);
+    ::freeaddrinfo(result);
+    return true;
+}
+
+// Parses "host:port"
+bool resolve_peer(const std::string& peer, sockaddr_in& address) {
+    auto colon = peer.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
+    }
+    int port = 0;
+    try {
+        port = std::stoi(peer.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (port <= 0 || port > 65535) {
+        return false;
+    }
+    return resolve(peer.substr(0, colon), static_cast<uint16_t>(port), address);
+}
+
+} // namespace
+
+DistributedLimiter::DistributedLimiter(const RateLimitConfig& config)
+    : max_requests_(config.max_requests)
+    , window_duration_(std::max(std::chrono::system_clock::duration(config.window_duration),
+                                std::chrono::system_clock::duration(1)))
+    , sync_interval_(std::max(config.sync_interval, std::chrono::milliseconds(1)))
+    , node_id_(std::random_device{}() | (uint64_t(std::random_device{}()) << 32)) {
+    if (open_socket(config)) {
+        running_ = true;
+        sync_thread_ = std::thread([this] { sync_loop(); });
+    }
+}
+
+DistributedLimiter::~DistributedLimiter() {
+    running_ = false;
+    if (sync_thread_.joinable()) {
+        sync_thread_.join();
+    }
+    if (socket_ >= 0) {
+        ::close(socket_);
+    }
+}
+
+bool DistributedLimiter::open_socket(const RateLimitConfig& config) {
+    for (const auto& peer : config.peers) {
+        sockaddr_in address{};
+        if (resolve_peer(peer, address)) {
+            peers_.push_back(address);
+        }
+    }
+    if (peers_.empty()) {
+        return false;
+    }
+
+    sockaddr_in local{};
+    if (!resolve(config.sync_address, config.sync_port, local)) {
+        return false;
+    }
+
+    socket_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socket_ < 0) {
+        return false;
+    }
+    if (::bind(socket_, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0) {
+        ::close(socket_);
+        socket_ = -1;
+        return false;
+    }
+    return true;
+}
+
+DistributedLimiter::Shard& DistributedLimiter::shard_for(std::string_view key) {
+    return shards_[std::hash<std::string_view>{}(key) % SHARD_COUNT];
+}
+
+int64_t DistributedLimiter::current_window() const {
+    return std::chrono::system_clock::now().time_since_epoch() / window_duration_;
+}
+
+void DistributedLimiter::advance(KeyState& state, int64_t window) {
+    // Never moves back: a peer whose clock runs slightly ahead may already
+    // have opened the next window
+    if (window <= state.window) {
+        return;
+    }
+    bool adjacent = state.window == window - 1;
+    state.local_previous = adjacent ? state.local_current : 0;
+    state.remote_previous = adjacent ? state.remote_current : 0;
+    state.unsent_previous = adjacent ? state.unsent_current : 0;
+    state.local_current = 0;
+    state.remote_current = 0;
+    state.unsent_current = 0;
+    state.window = window;
+}
+
+RateLimitResult DistributedLimiter::check_rate_limit(const std::string& key) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    int64_t window = now / window_duration_;
+    auto into_window = now % window_duration_;
+    double overlap = 1.0 - static_cast<double>(into_window.count()) / static_cast<double>(window_duration_.count());
+
+    auto& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& state = shard.entries[key];
+    advance(state, window);
+
+    double previous = static_cast<double>(state.local_previous) + static_cast<double>(state.remote_previous);
+    double current = static_cast<double>(state.local_current) + static_cast<double>(state.remote_current);
+    double estimate = previous * overlap + current;
+
+    RateLimitResult result;
+    result.limit_type = "distributed";
+    if (estimate + 1 <= static_cast<double>(max_requests_)) {
+        state.local_current = saturating_add(state.local_current, 1);
+        if (state.unsent_current == 0 && state.unsent_previous == 0) {
+            shard.dirty.push_back(key);
+        }
+        state.unsent_current = saturating_add(state.unsent_current, 1);
+        result.allowed = true;
+        result.remaining = static_cast<size_t>(static_cast<double>(max_requests_) - estimate - 1);
+        return result;
+    }
+
+    result.allowed = false;
+    result.remaining = 0;
+    result.reason = "Cluster rate limit exceeded";
+
+    // Same drain estimate as SlidingWindowCounterLimiter
+    auto wait = window_duration_ - into_window;
+    if (current + 1 <= static_cast<double>(max_requests_) && previous > 0) {
+        double needed = (static_cast<double>(max_requests_) - current - 1) / previous;
+        auto drained_at = std::chrono::system_clock::duration(
+            static_cast<std::chrono::system_clock::rep>((1.0 - needed) * static_cast<double>(window_duration_.count())));
+        wait = std::max(drained_at - into_window, std::chrono::system_clock::duration(0));
+    }
+    result.reset_time = std::chrono::ceil<std::chrono::seconds>(wait);
+    return result;
+}
+
+void DistributedLimiter::cleanup_shard(size_t shard_index) {
+    // Counters two windows old no longer affect any estimate, and peers
+    // would drop their deltas
+    int64_t window = current_window();
+    auto& shard = shards_[shard_index % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+        it = it->second.window < window - 1 ? shard.entries.erase(it) : std::next(it);
+    }
+}
+
+size_t DistributedLimiter::active_keys() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+void DistributedLimiter::reset() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.dirty.clear();
+    }
+}
+
+void DistributedLimiter::sync_loop() {
+    auto next_send = std::chrono::steady_clock::now() + sync_interval_;
+    while (running_.load(std::memory_order_relaxed)) {
+        auto now = std::chrono::steady_clock::now();
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_send - now);
+        pollfd pfd{socket_, POLLIN, 0};
+        if (::poll(&pfd, 1, static_cast<int>(std::max<int64_t>(wait.count(), 0))) > 0) {
+            receive_deltas();
+        }
+
+        now = std::chrono::steady_clock::now();
+        if (now >= next_send) {
+            send_deltas();
+            next_send = now + sync_interval_;
+        }
+    }
+    // Peers still get what was admitted since the last sync
+    send_deltas();
+}
+
+void DistributedLimiter::send_deltas() {
+    std::vector<Delta> deltas;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& key : shard.dirty) {
+            auto it = shard.entries.find(key);
+            if (it == shard.entries.end()) {
+                continue;
+            }
+            auto& state = it->second;
+            if (state.unsent_current > 0) {
+                deltas.push_back({key, state.window, state.unsent_current});
+            }
+            if (state.unsent_previous > 0) {
+                deltas.push_back({key, state.window - 1, state.unsent_previous});
+            }
+            state.unsent_current = 0;
+            state.unsent_previous = 0;
+        }
+        shard.dirty.clear();
+    }
+    if (deltas.empty()) {
+        return;
+    }
+
+    auto flush = [this](const std::string& datagram) {
+        for (const auto& peer : peers_) {
+            // Best effort: a lost datagram only lets the cluster admit a little more
+            ::sendto(socket_, datagram.data(), datagram.size(), MSG_DONTWAIT,
+                     reinterpret_cast<const sockaddr*>(&peer), sizeof(peer));
+        }
+    };
+
+    std::string datagram;
+    datagram.reserve(MAX_DATAGRAM);
+    for (const auto& delta : deltas) {
+        size_t entry_size = ENTRY_OVERHEAD + delta.key.size();
+        if (HEADER_SIZE + entry_size > MAX_DATAGRAM) {
+            continue;
+        }
+        if (datagram.size() + entry_size > MAX_DATAGRAM) {
+            flush(datagram);
+            datagram.clear();
+        }
+        if (datagram.empty()) {
+            put(datagram, SYNC_MAGIC);
+            put(datagram, node_id_);
+        }
+        put(datagram, static_cast<uint16_t>(delta.key.size()));
+        datagram.append(delta.key);
+        put(datagram, delta.window);
+        put(datagram, delta.count);
+    }
+    if (!datagram.empty()) {
+        flush(datagram);
+    }
+}
+
+void DistributedLimiter::receive_deltas() {
+    std::array<unsigned char, 64 * 1024> buffer;
+    for (;;) {
+        sockaddr_in sender{};
+        socklen_t sender_length = sizeof(sender);
+        ssize_t length = ::recvfrom(socket_, buffer.data(), buffer.size(), MSG_DONTWAIT,
+                                    reinterpret_cast<sockaddr*>(&sender), &sender_length);
+        if (length < 0) {
+            return;
+        }
+
+        bool known = std::any_of(peers_.begin(), peers_.end(), [&](const sockaddr_in& peer) {
+            return peer.sin_addr.s_addr == sender.sin_addr.s_addr && peer.sin_port == sender.sin_port;
+        });
+        if (!known || static_cast<size_t>(length) < HEADER_SIZE ||
+            get<uint32_t>(buffer.data()) != SYNC_MAGIC || get<uint64_t>(buffer.data() + 4) == node_id_) {
+            continue;
+        }
+
+        const unsigned char* p = buffer.data() + HEADER_SIZE;
+        const unsigned char* end = buffer.data() + length;
+        while (end - p >= static_cast<ptrdiff_t>(ENTRY_OVERHEAD)) {
+            size_t key_length = get<uint16_t>(p);
+            if (static_cast<size_t>(end - p) < ENTRY_OVERHEAD + key_length) {
+                break;
+            }
+            std::string_view key(reinterpret_cast<const char*>(p + 2), key_length);
+            p += 2 + key_length;
+            auto window = get<int64_t>(p);
+            auto count = get<uint32_t>(p + 8);
+            p += 12;
+            apply_delta(key, window, count);
+        }
+    }
+}
+
+void DistributedLimiter::apply_delta(std::string_view key, int64_t window, uint32_t count) {
+    int64_t now_window = current_window();
+    if (window < now_window - 1 || window > now_window + 1) {
+        return;  // Stale, or from a node whose clock is far off
+    }
+
+    auto& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& state = shard.entries[std::string(key)];
+    advance(state, window);
+    if (window == state.window) {
+        state.remote_current = saturating_add(state.remote_current, count);
+    } else if (window == state.window - 1) {
+        state.remote_previous = saturating_add(state.remote_previous, count);
+    }
+}
+
+} // namespace http_server
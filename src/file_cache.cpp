@@ -0,0 +1,405 @@
+/**
+ * @file file_cache.cpp
+ * @brief Implementation of the StaticFileCache class for serving hot static files from memory.
+ *
+ * Files are read once and served from shared buffers until inotify (or a stat after the
+ * revalidation interval) reports a change.
+ */
+#include "file_cache.hpp"
+#include "compression.hpp"
+#include "response.hpp"
+#include <fstream>
+#include <system_error>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace http_server {
+
+namespace {
+
+// True when path is base itself or lies below it
+bool is_within(const std::filesystem::path& path, const std::filesystem::path& base) {
+    const auto& p = path.native();
+    const auto& b = base.native();
+    if (!p.starts_with(b)) {
+        return false;
+    }
+    return p.size() == b.size() || p[b.size()] == '/' || (!b.empty() && b.back() == '/');
+}
+
+std::shared_ptr<const std::string> read_file(const std::filesystem::path& path, uint64_t size) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+        return nullptr;
+    }
+    std::string content(size, '\0');
+    stream.read(content.data(), static_cast<std::streamsize>(size));
+    if (static_cast<uint64_t>(stream.gcount()) != size) {
+        return nullptr;
+    }
+    return std::make_shared<const std::string>(std::move(content));
+}
+
+std::chrono::steady_clock::rep steady_now() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+} // namespace
+
+size_t CachedFile::footprint() const {
+    size_t total = content->size();
+    for (const auto& variant : precompressed) {
+        if (variant) {
+            total += variant->size();
+        }
+    }
+    return total;
+}
+
+StaticFileCache::StaticFileCache(size_t max_bytes, size_t max_file_size,
+                                 std::chrono::seconds revalidate_interval, bool load_precompressed)
+    : shard_capacity_(max_bytes / SHARD_COUNT)
+    , max_file_size_(max_file_size)
+    , revalidate_interval_(revalidate_interval)
+    , load_precompressed_(load_precompressed) {
+}
+
+StaticFileCache::~StaticFileCache() {
+    stop_watching();
+}
+
+StaticFileCache::Shard& StaticFileCache::shard_for(std::string_view key) {
+    return shards_[KeyHash{}(key) % SHARD_COUNT];
+}
+
+std::shared_ptr<const CachedFile> StaticFileCache::get(std::string_view key) {
+    std::shared_ptr<const CachedFile> file;
+    {
+        auto& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            return nullptr;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        file = it->second->file;
+    }
+
+    if (!still_valid(*file)) {
+        erase(key);
+        return nullptr;
+    }
+    return file;
+}
+
+bool StaticFileCache::still_valid(const CachedFile& file) {
+    if (watching_.load(std::memory_order_relaxed) || revalidate_interval_.count() == 0) {
+        return true;
+    }
+
+    auto now = steady_now();
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(revalidate_interval_).count();
+    if (now - file.validated_at.load(std::memory_order_relaxed) < interval) {
+        return true;
+    }
+
+    std::error_code ec;
+    auto write_time = std::filesystem::last_write_time(file.path, ec);
+    if (ec || write_time != file.write_time) {
+        return false;
+    }
+    auto size = std::filesystem::file_size(file.path, ec);
+    if (ec || size != file.content->size()) {
+        return false;
+    }
+
+    file.validated_at.store(now, std::memory_order_relaxed);
+    return true;
+}
+
+std::shared_ptr<const CachedFile> StaticFileCache::load(std::string_view key, const std::filesystem::path& path) {
+    auto& shard = shard_for(key);
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        generation = shard.generation;
+    }
+
+    std::error_code ec;
+    auto write_time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return nullptr;
+    }
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec || size > max_file_size_ || size > shard_capacity_) {
+        return nullptr;
+    }
+
+    auto content = read_file(path, size);
+    if (!content) {
+        return nullptr;
+    }
+
+    auto file = std::make_shared<CachedFile>();
+    file->path = path;
+    file->content = std::move(content);
+    file->write_time = write_time;
+    file->validated_at.store(steady_now(), std::memory_order_relaxed);
+
+    std::string extension = path.extension().string();
+    if (!extension.empty() && extension[0] == '.') {
+        extension = extension.substr(1);
+    }
+    file->mime_type = HttpResponse::get_mime_type(extension);
+
+    // Same ETag scheme as HttpResponse::conditional_file_response
+    auto ticks = write_time.time_since_epoch().count();
+    std::string identity = path.string();
+    identity.append(std::to_string(size)).append(std::to_string(static_cast<long long>(ticks)));
+    std::string digest = HttpResponse::generate_etag(identity);
+    file->etag.reserve(digest.size() + 2);
+    file->etag.append("\"").append(digest).append("\"");
+
+    auto system_time = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+        write_time - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now()
+    );
+    file->last_modified = HttpResponse::format_http_time(system_time);
+
+    if (load_precompressed_) {
+        for (auto encoding : {compression::Encoding::GZIP, compression::Encoding::BROTLI, compression::Encoding::ZSTD}) {
+            std::filesystem::path sibling = path;
+            sibling += compression::encoding_extension(encoding);
+            auto sibling_size = std::filesystem::file_size(sibling, ec);
+            if (ec || sibling_size > max_file_size_) {
+                continue;
+            }
+            if (auto variant = read_file(sibling, sibling_size)) {
+                file->precompressed[static_cast<size_t>(encoding)] = std::move(variant);
+                file->precompressed_mask |= compression::encoding_bit(encoding);
+            }
+        }
+    }
+
+    file->headers = {
+        {"Content-Type", file->mime_type},
+        {"ETag", file->etag},
+        {"Last-Modified", file->last_modified},
+        {"Cache-Control", "public, max-age=3600"}
+    };
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation != generation) {
+        // Invalidated while it was read: the watcher has already looked for
+        // an entry to drop, so this one would outlive the change
+        return nullptr;
+    }
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.bytes -= it->second->file->footprint();
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    shard.lru.push_front(Entry{std::string(key), file});
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += file->footprint();
+
+    while (shard.bytes > shard_capacity_ && shard.lru.size() > 1) {
+        auto& victim = shard.lru.back();
+        shard.bytes -= victim.file->footprint();
+        shard.index.erase(victim.key);
+        shard.lru.pop_back();
+    }
+
+    return file;
+}
+
+void StaticFileCache::erase(std::string_view key) {
+    auto& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.bytes -= it->second->file->footprint();
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void StaticFileCache::invalidate(const std::filesystem::path& path) {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.generation;
+        for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+            if (is_within(it->file->path, path)) {
+                shard.bytes -= it->file->footprint();
+                shard.index.erase(it->key);
+                it = shard.lru.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void StaticFileCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.generation;
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+size_t StaticFileCache::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.lru.size();
+    }
+    return total;
+}
+
+size_t StaticFileCache::bytes() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
+
+#ifdef __linux__
+
+bool StaticFileCache::watch(const std::filesystem::path& root) {
+    stop_watching();
+
+    std::error_code ec;
+    auto canonical_root = std::filesystem::canonical(root, ec);
+    if (ec || !std::filesystem::is_directory(canonical_root, ec)) {
+        return false;
+    }
+
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        return false;
+    }
+
+    add_watches(canonical_root);
+    if (watch_dirs_.empty()) {
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+        return false;
+    }
+
+    // Anything cached before the watch started may already be stale
+    clear();
+    watching_ = true;
+    watch_thread_ = std::thread([this] { watch_loop(); });
+    return true;
+}
+
+void StaticFileCache::stop_watching() {
+    if (!watching_.exchange(false)) {
+        return;
+    }
+    if (watch_thread_.joinable()) {
+        watch_thread_.join();
+    }
+    ::close(inotify_fd_);
+    inotify_fd_ = -1;
+    watch_dirs_.clear();
+}
+
+void StaticFileCache::add_watches(const std::filesystem::path& directory) {
+    constexpr uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                              IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+    int wd = ::inotify_add_watch(inotify_fd_, directory.c_str(), mask);
+    if (wd < 0) {
+        return;
+    }
+    watch_dirs_[wd] = directory;
+
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec)) {
+            add_watches(it->path());
+        }
+    }
+}
+
+void StaticFileCache::watch_loop() {
+    alignas(inotify_event) std::array<char, 16 * 1024> buffer;
+
+    while (watching_.load()) {
+        pollfd pfd{inotify_fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 250) <= 0) {
+            continue;
+        }
+
+        ssize_t length = ::read(inotify_fd_, buffer.data(), buffer.size());
+        if (length <= 0) {
+            continue;
+        }
+
+        for (char* p = buffer.data(); p < buffer.data() + length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                clear();
+                continue;
+            }
+
+            auto dir = watch_dirs_.find(event->wd);
+            if (dir == watch_dirs_.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watch_dirs_.erase(dir);
+                continue;
+            }
+
+            std::filesystem::path path = event->len > 0 ? dir->second / event->name : dir->second;
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (event->mask & IN_ISDIR) {
+                    add_watches(path);
+                }
+                // A new file can shadow what a directory request resolved to
+                invalidate(dir->second);
+            } else {
+                invalidate(path);
+            }
+
+            // A precompressed sibling belongs to the entry of its original
+            auto extension = path.extension().native();
+            if (extension == ".gz" || extension == ".br" || extension == ".zst") {
+                invalidate(std::filesystem::path(path).replace_extension());
+            }
+        }
+    }
+}
+
+#else
+
+bool StaticFileCache::watch(const std::filesystem::path& /*root*/) {
+    return false;
+}
+
+void StaticFileCache::stop_watching() {
+}
+
+void StaticFileCache::add_watches(const std::filesystem::path& /*directory*/) {
+}
+
+void StaticFileCache::watch_loop() {
+}
+
+#endif
+
+} // namespace http_server
@@ -0,0 +1,511 @@
+/**
+ * @file hpack.cpp
+ * @brief Implementation of HPACK header compression for HTTP/2 (RFC 7541).
+ */
+#include "hpack.hpp"
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+namespace http_server {
+
+namespace {
+
+struct StaticEntry {
+    std::string_view name;
+    std::string_view value;
+};
+
+// RFC 7541 Appendix A; index 0 is unused
+constexpr std::array<StaticEntry, 62> STATIC_TABLE{{
+    {"", ""},
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+constexpr size_t STATIC_ENTRIES = STATIC_TABLE.size() - 1;
+constexpr size_t ENTRY_OVERHEAD = 32;
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 Appendix B, indexed by symbol; 256 is EOS
+constexpr std::array<HuffmanCode, 257> HUFFMAN_CODES{{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+}};
+
+constexpr uint8_t MIN_CODE_BITS = 5;
+constexpr uint8_t MAX_CODE_BITS = 30;
+
+// The code is canonical: the codes of each length are consecutive, so one
+// first code and one offset per length are enough to decode
+struct HuffmanDecodeTable {
+    std::array<uint32_t, MAX_CODE_BITS + 1> first_code{};
+    std::array<uint16_t, MAX_CODE_BITS + 1> count{};
+    std::array<uint16_t, MAX_CODE_BITS + 1> offset{};
+    std::array<uint16_t, 257> symbols{};  // Ordered by code length, then code
+};
+
+const HuffmanDecodeTable& decode_table() {
+    static const HuffmanDecodeTable table = [] {
+        HuffmanDecodeTable t;
+        for (const auto& code : HUFFMAN_CODES) {
+            ++t.count[code.bits];
+        }
+        uint16_t position = 0;
+        for (uint8_t bits = MIN_CODE_BITS; bits <= MAX_CODE_BITS; ++bits) {
+            t.offset[bits] = position;
+            t.first_code[bits] = UINT32_MAX;
+            position = static_cast<uint16_t>(position + t.count[bits]);
+        }
+        for (uint8_t bits = MIN_CODE_BITS; bits <= MAX_CODE_BITS; ++bits) {
+            for (uint16_t symbol = 0; symbol < HUFFMAN_CODES.size(); ++symbol) {
+                if (HUFFMAN_CODES[symbol].bits == bits) {
+                    t.first_code[bits] = std::min(t.first_code[bits], HUFFMAN_CODES[symbol].code);
+                }
+            }
+        }
+        for (uint16_t symbol = 0; symbol < HUFFMAN_CODES.size(); ++symbol) {
+            const auto& code = HUFFMAN_CODES[symbol];
+            t.symbols[t.offset[code.bits] + (code.code - t.first_code[code.bits])] = symbol;
+        }
+        return t;
+    }();
+    return table;
+}
+
+// First static index carrying each name
+const std::unordered_map<std::string_view, size_t>& static_names() {
+    static const std::unordered_map<std::string_view, size_t> names = [] {
+        std::unordered_map<std::string_view, size_t> map;
+        for (size_t index = STATIC_ENTRIES; index >= 1; --index) {
+            map[STATIC_TABLE[index].name] = index;
+        }
+        return map;
+    }();
+    return names;
+}
+
+// Values that differ from one response to the next would only churn the
+// dynamic table
+bool worth_indexing(std::string_view name, std::string_view value, size_t max_table_size) {
+    if (name == "content-length" || name == "etag" || name == "last-modified" || name == "set-cookie" ||
+        name == "content-range" || name == "location") {
+        return false;
+    }
+    return name.size() + value.size() + ENTRY_OVERHEAD <= max_table_size / 4;
+}
+
+void encode_integer(uint64_t value, uint8_t prefix_bits, uint8_t first_byte, std::string& out) {
+    uint64_t limit = (1u << prefix_bits) - 1;
+    if (value < limit) {
+        out.push_back(static_cast<char>(first_byte | value));
+        return;
+    }
+    out.push_back(static_cast<char>(first_byte | limit));
+    value -= limit;
+    while (value >= 128) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool decode_integer(std::string_view input, size_t& pos, uint8_t prefix_bits, uint64_t& value) {
+    if (pos >= input.size()) {
+        return false;
+    }
+    uint64_t limit = (1u << prefix_bits) - 1;
+    value = static_cast<uint8_t>(input[pos++]) & limit;
+    if (value < limit) {
+        return true;
+    }
+    // Nothing legitimate needs more than 32 bits
+    for (unsigned shift = 0; shift <= 28; shift += 7) {
+        if (pos >= input.size()) {
+            return false;
+        }
+        uint8_t byte = static_cast<uint8_t>(input[pos++]);
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value <= UINT32_MAX;
+        }
+    }
+    return false;
+}
+
+size_t huffman_encoded_size(std::string_view value) {
+    uint64_t bits = 0;
+    for (unsigned char c : value) {
+        bits += HUFFMAN_CODES[c].bits;
+    }
+    return static_cast<size_t>((bits + 7) / 8);
+}
+
+void huffman_encode(std::string_view value, std::string& out) {
+    uint64_t pending = 0;
+    unsigned pending_bits = 0;
+    for (unsigned char c : value) {
+        const auto& code = HUFFMAN_CODES[c];
+        pending = (pending << code.bits) | code.code;
+        pending_bits += code.bits;
+        while (pending_bits >= 8) {
+            pending_bits -= 8;
+            out.push_back(static_cast<char>(pending >> pending_bits));
+        }
+        pending &= (uint64_t{1} << pending_bits) - 1;
+    }
+    if (pending_bits > 0) {
+        // Padded with the most significant bits of EOS, which are all ones
+        out.push_back(static_cast<char>((pending << (8 - pending_bits)) | (0xffu >> pending_bits)));
+    }
+}
+
+bool huffman_decode(std::string_view input, std::string& out) {
+    const auto& table = decode_table();
+    uint64_t pending = 0;
+    unsigned pending_bits = 0;
+    for (unsigned char byte : input) {
+        pending = (pending << 8) | byte;
+        pending_bits += 8;
+        while (pending_bits >= MIN_CODE_BITS) {
+            bool matched = false;
+            unsigned longest = std::min<unsigned>(pending_bits, MAX_CODE_BITS);
+            for (unsigned bits = MIN_CODE_BITS; bits <= longest; ++bits) {
+                auto code = static_cast<uint32_t>((pending >> (pending_bits - bits)) & ((uint64_t{1} << bits) - 1));
+                if (table.count[bits] != 0 && code >= table.first_code[bits] &&
+                    code - table.first_code[bits] < table.count[bits]) {
+                    uint16_t symbol = table.symbols[table.offset[bits] + (code - table.first_code[bits])];
+                    if (symbol == 256) {
+                        return false;  // EOS inside a string is an error
+                    }
+                    out.push_back(static_cast<char>(symbol));
+                    pending_bits -= bits;
+                    matched = true;
+                    break;
+                }
+            }
+            if (!matched) {
+                if (pending_bits >= MAX_CODE_BITS) {
+                    return false;
+                }
+                break;  // Needs more input
+            }
+        }
+        pending &= (uint64_t{1} << pending_bits) - 1;
+    }
+    // What is left must be padding: fewer than 8 bits, all ones
+    return pending_bits < 8 && pending == (uint64_t{1} << pending_bits) - 1;
+}
+
+void encode_string(std::string_view value, std::string& out) {
+    size_t huffman_size = huffman_encoded_size(value);
+    if (huffman_size < value.size()) {
+        encode_integer(huffman_size, 7, 0x80, out);
+        huffman_encode(value, out);
+    } else {
+        encode_integer(value.size(), 7, 0x00, out);
+        out.append(value);
+    }
+}
+
+bool decode_string(std::string_view input, size_t& pos, std::string& value) {
+    if (pos >= input.size()) {
+        return false;
+    }
+    bool huffman = static_cast<uint8_t>(input[pos]) & 0x80;
+    uint64_t length = 0;
+    if (!decode_integer(input, pos, 7, length) || length > input.size() - pos) {
+        return false;
+    }
+    std::string_view raw = input.substr(pos, static_cast<size_t>(length));
+    pos += static_cast<size_t>(length);
+    value.clear();
+    if (huffman) {
+        return huffman_decode(raw, value);
+    }
+    value.assign(raw);
+    return true;
+}
+
+} // namespace
+
+// HpackTable implementation
+void HpackTable::insert(std::string_view name, std::string_view value) {
+    size_t entry_size = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (entry_size > max_size_) {
+        // Not an error: an entry larger than the table empties it
+        evict_to(0);
+        return;
+    }
+    evict_to(max_size_ - entry_size);
+    fields_.push_front(HpackField{std::string(name), std::string(value)});
+    size_ += entry_size;
+}
+
+void HpackTable::resize(size_t max_size) {
+    max_size_ = max_size;
+    evict_to(max_size_);
+}
+
+void HpackTable::evict_to(size_t size) {
+    while (size_ > size && !fields_.empty()) {
+        const auto& oldest = fields_.back();
+        size_ -= oldest.name.size() + oldest.value.size() + ENTRY_OVERHEAD;
+        fields_.pop_back();
+    }
+}
+
+// HpackDecoder implementation
+bool HpackDecoder::lookup(uint64_t index, std::string_view& name, std::string_view& value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_ENTRIES) {
+        name = STATIC_TABLE[index].name;
+        value = STATIC_TABLE[index].value;
+        return true;
+    }
+    index -= STATIC_ENTRIES + 1;
+    if (index >= table_.entries()) {
+        return false;
+    }
+    const auto& field = table_.at(static_cast<size_t>(index));
+    name = field.name;
+    value = field.value;
+    return true;
+}
+
+HpackDecoder::Status HpackDecoder::decode(std::string_view block, std::vector<HpackField>& fields,
+                                          size_t max_list_size) {
+    size_t pos = 0;
+    size_t list_size = 0;
+    bool too_large = false;
+    bool seen_field = false;
+    std::string name;
+    std::string value;
+
+    auto emit = [&](std::string_view field_name, std::string_view field_value) {
+        seen_field = true;
+        list_size += field_name.size() + field_value.size() + ENTRY_OVERHEAD;
+        if (list_size > max_list_size) {
+            too_large = true;
+        }
+        if (!too_large) {
+            fields.push_back(HpackField{std::string(field_name), std::string(field_value)});
+        }
+    };
+
+    while (pos < block.size()) {
+        uint8_t first = static_cast<uint8_t>(block[pos]);
+        uint64_t index = 0;
+        std::string_view indexed_name;
+        std::string_view indexed_value;
+
+        if (first & 0x80) {
+            // Indexed field
+            if (!decode_integer(block, pos, 7, index) || !lookup(index, indexed_name, indexed_value)) {
+                return Status::CORRUPT;
+            }
+            emit(indexed_name, indexed_value);
+            continue;
+        }
+
+        if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update, only ahead of the first field
+            if (seen_field || !decode_integer(block, pos, 5, index) || index > limit_) {
+                return Status::CORRUPT;
+            }
+            table_.resize(static_cast<size_t>(index));
+            continue;
+        }
+
+        // Literal with incremental indexing (01), without indexing (0000)
+        // or never indexed (0001)
+        bool indexing = (first & 0xc0) == 0x40;
+        if (!decode_integer(block, pos, indexing ? 6 : 4, index)) {
+            return Status::CORRUPT;
+        }
+        if (index == 0) {
+            if (!decode_string(block, pos, name)) {
+                return Status::CORRUPT;
+            }
+        } else {
+            if (!lookup(index, indexed_name, indexed_value)) {
+                return Status::CORRUPT;
+            }
+            name.assign(indexed_name);
+        }
+        if (!decode_string(block, pos, value)) {
+            return Status::CORRUPT;
+        }
+        emit(name, value);
+        if (indexing) {
+            table_.insert(name, value);
+        }
+    }
+    return too_large ? Status::TOO_LARGE : Status::OK;
+}
+
+// HpackEncoder implementation
+void HpackEncoder::set_max_table_size(size_t size) {
+    // Never more than the table we started with, so memory stays bounded
+    pending_size_ = std::min(size, limit_);
+    size_changed_ = pending_size_ != table_.max_size() || size_changed_;
+}
+
+void HpackEncoder::start_block(std::string& out) {
+    if (size_changed_) {
+        size_changed_ = false;
+        table_.resize(pending_size_);
+        encode_integer(pending_size_, 5, 0x20, out);
+    }
+}
+
+size_t HpackEncoder::find(std::string_view name, std::string_view value, size_t& name_index) const {
+    name_index = 0;
+    const auto& names = static_names();
+    if (auto it = names.find(name); it != names.end()) {
+        name_index = it->second;
+        for (size_t index = it->second; index <= STATIC_ENTRIES && STATIC_TABLE[index].name == name; ++index) {
+            if (STATIC_TABLE[index].value == value) {
+                return index;
+            }
+        }
+    }
+    for (size_t i = 0; i < table_.entries(); ++i) {
+        const auto& field = table_.at(i);
+        if (field.name != name) {
+            continue;
+        }
+        if (field.value == value) {
+            return STATIC_ENTRIES + 1 + i;
+        }
+        if (name_index == 0) {
+            name_index = STATIC_ENTRIES + 1 + i;
+        }
+    }
+    return 0;
+}
+
+void HpackEncoder::encode(std::string_view name, std::string_view value, std::string& out) {
+    size_t name_index = 0;
+    if (size_t index = find(name, value, name_index); index != 0) {
+        encode_integer(index, 7, 0x80, out);
+        return;
+    }
+    bool indexing = worth_indexing(name, value, table_.max_size());
+    encode_integer(name_index, indexing ? 6 : 4, indexing ? 0x40 : 0x00, out);
+    if (name_index == 0) {
+        encode_string(name, out);
+    }
+    encode_string(value, out);
+    if (indexing) {
+        table_.insert(name, value);
+    }
+}
+
+} // namespace http_server
@@ -0,0 +1,1087 @@
+/**
+ * @file http2_connection.cpp
+ * @brief Implementation of the Http2Connection class for serving HTTP/2 clients over TLS.
+ *
+ * Handles the connection preface, frame parsing, HPACK, stream multiplexing and flow control,
+ * and hands every complete request to the same handler HTTP/1.1 connections use.
+ */
+#include "http2_connection.hpp"
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <unistd.h>
+
+namespace http_server {
+
+namespace {
+
+constexpr std::string_view CLIENT_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t FRAME_HEADER_SIZE = 9;
+
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+constexpr uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+uint32_t read_u32(std::string_view data, size_t pos) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(data[pos])) << 24 |
+           static_cast<uint32_t>(static_cast<uint8_t>(data[pos + 1])) << 16 |
+           static_cast<uint32_t>(static_cast<uint8_t>(data[pos + 2])) << 8 |
+           static_cast<uint32_t>(static_cast<uint8_t>(data[pos + 3]));
+}
+
+void append_u32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+void append_setting(std::string& out, uint16_t id, uint32_t value) {
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    append_u32(out, value);
+}
+
+// Removes the pad length and padding; false if they do not fit the frame
+bool strip_padding(uint8_t flags, std::string_view& payload) {
+    if (!(flags & FLAG_PADDED)) {
+        return true;
+    }
+    if (payload.empty()) {
+        return false;
+    }
+    size_t padding = static_cast<uint8_t>(payload[0]);
+    if (padding >= payload.size()) {
+        return false;
+    }
+    payload = payload.substr(1, payload.size() - 1 - padding);
+    return true;
+}
+
+// Fields that only mean something to HTTP/1.1 connections (RFC 9113 §8.2.2)
+bool is_connection_specific(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+} // namespace
+
+Http2Connection::Http2Connection(SslSocket socket, RequestHandler handler, std::function<void()> cleanup_callback,
+                                 ServerMetrics* metrics, ServerCounters* counters)
+    : socket_(std::move(socket))
+    , request_handler_(std::move(handler))
+    , cleanup_callback_(std::move(cleanup_callback))
+    , metrics_(metrics)
+    , counters_(counters)
+    , creation_time_(std::chrono::steady_clock::now()) {
+}
+
+Http2Connection::~Http2Connection() {
+    if (cleanup_callback_) {
+        cleanup_callback_();
+    }
+}
+
+void Http2Connection::set_idle_timeout(TimerWheel& timers, std::chrono::steady_clock::duration timeout) {
+    idle_timeout_ = timeout;
+    timeout_.bind(timers, weak_from_this(), socket_.get_executor(), [this] { handle_timeout(); });
+}
+
+void Http2Connection::on_request_body(BodyRouter router, uint64_t max_body_size) {
+    body_router_ = std::move(router);
+    max_body_size_ = max_body_size;
+}
+
+void Http2Connection::start() {
+    // Our SETTINGS open the connection; the window update lets request
+    // bodies arrive without waiting on the default 64KB window
+    std::string settings;
+    append_setting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    append_setting(settings, SETTINGS_INITIAL_WINDOW_SIZE, static_cast<uint32_t>(STREAM_WINDOW));
+    append_setting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, static_cast<uint32_t>(MAX_HEADER_LIST_SIZE));
+    append_setting(settings, SETTINGS_ENABLE_PUSH, 0);
+    queue_frame(FrameType::SETTINGS, 0, 0, settings);
+    std::string increment;
+    append_u32(increment, static_cast<uint32_t>(CONNECTION_WINDOW - DEFAULT_WINDOW));
+    queue_frame(FrameType::WINDOW_UPDATE, 0, 0, increment);
+
+    // Frames of many streams share the connection; none should wait on Nagle
+    boost::system::error_code ec;
+    socket_.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(true), ec);
+
+    setup_timeout();
+    read_frames();
+    flush();
+}
+
+bool Http2Connection::is_open() const {
+    return socket_.lowest_layer().is_open();
+}
+
+void Http2Connection::close() {
+    timeout_.cancel();
+    for (auto& [id, stream] : streams_) {
+        if (auto body = std::move(stream->request_body)) {
+            // A read waiting on the socket learns that it is gone
+            boost::asio::post(socket_.get_executor(), [body = std::move(body)] {
+                body->deliver(RequestBody::Status::CLOSED);
+            });
+        }
+    }
+
+    if (socket_.lowest_layer().is_open()) {
+        boost::system::error_code ec;
+        socket_.async_shutdown([self = shared_from_this()](const boost::system::error_code&) {
+        });
+        socket_.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        socket_.lowest_layer().close(ec);
+    }
+}
+
+void Http2Connection::read_frames() {
+    auto self = shared_from_this();
+    socket_.async_read_some(
+        boost::asio::buffer(buffer_),
+        [self](const boost::system::error_code& error, size_t bytes_transferred) {
+            self->handle_read(error, bytes_transferred);
+        }
+    );
+}
+
+void Http2Connection::handle_read(const boost::system::error_code& error, size_t bytes_transferred) {
+    if (error) {
+        handle_error(error);
+        return;
+    }
+
+    count_received(bytes_transferred);
+    input_.append(buffer_.data(), bytes_transferred);
+    setup_timeout();
+
+    processing_ = true;
+    bool healthy = process_input();
+    processing_ = false;
+    input_.erase(0, input_offset_);
+    input_offset_ = 0;
+
+    // A peer that keeps asking (PING, SETTINGS) without reading the answers
+    if (healthy && output_.size() > MAX_PENDING_OUTPUT) {
+        healthy = go_away(ENHANCE_YOUR_CALM);
+    }
+    flush();
+    if (healthy) {
+        read_frames();
+    }
+}
+
+bool Http2Connection::process_input() {
+    if (!preface_received_) {
+        size_t available = std::min(input_.size(), CLIENT_PREFACE.size());
+        if (std::string_view(input_).substr(0, available) != CLIENT_PREFACE.substr(0, available)) {
+            return go_away(PROTOCOL_ERROR);
+        }
+        if (available < CLIENT_PREFACE.size()) {
+            return true;
+        }
+        preface_received_ = true;
+        input_offset_ = CLIENT_PREFACE.size();
+    }
+
+    while (!close_after_write_ && input_.size() - input_offset_ >= FRAME_HEADER_SIZE) {
+        std::string_view frame = std::string_view(input_).substr(input_offset_);
+        size_t length = static_cast<size_t>(static_cast<uint8_t>(frame[0])) << 16 |
+                        static_cast<size_t>(static_cast<uint8_t>(frame[1])) << 8 |
+                        static_cast<size_t>(static_cast<uint8_t>(frame[2]));
+        if (length > MAX_FRAME_SIZE) {
+            return go_away(FRAME_SIZE_ERROR);
+        }
+        if (frame.size() < FRAME_HEADER_SIZE + length) {
+            break;
+        }
+        auto type = static_cast<FrameType>(frame[3]);
+        auto flags = static_cast<uint8_t>(frame[4]);
+        uint32_t stream_id = read_u32(frame, 5) & 0x7fffffff;
+        input_offset_ += FRAME_HEADER_SIZE + length;
+        if (!handle_frame(type, flags, stream_id, frame.substr(FRAME_HEADER_SIZE, length))) {
+            return false;
+        }
+    }
+    return !close_after_write_;
+}
+
+bool Http2Connection::handle_frame(FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    // The preface ends with the client's SETTINGS, and a header block may
+    // not be interleaved with anything
+    if (!settings_received_ && type != FrameType::SETTINGS) {
+        return go_away(PROTOCOL_ERROR);
+    }
+    if (continuation_stream_ != 0 && type != FrameType::CONTINUATION) {
+        return go_away(PROTOCOL_ERROR);
+    }
+
+    switch (type) {
+        case FrameType::DATA:
+            return handle_data(flags, stream_id, payload);
+        case FrameType::HEADERS:
+            return handle_headers(flags, stream_id, payload);
+        case FrameType::PRIORITY:
+            if (stream_id == 0) {
+                return go_away(PROTOCOL_ERROR);
+            }
+            if (payload.size() != 5) {
+                reset_stream(stream_id, FRAME_SIZE_ERROR);
+            }
+            return true;
+        case FrameType::RST_STREAM:
+            return handle_rst_stream(stream_id, payload);
+        case FrameType::SETTINGS:
+            return handle_settings(flags, stream_id, payload);
+        case FrameType::PUSH_PROMISE:
+            return go_away(PROTOCOL_ERROR);  // Clients cannot push
+        case FrameType::PING:
+            if (stream_id != 0) {
+                return go_away(PROTOCOL_ERROR);
+            }
+            if (payload.size() != 8) {
+                return go_away(FRAME_SIZE_ERROR);
+            }
+            if (!(flags & FLAG_ACK)) {
+                queue_frame(FrameType::PING, FLAG_ACK, 0, payload);
+            }
+            return true;
+        case FrameType::GOAWAY:
+            // The peer closes once the streams it still wants are answered
+            if (stream_id != 0) {
+                return go_away(PROTOCOL_ERROR);
+            }
+            return true;
+        case FrameType::WINDOW_UPDATE:
+            return handle_window_update(stream_id, payload);
+        case FrameType::CONTINUATION:
+            return handle_continuation(flags, stream_id, payload);
+    }
+    return true;  // Unknown frame types are ignored
+}
+
+bool Http2Connection::handle_headers(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0 || stream_id % 2 == 0) {
+        return go_away(PROTOCOL_ERROR);
+    }
+    if (!strip_padding(flags, payload)) {
+        return go_away(PROTOCOL_ERROR);
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (payload.size() < 5) {
+            return go_away(FRAME_SIZE_ERROR);
+        }
+        payload.remove_prefix(5);  // Priorities are not used
+    }
+
+    header_block_.assign(payload);
+    if (!(flags & FLAG_END_HEADERS)) {
+        continuation_stream_ = stream_id;
+        continuation_end_stream_ = flags & FLAG_END_STREAM;
+        return true;
+    }
+    return finish_headers(stream_id, flags & FLAG_END_STREAM);
+}
+
+bool Http2Connection::handle_continuation(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (continuation_stream_ == 0 || stream_id != continuation_stream_) {
+        return go_away(PROTOCOL_ERROR);
+    }
+    if (header_block_.size() + payload.size() > 2 * MAX_HEADER_LIST_SIZE) {
+        return go_away(ENHANCE_YOUR_CALM);
+    }
+    header_block_.append(payload);
+    if (!(flags & FLAG_END_HEADERS)) {
+        return true;
+    }
+    continuation_stream_ = 0;
+    return finish_headers(stream_id, continuation_end_stream_);
+}
+
+bool Http2Connection::finish_headers(uint32_t stream_id, bool end_stream) {
+    // Decoded even for streams that are then refused, to keep the table in step
+    std::vector<HpackField> fields;
+    auto status = decoder_.decode(header_block_, fields, MAX_HEADER_LIST_SIZE);
+    header_block_.clear();
+    if (status == HpackDecoder::Status::CORRUPT) {
+        return go_away(COMPRESSION_ERROR);
+    }
+
+    if (auto it = streams_.find(stream_id); it != streams_.end()) {
+        // Trailers: they have to end the stream, and are not passed on
+        Stream& stream = *it->second;
+        if (stream.remote_closed) {
+            reset_stream(stream_id, STREAM_CLOSED);
+            return true;
+        }
+        if (!end_stream) {
+            return go_away(PROTOCOL_ERROR);
+        }
+        if (stream.request_body) {
+            return receive_body(stream, {}, true);
+        }
+        stream.remote_closed = true;
+        if (!stream.dispatched) {
+            dispatch(stream);
+        }
+        return true;
+    }
+    if (stream_id <= last_stream_id_) {
+        return true;  // A stream we already reset; the peer had not heard yet
+    }
+    last_stream_id_ = stream_id;
+    if (goaway_sent_) {
+        return true;
+    }
+    if (streams_.size() >= MAX_CONCURRENT_STREAMS) {
+        reset_stream(stream_id, REFUSED_STREAM);
+        return true;
+    }
+
+    auto stream = std::make_unique<Stream>();
+    stream->id = stream_id;
+    stream->fields = std::move(fields);
+    stream->receive_window = STREAM_WINDOW;
+    stream->send_window = peer_initial_window_;
+    stream->remote_closed = end_stream;
+    Stream& opened = *stream;
+    streams_.emplace(stream_id, std::move(stream));
+
+    if (status == HpackDecoder::Status::TOO_LARGE) {
+        opened.dispatched = true;
+        HttpResponse response(HttpStatus::BAD_REQUEST);
+        response.set_text("Request header fields too large");
+        respond(opened, std::move(response));
+        return true;
+    }
+    if (end_stream) {
+        dispatch(opened);
+    } else if (body_router_) {
+        stream_request(opened);
+    }
+    return true;
+}
+
+bool Http2Connection::handle_data(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0) {
+        return go_away(PROTOCOL_ERROR);
+    }
+
+    // The whole frame, padding included, counts against the windows
+    size_t flow_length = payload.size();
+    receive_window_ -= static_cast<int64_t>(flow_length);
+    if (receive_window_ < 0) {
+        return go_away(FLOW_CONTROL_ERROR);
+    }
+    if (receive_window_ <= CONNECTION_WINDOW / 2) {
+        std::string increment;
+        append_u32(increment, static_cast<uint32_t>(CONNECTION_WINDOW - receive_window_));
+        queue_frame(FrameType::WINDOW_UPDATE, 0, 0, increment);
+        receive_window_ = CONNECTION_WINDOW;
+    }
+    if (!strip_padding(flags, payload)) {
+        return go_away(PROTOCOL_ERROR);
+    }
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        if (stream_id > last_stream_id_) {
+            return go_away(PROTOCOL_ERROR);  // Never opened
+        }
+        return true;  // Reset or answered already
+    }
+    Stream& stream = *it->second;
+    if (stream.remote_closed) {
+        reset_stream(stream_id, STREAM_CLOSED);
+        return true;
+    }
+    stream.receive_window -= static_cast<int64_t>(flow_length);
+    if (stream.receive_window < 0) {
+        reset_stream(stream_id, FLOW_CONTROL_ERROR);
+        return true;
+    }
+
+    bool end_stream = flags & FLAG_END_STREAM;
+    if (stream.request_body) {
+        return receive_body(stream, payload, end_stream);
+    }
+    if (!stream.dispatched) {
+        if (stream.body.size() + payload.size() > max_request_size_) {
+            // Answer now; the stream is reset once the answer is out
+            stream.dispatched = true;
+            stream.body.clear();
+            stream.body.shrink_to_fit();
+            HttpResponse response(HttpStatus::PAYLOAD_TOO_LARGE);
+            response.set_text("Request entity too large");
+            respond(stream, std::move(response));
+            return true;
+        }
+        stream.body.append(payload);
+        if (!end_stream && stream.receive_window <= STREAM_WINDOW / 2) {
+            std::string increment;
+            append_u32(increment, static_cast<uint32_t>(STREAM_WINDOW - stream.receive_window));
+            queue_frame(FrameType::WINDOW_UPDATE, 0, stream_id, increment);
+            stream.receive_window = STREAM_WINDOW;
+        }
+    }
+    if (end_stream) {
+        stream.remote_closed = true;
+        if (!stream.dispatched) {
+            dispatch(stream);
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::handle_settings(uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    if (stream_id != 0) {
+        return go_away(PROTOCOL_ERROR);
+    }
+    if (flags & FLAG_ACK) {
+        return payload.empty() ? true : go_away(FRAME_SIZE_ERROR);
+    }
+    if (payload.size() % 6 != 0) {
+        return go_away(FRAME_SIZE_ERROR);
+    }
+    settings_received_ = true;
+
+    for (size_t pos = 0; pos < payload.size(); pos += 6) {
+        uint16_t id = static_cast<uint16_t>(static_cast<uint8_t>(payload[pos]) << 8 | static_cast<uint8_t>(payload[pos + 1]));
+        uint32_t value = read_u32(payload, pos + 2);
+        switch (id) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                encoder_.set_max_table_size(value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1) {
+                    return go_away(PROTOCOL_ERROR);
+                }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW) {
+                    return go_away(FLOW_CONTROL_ERROR);
+                }
+                // Applies to the windows of open streams too
+                int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+                for (auto& [id, stream] : streams_) {
+                    stream->send_window += delta;
+                    if (stream->send_window > MAX_WINDOW) {
+                        return go_away(FLOW_CONTROL_ERROR);
+                    }
+                }
+                peer_initial_window_ = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) {
+                    return go_away(PROTOCOL_ERROR);
+                }
+                peer_max_frame_size_ = value;
+                break;
+            default:
+                break;  // MAX_CONCURRENT_STREAMS limits pushes; the rest are advisory
+        }
+    }
+    queue_frame(FrameType::SETTINGS, FLAG_ACK, 0, {});
+    return true;
+}
+
+bool Http2Connection::handle_window_update(uint32_t stream_id, std::string_view payload) {
+    if (payload.size() != 4) {
+        return go_away(FRAME_SIZE_ERROR);
+    }
+    uint32_t increment = read_u32(payload, 0) & 0x7fffffff;
+    if (stream_id == 0) {
+        if (increment == 0) {
+            return go_away(PROTOCOL_ERROR);
+        }
+        send_window_ += increment;
+        return send_window_ <= MAX_WINDOW ? true : go_away(FLOW_CONTROL_ERROR);
+    }
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        return stream_id > last_stream_id_ ? go_away(PROTOCOL_ERROR) : true;
+    }
+    if (increment == 0) {
+        reset_stream(stream_id, PROTOCOL_ERROR);
+        return true;
+    }
+    it->second->send_window += increment;
+    if (it->second->send_window > MAX_WINDOW) {
+        reset_stream(stream_id, FLOW_CONTROL_ERROR);
+    }
+    return true;
+}
+
+bool Http2Connection::handle_rst_stream(uint32_t stream_id, std::string_view payload) {
+    if (stream_id == 0 || stream_id > last_stream_id_) {
+        return go_away(PROTOCOL_ERROR);
+    }
+    if (payload.size() != 4) {
+        return go_away(FRAME_SIZE_ERROR);
+    }
+    // A handler still running finds the stream gone and its answer is dropped
+    erase_stream(stream_id);
+    return true;
+}
+
+bool Http2Connection::go_away(ErrorCode code) {
+    if (!goaway_sent_) {
+        goaway_sent_ = true;
+        std::string payload;
+        append_u32(payload, last_stream_id_);
+        append_u32(payload, code);
+        queue_frame(FrameType::GOAWAY, 0, 0, payload);
+    }
+    close_after_write_ = true;
+    return false;
+}
+
+void Http2Connection::reset_stream(uint32_t stream_id, ErrorCode code) {
+    std::string payload;
+    append_u32(payload, code);
+    queue_frame(FrameType::RST_STREAM, 0, stream_id, payload);
+    erase_stream(stream_id);
+}
+
+void Http2Connection::erase_stream(uint32_t stream_id) {
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        return;
+    }
+    if (auto body = std::move(it->second->request_body)) {
+        // Reset, or answered before the body ended: the rest never comes
+        boost::asio::post(socket_.get_executor(), [body = std::move(body)] {
+            body->deliver(RequestBody::Status::CLOSED);
+        });
+    }
+    streams_.erase(it);
+}
+
+void Http2Connection::dispatch(Stream& stream) {
+    stream.dispatched = true;
+    HttpRequest request;
+    if (!build_request(stream, request)) {
+        reset_stream(stream.id, PROTOCOL_ERROR);
+        return;
+    }
+    stream.fields = {};
+    stream.body = {};
+    start_request(stream, request);
+
+    uint32_t stream_id = stream.id;
+    try {
+        request_handler_(request, respond_to(stream_id));
+    } catch (const std::exception& e) {
+        auto response = HttpResponse(HttpStatus::INTERNAL_SERVER_ERROR);
+        response.set_text("Internal server error: " + std::string(e.what()));
+        complete_stream(stream_id, std::move(response));
+    }
+}
+
+void Http2Connection::stream_request(Stream& stream) {
+    // A head that does not parse is turned away by dispatch() once the
+    // body is in, as it would be without a router
+    HttpRequest request;
+    if (!build_request(stream, request, true)) {
+        return;
+    }
+    BodyHandler handler = body_router_(request);
+    if (!handler) {
+        return;
+    }
+
+    stream.dispatched = true;
+    stream.fields = {};
+    if (auto length = request.get_header("content-length")) {
+        uint64_t declared = 0;
+        std::from_chars(length->data(), length->data() + length->size(), declared);
+        stream.body_length = declared;
+        if (declared > max_body_size_) {
+            stream.body_status = RequestBody::Status::TOO_LARGE;  // The first read says so
+        }
+    }
+    start_request(stream, request);
+    uint32_t stream_id = stream.id;
+    stream.request_body = std::make_shared<RequestBody>(socket_.get_executor(), stream.body_length,
+        [weak = weak_from_this(), stream_id](RequestBody& body) {
+            if (auto self = weak.lock()) {
+                self->read_body(stream_id, body);
+            } else {
+                body.deliver(RequestBody::Status::CLOSED);
+            }
+        });
+    try {
+        handler(request, stream.request_body, respond_to(stream_id));
+    } catch (const std::exception& e) {
+        auto response = HttpResponse(HttpStatus::INTERNAL_SERVER_ERROR);
+        response.set_text("Internal server error: " + std::string(e.what()));
+        complete_stream(stream_id, std::move(response));
+    }
+}
+
+void Http2Connection::start_request(Stream& stream, HttpRequest& request) {
+    stream.head_request = request.method() == HttpMethod::HEAD;
+    stream.received_at = std::chrono::steady_clock::now();
+    request.set_received_at(stream.received_at);
+    if (metrics_) {
+        if (first_request_) {
+            first_request_ = false;
+            metrics_->record_first_request(stream.received_at - creation_time_);
+        }
+    }
+}
+
+Http2Connection::ResponseCallback Http2Connection::respond_to(uint32_t stream_id) {
+    return [self = shared_from_this(), stream_id](HttpResponse response) {
+        // Handlers may finish on a worker thread; hop back before writing
+        boost::asio::dispatch(self->socket_.get_executor(),
+            [self, stream_id, response = std::move(response)]() mutable {
+                self->complete_stream(stream_id, std::move(response));
+            }
+        );
+    };
+}
+
+bool Http2Connection::receive_body(Stream& stream, std::string_view data, bool end_stream) {
+    stream.remote_closed = stream.remote_closed || end_stream;
+    if (stream.body_status != RequestBody::Status::DATA) {
+        return true;  // Failed already; the rest is dropped
+    }
+    stream.body_received += data.size();
+    if (stream.body_received > max_body_size_) {
+        stream.body_status = RequestBody::Status::TOO_LARGE;
+    } else if (stream.body_length && (stream.body_received > *stream.body_length ||
+                                      (end_stream && stream.body_received != *stream.body_length))) {
+        stream.body_status = RequestBody::Status::INVALID;  // Not the length it declared
+    }
+    if (stream.body_status != RequestBody::Status::DATA) {
+        stream.body.clear();
+        stream.body.shrink_to_fit();
+    } else {
+        stream.body.append(data);
+    }
+    feed_body(stream);
+    return true;
+}
+
+void Http2Connection::read_body(uint32_t stream_id, RequestBody& body) {
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || it->second->request_body.get() != &body) {
+        body.deliver(RequestBody::Status::CLOSED);  // Reset while the read was on its way
+        return;
+    }
+    feed_body(*it->second);
+    flush();
+}
+
+void Http2Connection::feed_body(Stream& stream) {
+    auto body = stream.request_body;
+    if (!body || !body->waiting()) {
+        return;
+    }
+    if (!stream.body.empty()) {
+        // Everything received goes in one piece; what has been read the
+        // peer may send again, which bounds the buffer by the window
+        std::string data = std::move(stream.body);
+        stream.body.clear();
+        if (!stream.remote_closed && stream.receive_window <= STREAM_WINDOW / 2) {
+            std::string increment;
+            append_u32(increment, static_cast<uint32_t>(STREAM_WINDOW - stream.receive_window));
+            queue_frame(FrameType::WINDOW_UPDATE, 0, stream.id, increment);
+            stream.receive_window = STREAM_WINDOW;
+        }
+        uint32_t stream_id = stream.id;
+        body->deliver(RequestBody::Status::DATA, data);
+        // The buffer keeps its capacity for the next piece
+        if (auto it = streams_.find(stream_id); it != streams_.end() && it->second->body.empty()) {
+            data.clear();
+            it->second->body.swap(data);
+        }
+        return;
+    }
+    if (stream.body_status == RequestBody::Status::DATA && !stream.remote_closed) {
+        return;  // Waits for the next DATA frame
+    }
+    auto status = stream.body_status == RequestBody::Status::DATA ? RequestBody::Status::END : stream.body_status;
+    stream.request_body.reset();
+    body->deliver(status);
+}
+
+bool Http2Connection::build_request(Stream& stream, HttpRequest& request, bool head_only) {
+    std::string_view method;
+    std::string_view scheme;
+    std::string_view authority;
+    std::string_view path;
+    bool regular_seen = false;
+    bool has_host = false;
+    size_t cookies = 0;
+    size_t total = stream.body.size();
+
+    for (const auto& field : stream.fields) {
+        total += field.name.size() + field.value.size() + 2;
+        if (!field.name.empty() && field.name[0] == ':') {
+            // Pseudo-header fields come first, once each
+            std::string_view* slot = field.name == ":method" ? &method
+                                   : field.name == ":scheme" ? &scheme
+                                   : field.name == ":authority" ? &authority
+                                   : field.name == ":path" ? &path : nullptr;
+            if (regular_seen || !slot || slot->data() != nullptr) {
+                return false;
+            }
+            *slot = field.value;
+            continue;
+        }
+        regular_seen = true;
+        if (std::any_of(field.name.begin(), field.name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+            is_connection_specific(field.name) || (field.name == "te" && field.value != "trailers")) {
+            return false;
+        }
+        has_host = has_host || field.name == "host";
+        cookies += field.name == "cookie";
+    }
+    // CONNECT is the one method without :scheme and :path; it is not served
+    if (method.empty() || scheme.empty() || path.empty() || (path[0] != '/' && path != "*")) {
+        return false;
+    }
+
+    // One block holds every byte the request views; reserving it up front
+    // keeps the views valid while it is filled
+    auto storage = std::make_shared<std::string>();
+    storage->reserve(total);
+    auto store = [&storage](std::string_view text) {
+        size_t at = storage->size();
+        storage->append(text);
+        return std::string_view(storage->data() + at, text.size());
+    };
+
+    request.method_ = HttpRequest::string_to_method(method);
+    std::string_view target = store(path);
+    size_t query = target.find('?');
+    request.path_ = target.substr(0, query);
+    if (query != std::string_view::npos) {
+        request.query_string_ = target.substr(query + 1);
+    }
+    request.version_ = "HTTP/2";
+
+    // Cookie crumbs travel as separate fields; handlers expect one header
+    std::string_view cookie;
+    for (const auto& field : stream.fields) {
+        if (field.name[0] == ':') {
+            continue;
+        }
+        if (field.name == "cookie" && cookies > 1) {
+            if (cookie.empty()) {
+                cookie = store(field.value);
+            } else {
+                store("; ");
+                std::string_view crumb = store(field.value);
+                cookie = std::string_view(cookie.data(), crumb.data() + crumb.size() - cookie.data());
+            }
+            continue;
+        }
+        request.headers_.push_back(HttpRequest::Header{store(field.name), store(field.value)});
+    }
+    if (!cookie.empty()) {
+        request.headers_.push_back(HttpRequest::Header{"cookie", cookie});
+    }
+    if (!has_host && !authority.empty()) {
+        request.headers_.push_back(HttpRequest::Header{"host", store(authority)});
+    }
+    request.body_ = store(stream.body);
+
+    if (auto length = request.get_header("content-length")) {
+        size_t declared = 0;
+        auto [end, ec] = std::from_chars(length->data(), length->data() + length->size(), declared);
+        if (ec != std::errc() || end != length->data() + length->size() ||
+            (!head_only && declared != request.body_.size())) {
+            return false;
+        }
+    }
+    request.storage_ = std::move(storage);
+    request.is_valid_ = true;
+    return true;
+}
+
+void Http2Connection::complete_stream(uint32_t stream_id, HttpResponse response) {
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || !is_open()) {
+        return;  // Reset by the peer, or the connection is gone
+    }
+    respond(*it->second, std::move(response));
+    flush();
+}
+
+void Http2Connection::respond(Stream& stream, HttpResponse response) {
+    stream.handled_at = std::chrono::steady_clock::now();
+    stream.response = std::move(response);
+    const HttpResponse& answer = *stream.response;
+    if (stream.head_request) {
+        stream.body_done = true;
+    } else if (const auto& file = answer.file_body()) {
+        stream.file = *file;
+    } else if (answer.body_stream()) {
+        stream.stream_body = std::make_unique<StreamBody>(answer, false);
+    } else {
+        stream.pending = answer.body();
+        stream.body_done = true;
+    }
+    queue_headers(stream);
+}
+
+void Http2Connection::queue_headers(Stream& stream) {
+    std::string block;
+    encoder_.start_block(block);
+    char status[8];
+    auto status_end = std::to_chars(status, status + sizeof(status), static_cast<int>(stream.response->status())).ptr;
+    encoder_.encode(":status", std::string_view(status, static_cast<size_t>(status_end - status)), block);
+    std::string name;
+    stream.response->for_each_header([&](std::string_view header, std::string_view value) {
+        name.assign(header);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+        if (!is_connection_specific(name)) {
+            encoder_.encode(name, value, block);
+        }
+    });
+
+    // HEADERS, then CONTINUATION for what does not fit the peer's frame size
+    bool finished = stream.body_done && stream.pending.empty();
+    size_t length = std::min<size_t>(block.size(), peer_max_frame_size_);
+    uint8_t flags = (finished ? FLAG_END_STREAM : 0) | (length == block.size() ? FLAG_END_HEADERS : 0);
+    queue_frame(FrameType::HEADERS, flags, stream.id, std::string_view(block).substr(0, length));
+    for (size_t pos = length; pos < block.size(); pos += length) {
+        length = std::min<size_t>(block.size() - pos, peer_max_frame_size_);
+        queue_frame(FrameType::CONTINUATION, pos + length == block.size() ? FLAG_END_HEADERS : 0, stream.id,
+                    std::string_view(block).substr(pos, length));
+    }
+    stream.headers_sent = true;
+
+    if (finished) {
+        uint32_t stream_id = stream.id;
+        end_stream(stream);
+        erase_stream(stream_id);
+    }
+}
+
+void Http2Connection::end_stream(Stream& stream) {
+    stream.local_closed = true;
+    if (metrics_) {
+        timings_.push_back({static_cast<int>(stream.response->status()),
+                            stream.received_at == std::chrono::steady_clock::time_point{}
+                                ? stream.handled_at : stream.received_at,
+                            stream.handled_at});
+    }
+    if (!stream.remote_closed) {
+        // Answered before the request ended; tell the peer to stop sending
+        std::string payload;
+        append_u32(payload, NO_ERROR);
+        queue_frame(FrameType::RST_STREAM, 0, stream.id, payload);
+    }
+}
+
+void Http2Connection::append_frame_header(std::string& out, size_t length, FrameType type, uint8_t flags,
+                                          uint32_t stream_id) {
+    out.push_back(static_cast<char>(length >> 16));
+    out.push_back(static_cast<char>(length >> 8));
+    out.push_back(static_cast<char>(length));
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(flags));
+    append_u32(out, stream_id);
+}
+
+void Http2Connection::queue_frame(FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload) {
+    append_frame_header(output_, payload.size(), type, flags, stream_id);
+    output_.append(payload);
+}
+
+bool Http2Connection::refill(Stream& stream) {
+    if (stream.stream_body) {
+        stream.pending = stream.stream_body->next();
+        if (stream.pending.empty()) {
+            if (stream.stream_body->failed()) {
+                return false;
+            }
+            stream.body_done = true;
+        }
+        return true;
+    }
+    if (stream.file && stream.file->length > 0) {
+        if (!stream.file_buffer) {
+            stream.file_buffer = BufferPool::instance().acquire();
+        }
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(stream.file->length, stream.file_buffer->size()));
+        ssize_t bytes_read = ::pread(*stream.file->fd, stream.file_buffer->data(), wanted,
+                                     static_cast<off_t>(stream.file->offset));
+        if (bytes_read <= 0) {
+            return false;  // Truncated under us: the promised length cannot be met
+        }
+        stream.file->offset += static_cast<uint64_t>(bytes_read);
+        stream.file->length -= static_cast<uint64_t>(bytes_read);
+        stream.pending = std::string_view(stream.file_buffer->data(), static_cast<size_t>(bytes_read));
+        stream.body_done = stream.file->length == 0;
+        return true;
+    }
+    stream.body_done = true;
+    return true;
+}
+
+void Http2Connection::queue_data() {
+    // Rounds of one frame per stream, each round starting after the stream
+    // that went first in the previous one, until the windows or the budget
+    // for this write run out
+    size_t budget = MAX_WRITE_DATA;
+    bool progress = true;
+    while (progress && budget > 0 && send_window_ > 0 && !streams_.empty()) {
+        progress = false;
+        auto it = streams_.upper_bound(next_stream_turn_);
+        bool first = true;
+        for (size_t turns = streams_.size(); turns > 0 && !streams_.empty(); --turns) {
+            if (it == streams_.end()) {
+                it = streams_.begin();
+            }
+            Stream& stream = *it->second;
+            ++it;
+            if (!stream.headers_sent) {
+                continue;
+            }
+            if (stream.pending.empty() && !stream.body_done && !refill(stream)) {
+                // Part of the body may be out: only a reset tells the peer it is short
+                reset_stream(stream.id, INTERNAL_ERROR);
+                continue;
+            }
+            int64_t window = std::min(send_window_, stream.send_window);
+            if (!stream.pending.empty() && window <= 0) {
+                continue;
+            }
+
+            size_t length = std::min({stream.pending.size(), static_cast<size_t>(std::max<int64_t>(window, 0)),
+                                      static_cast<size_t>(peer_max_frame_size_), budget});
+            bool last = stream.body_done && length == stream.pending.size();
+            append_frame_header(frames_, length, FrameType::DATA, last ? FLAG_END_STREAM : 0, stream.id);
+            frames_.append(stream.pending.substr(0, length));
+            stream.pending.remove_prefix(length);
+            send_window_ -= static_cast<int64_t>(length);
+            stream.send_window -= static_cast<int64_t>(length);
+            budget -= length;
+            progress = true;
+            if (first) {
+                next_stream_turn_ = stream.id;
+                first = false;
+            }
+            if (last) {
+                end_stream(stream);
+                erase_stream(stream.id);
+            }
+            if (budget == 0 || send_window_ <= 0) {
+                break;
+            }
+        }
+    }
+}
+
+void Http2Connection::flush() {
+    if (writing_ || processing_ || !is_open()) {
+        return;
+    }
+
+    // Control frames and headers first, then DATA, then the resets DATA
+    // scheduling queued
+    frames_.clear();
+    frames_.swap(output_);
+    if (!close_after_write_) {
+        queue_data();
+        frames_.append(output_);
+        output_.clear();
+    }
+    if (frames_.empty()) {
+        if (close_after_write_) {
+            close();
+        }
+        return;
+    }
+
+    count_sent(frames_.size());
+    in_flight_timings_.insert(in_flight_timings_.end(), timings_.begin(), timings_.end());
+    timings_.clear();
+    writing_ = true;
+    auto self = shared_from_this();
+    boost::asio::async_write(
+        socket_,
+        boost::asio::buffer(frames_),
+        [self](const boost::system::error_code& error, size_t /*bytes_transferred*/) {
+            self->handle_write(error);
+        }
+    );
+}
+
+void Http2Connection::handle_write(const boost::system::error_code& error) {
+    writing_ = false;
+    if (error) {
+        in_flight_timings_.clear();
+        handle_error(error);
+        return;
+    }
+
+    if (metrics_ && !in_flight_timings_.empty()) {
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& timing : in_flight_timings_) {
+            metrics_->record_response(timing.status, timing.received_at, timing.handled_at, now);
+        }
+    }
+    in_flight_timings_.clear();
+    flush();
+}
+
+void Http2Connection::count_received(size_t bytes) {
+    bytes_received_ += bytes;
+    if (counters_) {
+        counters_->add(ServerCounters::BYTES_RECEIVED, bytes);
+    }
+}
+
+void Http2Connection::count_sent(size_t bytes) {
+    bytes_sent_ += bytes;
+    if (counters_) {
+        counters_->add(ServerCounters::BYTES_SENT, bytes);
+    }
+}
+
+void Http2Connection::handle_error(const boost::system::error_code& error) {
+    if (error != boost::asio::error::operation_aborted &&
+        error != boost::asio::error::eof &&
+        error != boost::asio::error::connection_reset &&
+        error != boost::asio::ssl::error::stream_truncated) {
+        std::cerr << "HTTP/2 connection error: " << error.message() << std::endl;
+    }
+    close();
+}
+
+void Http2Connection::setup_timeout() {
+    timeout_.schedule(idle_timeout_);
+}
+
+void Http2Connection::handle_timeout() {
+    if (!streams_.empty()) {
+        setup_timeout();  // Quiet, but responses are still being produced
+        return;
+    }
+    go_away(NO_ERROR);
+    flush();
+}
+
+} // namespace http_server
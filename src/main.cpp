@@ -10,11 +10,88 @@
 #include <memory>
 #include <filesystem>
 #include <fstream>
+#include <charconv>
+#include <cstdio>
+#include <algorithm>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/this_coro.hpp>
 #include "server.hpp"
 #include "compression.hpp"
 
 using namespace http_server;
 
+/**
+ * @brief Stream buffer that produces numbered lines on demand (for /stream)
+ */
+class LineGenerator : public std::streambuf {
+public:
+    explicit LineGenerator(size_t lines) : remaining_(lines) {}
+
+protected:
+    int_type underflow() override {
+        if (remaining_ == 0) {
+            return traits_type::eof();
+        }
+        line_ = "Line " + std::to_string(++current_) + ": the quick brown fox jumps over the lazy dog\n";
+        --remaining_;
+        setg(line_.data(), line_.data(), line_.data() + line_.size());
+        return traits_type::to_int_type(line_[0]);
+    }
+
+private:
+    size_t remaining_;
+    size_t current_{0};
+    std::string line_;
+};
+
+class LineStream : public std::istream {
+public:
+    explicit LineStream(size_t lines) : std::istream(nullptr), generator_(lines) {
+        rdbuf(&generator_);
+    }
+
+private:
+    LineGenerator generator_;
+};
+
+/**
+ * @brief Running size and FNV-1a hash of an upload (for /upload)
+ */
+struct UploadDigest {
+    uint64_t bytes{0};
+    uint64_t hash{14695981039346656037ull};
+};
+
+void read_upload(std::shared_ptr<RequestBody> body, std::shared_ptr<UploadDigest> digest,
+                 HttpServer::ResponseCallback done) {
+    body->read([body, digest, done = std::move(done)](RequestBody::Status status, std::string_view data) mutable {
+        switch (status) {
+            case RequestBody::Status::DATA:
+                for (char c : data) {
+                    digest->hash = (digest->hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+                }
+                digest->bytes += data.size();
+                read_upload(std::move(body), std::move(digest), std::move(done));
+                return;
+            case RequestBody::Status::END: {
+                char hash[17];
+                std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(digest->hash));
+                nlohmann::json response;
+                response["bytes"] = digest->bytes;
+                response["fnv1a"] = hash;
+                done(HttpResponse::json_response(response.dump()));
+                return;
+            }
+            case RequestBody::Status::TOO_LARGE:
+                done(HttpResponse(HttpStatus::PAYLOAD_TOO_LARGE).set_text("Upload too large"));
+                return;
+            default:
+                done(HttpResponse::bad_request("Malformed upload"));  // Unheard if the client left
+                return;
+        }
+    });
+}
+
 // Global server instance for signal handling
 std::unique_ptr<HttpServer> g_server;
 
@@ -29,6 +106,15 @@ void signal_handler(int signal) {
     }
 }
 
+/**
+ * @brief SIGHUP handler: reopens the access log after it was rotated.
+ */
+void reopen_log_handler(int /*signal*/) {
+    if (g_server) {
+        g_server->reopen_log();
+    }
+}
+
 /**
  * @brief Register example HTTP routes on the server.
  * @param server Reference to the HttpServer instance.
@@ -44,16 +130,24 @@ void setup_routes(HttpServer& server) {
         return HttpResponse::json_response(server.stats_json());
     });
     
+    // Prometheus scrape endpoint
+    server.add_get_route("/metrics", [&server](const HttpRequest& /*request*/) {
+        HttpResponse response;
+        response.set_content_type("text/plain; version=0.0.4; charset=utf-8");
+        response.set_body(server.metrics_text());
+        return response;
+    });
+    
     // Route with query parameters
     server.add_get_route("/greet", [](const HttpRequest& request) {
         auto name = request.get_query_param("name");
-        std::string greeting = "Hello, " + (name ? *name : "Anonymous") + "!";
+        std::string greeting = "Hello, " + std::string(name.value_or("Anonymous")) + "!";
         return HttpResponse::ok(greeting);
     });
     
     // POST endpoint for data
     server.add_post_route("/api/data", [](const HttpRequest& request) {
-        std::string body = request.body();
+        std::string body{request.body()};
         if (body.empty()) {
             return HttpResponse::bad_request("Request body is required");
         }
@@ -65,24 +159,21 @@ void setup_routes(HttpServer& server) {
         response["content_length"] = request.content_length();
         
         return HttpResponse::json_response(response.dump());
-    });
+    }, RouteOptions{.offload = true});  // JSON work runs off the I/O thread
     
-    // Route with path parameter simulation
-    server.add_get_route("/user/*", [](const HttpRequest& request) {
-        std::string path = request.path();
-        size_t pos = path.find_last_of('/');
-        if (pos != std::string::npos && pos < path.length() - 1) {
-            std::string user_id = path.substr(pos + 1);
-            
-            nlohmann::json user_info;
-            user_info["id"] = user_id;
-            user_info["name"] = "User " + user_id;
-            user_info["email"] = user_id + "@example.com";
-            
-            return HttpResponse::json_response(user_info.dump());
+    // Route with a path parameter
+    server.add_get_route("/user/:id", [](const HttpRequest& request) {
+        auto user_id = request.get_path_param("id");
+        if (!user_id) {
+            return HttpResponse::bad_request("Invalid user ID");
         }
         
-        return HttpResponse::bad_request("Invalid user ID");
+        nlohmann::json user_info;
+        user_info["id"] = *user_id;
+        user_info["name"] = "User " + std::string(*user_id);
+        user_info["email"] = std::string(*user_id) + "@example.com";
+        
+        return HttpResponse::json_response(user_info.dump());
     });
     
     // HTML response example
@@ -111,6 +202,8 @@ void setup_routes(HttpServer& server) {
         <div class="endpoint"><strong>GET</strong> <a href="/greet?name=YourName">/greet?name=YourName</a> - Personalized greeting</div>
         <div class="endpoint"><strong>GET</strong> <a href="/user/123">/user/{id}</a> - User information</div>
         <div class="endpoint"><strong>POST</strong> /api/data - Echo data back</div>
+        <div class="endpoint"><strong>GET</strong> <a href="/stream?lines=1000">/stream?lines=N</a> - Chunked, streamed body</div>
+        <div class="endpoint"><strong>GET</strong> <a href="/metrics">/metrics</a> - Prometheus metrics</div>
         <div class="endpoint"><strong>GET</strong> / - Static file serving (if enabled)</div>
     </div>
     
@@ -145,6 +238,58 @@ void setup_routes(HttpServer& server) {
         }
         return HttpResponse::ok(large_content).set_content_type("text/plain");
     });
+    
+    // Generated body of unknown length, sent chunked (and compressed when the
+    // client accepts it) without ever being held in memory as a whole
+    server.add_get_route("/stream", [](const HttpRequest& request) {
+        auto lines = request.get_query_param("lines");
+        size_t count = 100000;
+        if (lines) {
+            std::from_chars(lines->data(), lines->data() + lines->size(), count);
+        }
+        return HttpResponse().set_content_type("text/plain").set_body_stream(std::make_shared<LineStream>(count));
+    });
+    
+    // Upload of any size, read as it arrives with a single buffer of it in
+    // memory at a time. A real handler would write it to disk or upstream.
+    server.add_streaming_route("/upload", HttpMethod::POST,
+        [](const HttpRequest& /*request*/, std::shared_ptr<RequestBody> body, HttpServer::ResponseCallback done) {
+            read_upload(std::move(body), std::make_shared<UploadDigest>(), std::move(done));
+        });
+    
+    // Answers after a delay of ?ms= (capped at 10s), waiting on a timer
+    // rather than a thread, so any number of them can be outstanding at once
+    server.add_async_route("/api/delayed", HttpMethod::GET,
+        [](const HttpRequest& request) -> boost::asio::awaitable<HttpResponse> {
+            auto ms = request.get_query_param("ms");
+            unsigned delay = 100;
+            if (ms) {
+                std::from_chars(ms->data(), ms->data() + ms->size(), delay);
+            }
+            delay = std::min(delay, 10000u);
+            boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor,
+                                            std::chrono::milliseconds(delay));
+            co_await timer.async_wait(boost::asio::use_awaitable);
+            co_return HttpResponse::ok("Waited " + std::to_string(delay) + " ms");
+        });
+    
+    // Chat room: every message is broadcast to every member, serialized once
+    server.add_websocket_route("/ws/chat", [&server](std::shared_ptr<WebSocketConnection> connection) {
+        server.subscribe("chat", connection);
+        connection->on_message([&server](const std::string& message) {
+            server.publish("chat", message);
+        });
+    });
+    
+    server.add_websocket_route("/ws/echo", [](std::shared_ptr<WebSocketConnection> connection) {
+        // A handler that holds its own connection would keep it alive forever
+        std::weak_ptr<WebSocketConnection> weak = connection;
+        connection->on_message([weak](const std::string& message) {
+            if (auto connection = weak.lock()) {
+                connection->send_text(message);
+            }
+        });
+    });
 }
 
 /**
@@ -199,6 +344,7 @@ int main(int argc, char* argv[]) {
         // Setup signal handling
         signal(SIGINT, signal_handler);
         signal(SIGTERM, signal_handler);
+        signal(SIGHUP, reopen_log_handler);
         
         // Load configuration
         ServerConfig config;
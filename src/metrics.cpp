@@ -0,0 +1,278 @@
+/**
+ * @file metrics.cpp
+ * @brief Implementation of the server counters, latency histograms and their Prometheus / JSON exposition.
+ */
+#include "metrics.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdio>
+
+namespace http_server {
+
+namespace {
+
+// Bucket boundaries published to Prometheus, in seconds
+constexpr std::array<double, 16> PROMETHEUS_BUCKETS = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+constexpr std::array<const char*, 5> STATUS_CLASSES = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+uint64_t to_microseconds(std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return us > 0 ? static_cast<uint64_t>(us) : 0;
+}
+
+void append_number(std::string& out, uint64_t value) {
+    char buffer[24];
+    out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+
+void append_seconds(std::string& out, double seconds) {
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.9g", seconds);
+    out.append(buffer, static_cast<size_t>(std::max(length, 0)));
+}
+
+// Label values are quoted; backslash, quote and newline must be escaped
+std::string escape_label(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        } else if (c == '\n') {
+            escaped.append("\\n");
+        } else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+void append_header(std::string& out, const char* name, const char* type, const char* help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void append_histogram(std::string& out, const char* name, const std::string& labels,
+                      const LatencyHistogram& histogram) {
+    auto snapshot = histogram.snapshot();
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    for (double le : PROMETHEUS_BUCKETS) {
+        out.append(name).append("_bucket{").append(prefix).append("le=\"");
+        append_seconds(out, le);
+        out.append("\"} ");
+        append_number(out, snapshot.count_at_or_below(static_cast<uint64_t>(le * 1e6)));
+        out.push_back('\n');
+    }
+    out.append(name).append("_bucket{").append(prefix).append("le=\"+Inf\"} ");
+    append_number(out, snapshot.count);
+    out.push_back('\n');
+
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    out.append(name).append("_sum").append(braces).push_back(' ');
+    append_seconds(out, static_cast<double>(snapshot.sum_us) / 1e6);
+    out.push_back('\n');
+    out.append(name).append("_count").append(braces).push_back(' ');
+    append_number(out, snapshot.count);
+    out.push_back('\n');
+}
+
+nlohmann::json summary_json(const LatencyHistogram& histogram) {
+    auto snapshot = histogram.snapshot();
+    nlohmann::json json;
+    json["count"] = snapshot.count;
+    json["mean_us"] = snapshot.count ? snapshot.sum_us / snapshot.count : 0;
+    json["p50_us"] = snapshot.quantile_us(0.50);
+    json["p90_us"] = snapshot.quantile_us(0.90);
+    json["p99_us"] = snapshot.quantile_us(0.99);
+    json["p999_us"] = snapshot.quantile_us(0.999);
+    json["max_us"] = snapshot.quantile_us(1.0);
+    return json;
+}
+
+} // namespace
+
+size_t thread_slot() noexcept {
+    static std::atomic<size_t> next{0};
+    thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+// ServerCounters implementation
+size_t ServerCounters::sum(Counter counter) const noexcept {
+    size_t total = 0;
+    for (const auto& slab : slabs_) {
+        total += slab.values[counter].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+// LatencyHistogram implementation
+size_t LatencyHistogram::bucket_index(uint64_t value_us) noexcept {
+    if (value_us < SUB_BUCKETS) {
+        return static_cast<size_t>(value_us);
+    }
+    unsigned shift = static_cast<unsigned>(std::bit_width(value_us)) - 4;  // Keep the top 4 bits
+    size_t index = (shift + 1) * SUB_BUCKETS + ((value_us >> shift) & (SUB_BUCKETS - 1));
+    return std::min(index, BUCKET_COUNT - 1);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t index) noexcept {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    uint64_t shift = index / SUB_BUCKETS - 1;
+    uint64_t sub = index % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration elapsed) noexcept {
+    uint64_t us = to_microseconds(elapsed);
+    auto& stripe = stripes_[thread_slot() % STRIPES];
+    stripe.counts[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    for (const auto& stripe : stripes_) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            snapshot.counts[i] += stripe.counts[i].load(std::memory_order_relaxed);
+        }
+        snapshot.sum_us += stripe.sum_us.load(std::memory_order_relaxed);
+    }
+    // Counted from the buckets so that the total always matches them
+    for (auto count : snapshot.counts) {
+        snapshot.count += count;
+    }
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::Snapshot::quantile_us(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return bucket_upper_bound(i);
+        }
+    }
+    return bucket_upper_bound(BUCKET_COUNT - 1);
+}
+
+uint64_t LatencyHistogram::Snapshot::count_at_or_below(uint64_t limit_us) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT && bucket_upper_bound(i) <= limit_us; ++i) {
+        total += counts[i];
+    }
+    return total;
+}
+
+// ServerMetrics implementation
+ServerMetrics::ServerMetrics()
+    : unrouted_(std::make_shared<RouteMetrics>()) {
+    unrouted_->label = "unrouted";
+}
+
+std::shared_ptr<ServerMetrics::RouteMetrics> ServerMetrics::route(const std::string& label) {
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto& entry = routes_[label];
+    if (!entry) {
+        entry = std::make_shared<RouteMetrics>();
+        entry->label = label;
+    }
+    return entry;
+}
+
+std::vector<std::shared_ptr<ServerMetrics::RouteMetrics>> ServerMetrics::route_list() const {
+    std::vector<std::shared_ptr<RouteMetrics>> list;
+    {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        for (const auto& [label, metrics] : routes_) {
+            list.push_back(metrics);
+        }
+    }
+    list.push_back(unrouted_);
+    return list;
+}
+
+void ServerMetrics::record_handler(RouteMetrics& route, std::chrono::steady_clock::time_point received,
+                                   std::chrono::steady_clock::time_point started,
+                                   std::chrono::steady_clock::time_point finished) noexcept {
+    if (received != std::chrono::steady_clock::time_point{}) {
+        route.queue.record(started - received);
+    }
+    route.handler.record(finished - started);
+}
+
+void ServerMetrics::record_response(int status, std::chrono::steady_clock::time_point received,
+                                    std::chrono::steady_clock::time_point handled,
+                                    std::chrono::steady_clock::time_point written) noexcept {
+    size_t status_class = static_cast<size_t>(std::clamp(status / 100, 1, 5) - 1);
+    auto& metrics = status_classes_[status_class];
+    metrics.write.record(written - handled);
+    metrics.total.record(written - received);
+}
+
+void ServerMetrics::record_first_request(std::chrono::steady_clock::duration elapsed) noexcept {
+    first_request_.record(elapsed);
+}
+
+void ServerMetrics::append_prometheus(std::string& out) const {
+    auto routes = route_list();
+
+    append_header(out, "http_request_duration_seconds", "histogram",
+                  "Time from a request being parsed to its response being written");
+    for (size_t i = 0; i < status_classes_.size(); ++i) {
+        append_histogram(out, "http_request_duration_seconds",
+                         std::string("code=\"") + STATUS_CLASSES[i] + "\"", status_classes_[i].total);
+    }
+
+    append_header(out, "http_response_write_seconds", "histogram",
+                  "Time from a handler returning to its response being written");
+    for (size_t i = 0; i < status_classes_.size(); ++i) {
+        append_histogram(out, "http_response_write_seconds",
+                         std::string("code=\"") + STATUS_CLASSES[i] + "\"", status_classes_[i].write);
+    }
+
+    append_header(out, "http_handler_queue_seconds", "histogram",
+                  "Time from a request being parsed to its handler starting");
+    for (const auto& route : routes) {
+        append_histogram(out, "http_handler_queue_seconds", "route=\"" + escape_label(route->label) + "\"",
+                         route->queue);
+    }
+
+    append_header(out, "http_handler_duration_seconds", "histogram", "Time spent in the request handler");
+    for (const auto& route : routes) {
+        append_histogram(out, "http_handler_duration_seconds", "route=\"" + escape_label(route->label) + "\"",
+                         route->handler);
+    }
+
+    append_header(out, "http_connection_first_request_seconds", "histogram",
+                  "Time from accepting a connection to its first request being parsed");
+    append_histogram(out, "http_connection_first_request_seconds", "", first_request_);
+}
+
+nlohmann::json ServerMetrics::to_json() const {
+    nlohmann::json json;
+    for (size_t i = 0; i < status_classes_.size(); ++i) {
+        json["status"][STATUS_CLASSES[i]]["total"] = summary_json(status_classes_[i].total);
+        json["status"][STATUS_CLASSES[i]]["write"] = summary_json(status_classes_[i].write);
+    }
+    for (const auto& route : route_list()) {
+        json["routes"][route->label]["queue"] = summary_json(route->queue);
+        json["routes"][route->label]["handler"] = summary_json(route->handler);
+    }
+    json["first_request"] = summary_json(first_request_);
+    return json;
+}
+
+} // namespace http_server
@@ -1,4 +1,5 @@
 #include "rate_limiter.hpp"
+#include "distributed_limiter.hpp"
 #include <algorithm>
 #include <sstream>
 #include <thread>
@@ -6,65 +7,57 @@
 
 namespace http_server {
 
+void RateLimitAlgorithm::cleanup_expired() {
+    for (size_t shard = 0; shard < RATE_LIMIT_SHARDS; ++shard) {
+        cleanup_shard(shard);
+    }
+}
+
 // TokenBucketLimiter implementation
 TokenBucketLimiter::TokenBucketLimiter(size_t capacity, size_t refill_rate, 
                                       std::chrono::seconds refill_interval)
     : capacity_(capacity), refill_rate_(refill_rate), refill_interval_(refill_interval) {}
 
 RateLimitResult TokenBucketLimiter::check_rate_limit(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     auto now = std::chrono::steady_clock::now();
     
-    // Find or create bucket
-    auto it = buckets_.find(key);
-    if (it == buckets_.end()) {
-        it = buckets_.emplace(key, BucketState(capacity_)).first;
-    }
-    auto& bucket = it->second;
-    
-    // Calculate time elapsed since last refill
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - bucket.last_refill);
-    
-    // Refill tokens based on elapsed time
-    if (elapsed >= refill_interval_) {
-        size_t intervals = elapsed.count() / refill_interval_.count();
-        size_t tokens_to_add = intervals * refill_rate_;
-        bucket.tokens = std::min(capacity_, bucket.tokens + tokens_to_add);
-        bucket.last_refill = now;
-    }
-    
-    RateLimitResult result;
-    if (bucket.tokens > 0) {
-        bucket.tokens--;
-        result.allowed = true;
-        result.remaining = bucket.tokens;
-        result.limit_type = "token_bucket";
-    } else {
-        result.allowed = false;
-        result.remaining = 0;
-        result.reset_time = std::chrono::seconds(
-            (refill_interval_.count() - elapsed.count() % refill_interval_.count()));
-        result.limit_type = "token_bucket";
-        result.reason = "Token bucket exhausted";
-    }
-    
-    return result;
+    return buckets_.with(key, [this] { return BucketState(capacity_); }, [&](BucketState& bucket) {
+        // Calculate time elapsed since last refill
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - bucket.last_refill);
+        
+        // Refill tokens based on elapsed time
+        if (elapsed >= refill_interval_) {
+            size_t intervals = elapsed.count() / refill_interval_.count();
+            size_t tokens_to_add = intervals * refill_rate_;
+            bucket.tokens = std::min(capacity_, bucket.tokens + tokens_to_add);
+            bucket.last_refill = now;
+        }
+        
+        RateLimitResult result;
+        if (bucket.tokens > 0) {
+            bucket.tokens--;
+            result.allowed = true;
+            result.remaining = bucket.tokens;
+            result.limit_type = "token_bucket";
+        } else {
+            result.allowed = false;
+            result.remaining = 0;
+            result.reset_time = std::chrono::seconds(
+                (refill_interval_.count() - elapsed.count() % refill_interval_.count()));
+            result.limit_type = "token_bucket";
+            result.reason = "Token bucket exhausted";
+        }
+        return result;
+    });
 }
 
-void TokenBucketLimiter::cleanup_expired() {
-    std::lock_guard<std::mutex> lock(mutex_);
+void TokenBucketLimiter::cleanup_shard(size_t shard) {
     auto now = std::chrono::steady_clock::now();
     
-    auto it = buckets_.begin();
-    while (it != buckets_.end()) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::minutes>(now - it->second.last_refill);
-        if (elapsed.count() > 60) {  // Remove inactive buckets after 1 hour
-            it = buckets_.erase(it);
-        } else {
-            ++it;
-        }
-    }
+    // Remove inactive buckets after 1 hour
+    buckets_.sweep(shard, [now](const BucketState& bucket) {
+        return std::chrono::duration_cast<std::chrono::minutes>(now - bucket.last_refill).count() > 60;
+    });
 }
 
 // FixedWindowLimiter implementation
@@ -72,51 +65,41 @@ FixedWindowLimiter::FixedWindowLimiter(size_t max_requests, std::chrono::seconds
     : max_requests_(max_requests), window_duration_(window_duration) {}
 
 RateLimitResult FixedWindowLimiter::check_rate_limit(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     auto now = std::chrono::steady_clock::now();
     
-    // Find or create window
-    auto& window = windows_[key];
-    
-    // Check if we need to reset the window
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - window.window_start);
-    if (elapsed >= window_duration_) {
-        window.count = 0;
-        window.window_start = now;
-    }
-    
-    RateLimitResult result;
-    if (window.count < max_requests_) {
-        window.count++;
-        result.allowed = true;
-        result.remaining = max_requests_ - window.count;
-        result.limit_type = "fixed_window";
-    } else {
-        result.allowed = false;
-        result.remaining = 0;
-        result.reset_time = std::chrono::seconds(
-            window_duration_.count() - elapsed.count());
-        result.limit_type = "fixed_window";
-        result.reason = "Fixed window limit exceeded";
-    }
-    
-    return result;
+    return windows_.with(key, [] { return WindowState(); }, [&](WindowState& window) {
+        // Check if we need to reset the window
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - window.window_start);
+        if (elapsed >= window_duration_) {
+            window.count = 0;
+            window.window_start = now;
+        }
+        
+        RateLimitResult result;
+        if (window.count < max_requests_) {
+            window.count++;
+            result.allowed = true;
+            result.remaining = max_requests_ - window.count;
+            result.limit_type = "fixed_window";
+        } else {
+            result.allowed = false;
+            result.remaining = 0;
+            result.reset_time = std::chrono::seconds(
+                window_duration_.count() - elapsed.count());
+            result.limit_type = "fixed_window";
+            result.reason = "Fixed window limit exceeded";
+        }
+        return result;
+    });
 }
 
-void FixedWindowLimiter::cleanup_expired() {
-    std::lock_guard<std::mutex> lock(mutex_);
+void FixedWindowLimiter::cleanup_shard(size_t shard) {
     auto now = std::chrono::steady_clock::now();
     
-    auto it = windows_.begin();
-    while (it != windows_.end()) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::minutes>(now - it->second.window_start);
-        if (elapsed.count() > 60) {  // Remove inactive windows after 1 hour
-            it = windows_.erase(it);
-        } else {
-            ++it;
-        }
-    }
+    // Remove inactive windows after 1 hour
+    windows_.sweep(shard, [now](const WindowState& window) {
+        return std::chrono::duration_cast<std::chrono::minutes>(now - window.window_start).count() > 60;
+    });
 }
 
 // SlidingWindowLimiter implementation
@@ -124,88 +107,190 @@ SlidingWindowLimiter::SlidingWindowLimiter(size_t max_requests, std::chrono::sec
     : max_requests_(max_requests), window_duration_(window_duration) {}
 
 RateLimitResult SlidingWindowLimiter::check_rate_limit(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     auto now = std::chrono::steady_clock::now();
-    auto& requests = request_logs_[key];
     
-    // Remove expired requests
-    auto cutoff = now - window_duration_;
-    requests.erase(
-        std::remove_if(requests.begin(), requests.end(),
-                      [cutoff](const RequestRecord& record) {
-                          return record.timestamp < cutoff;
-                      }),
-        requests.end());
-    
-    RateLimitResult result;
-    if (requests.size() < max_requests_) {
-        requests.emplace_back();
-        result.allowed = true;
-        result.remaining = max_requests_ - requests.size();
-        result.limit_type = "sliding_window";
-    } else {
-        result.allowed = false;
-        result.remaining = 0;
-        // Find the oldest request to determine reset time
-        if (!requests.empty()) {
-            auto oldest = *std::min_element(requests.begin(), requests.end(),
-                [](const RequestRecord& a, const RequestRecord& b) {
-                    return a.timestamp < b.timestamp;
-                });
-            auto reset_at = oldest.timestamp + window_duration_;
-            result.reset_time = std::chrono::duration_cast<std::chrono::seconds>(reset_at - now);
+    return request_logs_.with(key, [] { return std::vector<RequestRecord>(); },
+                              [&](std::vector<RequestRecord>& requests) {
+        // Remove expired requests
+        auto cutoff = now - window_duration_;
+        requests.erase(
+            std::remove_if(requests.begin(), requests.end(),
+                          [cutoff](const RequestRecord& record) {
+                              return record.timestamp < cutoff;
+                          }),
+            requests.end());
+        
+        RateLimitResult result;
+        if (requests.size() < max_requests_) {
+            requests.emplace_back();
+            result.allowed = true;
+            result.remaining = max_requests_ - requests.size();
+            result.limit_type = "sliding_window";
+        } else {
+            result.allowed = false;
+            result.remaining = 0;
+            // Records are appended in time order, so the oldest is first
+            if (!requests.empty()) {
+                auto reset_at = requests.front().timestamp + window_duration_;
+                result.reset_time = std::chrono::duration_cast<std::chrono::seconds>(reset_at - now);
+            }
+            result.limit_type = "sliding_window";
+            result.reason = "Sliding window limit exceeded";
         }
-        result.limit_type = "sliding_window";
-        result.reason = "Sliding window limit exceeded";
-    }
-    
-    return result;
+        return result;
+    });
 }
 
-void SlidingWindowLimiter::cleanup_expired() {
-    std::lock_guard<std::mutex> lock(mutex_);
+void SlidingWindowLimiter::cleanup_shard(size_t shard) {
     auto now = std::chrono::steady_clock::now();
     auto cutoff = now - std::chrono::hours(1);  // Remove logs older than 1 hour
     
-    auto it = request_logs_.begin();
-    while (it != request_logs_.end()) {
-        auto& requests = it->second;
+    request_logs_.sweep(shard, [cutoff](std::vector<RequestRecord>& requests) {
         requests.erase(
             std::remove_if(requests.begin(), requests.end(),
                           [cutoff](const RequestRecord& record) {
                               return record.timestamp < cutoff;
                           }),
             requests.end());
+        return requests.empty();
+    });
+}
+
+// SlidingWindowCounterLimiter implementation
+SlidingWindowCounterLimiter::SlidingWindowCounterLimiter(size_t max_requests, std::chrono::seconds window_duration)
+    : max_requests_(max_requests)
+    , window_duration_(std::max(std::chrono::steady_clock::duration(window_duration),
+                                std::chrono::steady_clock::duration(1))) {}
+
+RateLimitResult SlidingWindowCounterLimiter::check_rate_limit(const std::string& key) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    int64_t window = now / window_duration_;
+    auto into_window = now % window_duration_;
+    double overlap = 1.0 - static_cast<double>(into_window.count()) / static_cast<double>(window_duration_.count());
+    
+    return counters_.with(key, [] { return CounterState(); }, [&](CounterState& state) {
+        if (state.window != window) {
+            state.previous = state.window == window - 1 ? state.current : 0;
+            state.current = 0;
+            state.window = window;
+        }
+        
+        double estimate = static_cast<double>(state.previous) * overlap + static_cast<double>(state.current);
+        RateLimitResult result;
+        result.limit_type = "sliding_window_counter";
+        if (estimate + 1 <= static_cast<double>(max_requests_)) {
+            state.current++;
+            result.allowed = true;
+            result.remaining = static_cast<size_t>(static_cast<double>(max_requests_) - estimate - 1);
+            return result;
+        }
+        
+        result.allowed = false;
+        result.remaining = 0;
+        result.reason = "Sliding window limit exceeded";
+        
+        // The estimate falls as the previous window slides out; once the
+        // current window alone is full, only the next window helps
+        auto until_next_window = window_duration_ - into_window;
+        auto wait = until_next_window;
+        if (state.current + 1 <= max_requests_ && state.previous > 0) {
+            double needed = static_cast<double>(max_requests_ - state.current - 1) / static_cast<double>(state.previous);
+            auto drained_at = std::chrono::steady_clock::duration(
+                static_cast<std::chrono::steady_clock::rep>((1.0 - needed) * static_cast<double>(window_duration_.count())));
+            wait = std::max(drained_at - into_window, std::chrono::steady_clock::duration(0));
+        }
+        result.reset_time = std::chrono::ceil<std::chrono::seconds>(wait);
+        return result;
+    });
+}
+
+void SlidingWindowCounterLimiter::cleanup_shard(size_t shard) {
+    // Counters two windows old no longer affect any estimate
+    int64_t window = std::chrono::steady_clock::now().time_since_epoch() / window_duration_;
+    counters_.sweep(shard, [window](const CounterState& state) {
+        return state.window < window - 1;
+    });
+}
+
+// LeakyBucketLimiter implementation
+LeakyBucketLimiter::LeakyBucketLimiter(size_t max_requests, std::chrono::seconds window_duration,
+                                       size_t burst_capacity)
+    : emission_interval_(std::chrono::steady_clock::duration(window_duration) /
+                         static_cast<std::chrono::steady_clock::rep>(std::max<size_t>(max_requests, 1)))
+    , burst_tolerance_(emission_interval_ * static_cast<std::chrono::steady_clock::rep>(
+                           std::max<size_t>(burst_capacity, 1) - 1))
+    , burst_capacity_(std::max<size_t>(burst_capacity, 1)) {}
+
+RateLimitResult LeakyBucketLimiter::check_rate_limit(const std::string& key) {
+    auto now = std::chrono::steady_clock::now();
+    
+    return arrivals_.with(key, [] { return ArrivalState(); }, [&](ArrivalState& state) {
+        auto tat = std::max(state.tat, now);
+        auto allow_at = tat - burst_tolerance_;
+        
+        RateLimitResult result;
+        result.limit_type = "leaky_bucket";
+        if (now < allow_at) {
+            result.allowed = false;
+            result.remaining = 0;
+            result.reset_time = std::chrono::ceil<std::chrono::seconds>(allow_at - now);
+            result.reason = "Leaky bucket overflow";
+            return result;
+        }
         
-        if (requests.empty()) {
-            it = request_logs_.erase(it);
+        state.tat = tat + emission_interval_;
+        // Requests that could still arrive right now without overflowing
+        auto slack = now - (state.tat - burst_tolerance_);
+        result.allowed = true;
+        if (slack < std::chrono::steady_clock::duration(0)) {
+            result.remaining = 0;
+        } else if (emission_interval_.count() == 0) {
+            result.remaining = burst_capacity_ - 1;
         } else {
-            ++it;
+            result.remaining = std::min<size_t>(burst_capacity_ - 1,
+                                                static_cast<size_t>(slack / emission_interval_) + 1);
         }
-    }
+        return result;
+    });
 }
 
-// RateLimiter implementation
-RateLimiter::RateLimiter(const RateLimitConfig& config) : config_(config) {
-    // Create algorithm based on strategy
-    switch (config_.strategy) {
-        case RateLimitStrategy::TOKEN_BUCKET:
-            algorithm_ = std::make_unique<TokenBucketLimiter>(
-                config_.burst_capacity, config_.max_requests, config_.window_duration);
-            break;
+void LeakyBucketLimiter::cleanup_shard(size_t shard) {
+    // A bucket that has fully drained is the same as no bucket
+    auto now = std::chrono::steady_clock::now();
+    arrivals_.sweep(shard, [now](const ArrivalState& state) {
+        return state.tat <= now;
+    });
+}
+
+namespace {
+
+std::unique_ptr<RateLimitAlgorithm> create_algorithm(const RateLimitConfig& config) {
+    if (config.distributed) {
+        return std::make_unique<DistributedLimiter>(config);
+    }
+    switch (config.strategy) {
         case RateLimitStrategy::FIXED_WINDOW:
-            algorithm_ = std::make_unique<FixedWindowLimiter>(
-                config_.max_requests, config_.window_duration);
-            break;
+            return std::make_unique<FixedWindowLimiter>(config.max_requests, config.window_duration);
         case RateLimitStrategy::SLIDING_WINDOW:
-            algorithm_ = std::make_unique<SlidingWindowLimiter>(
-                config_.max_requests, config_.window_duration);
-            break;
+            return std::make_unique<SlidingWindowLimiter>(config.max_requests, config.window_duration);
+        case RateLimitStrategy::SLIDING_WINDOW_COUNTER:
+            return std::make_unique<SlidingWindowCounterLimiter>(config.max_requests, config.window_duration);
+        case RateLimitStrategy::LEAKY_BUCKET:
+            return std::make_unique<LeakyBucketLimiter>(config.max_requests, config.window_duration,
+                                                        config.burst_capacity);
+        case RateLimitStrategy::TOKEN_BUCKET:
         default:
-            algorithm_ = std::make_unique<TokenBucketLimiter>(
-                config_.burst_capacity, config_.max_requests, config_.window_duration);
+            return std::make_unique<TokenBucketLimiter>(
+                config.burst_capacity, config.max_requests, config.window_duration);
     }
+}
+
+} // namespace
+
+// RateLimiter implementation
+RateLimiter::RateLimiter(const RateLimitConfig& config) : config_(config) {
+    // Create algorithm based on strategy
+    algorithm_ = create_algorithm(config_);
     
     // Start cleanup thread
     cleanup_thread_ = std::thread(&RateLimiter::cleanup_worker, this);
@@ -220,11 +305,14 @@ RateLimiter::~RateLimiter() {
 }
 
 void RateLimiter::cleanup_worker() {
+    auto tick = std::chrono::duration_cast<std::chrono::milliseconds>(CLEANUP_PERIOD) / RATE_LIMIT_SHARDS;
+    size_t shard = 0;
     while (!stop_cleanup_) {
         std::unique_lock<std::mutex> lock(cleanup_mutex_);
-        cleanup_cv_.wait_for(lock, std::chrono::minutes(5), [this] { return stop_cleanup_.load(); });
+        cleanup_cv_.wait_for(lock, tick, [this] { return stop_cleanup_.load(); });
         if (!stop_cleanup_) {
-            algorithm_->cleanup_expired();
+            algorithm_->cleanup_shard(shard);
+            shard = (shard + 1) % RATE_LIMIT_SHARDS;
         }
     }
 }
@@ -250,25 +338,15 @@ void RateLimiter::update_config(const RateLimitConfig& config) {
     config_ = config;
     
     // Recreate algorithm if strategy changed
-    switch (config_.strategy) {
-        case RateLimitStrategy::TOKEN_BUCKET:
-            algorithm_ = std::make_unique<TokenBucketLimiter>(
-                config_.burst_capacity, config_.max_requests, config_.window_duration);
-            break;
-        case RateLimitStrategy::FIXED_WINDOW:
-            algorithm_ = std::make_unique<FixedWindowLimiter>(
-                config_.max_requests, config_.window_duration);
-            break;
-        case RateLimitStrategy::SLIDING_WINDOW:
-            algorithm_ = std::make_unique<SlidingWindowLimiter>(
-                config_.max_requests, config_.window_duration);
-            break;
-        case RateLimitStrategy::LEAKY_BUCKET:
-            // Leaky bucket implementation not yet available
-            algorithm_ = std::make_unique<TokenBucketLimiter>(
-                config_.burst_capacity, config_.max_requests, config_.window_duration);
-            break;
-    }
+    algorithm_ = create_algorithm(config_);
+}
+
+size_t RateLimiter::get_active_keys() const {
+    return algorithm_->active_keys();
+}
+
+void RateLimiter::reset_all_limits() {
+    algorithm_->reset();
 }
 
 RateLimitConfig RateLimiter::get_config() const {
@@ -309,7 +387,7 @@ std::string RateLimitKeyExtractors::ip_address(const HttpRequest& request) {
     // Try X-Forwarded-For first (for reverse proxy scenarios)
     auto forwarded = request.get_header("X-Forwarded-For");
     if (forwarded) {
-        std::string forwarded_str = *forwarded;
+        std::string forwarded_str{*forwarded};
         size_t comma_pos = forwarded_str.find(',');
         if (comma_pos != std::string::npos) {
             return forwarded_str.substr(0, comma_pos);
@@ -320,7 +398,7 @@ std::string RateLimitKeyExtractors::ip_address(const HttpRequest& request) {
     // Try X-Real-IP
     auto real_ip = request.get_header("X-Real-IP");
     if (real_ip) {
-        return *real_ip;
+        return std::string(*real_ip);
     }
     
     // Fallback to connection remote address (would need server connection info)
@@ -332,7 +410,7 @@ std::string RateLimitKeyExtractors::user_id(const HttpRequest& request) {
     if (auth) {
         // Extract user ID from JWT token or API key
         // This is a simplified example
-        std::string auth_str = *auth;
+        std::string auth_str{*auth};
         if (auth_str.starts_with("Bearer ")) {
             return auth_str.substr(7);  // Remove "Bearer " prefix
         }
@@ -345,13 +423,13 @@ std::string RateLimitKeyExtractors::user_id(const HttpRequest& request) {
 std::string RateLimitKeyExtractors::api_key(const HttpRequest& request) {
     auto api_key = request.get_header("X-API-Key");
     if (api_key) {
-        return *api_key;
+        return std::string(*api_key);
     }
     
     // Try query parameter
     auto key_param = request.get_query_param("api_key");
     if (key_param) {
-        return *key_param;
+        return std::string(*key_param);
     }
     
     return ip_address(request);  // Fallback
@@ -367,7 +445,7 @@ std::string RateLimitKeyExtractors::ip_and_user_agent(const HttpRequest& request
 }
 
 std::string RateLimitKeyExtractors::endpoint_path(const HttpRequest& request) {
-    return request.path();
+    return std::string(request.path());
 }
 
 // Middleware factory implementations
@@ -398,4 +476,25 @@ RateLimitMiddleware::create_user_limiter(const RateLimitConfig& config) {
     return limiter->create_middleware();
 }
 
+std::function<bool(const HttpRequest&, HttpResponse&)> 
+RateLimitMiddleware::create_adaptive_limiter(const RateLimitConfig& base_config, std::function<bool()> overloaded) {
+    auto base = std::make_shared<RateLimiter>(base_config);
+    
+    // The reduced limit only counts requests made under load, and stays
+    // local: the base limiter already takes care of any peers
+    auto reduced_config = base_config;
+    reduced_config.max_requests = std::max<size_t>(1, base_config.max_requests / 4);
+    reduced_config.burst_capacity = std::max<size_t>(1, base_config.burst_capacity / 4);
+    reduced_config.distributed = false;
+    auto reduced = std::make_shared<RateLimiter>(reduced_config);
+    
+    return [base, reduced, base_check = base->create_middleware(), reduced_check = reduced->create_middleware(),
+            overloaded = std::move(overloaded)](const HttpRequest& request, HttpResponse& response) {
+        if (!base_check(request, response)) {
+            return false;
+        }
+        return !overloaded() || reduced_check(request, response);
+    };
+}
+
 } // namespace http_server
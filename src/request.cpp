@@ -3,206 +3,379 @@
  * @brief Implementation of the HttpRequest class for parsing and representing HTTP requests.
  *
  * Provides parsing logic for HTTP request lines, headers, query parameters, and body extraction.
+ * Parsing works in place over the raw bytes, so the request holds views rather than copies.
  */
 #include "request.hpp"
-#include <sstream>
 #include <algorithm>
-#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 
 namespace http_server {
 
+namespace {
+
+constexpr size_t MAX_BODY_SIZE = 10 * 1024 * 1024; // 10MB safety limit
+
+char to_lower_ascii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Compares a stored (already lowercase) header name against any-case input
+bool equals_lowercase(std::string_view lowercase, std::string_view name) {
+    if (lowercase.size() != name.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (lowercase[i] != to_lower_ascii(name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    size_t last = value.find_last_not_of(" \t");
+    return value.substr(first, last - first + 1);
+}
+
+// Splits off the next whitespace-delimited token from the front of line
+std::string_view next_token(std::string_view& line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        line = {};
+        return {};
+    }
+    size_t end = line.find_first_of(" \t", start);
+    std::string_view token = line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+    line = (end == std::string_view::npos) ? std::string_view{} : line.substr(end);
+    return token;
+}
+
+} // namespace
+
+HttpRequest::HttpRequest(std::pmr::memory_resource* resource)
+    : headers_(resource)
+    , query_params_(resource)
+    , path_params_(resource) {
+}
+
+HttpRequest::HttpRequest(const HttpRequest& other, std::pmr::memory_resource* resource)
+    : method_(other.method_)
+    , path_(other.path_)
+    , version_(other.version_)
+    , query_string_(other.query_string_)
+    , body_(other.body_)
+    , headers_(other.headers_, resource)
+    , query_params_(other.query_params_, resource)
+    , query_parsed_(other.query_parsed_)
+    , path_params_(other.path_params_, resource)
+    , is_valid_(other.is_valid_)
+    , received_at_(other.received_at_)
+    , storage_(other.storage_)
+    , owned_strings_(other.owned_strings_) {
+}
+
 std::optional<HttpRequest> HttpRequest::parse(std::string_view raw_request) {
-    HttpRequest request;
     if (raw_request.empty()) {
         return std::nullopt;
     }
 
+    // Take a single private copy of the raw bytes and parse over that
+    HttpRequest request;
+    auto storage = std::make_shared<std::string>(raw_request);
+    if (!request.parse_in_place(std::span<char>(storage->data(), storage->size()))) {
+        return std::nullopt;
+    }
+    request.storage_ = std::move(storage);
+    return request;
+}
+
+void HttpRequest::reset() {
+    method_ = HttpMethod::UNKNOWN;
+    path_ = {};
+    version_ = {};
+    query_string_ = {};
+    body_ = {};
+    headers_.clear();
+    query_params_.clear();
+    query_parsed_ = false;
+    path_params_.clear();
+    is_valid_ = false;
+    received_at_ = {};
+    storage_.reset();
+    owned_strings_.reset();
+}
+
+bool HttpRequest::parse_in_place(std::span<char> buffer) {
+    reset();
+    std::string_view raw_request(buffer.data(), buffer.size());
+    if (raw_request.empty()) {
+        return false;
+    }
+
     // Find the end of the headers
     size_t header_end_pos = raw_request.find("\r\n\r\n");
+    size_t body_start_pos = header_end_pos + 4;
     if (header_end_pos == std::string_view::npos) {
         // Fallback for headers ending with \n\n
         header_end_pos = raw_request.find("\n\n");
         if (header_end_pos == std::string_view::npos) {
-            return std::nullopt; // Headers not terminated
+            return false; // Headers not terminated
         }
+        body_start_pos = header_end_pos + 2;
     }
 
-    std::string header_str(raw_request.substr(0, header_end_pos));
-    std::istringstream header_stream(header_str);
-    std::string line;
-
-    // Parse request line
-    if (std::getline(header_stream, line)) {
-        if (!line.empty() && line.back() == '\r') {
-            line.pop_back();
-        }
-        request.parse_request_line(line);
-    } else {
-        return std::nullopt;
-    }
-
-    // Parse headers
-    while (std::getline(header_stream, line)) {
-        if (!line.empty() && line.back() == '\r') {
-            line.pop_back();
-        }
-        if (line.empty()) {
-            continue; // Should not happen with this logic, but safe
-        }
-        request.parse_header_line(line);
+    if (!parse_head(buffer.first(body_start_pos))) {
+        return false;
     }
 
-    // The body starts after the header separator
-    size_t body_start_pos = raw_request.find("\r\n\r\n") != std::string::npos ? header_end_pos + 4 : header_end_pos + 2;
-    std::string_view body_view = raw_request.substr(body_start_pos);
-
     // Body Parsing
-    auto transfer_encoding = request.get_header("transfer-encoding");
-    if (transfer_encoding && transfer_encoding->find("chunked") != std::string::npos) {
-        if (!request.parse_chunked_body(body_view)) {
-            return std::nullopt;
+    char* body_data = buffer.data() + body_start_pos;
+    size_t body_available = buffer.size() - body_start_pos;
+    auto transfer_encoding = get_header("transfer-encoding");
+    if (transfer_encoding && transfer_encoding->find("chunked") != std::string_view::npos) {
+        if (!parse_chunked_body(body_data, body_available)) {
+            return false;
         }
     }
     else {
-        size_t content_length = request.content_length();
-        if (content_length > 0) {
-            if (body_view.length() < content_length) {
+        size_t length = content_length();
+        if (length > 0) {
+            if (body_available < length) {
                 // This indicates an incomplete request, which the connection manager should handle.
                 // For this parser, we treat it as an error for now.
-                return std::nullopt;
+                return false;
             }
-            if (content_length > 10 * 1024 * 1024) { // 10MB limit for safety
-                return std::nullopt; 
+            if (length > MAX_BODY_SIZE) {
+                return false;
             }
-            request.body_ = std::string(body_view.substr(0, content_length));
+            body_ = std::string_view(body_data, length);
         }
     }
 
-    request.is_valid_ = (request.method_ != HttpMethod::UNKNOWN &&
-                          !request.path_.empty() &&
-                          is_valid_http_version(request.version_));
+    return is_valid_;
+}
+
+bool HttpRequest::parse_head(std::span<char> head) {
+    // Walk the header block line by line without copying it; the block ends
+    // at the first empty line after the request line
+    std::string_view raw_head(head.data(), head.size());
+    char* data = head.data();
+    size_t line_start = 0;
+    bool request_line = true;
+    while (line_start < raw_head.size()) {
+        size_t line_end = raw_head.find('\n', line_start);
+        if (line_end == std::string_view::npos) {
+            line_end = raw_head.size();
+        }
+
+        size_t length = line_end - line_start;
+        if (length > 0 && data[line_start + length - 1] == '\r') {
+            --length;
+        }
+
+        if (request_line) {
+            if (!parse_request_line(std::string_view(data + line_start, length))) {
+                return false;
+            }
+            request_line = false;
+        } else if (length == 0) {
+            break;
+        } else {
+            parse_header_line(data + line_start, length);
+        }
 
-    return request.is_valid_ ? std::make_optional(request) : std::nullopt;
+        line_start = line_end + 1;
+    }
+
+    is_valid_ = (method_ != HttpMethod::UNKNOWN &&
+                 !path_.empty() &&
+                 is_valid_http_version(version_));
+
+    return is_valid_;
 }
 
-void HttpRequest::parse_request_line(std::string_view line) {
-    std::istringstream iss{std::string{line}};
-    std::string method_str, path_and_query, version;
-    
-    if (!(iss >> method_str >> path_and_query >> version)) {
-        return;
+void HttpRequest::rebase(const char* old_base, const char* new_base) {
+    // The receive buffer moved; keep each view at the same offset
+    auto shift = [old_base, new_base](std::string_view& view) {
+        if (!view.empty()) {
+            auto offset = reinterpret_cast<std::uintptr_t>(view.data()) -
+                          reinterpret_cast<std::uintptr_t>(old_base);
+            view = std::string_view(new_base + offset, view.size());
+        }
+    };
+
+    shift(path_);
+    shift(version_);
+    shift(query_string_);
+    shift(body_);
+    for (auto& header : headers_) {
+        shift(header.name);
+        shift(header.value);
     }
-    
+    for (auto& param : query_params_) {
+        shift(param.name);
+        shift(param.value);
+    }
+}
+
+bool HttpRequest::parse_request_line(std::string_view line) {
+    std::string_view method_str = next_token(line);
+    std::string_view path_and_query = next_token(line);
+    std::string_view version = next_token(line);
+
+    if (version.empty()) {
+        return false;
+    }
+
     method_ = string_to_method(method_str);
     version_ = version;
-    
-    // Parse path and query string
+
+    // Split path and query string; the query itself is parsed on first use
     auto query_pos = path_and_query.find('?');
-    if (query_pos != std::string::npos) {
+    if (query_pos != std::string_view::npos) {
         path_ = path_and_query.substr(0, query_pos);
-        parse_query_string(path_and_query.substr(query_pos + 1));
+        query_string_ = path_and_query.substr(query_pos + 1);
     } else {
         path_ = path_and_query;
     }
+    return true;
 }
 
-void HttpRequest::parse_header_line(std::string_view line) {
-    auto colon_pos = line.find(':');
+void HttpRequest::parse_header_line(char* line, size_t length) {
+    std::string_view view(line, length);
+    auto colon_pos = view.find(':');
     if (colon_pos == std::string_view::npos) {
         return;
     }
-    
-    std::string name{line.substr(0, colon_pos)};
-    std::string value{line.substr(colon_pos + 1)};
-    
+
     // Trim whitespace
-    name.erase(name.find_last_not_of(" \t") + 1);
-    value.erase(0, value.find_first_not_of(" \t"));
-    value.erase(value.find_last_not_of(" \t") + 1);
-    
+    std::string_view name = view.substr(0, colon_pos);
+    name = name.substr(0, name.find_last_not_of(" \t") + 1);
+    std::string_view value = trim(view.substr(colon_pos + 1));
+
     // Validate header name to prevent injection attacks
     // RFC 7230: header names must be tokens (visible ASCII chars except separators)
     if (!is_valid_header_name(name)) {
         return; // Reject invalid header names
     }
-    
+
     // Validate header value to prevent injection attacks
     // RFC 7230: header values cannot contain control characters except HTAB
     if (!is_valid_header_value(value)) {
         return; // Reject invalid header values
     }
-    
-    normalize_header_name(name);
-    headers_[name] = value;
+
+    // Lowercase the name where it lies; name starts at the beginning of line
+    for (size_t i = 0; i < name.size(); ++i) {
+        line[i] = to_lower_ascii(line[i]);
+    }
+
+    // A repeated header replaces the earlier value
+    for (auto& header : headers_) {
+        if (header.name == name) {
+            header.value = value;
+            return;
+        }
+    }
+    headers_.push_back(Header{name, value});
 }
 
-void HttpRequest::parse_query_string(std::string_view query) {
-    std::string query_str{query};
-    std::istringstream iss(query_str);
-    std::string pair;
-    
-    while (std::getline(iss, pair, '&')) {
+void HttpRequest::parse_query_string() const {
+    query_parsed_ = true;
+
+    std::string_view query = query_string_;
+    while (!query.empty()) {
+        size_t amp_pos = query.find('&');
+        std::string_view pair = query.substr(0, amp_pos);
+        query = (amp_pos == std::string_view::npos) ? std::string_view{} : query.substr(amp_pos + 1);
+
+        if (pair.empty()) {
+            continue;
+        }
+
         auto eq_pos = pair.find('=');
-        if (eq_pos != std::string::npos) {
-            std::string key = pair.substr(0, eq_pos);
-            std::string value = pair.substr(eq_pos + 1);
-            query_params_[key] = value;
+        QueryParam param = (eq_pos != std::string_view::npos)
+            ? QueryParam{pair.substr(0, eq_pos), pair.substr(eq_pos + 1)}
+            : QueryParam{pair, {}};
+
+        // Later occurrences win, matching the previous map semantics
+        auto it = std::find_if(query_params_.begin(), query_params_.end(),
+                               [&](const QueryParam& p) { return p.name == param.name; });
+        if (it != query_params_.end()) {
+            it->value = param.value;
         } else {
-            query_params_[pair] = "";
+            query_params_.push_back(param);
         }
     }
 }
 
-void HttpRequest::normalize_header_name(std::string& name) const {
-    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+const std::pmr::vector<HttpRequest::QueryParam>& HttpRequest::query_params() const {
+    if (!query_parsed_) {
+        parse_query_string();
+    }
+    return query_params_;
 }
 
-std::optional<std::string> HttpRequest::get_header(const std::string& name) const {
-    std::string normalized_name = name;
-    normalize_header_name(normalized_name);
-    
-    auto it = headers_.find(normalized_name);
-    return (it != headers_.end()) ? std::make_optional(it->second) : std::nullopt;
+std::optional<std::string_view> HttpRequest::get_header(std::string_view name) const {
+    for (const auto& header : headers_) {
+        if (equals_lowercase(header.name, name)) {
+            return header.value;
+        }
+    }
+    return std::nullopt;
 }
 
-bool HttpRequest::has_header(const std::string& name) const {
-    std::string normalized_name = name;
-    normalize_header_name(normalized_name);
-    return headers_.find(normalized_name) != headers_.end();
+bool HttpRequest::has_header(std::string_view name) const {
+    return get_header(name).has_value();
 }
 
 size_t HttpRequest::content_length() const {
     auto length_header = get_header("content-length");
     if (length_header) {
-        try {
-            return std::stoull(*length_header);
-        } catch (const std::exception&) {
-            return 0;
-        }
+        size_t length = 0;
+        auto [ptr, ec] = std::from_chars(length_header->data(),
+                                         length_header->data() + length_header->size(), length);
+        return ec == std::errc{} ? length : 0;
     }
     return 0;
 }
 
-std::string HttpRequest::content_type() const {
-    auto type_header = get_header("content-type");
-    return type_header ? *type_header : "";
+std::string_view HttpRequest::content_type() const {
+    return get_header("content-type").value_or(std::string_view{});
 }
 
-std::optional<std::string> HttpRequest::get_query_param(const std::string& name) const {
-    auto it = query_params_.find(name);
-    return (it != query_params_.end()) ? std::make_optional(it->second) : std::nullopt;
+std::optional<std::string_view> HttpRequest::get_query_param(std::string_view name) const {
+    for (const auto& param : query_params()) {
+        if (param.name == name) {
+            return param.value;
+        }
+    }
+    return std::nullopt;
 }
 
-bool HttpRequest::has_query_param(const std::string& name) const {
-    return query_params_.find(name) != query_params_.end();
+bool HttpRequest::has_query_param(std::string_view name) const {
+    return get_query_param(name).has_value();
+}
+
+std::optional<std::string_view> HttpRequest::get_path_param(std::string_view name) const {
+    for (const auto& param : path_params_) {
+        if (param.name == name) {
+            return param.value;
+        }
+    }
+    return std::nullopt;
 }
 
 bool HttpRequest::is_keep_alive() const {
     auto connection_header = get_header("connection");
     if (connection_header) {
-        std::string conn = *connection_header;
-        std::transform(conn.begin(), conn.end(), conn.begin(), ::tolower);
-        return conn == "keep-alive";
+        return equals_lowercase("keep-alive", *connection_header);
     }
     
     // HTTP/1.1 defaults to keep-alive
@@ -210,28 +383,22 @@ bool HttpRequest::is_keep_alive() const {
 }
 
 std::string HttpRequest::to_string() const {
-    std::ostringstream oss;
-    oss << method_to_string(method_) << " " << path_;
+    std::string result;
+    result.append(method_to_string(method_)).append(" ").append(path_);
     
-    if (!query_params_.empty()) {
-        oss << "?";
-        bool first = true;
-        for (const auto& [key, value] : query_params_) {
-            if (!first) oss << "&";
-            oss << key << "=" << value;
-            first = false;
-        }
+    if (!query_string_.empty()) {
+        result.append("?").append(query_string_);
     }
     
-    oss << " " << version_ << "\r\n";
+    result.append(" ").append(version_).append("\r\n");
     
-    for (const auto& [name, value] : headers_) {
-        oss << name << ": " << value << "\r\n";
+    for (const auto& header : headers_) {
+        result.append(header.name).append(": ").append(header.value).append("\r\n");
     }
     
-    oss << "\r\n" << body_;
+    result.append("\r\n").append(body_);
     
-    return oss.str();
+    return result;
 }
 
 std::string HttpRequest::method_to_string(HttpMethod method) {
@@ -258,7 +425,7 @@ HttpMethod HttpRequest::string_to_method(std::string_view method_str) {
     return HttpMethod::UNKNOWN;
 }
 
-bool HttpRequest::is_valid_header_name(const std::string& name) {
+bool HttpRequest::is_valid_header_name(std::string_view name) {
     if (name.empty()) {
         return false;
     }
@@ -279,7 +446,7 @@ bool HttpRequest::is_valid_header_name(const std::string& name) {
     return true;
 }
 
-bool HttpRequest::is_valid_header_value(const std::string& value) {
+bool HttpRequest::is_valid_header_value(std::string_view value) {
     // RFC 7230: header values are field-content
     // field-content = field-vchar [ 1*( SP / HTAB ) field-vchar ]
     // field-vchar = VCHAR / obs-text
@@ -299,11 +466,12 @@ bool HttpRequest::is_valid_header_value(const std::string& value) {
     return true;
 }
 
-bool HttpRequest::parse_chunked_body(std::string_view body_view) {
-    std::ostringstream body_stream;
+bool HttpRequest::parse_chunked_body(char* body, size_t length) {
+    // Decoded data is compacted towards the start of the body as we go. The
+    // write position never overtakes the read position, so this is safe.
+    std::string_view body_view(body, length);
     size_t pos = 0;
     size_t total_body_size = 0;
-    const size_t MAX_BODY_SIZE = 10 * 1024 * 1024; // 10MB safety limit
 
     while (pos < body_view.length()) {
         // Find the end of the chunk size line
@@ -312,19 +480,13 @@ bool HttpRequest::parse_chunked_body(std::string_view body_view) {
             return false; // Malformed chunk size line
         }
 
-        // Parse chunk size
-        std::string size_hex = std::string(body_view.substr(pos, line_end - pos));
+        // Parse chunk size, ignoring any chunk extensions (semicolon and beyond)
+        std::string_view size_hex = trim(body_view.substr(pos, line_end - pos));
+        size_hex = size_hex.substr(0, size_hex.find(';'));
         
-        // Remove any chunk extensions (semicolon and beyond)
-        auto semicolon_pos = size_hex.find(';');
-        if (semicolon_pos != std::string::npos) {
-            size_hex = size_hex.substr(0, semicolon_pos);
-        }
-        
-        size_t chunk_size;
-        try {
-            chunk_size = std::stoul(size_hex, nullptr, 16);
-        } catch (const std::exception&) {
+        size_t chunk_size = 0;
+        auto [ptr, ec] = std::from_chars(size_hex.data(), size_hex.data() + size_hex.size(), chunk_size, 16);
+        if (ec != std::errc{} || size_hex.empty()) {
             return false; // Invalid chunk size format
         }
 
@@ -337,8 +499,7 @@ bool HttpRequest::parse_chunked_body(std::string_view body_view) {
         }
 
         // Safety check for total body size
-        total_body_size += chunk_size;
-        if (total_body_size > MAX_BODY_SIZE) {
+        if (chunk_size > MAX_BODY_SIZE || total_body_size + chunk_size > MAX_BODY_SIZE) {
             return false; // Body too large
         }
 
@@ -347,8 +508,9 @@ bool HttpRequest::parse_chunked_body(std::string_view body_view) {
             return false; // Incomplete chunk data
         }
 
-        // Append chunk data to the body
-        body_stream << body_view.substr(pos, chunk_size);
+        // Move chunk data down to the end of the decoded body
+        std::memmove(body + total_body_size, body + pos, chunk_size);
+        total_body_size += chunk_size;
         pos += chunk_size;
 
         // Skip the trailing CRLF after the chunk data
@@ -358,43 +520,59 @@ bool HttpRequest::parse_chunked_body(std::string_view body_view) {
         pos += 2;
     }
 
-    body_ = body_stream.str();
+    body_ = std::string_view(body, total_body_size);
     return true;
 }
 
-bool HttpRequest::is_valid_http_version(const std::string& version) {
+bool HttpRequest::is_valid_http_version(std::string_view version) {
     // Only accept HTTP/1.0 and HTTP/1.1 versions
     return version == "HTTP/1.0" || version == "HTTP/1.1";
 }
 
+std::string_view HttpRequest::own(std::string value) {
+    if (!owned_strings_) {
+        owned_strings_ = std::make_shared<std::deque<std::string>>();
+    }
+    owned_strings_->push_back(std::move(value));
+    return owned_strings_->back();
+}
+
 // Testing helper methods
 void HttpRequest::set_header(const std::string& name, const std::string& value) {
     std::string normalized_name = name;
-    normalize_header_name(normalized_name);
-    headers_[normalized_name] = value;
+    std::transform(normalized_name.begin(), normalized_name.end(), normalized_name.begin(), to_lower_ascii);
+
+    std::string_view stored_value = own(value);
+    for (auto& header : headers_) {
+        if (header.name == normalized_name) {
+            header.value = stored_value;
+            return;
+        }
+    }
+    headers_.push_back(Header{own(std::move(normalized_name)), stored_value});
 }
 
 void HttpRequest::set_path(const std::string& path) {
-    path_ = path;
+    path_ = own(path);
 }
 
 void HttpRequest::set_method(HttpMethod method) {
     method_ = method;
 }
 
-std::optional<std::string> HttpRequest::get_if_none_match() const {
+std::optional<std::string_view> HttpRequest::get_if_none_match() const {
     return get_header("If-None-Match");
 }
 
-std::optional<std::string> HttpRequest::get_if_modified_since() const {
+std::optional<std::string_view> HttpRequest::get_if_modified_since() const {
     return get_header("If-Modified-Since");
 }
 
-std::optional<std::string> HttpRequest::get_if_match() const {
+std::optional<std::string_view> HttpRequest::get_if_match() const {
     return get_header("If-Match");
 }
 
-std::optional<std::string> HttpRequest::get_if_unmodified_since() const {
+std::optional<std::string_view> HttpRequest::get_if_unmodified_since() const {
     return get_header("If-Unmodified-Since");
 }
 
@@ -405,4 +583,4 @@ bool HttpRequest::is_conditional_request() const {
            has_header("If-Unmodified-Since");
 }
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
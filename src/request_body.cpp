@@ -0,0 +1,52 @@
+/**
+ * @file request_body.cpp
+ * @brief Implementation of the RequestBody class for reading request bodies as they arrive.
+ */
+#include "request_body.hpp"
+#include <utility>
+
+namespace http_server {
+
+RequestBody::RequestBody(boost::asio::any_io_executor executor, std::optional<uint64_t> length, Source source)
+    : executor_(std::move(executor))
+    , length_(length)
+    , source_(std::move(source)) {
+}
+
+std::shared_ptr<RequestBody> RequestBody::buffered(boost::asio::any_io_executor executor, std::string_view data) {
+    return std::make_shared<RequestBody>(std::move(executor), data.size(),
+        [data](RequestBody& body) mutable {
+            if (data.empty()) {
+                body.deliver(Status::END);
+                return;
+            }
+            body.deliver(Status::DATA, std::exchange(data, std::string_view()));
+        });
+}
+
+void RequestBody::read(ReadHandler handler) {
+    // Posting keeps a handler that reads again from within its own
+    // completion off the stack, and off whatever thread it was called on
+    boost::asio::post(executor_, [self = shared_from_this(), handler = std::move(handler)]() mutable {
+        if (self->status_ != Status::DATA) {
+            handler(self->status_, {});
+            return;
+        }
+        self->handler_ = std::move(handler);
+        self->source_(*self);
+    });
+}
+
+void RequestBody::deliver(Status status, std::string_view data) {
+    if (status != Status::DATA) {
+        status_ = status;
+    }
+    if (!handler_) {
+        return;
+    }
+    ReadHandler handler = std::move(handler_);
+    handler_ = nullptr;
+    handler(status, data);
+}
+
+} // namespace http_server
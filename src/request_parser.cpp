@@ -0,0 +1,272 @@
+/**
+ * @file request_parser.cpp
+ * @brief Implementation of the RequestParser class for incremental HTTP request framing.
+ *
+ * Tracks where the previous read left off so each byte of a request is scanned once,
+ * no matter how many segments it arrives in.
+ */
+#include "request_parser.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace http_server {
+
+RequestParser::RequestParser(size_t max_request_size, std::pmr::memory_resource* resource)
+    : resource_(resource)
+    , request_(std::in_place, resource)
+    , max_request_size_(max_request_size) {
+}
+
+void RequestParser::reset() {
+    request_->reset();
+    state_ = State::HEADERS;
+    base_ = nullptr;
+    scan_offset_ = 0;
+    body_start_ = 0;
+    body_end_ = 0;
+    remaining_ = 0;
+    chunked_ = false;
+    streaming_ = false;
+    streamed_ = 0;
+}
+
+void RequestParser::stream_body(uint64_t max_body_size) noexcept {
+    streaming_ = true;
+    max_body_size_ = max_body_size;
+    // Positions from here on are in the buffer that starts after the head
+    scan_offset_ = 0;
+    body_start_ = 0;
+    body_end_ = 0;
+}
+
+size_t RequestParser::discard_body() noexcept {
+    size_t discarded = scan_offset_ - body_start_;
+    streamed_ += body_end_ - body_start_;
+    scan_offset_ = body_start_;
+    body_end_ = body_start_;
+    return discarded;
+}
+
+void RequestParser::detach() {
+    if (state_ == State::HEADERS) {
+        request_.emplace(resource_);  // Nothing parsed yet; only the capacity goes
+        return;
+    }
+    HttpRequest detached(*request_, std::pmr::get_default_resource());
+    request_.emplace(std::move(detached));
+}
+
+RequestParser::Status RequestParser::feed(std::span<char> buffer) {
+    // Once the header block is parsed request_ holds views into the buffer;
+    // follow it if a read made it reallocate
+    if (base_ && base_ != buffer.data() && state_ != State::HEADERS && !streaming_) {
+        request_->rebase(base_, buffer.data());
+    }
+    base_ = buffer.data();
+
+    switch (state_) {
+        case State::HEADERS:
+            return parse_headers(buffer);
+        case State::HEAD:
+            return begin_body(buffer);
+        case State::BODY:
+            if (streaming_) {
+                return stream_content(buffer);
+            }
+            if (buffer.size() < body_end_) {
+                scan_offset_ = buffer.size();
+                return Status::INCOMPLETE;
+            }
+            scan_offset_ = body_end_;
+            return finish(buffer);
+        case State::DONE:
+            return Status::COMPLETE;
+        default:
+            return parse_chunks(buffer);
+    }
+}
+
+RequestParser::Status RequestParser::parse_headers(std::span<char> buffer) {
+    const char* data = buffer.data();
+    size_t size = buffer.size();
+
+    // Look for an empty line, accepting both CRLF and bare LF endings. Each
+    // newline only needs the two bytes before it, so the scan resumes where
+    // the previous one stopped.
+    size_t pos = scan_offset_;
+    while (pos < size) {
+        const void* newline = std::memchr(data + pos, '\n', size - pos);
+        if (!newline) {
+            break;
+        }
+        size_t i = static_cast<const char*>(newline) - data;
+        bool blank_line = (i >= 1 && data[i - 1] == '\n') ||
+                          (i >= 2 && data[i - 1] == '\r' && data[i - 2] == '\n');
+        if (blank_line) {
+            body_start_ = i + 1;
+            scan_offset_ = body_start_;
+
+            request_->reset();
+            if (!request_->parse_head(buffer.first(body_start_))) {
+                return Status::INVALID;
+            }
+
+            auto transfer_encoding = request_->get_header("transfer-encoding");
+            chunked_ = transfer_encoding && transfer_encoding->find("chunked") != std::string_view::npos;
+            remaining_ = chunked_ ? 0 : request_->content_length();
+            body_end_ = body_start_;
+            if (pause_after_head_ && (chunked_ || remaining_ > 0)) {
+                state_ = State::HEAD;
+                return Status::HEAD;
+            }
+            return begin_body(buffer);
+        }
+        pos = i + 1;
+    }
+
+    scan_offset_ = size;
+    return size > max_request_size_ ? Status::TOO_LARGE : Status::INCOMPLETE;
+}
+
+RequestParser::Status RequestParser::begin_body(std::span<char> buffer) {
+    if (chunked_) {
+        state_ = State::CHUNK_SIZE;
+        return parse_chunks(buffer);
+    }
+
+    size_t length = remaining_;
+    if (streaming_) {
+        if (length > max_body_size_) {
+            return Status::TOO_LARGE;
+        }
+    } else {
+        if (length > max_request_size_ || body_start_ + length > max_request_size_) {
+            return Status::TOO_LARGE;
+        }
+        body_end_ = body_start_ + length;
+    }
+    state_ = State::BODY;
+    return feed(buffer);
+}
+
+RequestParser::Status RequestParser::stream_content(std::span<char> buffer) {
+    // The body bytes are used where they are; only the count is kept
+    size_t available = std::min(remaining_, buffer.size() - scan_offset_);
+    body_end_ += available;
+    scan_offset_ += available;
+    remaining_ -= available;
+    if (remaining_ == 0) {
+        return finish(buffer);
+    }
+    return incomplete();
+}
+
+RequestParser::Status RequestParser::incomplete() const noexcept {
+    return streaming_ && body_end_ > body_start_ ? Status::BODY : Status::INCOMPLETE;
+}
+
+RequestParser::Status RequestParser::parse_chunks(std::span<char> buffer) {
+    char* data = buffer.data();
+    std::string_view line;
+
+    while (true) {
+        if (!streaming_ && scan_offset_ > max_request_size_) {
+            return Status::TOO_LARGE;
+        }
+
+        switch (state_) {
+            case State::CHUNK_SIZE: {
+                if (!read_line(buffer, line)) {
+                    return buffer.size() - scan_offset_ > MAX_CHUNK_LINE ? Status::INVALID : incomplete();
+                }
+                // Chunk extensions after ';' are ignored
+                line = line.substr(0, line.find(';'));
+                while (!line.empty() && (line.back() == ' ' || line.back() == '\t')) {
+                    line.remove_suffix(1);
+                }
+                size_t chunk_size = 0;
+                auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), chunk_size, 16);
+                if (line.empty() || ec != std::errc() || ptr != line.data() + line.size()) {
+                    return Status::INVALID;
+                }
+                if (chunk_size == 0) {
+                    state_ = State::TRAILERS;
+                    break;
+                }
+                if (streaming_) {
+                    uint64_t used = streamed_ + (body_end_ - body_start_);
+                    if (chunk_size > max_body_size_ - used) {
+                        return Status::TOO_LARGE;
+                    }
+                } else if (chunk_size > max_request_size_ || body_end_ + chunk_size > max_request_size_) {
+                    return Status::TOO_LARGE;
+                }
+                remaining_ = chunk_size;
+                state_ = State::CHUNK_DATA;
+                break;
+            }
+            case State::CHUNK_DATA: {
+                // Slide chunk data down over the framing already consumed
+                size_t available = std::min(remaining_, buffer.size() - scan_offset_);
+                if (body_end_ != scan_offset_) {
+                    std::memmove(data + body_end_, data + scan_offset_, available);
+                }
+                body_end_ += available;
+                scan_offset_ += available;
+                remaining_ -= available;
+                if (remaining_ > 0) {
+                    return incomplete();
+                }
+                state_ = State::CHUNK_DATA_END;
+                break;
+            }
+            case State::CHUNK_DATA_END:
+                if (!read_line(buffer, line)) {
+                    return buffer.size() - scan_offset_ > 1 ? Status::INVALID : incomplete();
+                }
+                if (!line.empty()) {
+                    return Status::INVALID;
+                }
+                state_ = State::CHUNK_SIZE;
+                break;
+            case State::TRAILERS:
+                if (!read_line(buffer, line)) {
+                    return buffer.size() - scan_offset_ > MAX_CHUNK_LINE ? Status::INVALID : incomplete();
+                }
+                if (line.empty()) {
+                    return finish(buffer);
+                }
+                break;  // Trailer fields are not exposed
+            default:
+                return Status::INVALID;
+        }
+    }
+}
+
+bool RequestParser::read_line(std::span<char> buffer, std::string_view& line) {
+    const char* data = buffer.data();
+    const void* newline = std::memchr(data + scan_offset_, '\n', buffer.size() - scan_offset_);
+    if (!newline) {
+        return false;
+    }
+
+    size_t end = static_cast<const char*>(newline) - data;
+    line = std::string_view(data + scan_offset_, end - scan_offset_);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    scan_offset_ = end + 1;
+    return true;
+}
+
+RequestParser::Status RequestParser::finish(std::span<char> buffer) {
+    state_ = State::DONE;
+    // A streamed body went out through body_data() instead
+    if (!streaming_ && body_end_ > body_start_) {
+        request_->body_ = std::string_view(buffer.data() + body_start_, body_end_ - body_start_);
+    }
+    return Status::COMPLETE;
+}
+
+} // namespace http_server
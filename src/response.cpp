@@ -15,15 +15,144 @@
 #include <functional>
 #include <algorithm>
 #include <cctype>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace http_server {
 
-HttpResponse::HttpResponse() {
-    set_default_headers();
+namespace {
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+enum class ByteRange {
+    IGNORED,        // Absent, malformed or multi-range: serve the whole file
+    SATISFIABLE,
+    UNSATISFIABLE
+};
+
+// Parses a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range
+ByteRange parse_byte_range(std::string_view spec, uint64_t size, uint64_t& first, uint64_t& last) {
+    constexpr std::string_view prefix = "bytes=";
+    if (!spec.starts_with(prefix) || spec.find(',') != std::string_view::npos) {
+        return ByteRange::IGNORED;
+    }
+    spec.remove_prefix(prefix.size());
+    
+    auto dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+        return ByteRange::IGNORED;
+    }
+    
+    auto parse_number = [](std::string_view text, uint64_t& value) {
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && ec == std::errc() && ptr == text.data() + text.size();
+    };
+    
+    std::string_view first_text = spec.substr(0, dash);
+    std::string_view last_text = spec.substr(dash + 1);
+    
+    if (first_text.empty()) {
+        uint64_t suffix = 0;
+        if (!parse_number(last_text, suffix)) {
+            return ByteRange::IGNORED;
+        }
+        if (suffix == 0 || size == 0) {
+            return ByteRange::UNSATISFIABLE;
+        }
+        first = suffix >= size ? 0 : size - suffix;
+        last = size - 1;
+        return ByteRange::SATISFIABLE;
+    }
+    
+    if (!parse_number(first_text, first)) {
+        return ByteRange::IGNORED;
+    }
+    if (last_text.empty()) {
+        last = size == 0 ? 0 : size - 1;
+    } else if (!parse_number(last_text, last) || last < first) {
+        return ByteRange::IGNORED;
+    }
+    
+    if (first >= size) {
+        return ByteRange::UNSATISFIABLE;
+    }
+    last = std::min(last, size - 1);
+    return ByteRange::SATISFIABLE;
+}
+
+constexpr std::string_view SERVER_NAME = "cpp-http-server/1.0";
+
+// Built once instead of from a literal on every set_json() / set_html() / set_text()
+const std::string CONTENT_TYPE_JSON = "application/json; charset=utf-8";
+const std::string CONTENT_TYPE_HTML = "text/html; charset=utf-8";
+const std::string CONTENT_TYPE_TEXT = "text/plain; charset=utf-8";
+
+// Writes "Sun, 06 Nov 1994 08:49:37 GMT" (29 bytes) and returns its length
+size_t format_rfc1123(std::time_t time, char* out) {
+    static constexpr char days[][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static constexpr char months[][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                         "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    
+    auto two_digits = [](char* p, int value) {
+        p[0] = static_cast<char>('0' + value / 10);
+        p[1] = static_cast<char>('0' + value % 10);
+    };
+    std::memcpy(out, days[tm.tm_wday], 3);
+    out[3] = ',';
+    out[4] = ' ';
+    two_digits(out + 5, tm.tm_mday);
+    out[7] = ' ';
+    std::memcpy(out + 8, months[tm.tm_mon], 3);
+    out[11] = ' ';
+    int year = tm.tm_year + 1900;
+    two_digits(out + 12, year / 100 % 100);
+    two_digits(out + 14, year % 100);
+    out[16] = ' ';
+    two_digits(out + 17, tm.tm_hour);
+    out[19] = ':';
+    two_digits(out + 20, tm.tm_min);
+    out[22] = ':';
+    two_digits(out + 23, tm.tm_sec);
+    std::memcpy(out + 25, " GMT", 4);
+    return 29;
+}
+
+// "HTTP/1.1 200 OK\r\n" for every status the server knows, built once
+std::string_view status_line(HttpStatus status) {
+    static const auto lines = [] {
+        std::array<std::string, 600> table;
+        for (int code = 100; code < 600; ++code) {
+            auto reason = HttpResponse::status_reason(static_cast<HttpStatus>(code));
+            if (reason != "Unknown") {
+                table[code] = "HTTP/1.1 " + std::to_string(code) + " " + std::string(reason) + "\r\n";
+            }
+        }
+        return table;
+    }();
+    auto code = static_cast<int>(status);
+    if (code >= 0 && code < static_cast<int>(lines.size())) {
+        return lines[code];
+    }
+    return {};
 }
 
+} // namespace
+
+HttpResponse::HttpResponse() = default;
+
 HttpResponse::HttpResponse(HttpStatus status) : status_(status) {
-    set_default_headers();
 }
 
 HttpResponse& HttpResponse::set_status(HttpStatus status) {
@@ -31,80 +160,201 @@ HttpResponse& HttpResponse::set_status(HttpStatus status) {
     return *this;
 }
 
+uint8_t HttpResponse::implicit_header_bit(std::string_view name) {
+    if (iequals(name, "Content-Length")) return IMPLICIT_CONTENT_LENGTH;
+    if (iequals(name, "Date")) return IMPLICIT_DATE;
+    if (iequals(name, "Server")) return IMPLICIT_SERVER;
+    return 0;
+}
+
+std::string HttpResponse::implicit_header_value(uint8_t bit) const {
+    switch (bit) {
+        case IMPLICIT_SERVER: return std::string(SERVER_NAME);
+        case IMPLICIT_DATE: return std::string(current_http_date());
+        case IMPLICIT_CONTENT_LENGTH: return "0";
+        default: return {};
+    }
+}
+
+HttpResponse::Header* HttpResponse::find_header(std::string_view name) {
+    auto it = std::find_if(headers_.begin(), headers_.end(), [name](const Header& header) {
+        return iequals(header.name, name);
+    });
+    return it != headers_.end() ? &*it : nullptr;
+}
+
+const HttpResponse::Header* HttpResponse::find_header(std::string_view name) const {
+    return const_cast<HttpResponse*>(this)->find_header(name);
+}
+
 HttpResponse& HttpResponse::set_header(const std::string& name, const std::string& value) {
+    implicit_headers_ &= static_cast<uint8_t>(~implicit_header_bit(name));
+    if (Header* header = find_header(name)) {
+        header->value = value;
+        return *this;
+    }
     std::string normalized_name = name;
     normalize_header_name(normalized_name);
-    headers_[normalized_name] = value;
+    if (headers_.empty()) {
+        headers_.reserve(8);  // Enough for a typical response in one allocation
+    }
+    headers_.push_back(Header{std::move(normalized_name), value});
     return *this;
 }
 
 HttpResponse& HttpResponse::add_header(const std::string& name, const std::string& value) {
-    std::string normalized_name = name;
-    normalize_header_name(normalized_name);
+    if (uint8_t bit = implicit_header_bit(name); implicit_headers_ & bit) {
+        std::string implicit = implicit_header_value(bit);
+        set_header(name, implicit);
+    }
     
-    auto it = headers_.find(normalized_name);
-    if (it != headers_.end()) {
-        it->second += ", " + value;
-    } else {
-        headers_[normalized_name] = value;
+    if (Header* header = find_header(name)) {
+        header->value += ", " + value;
+        return *this;
     }
-    return *this;
+    return set_header(name, value);
 }
 
 std::string HttpResponse::get_header(const std::string& name) const {
-    std::string normalized_name = name;
-    normalize_header_name(normalized_name);
-    
-    auto it = headers_.find(normalized_name);
-    return (it != headers_.end()) ? it->second : "";
+    if (uint8_t bit = implicit_header_bit(name); implicit_headers_ & bit) {
+        return implicit_header_value(bit);
+    }
+    const Header* header = find_header(name);
+    return header ? header->value : "";
 }
 
 bool HttpResponse::has_header(const std::string& name) const {
-    std::string normalized_name = name;
-    normalize_header_name(normalized_name);
-    return headers_.find(normalized_name) != headers_.end();
+    return (implicit_headers_ & implicit_header_bit(name)) || find_header(name);
 }
 
 HttpResponse& HttpResponse::remove_header(const std::string& name) {
-    std::string normalized_name = name;
-    normalize_header_name(normalized_name);
-    headers_.erase(normalized_name);
+    implicit_headers_ &= static_cast<uint8_t>(~implicit_header_bit(name));
+    std::erase_if(headers_, [&name](const Header& header) {
+        return iequals(header.name, name);
+    });
     return *this;
 }
 
 HttpResponse& HttpResponse::set_body(const std::string& body) {
     body_content_ = body;
-    body_stream_ = std::make_shared<std::stringstream>(body_content_);
+    shared_body_.reset();
+    reset_body_stream();  // to_http_string() already carries the body
+    file_body_.reset();
     set_header("Content-Length", std::to_string(body_content_.size()));
     return *this;
 }
 
 HttpResponse& HttpResponse::set_body(std::string&& body) {
     body_content_ = std::move(body);
-    body_stream_ = std::make_shared<std::stringstream>(body_content_);
+    shared_body_.reset();
+    reset_body_stream();
+    file_body_.reset();
     set_header("Content-Length", std::to_string(body_content_.size()));
     return *this;
 }
 
+HttpResponse& HttpResponse::set_shared_body(std::shared_ptr<const std::string> body) {
+    body_content_.clear();
+    shared_body_ = std::move(body);
+    reset_body_stream();
+    file_body_.reset();
+    set_header("Content-Length", std::to_string(shared_body_ ? shared_body_->size() : 0));
+    return *this;
+}
+
+HttpResponse& HttpResponse::set_file_body(FileBody body) {
+    body_content_.clear();
+    shared_body_.reset();
+    reset_body_stream();
+    set_header("Content-Length", std::to_string(body.length));
+    file_body_ = std::move(body);
+    return *this;
+}
+
+HttpResponse& HttpResponse::set_body_stream(std::shared_ptr<std::istream> stream, std::optional<uint64_t> length) {
+    body_content_.clear();
+    shared_body_.reset();
+    file_body_.reset();
+    reset_body_stream();
+    body_stream_ = std::move(stream);
+    if (length) {
+        set_header("Content-Length", std::to_string(*length));
+    } else {
+        remove_header("Content-Length");
+        set_header("Transfer-Encoding", "chunked");
+    }
+    return *this;
+}
+
+HttpResponse& HttpResponse::set_stream_encoding(compression::Encoding encoding, int level) {
+    if (!body_stream_ || encoding == compression::Encoding::IDENTITY) {
+        return *this;
+    }
+    stream_encoding_ = encoding;
+    stream_level_ = level;
+    remove_header("Content-Length");
+    set_header("Transfer-Encoding", "chunked");
+    set_header("Content-Encoding", std::string(compression::encoding_name(encoding)));
+    return *this;
+}
+
+bool HttpResponse::is_chunked() const {
+    const Header* header = find_header("Transfer-Encoding");
+    return header && header->value.find("chunked") != std::string::npos;
+}
+
+void HttpResponse::reset_body_stream() {
+    if (!body_stream_) {
+        return;
+    }
+    body_stream_.reset();
+    if (stream_encoding_ != compression::Encoding::IDENTITY) {
+        stream_encoding_ = compression::Encoding::IDENTITY;
+        remove_header("Content-Encoding");
+    }
+    remove_header("Transfer-Encoding");
+}
+
+std::optional<FileBody> FileBody::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    
+    struct stat info {};
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    
+    FileBody body;
+    body.fd = std::shared_ptr<const int>(new int(fd), [](const int* descriptor) {
+        ::close(*descriptor);
+        delete descriptor;
+    });
+    body.length = static_cast<uint64_t>(info.st_size);
+    return body;
+}
+
 HttpResponse& HttpResponse::set_content_type(const std::string& content_type) {
     set_header("Content-Type", content_type);
     return *this;
 }
 
 HttpResponse& HttpResponse::set_json(const std::string& json_data) {
-    set_content_type("application/json; charset=utf-8");
+    set_content_type(CONTENT_TYPE_JSON);
     set_body(json_data);
     return *this;
 }
 
 HttpResponse& HttpResponse::set_html(const std::string& html_content) {
-    set_content_type("text/html; charset=utf-8");
+    set_content_type(CONTENT_TYPE_HTML);
     set_body(html_content);
     return *this;
 }
 
 HttpResponse& HttpResponse::set_text(const std::string& text_content) {
-    set_content_type("text/plain; charset=utf-8");
+    set_content_type(CONTENT_TYPE_TEXT);
     set_body(text_content);
     return *this;
 }
@@ -124,6 +374,8 @@ HttpResponse& HttpResponse::set_file_content(const std::string& file_path) {
                            std::istreambuf_iterator<char>());
         
         body_content_ = std::move(content);
+        shared_body_.reset();
+        file_body_.reset();
         set_header("Content-Length", std::to_string(body_content_.size()));
 
         // Get file extension for MIME type
@@ -149,6 +401,27 @@ HttpResponse& HttpResponse::set_keep_alive(bool keep_alive) {
     return *this;
 }
 
+bool HttpResponse::closes_connection() const {
+    std::string header = get_header("Connection");
+    std::string_view value = header;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view token = value.substr(0, comma);
+        size_t first = token.find_first_not_of(" \t");
+        if (first != std::string_view::npos) {
+            token = token.substr(first, token.find_last_not_of(" \t") - first + 1);
+            if (iequals(token, "close")) {
+                return true;
+            }
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
 HttpResponse& HttpResponse::set_cache_control(const std::string& cache_control) {
     set_header("Cache-Control", cache_control);
     return *this;
@@ -177,8 +450,8 @@ HttpResponse& HttpResponse::set_compressed_body(const std::string& body, const s
     return *this;
 }
 
-HttpResponse& HttpResponse::compress_body_if_supported(const std::string& accept_encoding) {
-    if (compression::supports_gzip(accept_encoding) && !body_content_.empty() && !is_compressed()) {
+HttpResponse& HttpResponse::compress_body_if_supported(std::string_view accept_encoding) {
+    if (compression::supports_gzip(accept_encoding) && !body().empty() && !is_compressed()) {
         // Check if content type is compressible (basic check)
         std::string content_type = get_header("Content-Type");
         if (content_type.find("text/") == 0 || 
@@ -187,9 +460,9 @@ HttpResponse& HttpResponse::compress_body_if_supported(const std::string& accept
             content_type.find("application/xml") == 0) {
             
             // Only compress if body is large enough (avoid overhead for small responses)
-            if (body_content_.size() >= 1024) {
-                std::string compressed = compression::gzip_compress(body_content_);
-                if (!compressed.empty() && compressed.size() < body_content_.size()) {
+            if (body().size() >= 1024) {
+                std::string compressed = compression::gzip_compress(body());
+                if (!compressed.empty() && compressed.size() < body().size()) {
                     set_body(compressed);
                     set_header("Content-Encoding", "gzip");
                 }
@@ -207,33 +480,70 @@ std::string HttpResponse::to_string() const {
     std::ostringstream oss;
     oss << "Status: " << static_cast<int>(status_) << " " << get_status_message(status_) << "\n";
     
+    for (uint8_t bit : {IMPLICIT_SERVER, IMPLICIT_DATE, IMPLICIT_CONTENT_LENGTH}) {
+        if (implicit_headers_ & bit) {
+            oss << (bit == IMPLICIT_SERVER ? "Server" : bit == IMPLICIT_DATE ? "Date" : "Content-Length")
+                << ": " << implicit_header_value(bit) << "\n";
+        }
+    }
     for (const auto& [name, value] : headers_) {
         oss << name << ": " << value << "\n";
     }
     
-    if (!body_content_.empty()) {
-        oss << "\nBody (" << body_content_.size() << " bytes):\n" << body_content_;
+    if (!body().empty()) {
+        oss << "\nBody (" << body().size() << " bytes):\n" << body();
     }
     
     return oss.str();
 }
 
 std::string HttpResponse::to_http_string() const {
-    std::ostringstream oss;
-    oss << version_ << " " << static_cast<int>(status_) << " " << get_status_message(status_) << "\r\n";
+    std::string out;
+    out.reserve(256 + body().size());
+    serialize_head(out);
+    out.append(body());
+    return out;
+}
+
+void HttpResponse::serialize_head(std::string& out) const {
+    if (auto line = status_line(status_); !line.empty()) {
+        out.append(line);
+    } else {
+        char status[8];
+        auto status_end = std::to_chars(status, status + sizeof(status), static_cast<int>(status_)).ptr;
+        out.append("HTTP/1.1 ").append(status, status_end).append(" ");
+        out.append(status_reason(status_)).append("\r\n");
+    }
     
+    if (implicit_headers_ & IMPLICIT_SERVER) {
+        out.append("Server: ").append(SERVER_NAME).append("\r\n");
+    }
+    if (implicit_headers_ & IMPLICIT_DATE) {
+        out.append("Date: ").append(current_http_date()).append("\r\n");
+    }
+    if (implicit_headers_ & IMPLICIT_CONTENT_LENGTH) {
+        out.append("Content-Length: 0\r\n");
+    }
     for (const auto& [name, value] : headers_) {
-        oss << name << ": " << value << "\r\n";
+        out.append(name).append(": ").append(value).append("\r\n");
     }
-    
-    oss << "\r\n";
-    
-    // Include the body content if available
-    if (!body_content_.empty()) {
-        oss << body_content_;
+    out.append("\r\n");
+}
+
+void HttpResponse::for_each_header(
+    const std::function<void(std::string_view name, std::string_view value)>& visit) const {
+    if (implicit_headers_ & IMPLICIT_SERVER) {
+        visit("Server", SERVER_NAME);
+    }
+    if (implicit_headers_ & IMPLICIT_DATE) {
+        visit("Date", current_http_date());
+    }
+    if (implicit_headers_ & IMPLICIT_CONTENT_LENGTH) {
+        visit("Content-Length", "0");
+    }
+    for (const auto& [name, value] : headers_) {
+        visit(name, value);
     }
-    
-    return oss.str();
 }
 
 HttpResponse HttpResponse::ok(const std::string& body) {
@@ -309,12 +619,17 @@ std::string HttpResponse::get_mime_type(const std::string& file_extension) {
 }
 
 std::string HttpResponse::get_status_message(HttpStatus status) {
+    return std::string(status_reason(status));
+}
+
+std::string_view HttpResponse::status_reason(HttpStatus status) {
     switch (status) {
         case HttpStatus::SWITCHING_PROTOCOLS: return "Switching Protocols";
         case HttpStatus::OK: return "OK";
         case HttpStatus::CREATED: return "Created";
         case HttpStatus::ACCEPTED: return "Accepted";
         case HttpStatus::NO_CONTENT: return "No Content";
+        case HttpStatus::PARTIAL_CONTENT: return "Partial Content";
         case HttpStatus::MOVED_PERMANENTLY: return "Moved Permanently";
         case HttpStatus::FOUND: return "Found";
         case HttpStatus::NOT_MODIFIED: return "Not Modified";
@@ -326,6 +641,7 @@ std::string HttpResponse::get_status_message(HttpStatus status) {
         case HttpStatus::CONFLICT: return "Conflict";
         case HttpStatus::LENGTH_REQUIRED: return "Length Required";
         case HttpStatus::PAYLOAD_TOO_LARGE: return "Payload Too Large";
+        case HttpStatus::RANGE_NOT_SATISFIABLE: return "Range Not Satisfiable";
         case HttpStatus::TOO_MANY_REQUESTS: return "Too Many Requests";
         case HttpStatus::INTERNAL_SERVER_ERROR: return "Internal Server Error";
         case HttpStatus::NOT_IMPLEMENTED: return "Not Implemented";
@@ -335,10 +651,20 @@ std::string HttpResponse::get_status_message(HttpStatus status) {
     }
 }
 
-void HttpResponse::set_default_headers() {
-    set_header("Server", "cpp-http-server/1.0");
-    set_header("Date", format_timestamp());
-    set_header("Content-Length", "0");
+std::string_view HttpResponse::current_http_date() {
+    struct DateCache {
+        std::time_t second{-1};
+        char text[32];
+        size_t length{0};
+    };
+    thread_local DateCache cache;
+    
+    std::time_t now = std::time(nullptr);
+    if (now != cache.second) {
+        cache.length = format_rfc1123(now, cache.text);
+        cache.second = now;
+    }
+    return {cache.text, cache.length};
 }
 
 void HttpResponse::normalize_header_name(std::string& name) const {
@@ -388,13 +714,14 @@ HttpResponse HttpResponse::conditional_file_response(const std::string& file_pat
     try {
         std::filesystem::path path(file_path);
         
-        if (!std::filesystem::exists(path)) {
+        auto file = FileBody::open(file_path);
+        if (!file) {
             return HttpResponse::not_found();
         }
         
         // Get file stats for Last-Modified and ETag generation
         auto file_time = std::filesystem::last_write_time(path);
-        auto file_size = std::filesystem::file_size(path);
+        auto file_size = file->length;
         
         // Generate ETag based on file path, size, and modification time
         // Use simple approach to avoid time conversion issues
@@ -429,15 +756,45 @@ HttpResponse HttpResponse::conditional_file_response(const std::string& file_pat
             // In a real implementation, you would parse if_modified_since and compare
         }
         
-        // File has been modified or no conditional headers - serve full file
-        HttpResponse response = file_response(file_path);
-        if (response.status() == HttpStatus::OK) {
-            response.set_etag(etag);  // set_etag will add quotes
-            response.set_last_modified(sctp);
-            // Set appropriate cache headers
-            response.set_cache_control("public, max-age=3600"); // Cache for 1 hour
+        // File has been modified or no conditional headers - serve the file
+        // straight from its descriptor
+        HttpResponse response(HttpStatus::OK);
+        std::string extension = path.extension().string();
+        if (!extension.empty() && extension[0] == '.') {
+            extension = extension.substr(1);
         }
+        response.set_content_type(get_mime_type(extension));
+        response.set_etag(etag);  // set_etag will add quotes
+        response.set_last_modified(sctp);
+        // Set appropriate cache headers
+        response.set_cache_control("public, max-age=3600"); // Cache for 1 hour
+        response.set_header("Accept-Ranges", "bytes");
         
+        // A Range is honoured unless If-Range names a different version
+        auto range = request.get_header("range");
+        auto if_range = request.get_header("if-range");
+        if (range && (!if_range || etag_matches("\"" + etag + "\"", *if_range))) {
+            uint64_t first = 0;
+            uint64_t last = 0;
+            switch (parse_byte_range(*range, file_size, first, last)) {
+                case ByteRange::SATISFIABLE:
+                    response.set_status(HttpStatus::PARTIAL_CONTENT);
+                    response.set_header("Content-Range", "bytes " + std::to_string(first) + "-" +
+                                        std::to_string(last) + "/" + std::to_string(file_size));
+                    file->offset = first;
+                    file->length = last - first + 1;
+                    break;
+                case ByteRange::UNSATISFIABLE:
+                    response.set_status(HttpStatus::RANGE_NOT_SATISFIABLE);
+                    response.set_header("Content-Range", "bytes */" + std::to_string(file_size));
+                    response.set_body("");
+                    return response;
+                case ByteRange::IGNORED:
+                    break;
+            }
+        }
+        
+        response.set_file_body(std::move(*file));
         return response;
         
     } catch (const std::exception&) {
@@ -477,11 +834,8 @@ std::string HttpResponse::generate_file_etag(const std::string& file_path) {
 }
 
 std::string HttpResponse::format_http_time(const std::chrono::system_clock::time_point& time) {
-    auto time_t = std::chrono::system_clock::to_time_t(time);
-    
-    std::ostringstream oss;
-    oss << std::put_time(std::gmtime(&time_t), "%a, %d %b %Y %H:%M:%S GMT");
-    return oss.str();
+    char text[32];
+    return std::string(text, format_rfc1123(std::chrono::system_clock::to_time_t(time), text));
 }
 
 std::chrono::system_clock::time_point HttpResponse::parse_http_time(const std::string& time_str) {
@@ -499,39 +853,32 @@ std::chrono::system_clock::time_point HttpResponse::parse_http_time(const std::s
     return now;
 }
 
-bool HttpResponse::etag_matches(const std::string& etag, const std::string& if_none_match) {
+bool HttpResponse::etag_matches(std::string_view etag, std::string_view if_none_match) {
     // Handle "*" which matches any ETag
     if (if_none_match == "*") {
         return true;
     }
     
-    // Parse multiple ETags separated by commas
-    std::istringstream iss(if_none_match);
-    std::string token;
+    // Weak comparison: ignore the W/ prefix on either side
+    auto strip_weak = [](std::string_view tag) {
+        return tag.starts_with("W/") ? tag.substr(2) : tag;
+    };
+    std::string_view clean_etag = strip_weak(etag);
     
-    while (std::getline(iss, token, ',')) {
-        // Trim whitespace
-        token.erase(0, token.find_first_not_of(" \t"));
-        token.erase(token.find_last_not_of(" \t") + 1);
-        
-        // Compare ETags (handle both weak and strong)
-        if (token == etag) {
-            return true;
-        }
-        
-        // Check if this is a weak ETag comparison
-        std::string clean_etag = etag;
-        std::string clean_token = token;
+    // Parse multiple ETags separated by commas
+    while (!if_none_match.empty()) {
+        size_t comma_pos = if_none_match.find(',');
+        std::string_view token = if_none_match.substr(0, comma_pos);
+        if_none_match = (comma_pos == std::string_view::npos) ? std::string_view{} : if_none_match.substr(comma_pos + 1);
         
-        // Remove W/ prefix if present
-        if (clean_etag.substr(0, 2) == "W/") {
-            clean_etag = clean_etag.substr(2);
-        }
-        if (clean_token.substr(0, 2) == "W/") {
-            clean_token = clean_token.substr(2);
+        // Trim whitespace
+        size_t first = token.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            continue;
         }
+        token = token.substr(first, token.find_last_not_of(" \t") - first + 1);
         
-        if (clean_token == clean_etag) {
+        if (token == etag || strip_weak(token) == clean_etag) {
             return true;
         }
     }
@@ -539,13 +886,4 @@ bool HttpResponse::etag_matches(const std::string& etag, const std::string& if_n
     return false;
 }
 
-std::string HttpResponse::format_timestamp() const {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    
-    std::ostringstream oss;
-    oss << std::put_time(std::gmtime(&time_t), "%a, %d %b %Y %H:%M:%S GMT");
-    return oss.str();
-}
-
 } // namespace http_server
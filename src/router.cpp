@@ -0,0 +1,210 @@
+/**
+ * @file router.cpp
+ * @brief Implementation of the Router class, a radix tree of route patterns.
+ */
+#include "router.hpp"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+
+namespace http_server {
+
+namespace {
+
+constexpr size_t METHOD_COUNT = static_cast<size_t>(HttpMethod::UNKNOWN) + 1;
+
+} // namespace
+
+struct Router::Node {
+    std::string prefix;                         // Literal bytes this node consumes
+    std::vector<std::unique_ptr<Node>> children; // Literal children, distinct first bytes
+    std::unique_ptr<Node> param;                // ":name" child, consumes one segment
+    std::string param_name;                     // Set on a param node
+    std::string wildcard_name;                  // Empty for a bare "*"
+    std::array<size_t, METHOD_COUNT> routes;    // Patterns ending here
+    std::array<size_t, METHOD_COUNT> wildcard_routes; // Patterns ending in "*" here
+
+    Node() {
+        routes.fill(NO_ROUTE);
+        wildcard_routes.fill(NO_ROUTE);
+    }
+
+    std::unique_ptr<Node> clone() const {
+        auto copy = std::make_unique<Node>();
+        copy->prefix = prefix;
+        copy->param_name = param_name;
+        copy->wildcard_name = wildcard_name;
+        copy->routes = routes;
+        copy->wildcard_routes = wildcard_routes;
+        copy->children.reserve(children.size());
+        for (const auto& child : children) {
+            copy->children.push_back(child->clone());
+        }
+        if (param) {
+            copy->param = param->clone();
+        }
+        return copy;
+    }
+
+    // Descends along text, splitting nodes where text diverges from them
+    Node* insert_literal(std::string_view text) {
+        Node* node = this;
+        while (!text.empty()) {
+            auto it = std::find_if(node->children.begin(), node->children.end(),
+                                   [&](const auto& child) { return child->prefix[0] == text[0]; });
+            if (it == node->children.end()) {
+                node->children.push_back(std::make_unique<Node>());
+                node->children.back()->prefix = std::string(text);
+                return node->children.back().get();
+            }
+
+            Node* child = it->get();
+            auto [prefix_end, text_end] = std::mismatch(child->prefix.begin(), child->prefix.end(),
+                                                        text.begin(), text.end());
+            size_t common = static_cast<size_t>(prefix_end - child->prefix.begin());
+            if (common < child->prefix.size()) {
+                auto split = std::make_unique<Node>();
+                split->prefix = child->prefix.substr(0, common);
+                child->prefix.erase(0, common);
+                split->children.push_back(std::move(*it));
+                *it = std::move(split);
+                child = it->get();
+            }
+            text.remove_prefix(common);
+            node = child;
+        }
+        return node;
+    }
+
+    bool match(std::string_view rest, size_t method, Params& params, size_t& id) const {
+        if (rest.empty() && routes[method] != NO_ROUTE) {
+            id = routes[method];
+            return true;
+        }
+
+        if (!rest.empty()) {
+            for (const auto& child : children) {
+                if (child->prefix[0] != rest[0]) {
+                    continue;
+                }
+                if (rest.starts_with(child->prefix) &&
+                    child->match(rest.substr(child->prefix.size()), method, params, id)) {
+                    return true;
+                }
+                break;
+            }
+
+            if (param && rest[0] != '/') {
+                std::string_view segment = rest.substr(0, rest.find('/'));
+                params.push_back({param->param_name, segment});
+                if (param->match(rest.substr(segment.size()), method, params, id)) {
+                    return true;
+                }
+                params.pop_back();
+            }
+        }
+
+        if (wildcard_routes[method] != NO_ROUTE) {
+            if (!wildcard_name.empty()) {
+                params.push_back({wildcard_name, rest});
+            }
+            id = wildcard_routes[method];
+            return true;
+        }
+        return false;
+    }
+};
+
+Router::Router()
+    : root_(std::make_unique<Node>()) {
+}
+
+Router::~Router() = default;
+Router::Router(Router&&) noexcept = default;
+Router& Router::operator=(Router&&) noexcept = default;
+
+Router::Router(const Router& other)
+    : root_(other.root_->clone()) {
+}
+
+Router& Router::operator=(const Router& other) {
+    if (this != &other) {
+        root_ = other.root_->clone();
+    }
+    return *this;
+}
+
+size_t Router::insert(HttpMethod method, std::string_view pattern, size_t id) {
+    auto slot = static_cast<size_t>(method);
+    if (pattern.empty() || pattern[0] != '/') {
+        throw std::invalid_argument("Route pattern must start with '/': " + std::string(pattern));
+    }
+
+    Node* node = root_.get();
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        if (pattern[pos] == '*') {
+            std::string_view name = pattern.substr(pos + 1);
+            if (name.find_first_of("/:*") != std::string_view::npos) {
+                throw std::invalid_argument("'*' must end a route pattern: " + std::string(pattern));
+            }
+            bool has_wildcard = std::any_of(node->wildcard_routes.begin(), node->wildcard_routes.end(),
+                                            [](size_t route) { return route != NO_ROUTE; });
+            if (has_wildcard && node->wildcard_name != name) {
+                throw std::invalid_argument("Route wildcard *" + std::string(name) + " conflicts with *" +
+                                            node->wildcard_name + " in: " + std::string(pattern));
+            }
+            if (node->wildcard_routes[slot] != NO_ROUTE) {
+                return node->wildcard_routes[slot];
+            }
+            node->wildcard_name = std::string(name);
+            node->wildcard_routes[slot] = id;
+            return id;
+        }
+
+        if (pattern[pos] == ':' && pattern[pos - 1] == '/') {
+            size_t end = std::min(pattern.find('/', pos), pattern.size());
+            std::string_view name = pattern.substr(pos + 1, end - pos - 1);
+            if (name.empty() || name.find('*') != std::string_view::npos) {
+                throw std::invalid_argument("Invalid route parameter in: " + std::string(pattern));
+            }
+            if (!node->param) {
+                node->param = std::make_unique<Node>();
+                node->param->param_name = std::string(name);
+            } else if (node->param->param_name != name) {
+                throw std::invalid_argument("Route parameter :" + std::string(name) + " conflicts with :" +
+                                            node->param->param_name + " in: " + std::string(pattern));
+            }
+            node = node->param.get();
+            pos = end;
+            continue;
+        }
+
+        // Literal run up to the next placeholder
+        size_t end = pos;
+        while (end < pattern.size() && pattern[end] != '*' &&
+               !(pattern[end] == ':' && pattern[end - 1] == '/')) {
+            ++end;
+        }
+        node = node->insert_literal(pattern.substr(pos, end - pos));
+        pos = end;
+    }
+
+    if (node->routes[slot] != NO_ROUTE) {
+        return node->routes[slot];
+    }
+    node->routes[slot] = id;
+    return id;
+}
+
+size_t Router::match(HttpMethod method, std::string_view path, Params& params) const {
+    params.clear();
+    size_t id = NO_ROUTE;
+    if (!root_->match(path, static_cast<size_t>(method), params, id)) {
+        params.clear();
+    }
+    return id;
+}
+
+} // namespace http_server
@@ -2,7 +2,7 @@
  * @file server.cpp
  * @brief Implementation of the Modern C++ HTTP Server core logic, including server lifecycle, configuration, routing, and statistics.
  *
- * This file contains the implementation of the HttpServer class, the ServerConfig struct, and the ThreadPool utility for request handling.
+ * This file contains the implementation of the HttpServer class and the ServerConfig struct.
  */
 #include "server.hpp"
 #include "compression.hpp"
@@ -12,59 +12,134 @@
 #include <iomanip>
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <exception>
 #include <filesystem>
+#include <limits>
 #include <thread>
+#include <boost/asio/co_spawn.hpp>
 #include <nlohmann/json.hpp>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace http_server {
 
-// ThreadPool implementation
-ThreadPool::ThreadPool(size_t thread_count) {
-    for (size_t i = 0; i < thread_count; ++i) {
-        workers_.emplace_back([this] {
-            while (true) {
-                std::function<void()> task;
-                
-                {
-                    std::unique_lock<std::mutex> lock(queue_mutex_);
-                    condition_.wait(lock, [this] { return stop_.load() || !tasks_.empty(); });
-                    
-                    if (stop_.load() && tasks_.empty()) {
-                        return;
-                    }
-                    
-                    task = std::move(tasks_.front());
-                    tasks_.pop();
-                }
-                
-                task();
-            }
-        });
+namespace {
+
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+constexpr auto LOAD_PROBE_INTERVAL = std::chrono::milliseconds(10);
+
+// Written straight to connections over max_connections, before reading anything
+constexpr std::string_view CONNECTION_LIMIT_RESPONSE =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// Built once; copies share the body
+HttpResponse overload_response() {
+    static const HttpResponse response = [] {
+        HttpResponse prototype(HttpStatus::SERVICE_UNAVAILABLE);
+        prototype.set_header("Retry-After", "1");
+        prototype.set_content_type("text/plain");
+        prototype.set_shared_body(std::make_shared<const std::string>("Service overloaded, retry later\n"));
+        return prototype;
+    }();
+    return response;
+}
+
+// Best effort and never blocking: a client that is not reading just sees the close
+void reject_connection(boost::asio::ip::tcp::socket& socket, bool plaintext) {
+    boost::system::error_code ec;
+    if (plaintext) {
+        socket.non_blocking(true, ec);
+        socket.write_some(boost::asio::buffer(CONNECTION_LIMIT_RESPONSE), ec);
     }
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    socket.close(ec);
 }
 
-ThreadPool::~ThreadPool() {
-    shutdown();
+// Prefers h2; clients offering neither protocol get no ALPN answer and
+// are served HTTP/1.1
+int select_alpn_protocol(SSL*, const unsigned char** out, unsigned char* outlen,
+                         const unsigned char* in, unsigned int inlen, void*) {
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, protocols, sizeof(protocols) - 1, in, inlen) !=
+        OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
 }
 
-void ThreadPool::shutdown() {
-    stop_.store(true);
-    condition_.notify_all();
-    
-    for (std::thread& worker : workers_) {
-        if (worker.joinable()) {
-            worker.join();
-        }
+std::string reactor_mode_to_string(ReactorMode mode) {
+    switch (mode) {
+        case ReactorMode::PER_CORE: return "per_core";
+        default: return "shared";
     }
-    
-    workers_.clear();
 }
 
-size_t ThreadPool::pending_tasks() const {
-    std::unique_lock<std::mutex> lock(queue_mutex_);
-    return tasks_.size();
+ReactorMode string_to_reactor_mode(const std::string& mode) {
+    if (mode == "per_core") return ReactorMode::PER_CORE;
+    if (mode == "shared") return ReactorMode::SHARED;
+    throw std::runtime_error("Unknown reactor_mode: " + mode);
 }
 
+std::string log_overflow_to_string(LogOverflowPolicy policy) {
+    switch (policy) {
+        case LogOverflowPolicy::BLOCK: return "block";
+        default: return "drop";
+    }
+}
+
+LogOverflowPolicy string_to_log_overflow(const std::string& policy) {
+    if (policy == "block") return LogOverflowPolicy::BLOCK;
+    if (policy == "drop") return LogOverflowPolicy::DROP;
+    throw std::runtime_error("Unknown log_overflow: " + policy);
+}
+
+std::string slow_consumer_to_string(SlowConsumerPolicy policy) {
+    switch (policy) {
+        case SlowConsumerPolicy::DISCONNECT: return "disconnect";
+        default: return "skip";
+    }
+}
+
+SlowConsumerPolicy string_to_slow_consumer(const std::string& policy) {
+    if (policy == "disconnect") return SlowConsumerPolicy::DISCONNECT;
+    if (policy == "skip") return SlowConsumerPolicy::SKIP;
+    throw std::runtime_error("Unknown websocket_slow_consumer: " + policy);
+}
+
+WebSocketDeflateOptions deflate_options(const ServerConfig& config) {
+    WebSocketDeflateOptions options = config.websocket_deflate;
+    options.level = config.compression_level;
+    return options;
+}
+
+void pin_thread_to_cpu(std::thread& thread, size_t index) {
+#ifdef __linux__
+    unsigned int cpu_count = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(index % cpu_count, &cpuset);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset) != 0) {
+        std::cerr << "Failed to pin reactor thread " << index << " to a CPU" << std::endl;
+    }
+#else
+    (void)thread;
+    (void)index;
+#endif
+}
+
+} // namespace
+
 // ServerConfig implementation
 ServerConfig ServerConfig::from_json(const std::string& config_file) {
     std::ifstream file(config_file);
@@ -85,13 +160,31 @@ ServerConfig ServerConfig::from_json_string(const std::string& json_str) {
     if (json.contains("host")) config.host = json["host"];
     if (json.contains("port")) config.port = json["port"];
     if (json.contains("thread_pool_size")) config.thread_pool_size = json["thread_pool_size"];
+    if (json.contains("worker_pool_size")) config.worker_pool_size = json["worker_pool_size"];
+    if (json.contains("reactor_mode")) config.reactor_mode = string_to_reactor_mode(json["reactor_mode"]);
+    if (json.contains("pin_reactor_threads")) config.pin_reactor_threads = json["pin_reactor_threads"];
     if (json.contains("document_root")) config.document_root = json["document_root"];
     if (json.contains("max_connections")) config.max_connections = json["max_connections"];
     if (json.contains("keep_alive_timeout")) config.keep_alive_timeout = std::chrono::seconds(json["keep_alive_timeout"]);
+    if (json.contains("websocket_ping_interval")) config.websocket_ping_interval = std::chrono::seconds(json["websocket_ping_interval"]);
+    if (json.contains("websocket_timeout")) config.websocket_timeout = std::chrono::seconds(json["websocket_timeout"]);
     if (json.contains("max_request_size")) config.max_request_size = json["max_request_size"];
+    if (json.contains("max_upload_size")) config.max_upload_size = json["max_upload_size"];
     if (json.contains("enable_logging")) config.enable_logging = json["enable_logging"];
     if (json.contains("log_file")) config.log_file = json["log_file"];
+    if (json.contains("log_buffer_records")) config.log_buffer_records = json["log_buffer_records"];
+    if (json.contains("log_overflow")) config.log_overflow = string_to_log_overflow(json["log_overflow"]);
+    if (json.contains("log_flush_interval_ms")) config.log_flush_interval = std::chrono::milliseconds(json["log_flush_interval_ms"]);
+    if (json.contains("enable_metrics")) config.enable_metrics = json["enable_metrics"];
+    if (json.contains("enable_load_shedding")) config.enable_load_shedding = json["enable_load_shedding"];
+    if (json.contains("load_shedding_target_ms")) config.load_shedding_target = std::chrono::milliseconds(json["load_shedding_target_ms"]);
+    if (json.contains("load_shedding_interval_ms")) config.load_shedding_interval = std::chrono::milliseconds(json["load_shedding_interval_ms"]);
     if (json.contains("serve_static_files")) config.serve_static_files = json["serve_static_files"];
+    if (json.contains("enable_file_cache")) config.enable_file_cache = json["enable_file_cache"];
+    if (json.contains("file_cache_size")) config.file_cache_size = json["file_cache_size"];
+    if (json.contains("file_cache_max_file_size")) config.file_cache_max_file_size = json["file_cache_max_file_size"];
+    if (json.contains("file_cache_watch")) config.file_cache_watch = json["file_cache_watch"];
+    if (json.contains("file_cache_revalidate_interval")) config.file_cache_revalidate_interval = std::chrono::seconds(json["file_cache_revalidate_interval"]);
     
     if (json.contains("index_files")) {
         config.index_files.clear();
@@ -104,6 +197,8 @@ ServerConfig ServerConfig::from_json_string(const std::string& json_str) {
     if (json.contains("enable_compression")) config.enable_compression = json["enable_compression"];
     if (json.contains("compression_min_size")) config.compression_min_size = json["compression_min_size"];
     if (json.contains("compression_level")) config.compression_level = json["compression_level"];
+    if (json.contains("compression_cache_size")) config.compression_cache_size = json["compression_cache_size"];
+    if (json.contains("serve_precompressed")) config.serve_precompressed = json["serve_precompressed"];
     
     if (json.contains("compressible_types")) {
         config.compressible_types.clear();
@@ -112,6 +207,21 @@ ServerConfig ServerConfig::from_json_string(const std::string& json_str) {
         }
     }
     
+    if (json.contains("websocket_high_water_mark")) config.websocket_high_water_mark = json["websocket_high_water_mark"];
+    if (json.contains("websocket_slow_consumer")) {
+        config.websocket_slow_consumer = string_to_slow_consumer(json["websocket_slow_consumer"]);
+    }
+    auto& deflate = config.websocket_deflate;
+    if (json.contains("websocket_deflate")) deflate.enabled = json["websocket_deflate"];
+    if (json.contains("websocket_deflate_server_context_takeover")) deflate.server_context_takeover = json["websocket_deflate_server_context_takeover"];
+    if (json.contains("websocket_deflate_client_context_takeover")) deflate.client_context_takeover = json["websocket_deflate_client_context_takeover"];
+    if (json.contains("websocket_deflate_server_window_bits")) deflate.server_max_window_bits = json["websocket_deflate_server_window_bits"];
+    if (json.contains("websocket_deflate_client_window_bits")) deflate.client_max_window_bits = json["websocket_deflate_client_window_bits"];
+    if (json.contains("websocket_deflate_min_size")) deflate.min_size = json["websocket_deflate_min_size"];
+    if (deflate.server_max_window_bits < 9 || deflate.server_max_window_bits > 15 ||
+        deflate.client_max_window_bits < 8 || deflate.client_max_window_bits > 15) {
+        throw std::runtime_error("websocket_deflate window bits must be 9-15 (server) and 8-15 (client)");
+    }
     if (json.contains("mime_types")) {
         for (const auto& [ext, mime] : json["mime_types"].items()) {
             config.mime_types[ext] = mime;
@@ -127,6 +237,12 @@ ServerConfig ServerConfig::from_json_string(const std::string& json_str) {
     if (json.contains("ssl_dh_file")) config.ssl_dh_file = json["ssl_dh_file"];
     if (json.contains("ssl_verify_client")) config.ssl_verify_client = json["ssl_verify_client"];
     if (json.contains("ssl_cipher_list")) config.ssl_cipher_list = json["ssl_cipher_list"];
+    if (json.contains("ssl_session_cache_size")) config.ssl_session_cache_size = json["ssl_session_cache_size"];
+    if (json.contains("ssl_session_timeout")) config.ssl_session_timeout = std::chrono::seconds(json["ssl_session_timeout"]);
+    if (json.contains("ssl_session_tickets")) config.ssl_session_tickets = json["ssl_session_tickets"];
+    if (json.contains("ssl_ticket_key_rotation")) config.ssl_ticket_key_rotation = std::chrono::seconds(json["ssl_ticket_key_rotation"]);
+    if (json.contains("ssl_ktls")) config.ssl_ktls = json["ssl_ktls"];
+    if (json.contains("enable_http2")) config.enable_http2 = json["enable_http2"];
     
     return config;
 }
@@ -137,18 +253,46 @@ nlohmann::json ServerConfig::to_json() const {
     json["host"] = host;
     json["port"] = port;
     json["thread_pool_size"] = thread_pool_size;
+    json["worker_pool_size"] = worker_pool_size;
+    json["reactor_mode"] = reactor_mode_to_string(reactor_mode);
+    json["pin_reactor_threads"] = pin_reactor_threads;
     json["document_root"] = document_root;
     json["max_connections"] = max_connections;
     json["keep_alive_timeout"] = keep_alive_timeout.count();
+    json["websocket_ping_interval"] = websocket_ping_interval.count();
+    json["websocket_timeout"] = websocket_timeout.count();
     json["max_request_size"] = max_request_size;
+    json["max_upload_size"] = max_upload_size;
     json["enable_logging"] = enable_logging;
     json["log_file"] = log_file;
+    json["log_buffer_records"] = log_buffer_records;
+    json["log_overflow"] = log_overflow_to_string(log_overflow);
+    json["log_flush_interval_ms"] = log_flush_interval.count();
+    json["enable_metrics"] = enable_metrics;
+    json["enable_load_shedding"] = enable_load_shedding;
+    json["load_shedding_target_ms"] = load_shedding_target.count();
+    json["load_shedding_interval_ms"] = load_shedding_interval.count();
     json["serve_static_files"] = serve_static_files;
     json["index_files"] = index_files;
+    json["enable_file_cache"] = enable_file_cache;
+    json["file_cache_size"] = file_cache_size;
+    json["file_cache_max_file_size"] = file_cache_max_file_size;
+    json["file_cache_watch"] = file_cache_watch;
+    json["file_cache_revalidate_interval"] = file_cache_revalidate_interval.count();
     json["enable_compression"] = enable_compression;
     json["compression_min_size"] = compression_min_size;
     json["compression_level"] = compression_level;
     json["compressible_types"] = compressible_types;
+    json["compression_cache_size"] = compression_cache_size;
+    json["serve_precompressed"] = serve_precompressed;
+    json["websocket_high_water_mark"] = websocket_high_water_mark;
+    json["websocket_slow_consumer"] = slow_consumer_to_string(websocket_slow_consumer);
+    json["websocket_deflate"] = websocket_deflate.enabled;
+    json["websocket_deflate_server_context_takeover"] = websocket_deflate.server_context_takeover;
+    json["websocket_deflate_client_context_takeover"] = websocket_deflate.client_context_takeover;
+    json["websocket_deflate_server_window_bits"] = websocket_deflate.server_max_window_bits;
+    json["websocket_deflate_client_window_bits"] = websocket_deflate.client_max_window_bits;
+    json["websocket_deflate_min_size"] = websocket_deflate.min_size;
     json["mime_types"] = mime_types;
     
     // HTTPS configuration
@@ -160,6 +304,12 @@ nlohmann::json ServerConfig::to_json() const {
     json["ssl_dh_file"] = ssl_dh_file;
     json["ssl_verify_client"] = ssl_verify_client;
     json["ssl_cipher_list"] = ssl_cipher_list;
+    json["ssl_session_cache_size"] = ssl_session_cache_size;
+    json["ssl_session_timeout"] = ssl_session_timeout.count();
+    json["ssl_session_tickets"] = ssl_session_tickets;
+    json["ssl_ticket_key_rotation"] = ssl_ticket_key_rotation.count();
+    json["ssl_ktls"] = ssl_ktls;
+    json["enable_http2"] = enable_http2;
     
     return json;
 }
@@ -167,18 +317,26 @@ nlohmann::json ServerConfig::to_json() const {
 // HttpServer implementation
 HttpServer::HttpServer(const ServerConfig& config)
     : config_(config)
-    , acceptor_(io_context_)
-    , thread_pool_(std::make_unique<ThreadPool>(config_.thread_pool_size)) {
+    , work_pool_(std::make_unique<WorkStealingPool>(config_.worker_pool_size))
+    , websocket_hub_(config_.websocket_high_water_mark, config_.websocket_slow_consumer, deflate_options(config_))
+    , admission_(config_.enable_load_shedding, config_.load_shedding_target, config_.load_shedding_interval) {
     
     // Initialize HTTPS if enabled
     if (config_.enable_https) {
-        https_acceptor_ = std::make_unique<boost::asio::ip::tcp::acceptor>(io_context_);
         ssl_context_ = std::make_unique<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12);
         initialize_ssl_context();
     }
     
     initialize_mime_types();
-    stats_.start_time = std::chrono::steady_clock::now();
+    configure_file_cache();
+    if (config_.enable_metrics) {
+        metrics_ = std::make_unique<ServerMetrics>();
+    }
+    if (config_.enable_logging) {
+        access_log_ = std::make_unique<AccessLog>(config_.log_file, config_.log_buffer_records,
+                                                  config_.log_overflow, config_.log_flush_interval);
+    }
+    start_time_ = std::chrono::steady_clock::now();
 }
 
 HttpServer::~HttpServer() {
@@ -191,31 +349,10 @@ void HttpServer::start() {
     }
     
     try {
-        // Setup HTTP endpoint
-        boost::asio::ip::tcp::endpoint endpoint(
-            boost::asio::ip::address::from_string(config_.host),
-            config_.port
-        );
-        
-        acceptor_.open(endpoint.protocol());
-        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-        acceptor_.bind(endpoint);
-        acceptor_.listen();
+        create_reactors();
         
         std::cout << "HTTP Server starting on " << config_.host << ":" << config_.port << std::endl;
-        
-        // Setup HTTPS endpoint if enabled
-        if (config_.enable_https && https_acceptor_) {
-            boost::asio::ip::tcp::endpoint https_endpoint(
-                boost::asio::ip::address::from_string(config_.host),
-                config_.https_port
-            );
-            
-            https_acceptor_->open(https_endpoint.protocol());
-            https_acceptor_->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-            https_acceptor_->bind(https_endpoint);
-            https_acceptor_->listen();
-            
+        if (config_.enable_https && ssl_context_) {
             std::cout << "HTTPS Server starting on " << config_.host << ":" << config_.https_port << std::endl;
         }
         
@@ -223,22 +360,35 @@ void HttpServer::start() {
         
         std::cout << "Document root: " << config_.document_root << std::endl;
         std::cout << "Thread pool size: " << config_.thread_pool_size << std::endl;
-        
-        accept_connections();
-        if (config_.enable_https && https_acceptor_) {
-            accept_ssl_connections();
+        std::cout << "Worker pool size: " << work_pool_->size() << std::endl;
+        std::cout << "Reactor mode: " << reactor_mode_to_string(config_.reactor_mode)
+                  << " (" << reactors_.size() << " reactor(s))" << std::endl;
+        if (file_cache_) {
+            std::cout << "Static file cache: " << config_.file_cache_size / (1024 * 1024) << " MB"
+                      << (file_cache_->is_watching() ? " (inotify)" : " (revalidating)") << std::endl;
         }
         
-        // Run the io_context in a separate thread
-        auto io_thread = std::thread([this]() {
-            io_context_.run();
-        });
+        for (auto& reactor : reactors_) {
+            probe_reactor(*reactor);
+            reactor->timers.start();
+            accept_connections(*reactor);
+            if (reactor->https_acceptor && ktls_) {
+                accept_ktls_connections(*reactor);
+            } else if (reactor->https_acceptor) {
+                accept_ssl_connections(*reactor);
+            }
+        }
         
-        io_thread.join();
+        // Blocks until stop() is called
+        run_reactors();
         
     } catch (const std::exception& e) {
         std::cerr << "Server start error: " << e.what() << std::endl;
         running_.store(false);
+        {
+            std::lock_guard<std::mutex> lock(reactors_mutex_);
+            reactors_.clear();
+        }
         throw;
     }
 }
@@ -250,41 +400,195 @@ void HttpServer::stop() {
     
     running_.store(false);
     
-    boost::system::error_code ec;
-    acceptor_.close(ec);
-    io_context_.stop();
+    // Acceptors are closed by run_reactors() once the I/O threads have exited,
+    // so they are never touched concurrently with a pending accept.
+    {
+        std::lock_guard<std::mutex> lock(reactors_mutex_);
+        for (auto& reactor : reactors_) {
+            reactor->io_context.stop();
+        }
+    }
     
-    thread_pool_->shutdown();
+    work_pool_->shutdown();
     
     std::cout << "HTTP Server stopped" << std::endl;
 }
 
-void HttpServer::add_route(const std::string& path, HttpMethod method, RequestHandler handler) {
-    routes_[{path, method}] = std::move(handler);
+void HttpServer::create_reactors() {
+    size_t thread_count = std::max<size_t>(1, config_.thread_pool_size);
+    bool per_core = config_.reactor_mode == ReactorMode::PER_CORE;
+    size_t reactor_count = per_core ? thread_count : 1;
+    int concurrency_hint = per_core ? 1 : static_cast<int>(thread_count);
+    
+    std::lock_guard<std::mutex> lock(reactors_mutex_);
+    reactors_.clear();
+    admission_.set_reactor_count(reactor_count);
+    for (size_t i = 0; i < reactor_count; ++i) {
+        auto reactor = std::make_unique<Reactor>(concurrency_hint, i);
+        
+        reactor->acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(reactor->io_context);
+        open_acceptor(*reactor->acceptor, config_.port, per_core);
+        
+        if (config_.enable_https && ssl_context_) {
+            reactor->https_acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(reactor->io_context);
+            open_acceptor(*reactor->https_acceptor, config_.https_port, per_core);
+        }
+        
+        reactors_.push_back(std::move(reactor));
+    }
+}
+
+void HttpServer::open_acceptor(boost::asio::ip::tcp::acceptor& acceptor, uint16_t port, bool reuse_port_enabled) {
+    boost::asio::ip::tcp::endpoint endpoint(
+        boost::asio::ip::address::from_string(config_.host),
+        port
+    );
+    
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    if (reuse_port_enabled) {
+        acceptor.set_option(reuse_port(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+}
+
+void HttpServer::run_reactors() {
+    size_t thread_count = std::max<size_t>(1, config_.thread_pool_size);
+    
+    io_threads_.clear();
+    for (size_t i = 0; i < thread_count; ++i) {
+        auto& reactor = *reactors_[i % reactors_.size()];
+        io_threads_.emplace_back([&reactor]() {
+            reactor.io_context.run();
+        });
+        
+        if (config_.pin_reactor_threads) {
+            pin_thread_to_cpu(io_threads_.back(), i);
+        }
+    }
+    
+    for (auto& thread : io_threads_) {
+        thread.join();
+    }
+    io_threads_.clear();
+    
+    // Subscriptions refer to the loops that are about to go away
+    websocket_hub_.clear();
+    
+    std::lock_guard<std::mutex> lock(reactors_mutex_);
+    for (auto& reactor : reactors_) {
+        boost::system::error_code ec;
+        reactor->acceptor->close(ec);
+        if (reactor->https_acceptor) {
+            reactor->https_acceptor->close(ec);
+        }
+    }
+    reactors_.clear();
 }
 
-void HttpServer::add_get_route(const std::string& path, RequestHandler handler) {
-    add_route(path, HttpMethod::GET, std::move(handler));
+boost::asio::any_io_executor HttpServer::connection_executor(Reactor& reactor) {
+    // A reactor driven by several threads needs a strand per connection so
+    // that a connection's handlers never run concurrently.
+    if (config_.reactor_mode == ReactorMode::SHARED && config_.thread_pool_size > 1) {
+        return boost::asio::make_strand(reactor.io_context);
+    }
+    return reactor.io_context.get_executor();
 }
 
-void HttpServer::add_post_route(const std::string& path, RequestHandler handler) {
-    add_route(path, HttpMethod::POST, std::move(handler));
+void HttpServer::probe_reactor(Reactor& reactor) {
+    // How late the timer fires is how long a ready handler waits for the loop
+    reactor.load_probe.expires_after(LOAD_PROBE_INTERVAL);
+    reactor.load_probe.async_wait([this, &reactor](const boost::system::error_code& error) {
+        if (error) {
+            return;
+        }
+        admission_.record_reactor_delay(reactor.index,
+                                        std::chrono::steady_clock::now() - reactor.load_probe.expiry());
+        probe_reactor(reactor);
+    });
 }
 
-void HttpServer::add_put_route(const std::string& path, RequestHandler handler) {
-    add_route(path, HttpMethod::PUT, std::move(handler));
+bool HttpServer::admit_connection() const noexcept {
+    return config_.max_connections == 0 ||
+           counters_.sum(ServerCounters::ACTIVE_CONNECTIONS) < config_.max_connections;
 }
 
-void HttpServer::add_delete_route(const std::string& path, RequestHandler handler) {
-    add_route(path, HttpMethod::DELETE, std::move(handler));
+void HttpServer::add_route(const std::string& path, HttpMethod method, RequestHandler handler,
+                           RouteOptions options) {
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto& table = pending_routes_;
+    size_t id = table.router.insert(method, path, table.routes.size());
+    auto metrics = metrics_ ? metrics_->route(HttpRequest::method_to_string(method) + " " + path) : nullptr;
+    if (id == table.routes.size()) {
+        table.routes.push_back(Route{std::move(handler), options, std::move(metrics)});
+    } else {
+        table.routes[id] = Route{std::move(handler), options, std::move(metrics)};
+    }
+    routes_changed_.store(true, std::memory_order_release);
 }
 
-void HttpServer::add_patch_route(const std::string& path, RequestHandler handler) {
-    add_route(path, HttpMethod::PATCH, std::move(handler));
+void HttpServer::add_streaming_route(const std::string& path, HttpMethod method, StreamingHandler handler,
+                                     RouteOptions options) {
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto& table = pending_routes_;
+    size_t id = table.router.insert(method, path, table.routes.size());
+    auto metrics = metrics_ ? metrics_->route(HttpRequest::method_to_string(method) + " " + path) : nullptr;
+    Route route{nullptr, options, std::move(metrics), std::move(handler)};
+    if (id == table.routes.size()) {
+        table.routes.push_back(std::move(route));
+    } else {
+        table.routes[id] = std::move(route);
+    }
+    table.streaming = true;
+    routes_changed_.store(true, std::memory_order_release);
+}
+
+void HttpServer::add_async_route(const std::string& path, HttpMethod method, AsyncHandler handler,
+                                 RouteOptions options) {
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto& table = pending_routes_;
+    size_t id = table.router.insert(method, path, table.routes.size());
+    auto metrics = metrics_ ? metrics_->route(HttpRequest::method_to_string(method) + " " + path) : nullptr;
+    Route route{nullptr, options, std::move(metrics), nullptr, std::move(handler)};
+    if (id == table.routes.size()) {
+        table.routes.push_back(std::move(route));
+    } else {
+        table.routes[id] = std::move(route);
+    }
+    routes_changed_.store(true, std::memory_order_release);
+}
+
+void HttpServer::add_get_route(const std::string& path, RequestHandler handler, RouteOptions options) {
+    add_route(path, HttpMethod::GET, std::move(handler), options);
+}
+
+void HttpServer::add_post_route(const std::string& path, RequestHandler handler, RouteOptions options) {
+    add_route(path, HttpMethod::POST, std::move(handler), options);
+}
+
+void HttpServer::add_put_route(const std::string& path, RequestHandler handler, RouteOptions options) {
+    add_route(path, HttpMethod::PUT, std::move(handler), options);
+}
+
+void HttpServer::add_delete_route(const std::string& path, RequestHandler handler, RouteOptions options) {
+    add_route(path, HttpMethod::DELETE, std::move(handler), options);
+}
+
+void HttpServer::add_patch_route(const std::string& path, RequestHandler handler, RouteOptions options) {
+    add_route(path, HttpMethod::PATCH, std::move(handler), options);
 }
 
 void HttpServer::add_websocket_route(const std::string& path, WebSocketHandler handler) {
-    websocket_routes_[path] = std::move(handler);
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto& table = pending_routes_;
+    size_t id = table.websocket_router.insert(HttpMethod::GET, path, table.websocket_handlers.size());
+    if (id == table.websocket_handlers.size()) {
+        table.websocket_handlers.push_back(std::move(handler));
+    } else {
+        table.websocket_handlers[id] = std::move(handler);
+    }
+    routes_changed_.store(true, std::memory_order_release);
 }
 
 void HttpServer::add_middleware(MiddlewareHandler middleware) {
@@ -294,6 +598,7 @@ void HttpServer::add_middleware(MiddlewareHandler middleware) {
 void HttpServer::enable_static_files(const std::string& document_root) {
     config_.serve_static_files = true;
     config_.document_root = document_root;
+    configure_file_cache();
 }
 
 void HttpServer::disable_static_files() {
@@ -302,70 +607,396 @@ void HttpServer::disable_static_files() {
 
 void HttpServer::update_config(const ServerConfig& new_config) {
     config_ = new_config;
+    configure_file_cache();
+}
+
+void HttpServer::configure_file_cache() {
+    compression_cache_.reset();
+    if (config_.enable_compression && config_.compression_cache_size > 0) {
+        compression_cache_ = std::make_unique<CompressionCache>(config_.compression_cache_size);
+    }
+    
+    if (!config_.enable_file_cache || !config_.serve_static_files) {
+        file_cache_.reset();
+        return;
+    }
+    
+    file_cache_ = std::make_unique<StaticFileCache>(config_.file_cache_size,
+                                                    config_.file_cache_max_file_size,
+                                                    config_.file_cache_revalidate_interval,
+                                                    config_.enable_compression && config_.serve_precompressed);
+    if (config_.file_cache_watch) {
+        file_cache_->watch(config_.document_root);
+    }
+}
+
+HttpServer::Statistics HttpServer::stats() const noexcept {
+    Statistics stats;
+    stats.total_requests = counters_.sum(ServerCounters::TOTAL_REQUESTS);
+    stats.active_connections = counters_.sum(ServerCounters::ACTIVE_CONNECTIONS);
+    stats.total_connections = counters_.sum(ServerCounters::TOTAL_CONNECTIONS);
+    stats.active_websockets = counters_.sum(ServerCounters::ACTIVE_WEBSOCKETS);
+    stats.total_websockets = counters_.sum(ServerCounters::TOTAL_WEBSOCKETS);
+    stats.bytes_sent = counters_.sum(ServerCounters::BYTES_SENT);
+    stats.bytes_received = counters_.sum(ServerCounters::BYTES_RECEIVED);
+    stats.rate_limited_requests = counters_.sum(ServerCounters::RATE_LIMITED_REQUESTS);
+    stats.tls_handshakes = counters_.sum(ServerCounters::TLS_HANDSHAKES);
+    stats.tls_resumed = counters_.sum(ServerCounters::TLS_RESUMED);
+    stats.http2_connections = counters_.sum(ServerCounters::HTTP2_CONNECTIONS);
+    stats.rejected_connections = counters_.sum(ServerCounters::REJECTED_CONNECTIONS);
+    stats.shed_requests = counters_.sum(ServerCounters::SHED_REQUESTS);
+    stats.start_time = start_time_;
+    return stats;
 }
 
 std::string HttpServer::stats_json() const {
     nlohmann::json json;
+    auto stats = this->stats();
+    
+    json["total_requests"] = stats.total_requests;
+    json["active_connections"] = stats.active_connections;
+    json["total_connections"] = stats.total_connections;
+    json["bytes_sent"] = stats.bytes_sent;
+    json["bytes_received"] = stats.bytes_received;
+    json["active_websockets"] = stats.active_websockets;
+    json["total_websockets"] = stats.total_websockets;
+    json["broadcast_skipped"] = websocket_hub_.skipped();
+    json["broadcast_disconnected"] = websocket_hub_.disconnected();
+    json["tls_handshakes"] = stats.tls_handshakes;
+    json["tls_resumed"] = stats.tls_resumed;
+    json["http2_connections"] = stats.http2_connections;
+    json["rejected_connections"] = stats.rejected_connections;
+    json["shed_requests"] = stats.shed_requests;
     
-    json["total_requests"] = stats_.total_requests.load();
-    json["active_connections"] = stats_.active_connections.load();
-    json["total_connections"] = stats_.total_connections.load();
-    json["bytes_sent"] = stats_.bytes_sent.load();
-    json["bytes_received"] = stats_.bytes_received.load();
+    auto load = admission_.signals();
+    json["load"] = {
+        {"reactor_delay_us", load.reactor_delay.count()},
+        {"queue_delay_us", load.queue_delay.count()},
+        {"handler_latency_us", load.handler_latency.count()},
+        {"overloaded", load.overloaded}
+    };
     
-    auto uptime = std::chrono::steady_clock::now() - stats_.start_time;
+    auto uptime = std::chrono::steady_clock::now() - stats.start_time;
     auto uptime_seconds = std::chrono::duration_cast<std::chrono::seconds>(uptime).count();
     json["uptime_seconds"] = uptime_seconds;
     
+    if (metrics_) {
+        json["latency"] = metrics_->to_json();
+    }
+    
     return json.dump(2);
 }
 
-void HttpServer::accept_connections() {
-    auto socket = std::make_shared<boost::asio::ip::tcp::socket>(io_context_);
+std::string HttpServer::metrics_text() const {
+    std::string out;
+    auto counter = [&out](const char* name, const char* type, const char* help, uint64_t value) {
+        out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+        out.append(name).append(" ").append(std::to_string(value)).append("\n");
+    };
+    
+    auto stats = this->stats();
+    counter("http_requests_total", "counter", "Requests received", stats.total_requests);
+    counter("http_connections_total", "counter", "Connections accepted", stats.total_connections);
+    counter("http_connections_active", "gauge", "Connections currently open", stats.active_connections);
+    counter("websocket_connections_total", "counter", "WebSocket connections upgraded", stats.total_websockets);
+    counter("websocket_connections_active", "gauge", "WebSocket connections currently open",
+            stats.active_websockets);
+    counter("websocket_broadcast_skipped_total", "counter", "Broadcast messages left out for slow subscribers",
+            websocket_hub_.skipped());
+    counter("http_sent_bytes_total", "counter", "Bytes written to clients", stats.bytes_sent);
+    counter("http_received_bytes_total", "counter", "Bytes read from clients", stats.bytes_received);
+    counter("http_rate_limited_total", "counter", "Requests rejected by rate limiting",
+            stats.rate_limited_requests);
+    counter("tls_handshakes_total", "counter", "TLS handshakes completed", stats.tls_handshakes);
+    counter("tls_resumed_total", "counter", "TLS handshakes that resumed a session", stats.tls_resumed);
+    counter("http2_connections_total", "counter", "HTTPS connections that negotiated HTTP/2",
+            stats.http2_connections);
+    counter("http_rejected_connections_total", "counter", "Connections closed at accept over max_connections",
+            stats.rejected_connections);
+    counter("http_shed_requests_total", "counter", "Requests answered 503 by load shedding", stats.shed_requests);
+    auto load = admission_.signals();
+    counter("http_reactor_delay_microseconds", "gauge", "How far behind the busiest event loop runs",
+            static_cast<uint64_t>(load.reactor_delay.count()));
+    counter("http_queue_delay_microseconds", "gauge", "Smallest request queue delay of the last interval",
+            static_cast<uint64_t>(load.queue_delay.count()));
+    counter("http_handler_latency_microseconds", "gauge", "Moving average of handler run time",
+            static_cast<uint64_t>(load.handler_latency.count()));
+    counter("http_overloaded", "gauge", "1 while requests are being shed", load.overloaded ? 1 : 0);
+    auto uptime = std::chrono::steady_clock::now() - stats.start_time;
+    counter("http_server_uptime_seconds", "gauge", "Seconds since the server was created",
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(uptime).count()));
+    
+    if (metrics_) {
+        metrics_->append_prometheus(out);
+    }
+    return out;
+}
+
+void HttpServer::accept_connections(Reactor& reactor) {
+    auto socket = std::make_shared<boost::asio::ip::tcp::socket>(connection_executor(reactor));
     
-    acceptor_.async_accept(*socket,
-        [this, socket](const boost::system::error_code& error) {
-            handle_accept(error, std::move(*socket));
+    reactor.acceptor->async_accept(*socket,
+        [this, &reactor, socket](const boost::system::error_code& error) {
+            handle_accept(reactor, error, std::move(*socket));
         }
     );
 }
 
-void HttpServer::handle_accept(const boost::system::error_code& error, 
+void HttpServer::handle_accept(Reactor& reactor, const boost::system::error_code& error, 
                               boost::asio::ip::tcp::socket socket) {
-    if (!error && running_.load()) {
-        stats_.total_connections.fetch_add(1);
-        stats_.active_connections.fetch_add(1);
+    if (!error && running_.load() && !admit_connection()) {
+        counters_.add(ServerCounters::REJECTED_CONNECTIONS);
+        reject_connection(socket, true);
+        accept_connections(reactor);
+    } else if (!error && running_.load()) {
+        counters_.add(ServerCounters::TOTAL_CONNECTIONS);
+        counters_.add(ServerCounters::ACTIVE_CONNECTIONS);
         
-        auto connection = std::make_shared<Connection>(
+        // Pooled: a closed connection's memory goes to the next one accepted
+        auto executor = socket.get_executor();
+        auto connection = std::allocate_shared<Connection>(PoolAllocator<Connection>(),
             std::move(socket),
-            [this](const HttpRequest& request) {
-                stats_.total_requests.fetch_add(1);
+            [this, executor](const HttpRequest& request, ResponseCallback done) {
+                counters_.add(ServerCounters::TOTAL_REQUESTS);
                 
                 // Check for WebSocket upgrade first
                 if (WebSocketUtils::is_websocket_request(request)) {
                     // Handle WebSocket upgrade (this will be handled in connection level)
-                    return handle_websocket_upgrade_response(request);
+                    done(handle_websocket_upgrade_response(request));
+                    return;
                 }
                 
-                auto response = handle_request(request);
-                log_request(request, response);
-                return response;
+                dispatch_request(request, std::move(done), executor);
             },
             [this]() {
-                stats_.active_connections.fetch_sub(1);
-            }
+                counters_.subtract(ServerCounters::ACTIVE_CONNECTIONS);
+            },
+            metrics_.get(),
+            &counters_
         );
+        connection->on_upgrade([this, &reactor](boost::asio::ip::tcp::socket socket, const HttpRequest& request,
+                                                std::string_view buffered) {
+            handle_websocket_upgrade(reactor, std::move(socket), request, buffered);
+        });
+        connection->set_idle_timeout(reactor.timers, config_.keep_alive_timeout);
+        connection->set_max_request_size(config_.max_request_size);
+        connection->on_request_body([this](const HttpRequest& head) { return body_handler(head); },
+                                    upload_limit());
         
         connection->start();
         
         // Accept next connection
-        accept_connections();
+        accept_connections(reactor);
     } else if (error) {
         std::cerr << "Accept error: " << error.message() << std::endl;
     }
 }
 
+void HttpServer::dispatch_request(const HttpRequest& request, ResponseCallback done,
+                                  boost::asio::any_io_executor executor) {
+    auto routes = route_table();
+    const Route* route = find_route(*routes, request);
+    
+    if (route && route->streaming_handler) {
+        // The body arrived in full: it came over HTTP/2, or there is none
+        auto body = RequestBody::buffered(std::move(executor), request.body());
+        dispatch_streaming(request, std::move(routes), route, std::move(body), std::move(done));
+        return;
+    }
+    
+    if (route && route->async_handler) {
+        dispatch_async(request, std::move(routes), route, std::move(executor), std::move(done));
+        return;
+    }
+    
+    if (route && route->options.offload) {
+        // The connection does not read again until it has written this
+        // response, so the request can safely travel to the worker by value.
+        // The snapshot travels with it to keep the route alive.
+        work_pool_->submit([this, request, routes, route, done = std::move(done)]() {
+            auto response = run_handler(request, route);
+            log_request(request, response);
+            done(std::move(response));
+        });
+        return;
+    }
+    
+    auto response = run_handler(request, route);
+    log_request(request, response);
+    done(std::move(response));
+}
+
+Connection::BodyHandler HttpServer::body_handler(const HttpRequest& head) {
+    auto routes = route_table();
+    if (!routes->streaming) {
+        return nullptr;
+    }
+    const Route* route = find_route(*routes, head);
+    if (!route || !route->streaming_handler) {
+        return nullptr;
+    }
+    return [this, routes = std::move(routes), route](const HttpRequest& request, std::shared_ptr<RequestBody> body,
+                                                     ResponseCallback done) mutable {
+        counters_.add(ServerCounters::TOTAL_REQUESTS);
+        dispatch_streaming(request, std::move(routes), route, std::move(body), std::move(done));
+    };
+}
+
+bool HttpServer::screen_request(const HttpRequest& request, std::chrono::steady_clock::time_point started,
+                                ResponseCallback& done) {
+    auto waited = request.received_at() == std::chrono::steady_clock::time_point{}
+                      ? std::chrono::steady_clock::duration::zero() : started - request.received_at();
+    if (admission_.should_shed(waited, started)) {
+        counters_.add(ServerCounters::SHED_REQUESTS);
+        auto response = overload_response();
+        log_request(request, response);
+        done(std::move(response));
+        return true;
+    }
+    HttpResponse middleware_response;
+    for (const auto& middleware : middleware_) {
+        if (!middleware(request, middleware_response)) {
+            log_request(request, middleware_response);
+            done(std::move(middleware_response));
+            return true;
+        }
+    }
+    return false;
+}
+
+HttpServer::ResponseCallback HttpServer::deferred_response(std::shared_ptr<const HttpRequest> request,
+                                                           std::shared_ptr<const RouteTable> routes,
+                                                           const Route* route,
+                                                           std::chrono::steady_clock::time_point started,
+                                                           ResponseCallback done) {
+    // The handler's latency runs until it answers, however long it spent
+    // waiting rather than working, so it stays out of admission control
+    return [this, request = std::move(request), routes = std::move(routes), route, started,
+            done = std::move(done)](HttpResponse response) {
+        if (config_.enable_compression) {
+            compress_response(*request, response);
+        }
+        if (metrics_) {
+            auto& route_metrics = route->metrics ? *route->metrics : metrics_->unrouted();
+            metrics_->record_handler(route_metrics, request->received_at(), started, std::chrono::steady_clock::now());
+        }
+        log_request(*request, response);
+        done(std::move(response));
+    };
+}
+
+void HttpServer::dispatch_streaming(const HttpRequest& request, std::shared_ptr<const RouteTable> routes,
+                                    const Route* route, std::shared_ptr<RequestBody> body, ResponseCallback done) {
+    // Shedding and middleware only need the head, so a request they turn
+    // away is answered before any of its body is read
+    auto started = std::chrono::steady_clock::now();
+    if (screen_request(request, started, done)) {
+        return;
+    }
+    
+    // The connection keeps the head where it is until the response is out,
+    // so the copy can go to a worker and outlive the handler's return
+    auto copy = std::make_shared<const HttpRequest>(request);
+    auto respond = deferred_response(copy, std::move(routes), route, started, std::move(done));
+    auto run = [route, copy, body = std::move(body), respond = std::move(respond)] {
+        try {
+            route->streaming_handler(*copy, body, respond);
+        } catch (const std::exception& e) {
+            HttpResponse response(HttpStatus::INTERNAL_SERVER_ERROR);
+            response.set_text("Internal server error: " + std::string(e.what()));
+            respond(std::move(response));
+        }
+    };
+    if (route->options.offload) {
+        work_pool_->submit(std::move(run));
+    } else {
+        run();
+    }
+}
+
+void HttpServer::dispatch_async(const HttpRequest& request, std::shared_ptr<const RouteTable> routes,
+                                const Route* route, boost::asio::any_io_executor executor, ResponseCallback done) {
+    auto started = std::chrono::steady_clock::now();
+    if (screen_request(request, started, done)) {
+        return;
+    }
+    
+    // The coroutine frame only holds a reference, to a copy that lives as
+    // long as it does, like the request an offloaded handler gets
+    auto copy = std::make_shared<const HttpRequest>(request);
+    auto respond = deferred_response(copy, std::move(routes), route, started, std::move(done));
+    std::optional<boost::asio::awaitable<HttpResponse>> handler;
+    try {
+        handler.emplace(route->async_handler(*copy));
+    } catch (const std::exception& e) {
+        // A coroutine's own exceptions surface through co_spawn; this is a
+        // handler that failed before it got one started
+        respond(create_error_response(HttpStatus::INTERNAL_SERVER_ERROR,
+                                      "Internal server error: " + std::string(e.what())));
+        return;
+    }
+    boost::asio::co_spawn(std::move(executor), std::move(*handler),
+        [this, respond = std::move(respond)](std::exception_ptr error, HttpResponse response) {
+            if (error) {
+                try {
+                    std::rethrow_exception(error);
+                } catch (const std::exception& e) {
+                    response = create_error_response(HttpStatus::INTERNAL_SERVER_ERROR,
+                                                     "Internal server error: " + std::string(e.what()));
+                } catch (...) {
+                    response = create_error_response(HttpStatus::INTERNAL_SERVER_ERROR, "Internal server error");
+                }
+            }
+            respond(std::move(response));
+        });
+}
+
+uint64_t HttpServer::upload_limit() const noexcept {
+    return config_.max_upload_size == 0 ? std::numeric_limits<uint64_t>::max() : config_.max_upload_size;
+}
+
+HttpResponse HttpServer::run_handler(const HttpRequest& request, const Route* route) {
+    auto started = std::chrono::steady_clock::now();
+    auto waited = request.received_at() == std::chrono::steady_clock::time_point{}
+                      ? std::chrono::steady_clock::duration::zero() : started - request.received_at();
+    if (admission_.should_shed(waited, started)) {
+        counters_.add(ServerCounters::SHED_REQUESTS);
+        return overload_response();
+    }
+    
+    auto response = handle_request(request, route);
+    auto finished = std::chrono::steady_clock::now();
+    admission_.record_handler(finished - started);
+    if (metrics_) {
+        auto& route_metrics = route && route->metrics ? *route->metrics : metrics_->unrouted();
+        metrics_->record_handler(route_metrics, request.received_at(), started, finished);
+    }
+    return response;
+}
+
+std::shared_ptr<const HttpServer::RouteTable> HttpServer::route_table() const {
+    if (routes_changed_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        if (routes_changed_.load(std::memory_order_relaxed)) {
+            route_table_.store(std::make_shared<const RouteTable>(pending_routes_), std::memory_order_release);
+            routes_changed_.store(false, std::memory_order_release);
+        }
+    }
+    return route_table_.load(std::memory_order_acquire);
+}
+
+const HttpServer::Route* HttpServer::find_route(const RouteTable& table, const HttpRequest& request) const {
+    size_t id = table.router.match(request.method(), request.path(), request.path_params_);
+    return id == Router::NO_ROUTE ? nullptr : &table.routes[id];
+}
+
 HttpResponse HttpServer::handle_request(const HttpRequest& request) {
+    auto routes = route_table();
+    return handle_request(request, find_route(*routes, request));
+}
+
+HttpResponse HttpServer::handle_request(const HttpRequest& request, const Route* route) {
     try {
         // Run middleware
         HttpResponse middleware_response;
@@ -377,40 +1008,18 @@ HttpResponse HttpServer::handle_request(const HttpRequest& request) {
         
         HttpResponse response;
         
-        // Check for exact route match
-        RouteKey key{request.path(), request.method()};
-        auto route_it = routes_.find(key);
-        
-        if (route_it != routes_.end()) {
-            response = route_it->second(request);
+        if (route) {
+            response = route->handler(request);
+        } else if (config_.serve_static_files && request.method() == HttpMethod::GET) {
+            // Try static file serving
+            response = handle_static_file(request);
         } else {
-            // Check for pattern matches
-            bool route_found = false;
-            for (const auto& [route_key, handler] : routes_) {
-                if (route_key.method == request.method() && 
-                    path_matches(route_key.path, request.path())) {
-                    response = handler(request);
-                    route_found = true;
-                    break;
-                }
-            }
-            
-            if (!route_found) {
-                // Try static file serving
-                if (config_.serve_static_files && request.method() == HttpMethod::GET) {
-                    response = handle_static_file(request);
-                } else {
-                    response = create_error_response(HttpStatus::NOT_FOUND, "Resource not found");
-                }
-            }
+            response = create_error_response(HttpStatus::NOT_FOUND, "Resource not found");
         }
         
         // Apply compression if enabled and supported by client
         if (config_.enable_compression) {
-            auto accept_encoding = request.get_header("Accept-Encoding");
-            if (accept_encoding) {
-                response.compress_body_if_supported(*accept_encoding);
-            }
+            compress_response(request, response);
         }
         
         return response;
@@ -423,18 +1032,73 @@ HttpResponse HttpServer::handle_request(const HttpRequest& request) {
 
 HttpResponse HttpServer::handle_websocket_upgrade_response(const HttpRequest& request) {
     // Find matching WebSocket route
-    for (const auto& [path, handler] : websocket_routes_) {
-        if (path_matches(path, request.path())) {
-            // Return WebSocket upgrade response
-            return WebSocketUtils::create_handshake_response(request);
-        }
+    auto routes = route_table();
+    if (routes->websocket_router.match(HttpMethod::GET, request.path(), request.path_params_) != Router::NO_ROUTE) {
+        return WebSocketUtils::create_handshake_response(request, deflate_options(config_));
     }
     
     // No matching WebSocket route found
-    return WebSocketUtils::create_handshake_rejection("No WebSocket route found for path: " + request.path());
+    return WebSocketUtils::create_handshake_rejection("No WebSocket route found for path: " + std::string(request.path()));
+}
+
+void HttpServer::handle_websocket_upgrade(Reactor& reactor, boost::asio::ip::tcp::socket socket,
+                                          const HttpRequest& request, std::string_view buffered) {
+    auto routes = route_table();
+    Router::Params params;
+    size_t id = routes->websocket_router.match(HttpMethod::GET, request.path(), params);
+    if (id == Router::NO_ROUTE) {
+        return;  // The route went away after the handshake; dropping the socket closes it
+    }
+    
+    counters_.add(ServerCounters::TOTAL_WEBSOCKETS);
+    counters_.add(ServerCounters::ACTIVE_WEBSOCKETS);
+    auto connection = std::make_shared<WebSocketConnection>(std::move(socket), [this]() {
+        counters_.subtract(ServerCounters::ACTIVE_WEBSOCKETS);
+    });
+    connection->set_high_water_mark(config_.websocket_high_water_mark);
+    connection->set_timeouts(reactor.timers, config_.websocket_ping_interval, config_.websocket_timeout);
+    // Same request, same options: this agrees with the 101 already sent
+    if (auto negotiated = WebSocketUtils::negotiate_deflate(request, deflate_options(config_))) {
+        connection->enable_deflate(*negotiated);
+    }
+    
+    // Handlers are registered before the first frame is read
+    try {
+        routes->websocket_handlers[id](connection);
+    } catch (const std::exception& e) {
+        std::cerr << "WebSocket handler error: " << e.what() << std::endl;
+        connection->close(1011, "Internal error");
+        return;
+    }
+    connection->start_upgraded(std::span(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()));
+}
+
+void HttpServer::subscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection) {
+    websocket_hub_.subscribe(topic, connection);
+}
+
+void HttpServer::unsubscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection) {
+    websocket_hub_.unsubscribe(topic, connection);
+}
+
+size_t HttpServer::publish(const std::string& topic, std::string_view message) {
+    return websocket_hub_.publish(topic, message);
+}
+
+size_t HttpServer::publish_binary(const std::string& topic, std::span<const uint8_t> data) {
+    return websocket_hub_.publish(topic, data, WebSocketOpcode::BINARY);
 }
 
 HttpResponse HttpServer::handle_static_file(const HttpRequest& request) {
+    // Hot assets are served straight from memory, without touching the disk.
+    // Range requests are answered from the file itself.
+    bool use_cache = file_cache_ && !request.has_header("range");
+    if (use_cache) {
+        if (auto cached = file_cache_->get(request.path())) {
+            return cached_file_response(*cached, request);
+        }
+    }
+    
     std::filesystem::path requested_path = std::filesystem::path(config_.document_root) / request.path().substr(1);
     
     // Security check: ensure path is within document root
@@ -451,7 +1115,7 @@ HttpResponse HttpServer::handle_static_file(const HttpRequest& request) {
         for (const auto& index_file : config_.index_files) {
             auto index_path = requested_path / index_file;
             if (std::filesystem::exists(index_path) && std::filesystem::is_regular_file(index_path)) {
-                return HttpResponse::conditional_file_response(index_path.string(), request);
+                return serve_file(request, canonical_requested / index_file);
             }
         }
         return create_error_response(HttpStatus::FORBIDDEN, "Directory listing disabled");
@@ -462,7 +1126,177 @@ HttpResponse HttpServer::handle_static_file(const HttpRequest& request) {
         return create_error_response(HttpStatus::NOT_FOUND, "File not found");
     }
     
-    return HttpResponse::conditional_file_response(requested_path.string(), request);
+    return serve_file(request, canonical_requested);
+}
+
+HttpResponse HttpServer::serve_file(const HttpRequest& request, const std::filesystem::path& path) {
+    bool range_request = request.has_header("range");
+    if (file_cache_ && !range_request) {
+        if (auto cached = file_cache_->load(request.path(), path)) {
+            return cached_file_response(*cached, request);
+        }
+    }
+    
+    // Too large to cache, or a Range request; sent from the file descriptor.
+    // Ranges always refer to the identity encoding.
+    compression::Encoding encoding = compression::Encoding::IDENTITY;
+    if (!range_request) {
+        if (auto sibling = precompressed_sibling(path, request, encoding)) {
+            HttpResponse response = HttpResponse::conditional_file_response(sibling->string(), request);
+            std::string extension = path.extension().string();
+            response.set_content_type(HttpResponse::get_mime_type(extension.empty() ? extension : extension.substr(1)));
+            response.remove_header("Accept-Ranges");
+            response.set_header("Vary", "Accept-Encoding");
+            if (response.status() == HttpStatus::OK) {
+                response.set_header("Content-Encoding", std::string(compression::encoding_name(encoding)));
+            }
+            return response;
+        }
+    }
+    
+    return HttpResponse::conditional_file_response(path.string(), request);
+}
+
+std::optional<std::filesystem::path> HttpServer::precompressed_sibling(const std::filesystem::path& path,
+                                                                      const HttpRequest& request,
+                                                                      compression::Encoding& encoding) const {
+    if (!config_.enable_compression || !config_.serve_precompressed) {
+        return std::nullopt;
+    }
+    auto accept_encoding = request.get_header("accept-encoding");
+    if (!accept_encoding) {
+        return std::nullopt;
+    }
+    
+    // Offer only the siblings that exist, best first as the client ranks them
+    unsigned present = 0;
+    std::error_code ec;
+    for (auto candidate : {compression::Encoding::GZIP, compression::Encoding::BROTLI, compression::Encoding::ZSTD}) {
+        auto sibling = path;
+        sibling += compression::encoding_extension(candidate);
+        if (std::filesystem::is_regular_file(sibling, ec)) {
+            present |= compression::encoding_bit(candidate);
+        }
+    }
+    if (present == 0) {
+        return std::nullopt;
+    }
+    
+    encoding = compression::negotiate_encoding(*accept_encoding, present);
+    if (encoding == compression::Encoding::IDENTITY) {
+        return std::nullopt;
+    }
+    auto sibling = path;
+    sibling += compression::encoding_extension(encoding);
+    return sibling;
+}
+
+HttpResponse HttpServer::cached_file_response(const CachedFile& file, const HttpRequest& request) {
+    auto if_none_match = request.get_if_none_match();
+    if (if_none_match && HttpResponse::etag_matches(file.etag, *if_none_match)) {
+        HttpResponse response(HttpStatus::NOT_MODIFIED);
+        response.set_header("ETag", file.etag);
+        response.set_header("Last-Modified", file.last_modified);
+        if (config_.enable_compression && (file.precompressed_mask != 0 || is_compressible_type(file.mime_type))) {
+            response.set_header("Vary", "Accept-Encoding");
+        }
+        response.set_body("");
+        return response;
+    }
+    
+    HttpResponse response(HttpStatus::OK);
+    for (const auto& [name, value] : file.headers) {
+        response.set_header(name, value);
+    }
+    
+    // A precompressed sibling wins when the client ranks it at least as high
+    // as anything compress_response() could produce
+    if (file.precompressed_mask != 0 && config_.enable_compression) {
+        auto accept_encoding = request.get_header("accept-encoding");
+        if (accept_encoding) {
+            unsigned dynamic = is_compressible_type(file.mime_type) ? compression::available_encoders() : 0;
+            auto encoding = compression::negotiate_encoding(*accept_encoding, file.precompressed_mask | dynamic);
+            if (encoding != compression::Encoding::IDENTITY &&
+                (file.precompressed_mask & compression::encoding_bit(encoding))) {
+                response.set_shared_body(file.precompressed[static_cast<size_t>(encoding)]);
+                response.set_header("Content-Encoding", std::string(compression::encoding_name(encoding)));
+                response.set_header("ETag", "W/" + file.etag);
+                response.set_header("Vary", "Accept-Encoding");
+                return response;
+            }
+        }
+        response.set_header("Vary", "Accept-Encoding");
+    }
+    
+    response.set_shared_body(file.content);
+    return response;
+}
+
+bool HttpServer::is_compressible_type(std::string_view content_type) const {
+    for (const auto& type : config_.compressible_types) {
+        if (content_type.starts_with(type)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpServer::compress_response(const HttpRequest& request, HttpResponse& response) {
+    // Stream bodies are compressed as they are sent, whatever their length
+    bool streamed = response.body_stream() != nullptr;
+    if (response.status() != HttpStatus::OK || response.is_compressed() || response.file_body() ||
+        (!streamed && response.body().size() < config_.compression_min_size) ||
+        !is_compressible_type(response.get_header("Content-Type"))) {
+        return;
+    }
+    
+    // The representation depends on Accept-Encoding from here on, whatever
+    // this particular client asked for
+    response.set_header("Vary", "Accept-Encoding");
+    
+    auto accept_encoding = request.get_header("accept-encoding");
+    if (!accept_encoding) {
+        return;
+    }
+    auto encoding = compression::negotiate_encoding(*accept_encoding, compression::available_encoders());
+    if (encoding == compression::Encoding::IDENTITY) {
+        return;
+    }
+    
+    if (streamed) {
+        response.set_stream_encoding(encoding, config_.compression_level);
+        return;
+    }
+    
+    // Identical bodies (same ETag, or same bytes) are compressed only once
+    std::shared_ptr<const std::string> compressed;
+    std::string etag = response.get_header("ETag");
+    if (compression_cache_) {
+        std::string resource;
+        if (!etag.empty()) {
+            resource.append(request.path());
+            if (!request.query_string().empty()) {
+                resource.push_back('?');
+                resource.append(request.query_string());
+            }
+        }
+        compressed = compression_cache_->get_or_compress(resource, etag, response.body(), encoding,
+                                                         config_.compression_level);
+    } else {
+        std::string data = compression::compress(response.body(), encoding, config_.compression_level);
+        if (!data.empty() && data.size() < response.body().size()) {
+            compressed = std::make_shared<const std::string>(std::move(data));
+        }
+    }
+    if (!compressed) {
+        return;
+    }
+    
+    response.set_shared_body(std::move(compressed));
+    response.set_header("Content-Encoding", std::string(compression::encoding_name(encoding)));
+    if (!etag.empty() && !etag.starts_with("W/")) {
+        response.set_header("ETag", "W/" + etag);
+    }
 }
 
 HttpResponse HttpServer::create_error_response(HttpStatus status, const std::string& message) {
@@ -501,89 +1335,173 @@ void HttpServer::initialize_mime_types() {
 }
 
 void HttpServer::log_request(const HttpRequest& request, const HttpResponse& response) {
-    if (!config_.enable_logging) {
-        return;
-    }
-    
-    std::ostringstream log_entry;
-    log_entry << "[" << get_current_timestamp() << "] "
-              << HttpRequest::method_to_string(request.method()) << " "
-              << request.path() << " "
-              << static_cast<int>(response.status()) << " "
-              << response.body().size() << " bytes";
-    
-    if (config_.log_file.empty()) {
-        std::cout << log_entry.str() << std::endl;
-    } else {
-        std::ofstream log_file(config_.log_file, std::ios::app);
-        if (log_file.is_open()) {
-            log_file << log_entry.str() << std::endl;
+    if (access_log_) {
+        // A file response carries its bytes (or the requested range) in
+        // file_body(), and a streamed one has a length only if it is not
+        // chunked; neither is in body()
+        std::optional<uint64_t> bytes = response.body().size();
+        if (const auto& file = response.file_body()) {
+            bytes = file->length;
+        } else if (response.body_stream()) {
+            bytes.reset();
+            auto length = response.get_header("Content-Length");
+            uint64_t value = 0;
+            if (!response.is_chunked() &&
+                std::from_chars(length.data(), length.data() + length.size(), value).ec == std::errc()) {
+                bytes = value;
+            }
         }
+        access_log_->log(request.method(), request.path(), static_cast<int>(response.status()), bytes);
     }
 }
 
-std::string HttpServer::get_current_timestamp() const {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    
-    std::ostringstream oss;
-    oss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-    return oss.str();
-}
-
-bool HttpServer::path_matches(const std::string& pattern, const std::string& path) const {
-    // Simple wildcard matching (could be enhanced with regex)
-    if (pattern == path) {
-        return true;
-    }
-    
-    // Check for wildcard at end
-    if (pattern.ends_with("*")) {
-        std::string prefix = pattern.substr(0, pattern.length() - 1);
-        return path.starts_with(prefix);
+void HttpServer::reopen_log() noexcept {
+    if (access_log_) {
+        access_log_->reopen();
     }
-    
-    return false;
 }
 
-void HttpServer::accept_ssl_connections() {
-    auto socket = std::make_shared<SslConnection::SslSocket>(io_context_, *ssl_context_);
+void HttpServer::accept_ssl_connections(Reactor& reactor) {
+    auto socket = std::make_shared<SslConnection::SslSocket>(connection_executor(reactor), *ssl_context_);
     
-    https_acceptor_->async_accept(socket->lowest_layer(),
-        [this, socket](const boost::system::error_code& error) {
-            handle_ssl_accept(error, socket);
+    reactor.https_acceptor->async_accept(socket->lowest_layer(),
+        [this, &reactor, socket](const boost::system::error_code& error) {
+            handle_ssl_accept(reactor, error, socket);
         }
     );
 }
 
-void HttpServer::handle_ssl_accept(const boost::system::error_code& error, 
+void HttpServer::handle_ssl_accept(Reactor& reactor, const boost::system::error_code& error, 
                                   std::shared_ptr<SslConnection::SslSocket> socket) {
-    if (!error && running_.load()) {
-        stats_.total_connections.fetch_add(1);
-        stats_.active_connections.fetch_add(1);
+    if (!error && running_.load() && !admit_connection()) {
+        // Turned away before the handshake, the expensive part
+        counters_.add(ServerCounters::REJECTED_CONNECTIONS);
+        reject_connection(socket->next_layer(), false);
+        accept_ssl_connections(reactor);
+    } else if (!error && running_.load()) {
+        counters_.add(ServerCounters::TOTAL_CONNECTIONS);
+        counters_.add(ServerCounters::ACTIVE_CONNECTIONS);
         
-        auto connection = std::make_shared<SslConnection>(
+        auto executor = socket->get_executor();
+        auto connection = std::allocate_shared<SslConnection>(PoolAllocator<SslConnection>(),
             std::move(*socket),
-            [this](const HttpRequest& request) {
-                stats_.total_requests.fetch_add(1);
-                auto response = handle_request(request);
-                log_request(request, response);
-                return response;
+            [this, executor](const HttpRequest& request, ResponseCallback done) {
+                counters_.add(ServerCounters::TOTAL_REQUESTS);
+                dispatch_request(request, std::move(done), executor);
             },
             [this]() {
-                stats_.active_connections.fetch_sub(1);
-            }
+                counters_.subtract(ServerCounters::ACTIVE_CONNECTIONS);
+            },
+            metrics_.get(),
+            &counters_
         );
+        if (config_.enable_http2) {
+            connection->on_http2([this, &reactor](SslConnection::SslSocket socket) {
+                handle_http2(reactor, std::move(socket));
+            });
+        }
+        connection->set_idle_timeout(reactor.timers, config_.keep_alive_timeout);
+        connection->set_max_request_size(config_.max_request_size);
+        connection->on_request_body([this](const HttpRequest& head) { return body_handler(head); },
+                                    upload_limit());
         
         connection->start();
         
         // Accept next SSL connection
-        accept_ssl_connections();
+        accept_ssl_connections(reactor);
     } else if (error) {
         std::cerr << "HTTPS Accept error: " << error.message() << std::endl;
     }
 }
 
+void HttpServer::handle_http2(Reactor& reactor, SslConnection::SslSocket socket) {
+    // The SslConnection that did the handshake is done with once this returns
+    counters_.add(ServerCounters::ACTIVE_CONNECTIONS);
+    counters_.add(ServerCounters::HTTP2_CONNECTIONS);
+    
+    auto executor = socket.get_executor();
+    auto connection = std::make_shared<Http2Connection>(
+        std::move(socket),
+        [this, executor](const HttpRequest& request, ResponseCallback done) {
+            counters_.add(ServerCounters::TOTAL_REQUESTS);
+            dispatch_request(request, std::move(done), executor);
+        },
+        [this]() {
+            counters_.subtract(ServerCounters::ACTIVE_CONNECTIONS);
+        },
+        metrics_.get(),
+        &counters_
+    );
+    connection->set_idle_timeout(reactor.timers, config_.keep_alive_timeout);
+    connection->set_max_request_size(config_.max_request_size);
+    connection->on_request_body([this](const HttpRequest& head) { return body_handler(head); }, upload_limit());
+    connection->start();
+}
+
+void HttpServer::accept_ktls_connections(Reactor& reactor) {
+    auto socket = std::make_shared<boost::asio::ip::tcp::socket>(connection_executor(reactor));
+    
+    reactor.https_acceptor->async_accept(*socket,
+        [this, &reactor, socket](const boost::system::error_code& error) {
+            if (!error && running_.load() && !admit_connection()) {
+                counters_.add(ServerCounters::REJECTED_CONNECTIONS);
+                reject_connection(*socket, false);
+                accept_ktls_connections(reactor);
+            } else if (!error && running_.load()) {
+                // Counted from here, like an SslConnection, so connections
+                // stalled in the handshake still count toward max_connections
+                counters_.add(ServerCounters::TOTAL_CONNECTIONS);
+                counters_.add(ServerCounters::ACTIVE_CONNECTIONS);
+                TlsSession::async_accept(std::move(*socket), ssl_context_->native_handle(), std::chrono::seconds(30),
+                    [this, &reactor](const boost::system::error_code& error, boost::asio::ip::tcp::socket socket,
+                                     std::unique_ptr<TlsSession> session) {
+                        handle_ktls_handshake(reactor, error, std::move(socket), std::move(session));
+                    });
+                accept_ktls_connections(reactor);
+            } else if (error) {
+                std::cerr << "HTTPS Accept error: " << error.message() << std::endl;
+            }
+        }
+    );
+}
+
+void HttpServer::handle_ktls_handshake(Reactor& reactor, const boost::system::error_code& error,
+                                       boost::asio::ip::tcp::socket socket, std::unique_ptr<TlsSession> session) {
+    if (error) {
+        std::cerr << "SSL handshake error: " << error.message() << std::endl;
+        counters_.subtract(ServerCounters::ACTIVE_CONNECTIONS);
+        return;
+    }
+    if (!running_.load()) {
+        counters_.subtract(ServerCounters::ACTIVE_CONNECTIONS);
+        return;
+    }
+    counters_.add(ServerCounters::TLS_HANDSHAKES);
+    if (session->resumed()) {
+        counters_.add(ServerCounters::TLS_RESUMED);
+    }
+    
+    auto executor = socket.get_executor();
+    auto connection = std::allocate_shared<Connection>(PoolAllocator<Connection>(),
+        std::move(socket),
+        [this, executor](const HttpRequest& request, ResponseCallback done) {
+            counters_.add(ServerCounters::TOTAL_REQUESTS);
+            dispatch_request(request, std::move(done), executor);
+        },
+        [this]() {
+            counters_.subtract(ServerCounters::ACTIVE_CONNECTIONS);
+        },
+        metrics_.get(),
+        &counters_
+    );
+    connection->set_tls(std::move(session));
+    connection->set_idle_timeout(reactor.timers, config_.keep_alive_timeout);
+    connection->set_max_request_size(config_.max_request_size);
+    connection->on_request_body([this](const HttpRequest& head) { return body_handler(head); },
+                                upload_limit());
+    connection->start();
+}
+
 void HttpServer::initialize_ssl_context() {
     if (!ssl_context_) {
         return;
@@ -625,6 +1543,41 @@ void HttpServer::initialize_ssl_context() {
             ssl_context_->use_tmp_dh_file(config_.ssl_dh_file);
         }
         
+        // Resumption: a shared cache for session IDs, rotating keys for tickets
+        SSL_CTX* native = ssl_context_->native_handle();
+        static const unsigned char session_id_context[] = "cpp-http-server";
+        SSL_CTX_set_session_id_context(native, session_id_context, sizeof(session_id_context) - 1);
+        SSL_CTX_set_timeout(native, static_cast<long>(config_.ssl_session_timeout.count()));
+        if (config_.ssl_session_cache_size > 0) {
+            SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(native, static_cast<long>(config_.ssl_session_cache_size));
+        } else {
+            SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_OFF);
+        }
+        if (config_.ssl_session_tickets) {
+            ticket_keys_ = std::make_unique<SessionTicketKeys>(config_.ssl_ticket_key_rotation);
+            ticket_keys_->install(native);
+        } else {
+            SSL_CTX_set_options(native, SSL_OP_NO_TICKET);
+        }
+        
+        if (config_.ssl_ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+            ktls_ = TlsSession::kernel_supported();
+            if (ktls_) {
+                SSL_CTX_set_options(native, SSL_OP_ENABLE_KTLS);
+            }
+#endif
+            if (!ktls_) {
+                std::cerr << "Kernel TLS is not available; HTTPS stays in userspace" << std::endl;
+            }
+        }
+        
+        // kTLS connections are served by Connection, which only speaks HTTP/1.1
+        if (config_.enable_http2 && !ktls_) {
+            SSL_CTX_set_alpn_select_cb(native, select_alpn_protocol, nullptr);
+        }
+        
         // Set password callback if needed
         ssl_context_->set_password_callback([this](std::size_t, boost::asio::ssl::context::password_purpose) {
             return get_password();
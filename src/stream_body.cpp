@@ -0,0 +1,118 @@
+/**
+ * @file stream_body.cpp
+ * @brief Implementation of the StreamBody class for sending stream bodies in bounded pieces.
+ */
+#include "stream_body.hpp"
+#include <charconv>
+#include <cstdio>
+
+namespace http_server {
+
+namespace {
+
+// Room reserved in front of a chunk for its size line ("ffffffff\r\n")
+constexpr size_t CHUNK_HEADER_ROOM = 10;
+
+} // namespace
+
+StreamBody::StreamBody(const HttpResponse& response, bool chunk_framing)
+    : stream_(response.body_stream())
+    , compressor_(compression::StreamCompressor::create(response.stream_encoding(),
+                                                        response.stream_compression_level()))
+    , buffer_(BufferPool::instance().acquire())
+    , chunked_(response.is_chunked())
+    , framed_(chunk_framing) {
+    if (!chunked_ && compressor_) {
+        compressor_.reset();  // A compressed body always goes out chunked
+    }
+    std::string length = response.get_header("Content-Length");
+    uint64_t value = 0;
+    if (!chunked_ &&
+        std::from_chars(length.data(), length.data() + length.size(), value).ec == std::errc()) {
+        remaining_ = value;
+    }
+    if (!stream_) {
+        done_ = true;
+    }
+}
+
+std::string_view StreamBody::next() {
+    while (!done_) {
+        size_t wanted = buffer_->size();
+        if (remaining_ && *remaining_ < wanted) {
+            wanted = static_cast<size_t>(*remaining_);
+        }
+        size_t bytes_read = 0;
+        if (wanted > 0) {
+            stream_->read(buffer_->data(), static_cast<std::streamsize>(wanted));
+            bytes_read = static_cast<size_t>(stream_->gcount());
+        }
+        bool at_end = bytes_read < wanted || wanted == 0;
+        if (at_end && stream_->bad()) {
+            failed_ = true;
+            done_ = true;
+            return {};
+        }
+        if (remaining_) {
+            *remaining_ -= bytes_read;
+            if (at_end && *remaining_ > 0) {
+                failed_ = true;
+                done_ = true;
+                return {};
+            }
+        }
+
+        if (!chunked_) {
+            done_ = at_end;
+            if (bytes_read > 0) {
+                return {buffer_->data(), bytes_read};
+            }
+            continue;
+        }
+
+        size_t room = framed_ ? CHUNK_HEADER_ROOM : 0;
+        encoded_.assign(room, '\0');
+        std::string_view input(buffer_->data(), bytes_read);
+        if (compressor_) {
+            if (!compressor_->write(input, encoded_) || (at_end && !compressor_->finish(encoded_))) {
+                failed_ = true;
+                done_ = true;
+                return {};
+            }
+        } else {
+            encoded_.append(input);
+        }
+
+        // A compressor may swallow a whole read; an empty chunk would end
+        // the body early, so keep reading until there is output
+        size_t start = 0;
+        if (encoded_.size() > room) {
+            start = framed_ ? frame_chunk() : 0;
+        } else {
+            encoded_.clear();
+        }
+        if (at_end) {
+            if (framed_) {
+                encoded_.append("0\r\n\r\n");
+            }
+            done_ = true;
+        }
+        if (encoded_.size() > start) {
+            return std::string_view(encoded_).substr(start);
+        }
+    }
+    return {};
+}
+
+size_t StreamBody::frame_chunk() {
+    // Write the size line right in front of the payload so the chunk is one
+    // contiguous piece
+    char header[CHUNK_HEADER_ROOM + 1];
+    int length = std::snprintf(header, sizeof(header), "%zx\r\n", encoded_.size() - CHUNK_HEADER_ROOM);
+    size_t start = CHUNK_HEADER_ROOM - static_cast<size_t>(length);
+    encoded_.replace(start, static_cast<size_t>(length), header, static_cast<size_t>(length));
+    encoded_.append("\r\n");
+    return start;
+}
+
+} // namespace http_server
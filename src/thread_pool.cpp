@@ -1,8 +1,10 @@
 /**
  * @file thread_pool.cpp
- * @brief Implementation of ThreadPool class
+ * @brief Implementation of the ThreadPool and WorkStealingPool executors
  */
 #include "thread_pool.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 namespace http_server {
 
@@ -52,4 +54,121 @@ size_t ThreadPool::pending_tasks() const {
     return tasks_.size();
 }
 
+// WorkStealingPool implementation
+namespace {
+    // Identifies the pool and deque owned by the calling thread, if any
+    thread_local const WorkStealingPool* current_pool = nullptr;
+    thread_local size_t current_queue = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t thread_count) {
+    thread_count = std::max<size_t>(1, thread_count);
+    
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    shutdown();
+}
+
+void WorkStealingPool::submit(Task task) {
+    if (stop_.load()) {
+        throw std::runtime_error("submit on stopped WorkStealingPool");
+    }
+    
+    size_t index = (current_pool == this)
+        ? current_queue
+        : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    pending_.fetch_add(1);
+    
+    // Parking is rare under load, so the common case never touches park_mutex_
+    if (idle_workers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        park_cv_.notify_one();
+    }
+}
+
+void WorkStealingPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        stop_.store(true);
+    }
+    park_cv_.notify_all();
+    
+    for (std::thread& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    
+    workers_.clear();
+}
+
+void WorkStealingPool::worker_loop(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    
+    while (true) {
+        Task task;
+        if (try_pop(index, task) || try_steal(index, task, false) || try_steal(index, task, true)) {
+            pending_.fetch_sub(1);
+            try {
+                task();
+            } catch (...) {
+                // Tasks report their own failures; never let one kill a worker
+            }
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(park_mutex_);
+        if (stop_.load() && pending_.load() == 0) {
+            return;
+        }
+        
+        idle_workers_.fetch_add(1);
+        park_cv_.wait(lock, [this] { return stop_.load() || pending_.load() > 0; });
+        idle_workers_.fetch_sub(1);
+    }
+}
+
+bool WorkStealingPool::try_pop(size_t index, Task& task) {
+    auto& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::try_steal(size_t thief, Task& task, bool wait_for_lock) {
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        auto& victim = *queues_[(thief + offset) % queues_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::defer_lock);
+        if (wait_for_lock) {
+            lock.lock();
+        } else {
+            lock.try_lock();
+        }
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
 } // namespace http_server
\ No newline at end of file
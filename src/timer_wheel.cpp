@@ -0,0 +1,175 @@
+/**
+ * @file timer_wheel.cpp
+ * @brief Implementation of the TimerWheel class: hierarchical wheel of coarse connection timeouts.
+ */
+#include "timer_wheel.hpp"
+#include <algorithm>
+
+namespace http_server {
+
+namespace {
+
+constexpr uint64_t SLOT_MASK = TimerWheel::SLOTS - 1;
+constexpr uint64_t MAX_DELTA = (uint64_t{1} << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) - 1;
+
+} // namespace
+
+void TimerWheel::Entry::bind(TimerWheel& wheel, std::weak_ptr<void> owner, boost::asio::any_io_executor executor,
+                             std::function<void()> callback) {
+    core_ = wheel.core_;
+    owner_ = std::move(owner);
+    executor_ = std::move(executor);
+    callback_ = std::move(callback);
+}
+
+void TimerWheel::Entry::schedule(Clock::duration timeout) {
+    if (!core_) {
+        return;
+    }
+    // Expires on the first tick after the deadline, so never early
+    uint64_t expiry = core_->tick_at(Clock::now() + timeout) + 1;
+
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    ++generation_;
+    if (linked()) {
+        unlink();
+        --core_->size;
+    }
+    expiry_ = expiry;
+    core_->insert(*this);
+    ++core_->size;
+}
+
+void TimerWheel::Entry::cancel() {
+    if (!core_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    ++generation_;
+    if (linked()) {
+        unlink();
+        --core_->size;
+    }
+}
+
+void TimerWheel::Entry::unlink() noexcept {
+    prev->next = next;
+    next->prev = prev;
+    prev = next = this;
+}
+
+uint64_t TimerWheel::Core::tick_at(Clock::time_point time) const noexcept {
+    return time <= origin ? 0 : static_cast<uint64_t>((time - origin) / TICK);
+}
+
+void TimerWheel::Core::insert(Entry& entry) noexcept {
+    // The level is the first whose span covers the time left; within it the
+    // slot comes from the expiry itself, so it is reached within one turn.
+    // A tick may have gone by since schedule() read the clock.
+    entry.expiry_ = std::max(entry.expiry_, next_tick);
+    if (entry.expiry_ - next_tick > MAX_DELTA) {
+        entry.expiry_ = next_tick + MAX_DELTA;
+    }
+    uint64_t delta = entry.expiry_ - next_tick;
+    size_t level = 0;
+    while (level + 1 < LEVELS && delta >= (uint64_t{1} << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    Link& head = slots[level][(entry.expiry_ >> (SLOT_BITS * level)) & SLOT_MASK];
+
+    Link* link = &entry;
+    link->prev = head.prev;
+    link->next = &head;
+    head.prev->next = link;
+    head.prev = link;
+}
+
+void TimerWheel::Core::cascade(size_t level, size_t slot) noexcept {
+    Link& head = slots[level][slot];
+    if (head.next == &head) {
+        return;
+    }
+    Link pending;
+    // Detach the whole list first: entries may land back in this very slot
+    pending.next = head.next;
+    pending.prev = head.prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    head.prev = head.next = &head;
+
+    while (pending.next != &pending) {
+        auto* entry = static_cast<Entry*>(pending.next);
+        entry->unlink();
+        insert(*entry);
+    }
+}
+
+TimerWheel::TimerWheel(boost::asio::io_context& io_context)
+    : timer_(io_context)
+    , core_(std::make_shared<Core>()) {
+}
+
+TimerWheel::~TimerWheel() = default;
+
+void TimerWheel::start() {
+    wait();
+}
+
+size_t TimerWheel::size() const {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    return core_->size;
+}
+
+void TimerWheel::wait() {
+    // Only this handler moves next_tick, so it can be read without the lock
+    timer_.expires_at(core_->origin + TICK * static_cast<int64_t>(core_->next_tick));
+    timer_.async_wait([this](const boost::system::error_code& error) {
+        if (error) {
+            return;
+        }
+        advance(Clock::now());
+        wait();
+    });
+}
+
+void TimerWheel::advance(Clock::time_point now) {
+    uint64_t target = core_->tick_at(now);
+    {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        Core& core = *core_;
+        // A loop that fell behind catches up on every tick it missed
+        for (; core.next_tick <= target; ++core.next_tick) {
+            uint64_t tick = core.next_tick;
+            for (size_t level = 1; level < LEVELS; ++level) {
+                if (((tick >> (SLOT_BITS * (level - 1))) & SLOT_MASK) != 0) {
+                    break;
+                }
+                core.cascade(level, (tick >> (SLOT_BITS * level)) & SLOT_MASK);
+            }
+
+            Link& head = core.slots[0][tick & SLOT_MASK];
+            while (head.next != &head) {
+                auto* entry = static_cast<Entry*>(head.next);
+                entry->unlink();
+                --core.size;
+                // Fails only for an owner being destroyed, which no longer needs it
+                if (auto owner = entry->owner_.lock()) {
+                    expired_.push_back(Expired{std::move(owner), entry, entry->generation_});
+                }
+            }
+        }
+    }
+
+    for (auto& expired : expired_) {
+        Entry* entry = expired.entry;
+        boost::asio::post(entry->executor_,
+            [owner = std::move(expired.owner), entry, generation = expired.generation] {
+                if (entry->generation_ == generation) {
+                    entry->callback_();
+                }
+            });
+    }
+    expired_.clear();
+}
+
+} // namespace http_server
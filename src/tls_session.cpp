@@ -0,0 +1,413 @@
+/**
+ * @file tls_session.cpp
+ * @brief Implementation of rotating session ticket keys and socket-level TLS sessions for kernel TLS offload.
+ */
+#include "tls_session.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <boost/asio/ssl/error.hpp>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace http_server {
+
+namespace {
+
+// Where a context keeps its SessionTicketKeys
+int ticket_keys_index() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+// Maps a failed SSL_* call onto an error code; call straight after it
+boost::system::error_code ssl_error(SSL* ssl, int result) {
+    int saved_errno = errno;
+    int error = SSL_get_error(ssl, result);
+    if (error == SSL_ERROR_ZERO_RETURN) {
+        return boost::asio::error::eof;
+    }
+    unsigned long code = ERR_get_error();
+    ERR_clear_error();
+    if (error == SSL_ERROR_SYSCALL && code == 0) {
+        return saved_errno != 0
+            ? boost::system::error_code(saved_errno, boost::system::system_category())
+            : boost::system::error_code(boost::asio::error::eof);
+    }
+#ifdef SSL_R_UNEXPECTED_EOF_WHILE_READING
+    // A peer that closes without close_notify; for HTTP that is just a close
+    if (ERR_GET_REASON(code) == SSL_R_UNEXPECTED_EOF_WHILE_READING) {
+        return boost::asio::error::eof;
+    }
+#endif
+    return boost::system::error_code(static_cast<int>(code), boost::asio::error::get_ssl_category());
+}
+
+} // namespace
+
+// SessionTicketKeys implementation
+SessionTicketKeys::SessionTicketKeys(std::chrono::seconds rotation_interval)
+    : rotation_interval_(rotation_interval)
+    , current_(generate())
+    , previous_()
+    , rotated_at_(std::chrono::steady_clock::now()) {
+}
+
+SessionTicketKeys::Key SessionTicketKeys::generate() {
+    Key key;
+    if (RAND_bytes(key.name.data(), static_cast<int>(key.name.size())) != 1 ||
+        RAND_bytes(key.aes_key.data(), static_cast<int>(key.aes_key.size())) != 1 ||
+        RAND_bytes(key.hmac_key.data(), static_cast<int>(key.hmac_key.size())) != 1) {
+        throw std::runtime_error("Failed to generate a session ticket key");
+    }
+    return key;
+}
+
+void SessionTicketKeys::rotate_if_due() {
+    auto now = std::chrono::steady_clock::now();
+    if (rotation_interval_.count() <= 0 || now - rotated_at_ < rotation_interval_) {
+        return;
+    }
+    Key fresh;
+    try {
+        fresh = generate();
+    } catch (const std::exception&) {
+        return;  // Keep the current key rather than sealing nothing
+    }
+    // Rotation happens on use, so the retiring key sealed tickets until now;
+    // the session timeout still bounds how old an accepted ticket can be
+    previous_ = current_;
+    has_previous_ = true;
+    current_ = fresh;
+    rotated_at_ = now;
+    ++rotations_;
+}
+
+uint64_t SessionTicketKeys::rotations() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rotations_;
+}
+
+struct TicketCallback {
+    // Returns the key to seal with, or the key a ticket was sealed with and
+    // whether that is the current one
+    static bool key_for(SSL* ssl, unsigned char* key_name, bool encrypt, SessionTicketKeys::Key& key,
+                        bool& current) {
+        auto* keys = static_cast<SessionTicketKeys*>(
+            SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ticket_keys_index()));
+        if (!keys) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(keys->mutex_);
+        keys->rotate_if_due();
+        if (encrypt) {
+            key = keys->current_;
+            current = true;
+            std::memcpy(key_name, key.name.data(), key.name.size());
+            return true;
+        }
+        if (std::memcmp(key_name, keys->current_.name.data(), keys->current_.name.size()) == 0) {
+            key = keys->current_;
+            current = true;
+            return true;
+        }
+        if (keys->has_previous_ &&
+            std::memcmp(key_name, keys->previous_.name.data(), keys->previous_.name.size()) == 0) {
+            key = keys->previous_;
+            current = false;
+            return true;
+        }
+        return false;
+    }
+
+    // 1: use the key, 2: use it and issue a fresh ticket, 0: unknown key
+    // (full handshake), -1: error
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int callback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                        EVP_MAC_CTX* mac, int encrypt) {
+        SessionTicketKeys::Key key;
+        bool current = false;
+        if (!key_for(ssl, key_name, encrypt != 0, key, current)) {
+            return encrypt ? -1 : 0;
+        }
+        if (encrypt && RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key.data(), key.hmac_key.size()),
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+            OSSL_PARAM_construct_end()
+        };
+        if (EVP_MAC_CTX_set_params(mac, params) != 1) {
+            return -1;
+        }
+        int ok = encrypt
+            ? EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv)
+            : EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv);
+        if (ok != 1) {
+            return -1;
+        }
+        return current ? 1 : 2;
+    }
+#else
+    static int callback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                        HMAC_CTX* mac, int encrypt) {
+        SessionTicketKeys::Key key;
+        bool current = false;
+        if (!key_for(ssl, key_name, encrypt != 0, key, current)) {
+            return encrypt ? -1 : 0;
+        }
+        if (encrypt && RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+        if (HMAC_Init_ex(mac, key.hmac_key.data(), static_cast<int>(key.hmac_key.size()), EVP_sha256(), nullptr) != 1) {
+            return -1;
+        }
+        int ok = encrypt
+            ? EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv)
+            : EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv);
+        if (ok != 1) {
+            return -1;
+        }
+        return current ? 1 : 2;
+    }
+#endif
+};
+
+void SessionTicketKeys::install(SSL_CTX* context) {
+    SSL_CTX_set_ex_data(context, ticket_keys_index(), this);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(context, &TicketCallback::callback);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(context, &TicketCallback::callback);
+#endif
+}
+
+// TlsSession implementation
+struct TlsSession::WriteOperation {
+    std::vector<boost::asio::const_buffer> buffers;
+    size_t index = 0;        // Buffer being written
+    size_t offset = 0;       // Bytes of it already written
+    size_t transferred = 0;
+    IoHandler handler;
+};
+
+struct HandshakeOperation : std::enable_shared_from_this<HandshakeOperation> {
+    boost::asio::ip::tcp::socket socket;
+    SSL* ssl;
+    boost::asio::steady_timer timer;
+    TlsSession::HandshakeHandler handler;
+    bool finished = false;
+    bool timed_out = false;
+
+    HandshakeOperation(boost::asio::ip::tcp::socket s, SSL* session, TlsSession::HandshakeHandler h)
+        : socket(std::move(s)), ssl(session), timer(socket.get_executor()), handler(std::move(h)) {}
+
+    ~HandshakeOperation() {
+        if (ssl) {
+            SSL_free(ssl);
+        }
+    }
+
+    void step() {
+        ERR_clear_error();
+        int result = SSL_do_handshake(ssl);
+        if (result == 1) {
+            finish({});
+            return;
+        }
+        int error = SSL_get_error(ssl, result);
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+            auto self = shared_from_this();
+            socket.async_wait(error == SSL_ERROR_WANT_READ
+                                  ? boost::asio::ip::tcp::socket::wait_read
+                                  : boost::asio::ip::tcp::socket::wait_write,
+                [self](const boost::system::error_code& wait_error) {
+                    if (wait_error) {
+                        self->finish(self->timed_out ? boost::asio::error::timed_out : wait_error);
+                    } else {
+                        self->step();
+                    }
+                });
+            return;
+        }
+        finish(ssl_error(ssl, result));
+    }
+
+    void finish(const boost::system::error_code& error) {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        timer.cancel();
+        if (error) {
+            handler(error, std::move(socket), nullptr);
+            return;
+        }
+        std::unique_ptr<TlsSession> session(new TlsSession(ssl));
+        ssl = nullptr;
+        handler({}, std::move(socket), std::move(session));
+    }
+};
+
+bool TlsSession::kernel_supported() {
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    // Kernel TLS is a TCP upper-layer protocol. Attaching it to a socket
+    // that is not connected fails with ENOTCONN when the kernel has it, and
+    // ENOENT when it does not.
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int result = ::setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", 3);
+    int error = errno;
+    ::close(fd);
+    return result == 0 || error == ENOTCONN;
+#else
+    return false;
+#endif
+}
+
+void TlsSession::async_accept(boost::asio::ip::tcp::socket socket, SSL_CTX* context,
+                              std::chrono::steady_clock::duration timeout, HandshakeHandler handler) {
+    boost::system::error_code ec;
+    socket.native_non_blocking(true, ec);
+    SSL* ssl = ec ? nullptr : SSL_new(context);
+    if (!ssl) {
+        handler(ec ? ec : boost::asio::error::no_memory, std::move(socket), nullptr);
+        return;
+    }
+    if (SSL_set_fd(ssl, static_cast<int>(socket.native_handle())) != 1) {
+        SSL_free(ssl);
+        handler(boost::asio::error::invalid_argument, std::move(socket), nullptr);
+        return;
+    }
+    SSL_set_accept_state(ssl);
+    SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
+
+    auto operation = std::make_shared<HandshakeOperation>(std::move(socket), ssl, std::move(handler));
+    operation->timer.expires_after(timeout);
+    operation->timer.async_wait([weak = std::weak_ptr<HandshakeOperation>(operation)](
+                                    const boost::system::error_code& error) {
+        auto operation = weak.lock();
+        if (!error && operation && !operation->finished) {
+            operation->timed_out = true;
+            boost::system::error_code ignored;
+            operation->socket.cancel(ignored);
+        }
+    });
+    operation->step();
+}
+
+TlsSession::TlsSession(SSL* ssl) : ssl_(ssl) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    kernel_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+    kernel_receive_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
+}
+
+TlsSession::~TlsSession() {
+    // The socket BIO does not own the descriptor
+    SSL_free(ssl_);
+}
+
+bool TlsSession::resumed() const noexcept {
+    return SSL_session_reused(ssl_) == 1;
+}
+
+template <typename Retry>
+void TlsSession::wait_or_fail(boost::asio::ip::tcp::socket& socket, int result, Retry retry,
+                              const IoHandler& handler, size_t transferred) {
+    int error = SSL_get_error(ssl_, result);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        socket.async_wait(error == SSL_ERROR_WANT_READ
+                              ? boost::asio::ip::tcp::socket::wait_read
+                              : boost::asio::ip::tcp::socket::wait_write,
+            [retry = std::move(retry), handler, transferred](const boost::system::error_code& wait_error) {
+                if (wait_error) {
+                    handler(wait_error, transferred);
+                } else {
+                    retry();
+                }
+            });
+        return;
+    }
+    auto failure = ssl_error(ssl_, result);
+    boost::asio::post(socket.get_executor(), [handler, failure, transferred] {
+        handler(failure, transferred);
+    });
+}
+
+void TlsSession::async_read_some(boost::asio::ip::tcp::socket& socket, boost::asio::mutable_buffer buffer,
+                                 IoHandler handler) {
+    // Try first: OpenSSL may hold decrypted bytes the socket knows nothing of
+    ERR_clear_error();
+    size_t read = 0;
+    int result = SSL_read_ex(ssl_, buffer.data(), buffer.size(), &read);
+    if (result == 1) {
+        boost::asio::post(socket.get_executor(), [handler = std::move(handler), read] {
+            handler({}, read);
+        });
+        return;
+    }
+    wait_or_fail(socket, result, [this, &socket, buffer, handler] {
+        async_read_some(socket, buffer, handler);
+    }, handler, 0);
+}
+
+void TlsSession::async_write(boost::asio::ip::tcp::socket& socket, std::vector<boost::asio::const_buffer> buffers,
+                             IoHandler handler) {
+    auto operation = std::make_shared<WriteOperation>();
+    operation->buffers = std::move(buffers);
+    operation->handler = std::move(handler);
+    write_some(socket, std::move(operation));
+}
+
+void TlsSession::write_some(boost::asio::ip::tcp::socket& socket, std::shared_ptr<WriteOperation> operation) {
+    while (operation->index < operation->buffers.size()) {
+        const auto& buffer = operation->buffers[operation->index];
+        if (operation->offset == buffer.size()) {
+            ++operation->index;
+            operation->offset = 0;
+            continue;
+        }
+        // A retry after WANT_WRITE passes the same bytes again, as OpenSSL requires
+        ERR_clear_error();
+        size_t written = 0;
+        int result = SSL_write_ex(ssl_, static_cast<const char*>(buffer.data()) + operation->offset,
+                                  buffer.size() - operation->offset, &written);
+        if (result != 1) {
+            wait_or_fail(socket, result, [this, &socket, operation] {
+                write_some(socket, operation);
+            }, operation->handler, operation->transferred);
+            return;
+        }
+        operation->offset += written;
+        operation->transferred += written;
+    }
+    boost::asio::post(socket.get_executor(), [operation] {
+        operation->handler({}, operation->transferred);
+    });
+}
+
+void TlsSession::shutdown() noexcept {
+    // One non-blocking attempt; the peer is not waited for
+    ERR_clear_error();
+    SSL_shutdown(ssl_);
+    ERR_clear_error();
+}
+
+} // namespace http_server
@@ -3,12 +3,31 @@
 #include <sstream>
 #include <random>
 #include <algorithm>
+#include <cstring>
+#include <charconv>
+#include <limits>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SERVER_WS_SSE2 1
+#if defined(__GNUC__)
+// Built for the baseline ISA; AVX2 is picked at run time
+#define HTTP_SERVER_WS_AVX2 1
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define HTTP_SERVER_WS_NEON 1
+#endif
+
 namespace http_server {
 
 namespace {
+    // Appended to a compressed message before inflating it (RFC 7692 7.2.2)
+    constexpr uint8_t DEFLATE_TAIL_BYTES[4] = {0x00, 0x00, 0xff, 0xff};
+    constexpr std::span<const uint8_t> DEFLATE_TAIL(DEFLATE_TAIL_BYTES);
+    
     const std::string WEBSOCKET_MAGIC_STRING = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
     const std::string BASE64_CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
     
@@ -57,11 +76,115 @@ namespace {
         SHA1(reinterpret_cast<const unsigned char*>(data.c_str()), data.length(), hash.data());
         return hash;
     }
+    
+    // The mask kernels take the key as it repeats in memory and return how
+    // many bytes they covered; every kernel advances in multiples of 4, so
+    // the remainder starts on key byte 0 again.
+#if HTTP_SERVER_WS_AVX2
+    __attribute__((target("avx2")))
+    size_t mask_avx2(uint8_t* data, size_t size, uint32_t key) {
+        const __m256i mask = _mm256_set1_epi32(static_cast<int>(key));
+        size_t i = 0;
+        for (; i + 128 <= size; i += 128) {
+            auto* p = reinterpret_cast<__m256i*>(data + i);
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256(p), mask);
+            __m256i b = _mm256_xor_si256(_mm256_loadu_si256(p + 1), mask);
+            __m256i c = _mm256_xor_si256(_mm256_loadu_si256(p + 2), mask);
+            __m256i d = _mm256_xor_si256(_mm256_loadu_si256(p + 3), mask);
+            _mm256_storeu_si256(p, a);
+            _mm256_storeu_si256(p + 1, b);
+            _mm256_storeu_si256(p + 2, c);
+            _mm256_storeu_si256(p + 3, d);
+        }
+        for (; i + 32 <= size; i += 32) {
+            auto* p = reinterpret_cast<__m256i*>(data + i);
+            _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), mask));
+        }
+        return i;
+    }
+    
+    bool cpu_has_avx2() {
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        return has_avx2;
+    }
+#endif
+    
+#if HTTP_SERVER_WS_SSE2
+    size_t mask_sse2(uint8_t* data, size_t size, uint32_t key) {
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(key));
+        size_t i = 0;
+        for (; i + 64 <= size; i += 64) {
+            auto* p = reinterpret_cast<__m128i*>(data + i);
+            __m128i a = _mm_xor_si128(_mm_loadu_si128(p), mask);
+            __m128i b = _mm_xor_si128(_mm_loadu_si128(p + 1), mask);
+            __m128i c = _mm_xor_si128(_mm_loadu_si128(p + 2), mask);
+            __m128i d = _mm_xor_si128(_mm_loadu_si128(p + 3), mask);
+            _mm_storeu_si128(p, a);
+            _mm_storeu_si128(p + 1, b);
+            _mm_storeu_si128(p + 2, c);
+            _mm_storeu_si128(p + 3, d);
+        }
+        for (; i + 16 <= size; i += 16) {
+            auto* p = reinterpret_cast<__m128i*>(data + i);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+        }
+        return i;
+    }
+#endif
+    
+#if HTTP_SERVER_WS_NEON
+    size_t mask_neon(uint8_t* data, size_t size, uint32_t key) {
+        const uint8x16_t mask = vreinterpretq_u8_u32(vdupq_n_u32(key));
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), mask));
+        }
+        return i;
+    }
+#endif
+    
+    // 64-bit words, then single bytes
+    void mask_scalar(uint8_t* data, size_t size, uint32_t key) {
+        uint64_t wide = (static_cast<uint64_t>(key) << 32) | key;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            word ^= wide;
+            std::memcpy(data + i, &word, sizeof(word));
+        }
+        const auto* key_bytes = reinterpret_cast<const uint8_t*>(&key);
+        for (size_t k = 0; i < size; ++i, ++k) {
+            data[i] ^= key_bytes[k & 3];
+        }
+    }
 }
 
 // WebSocketFrame implementation
+namespace {
+    void append_frame_header(std::vector<uint8_t>& frame, uint8_t first_byte, bool masked, uint64_t payload_length) {
+        frame.push_back(first_byte);
+        
+        // Second byte: MASK + Payload length
+        uint8_t second_byte = masked ? 0x80 : 0;
+        if (payload_length < 126) {
+            frame.push_back(second_byte | static_cast<uint8_t>(payload_length));
+        } else if (payload_length < 65536) {
+            frame.push_back(second_byte | 126);
+            frame.push_back(static_cast<uint8_t>((payload_length >> 8) & 0xFF));
+            frame.push_back(static_cast<uint8_t>(payload_length & 0xFF));
+        } else {
+            frame.push_back(second_byte | 127);
+            for (int i = 7; i >= 0; --i) {
+                frame.push_back(static_cast<uint8_t>((payload_length >> (i * 8)) & 0xFF));
+            }
+        }
+    }
+}
+
 std::vector<uint8_t> WebSocketFrame::serialize() const {
     std::vector<uint8_t> frame;
+    frame.reserve(14 + payload.size());
     
     // First byte: FIN + RSV + Opcode
     uint8_t first_byte = static_cast<uint8_t>(opcode);
@@ -69,27 +192,7 @@ std::vector<uint8_t> WebSocketFrame::serialize() const {
     if (rsv1) first_byte |= 0x40;
     if (rsv2) first_byte |= 0x20;
     if (rsv3) first_byte |= 0x10;
-    frame.push_back(first_byte);
-    
-    // Second byte: MASK + Payload length
-    uint8_t second_byte = 0;
-    if (masked) second_byte |= 0x80;
-    
-    if (payload_length < 126) {
-        second_byte |= static_cast<uint8_t>(payload_length);
-        frame.push_back(second_byte);
-    } else if (payload_length < 65536) {
-        second_byte |= 126;
-        frame.push_back(second_byte);
-        frame.push_back(static_cast<uint8_t>((payload_length >> 8) & 0xFF));
-        frame.push_back(static_cast<uint8_t>(payload_length & 0xFF));
-    } else {
-        second_byte |= 127;
-        frame.push_back(second_byte);
-        for (int i = 7; i >= 0; --i) {
-            frame.push_back(static_cast<uint8_t>((payload_length >> (i * 8)) & 0xFF));
-        }
-    }
+    append_frame_header(frame, first_byte, masked, payload_length);
     
     // Masking key (if present)
     if (masked) {
@@ -100,98 +203,164 @@ std::vector<uint8_t> WebSocketFrame::serialize() const {
     }
     
     // Payload
+    size_t header_size = frame.size();
+    frame.insert(frame.end(), payload.begin(), payload.end());
     if (masked) {
-        auto masked_payload = payload;
-        for (size_t i = 0; i < masked_payload.size(); ++i) {
-            masked_payload[i] ^= static_cast<uint8_t>((masking_key >> ((3 - (i % 4)) * 8)) & 0xFF);
-        }
-        frame.insert(frame.end(), masked_payload.begin(), masked_payload.end());
-    } else {
-        frame.insert(frame.end(), payload.begin(), payload.end());
+        WebSocketUtils::apply_mask(std::span<uint8_t>(frame).subspan(header_size), masking_key);
     }
     
     return frame;
 }
 
+std::vector<uint8_t> WebSocketFrame::encode(WebSocketOpcode opcode, std::span<const uint8_t> payload, bool fin,
+                                            bool compressed) {
+    std::vector<uint8_t> frame;
+    frame.reserve(10 + payload.size());
+    append_frame_header(frame, static_cast<uint8_t>(opcode) | (fin ? 0x80 : 0) | (compressed ? 0x40 : 0), false,
+                        payload.size());
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    return frame;
+}
+
 WebSocketFrame WebSocketFrame::parse(const std::vector<uint8_t>& data, size_t& bytes_consumed) {
     bytes_consumed = 0;
-    if (data.size() < 2) {
-        throw std::runtime_error("Insufficient data for WebSocket frame header");
+    std::vector<uint8_t> copy(data);
+    WebSocketFrameParser parser(std::numeric_limits<uint64_t>::max());
+    
+    switch (parser.feed(copy)) {
+        case WebSocketFrameParser::Status::COMPLETE:
+            break;
+        case WebSocketFrameParser::Status::INCOMPLETE:
+            throw std::runtime_error("Insufficient data for WebSocket frame");
+        default:
+            throw std::runtime_error("Invalid WebSocket frame");
     }
     
+    const auto& view = parser.frame();
     WebSocketFrame frame;
-    size_t offset = 0;
-    
-    // Parse first byte
-    uint8_t first_byte = data[offset++];
-    frame.fin = (first_byte & 0x80) != 0;
-    frame.rsv1 = (first_byte & 0x40) != 0;
-    frame.rsv2 = (first_byte & 0x20) != 0;
-    frame.rsv3 = (first_byte & 0x10) != 0;
-    frame.opcode = static_cast<WebSocketOpcode>(first_byte & 0x0F);
+    frame.fin = view.fin;
+    frame.rsv1 = view.rsv1;
+    frame.rsv2 = view.rsv2;
+    frame.rsv3 = view.rsv3;
+    frame.opcode = view.opcode;
+    frame.masked = view.masked;
+    frame.masking_key = view.masking_key;
+    frame.payload.assign(view.payload.begin(), view.payload.end());
+    frame.payload_length = frame.payload.size();
+    bytes_consumed = parser.consumed();
+    return frame;
+}
+
+// WebSocketFrameParser implementation
+WebSocketFrameParser::WebSocketFrameParser(uint64_t max_payload_size)
+    : max_payload_size_(max_payload_size) {
+}
+
+void WebSocketFrameParser::reset() noexcept {
+    frame_ = Frame{};
+    header_size_ = 0;
+    payload_length_ = 0;
+}
+
+WebSocketFrameParser::Status WebSocketFrameParser::parse_header(std::span<uint8_t> buffer) {
+    if (buffer.size() < 2) {
+        return Status::INCOMPLETE;
+    }
     
-    // Parse second byte
-    uint8_t second_byte = data[offset++];
-    frame.masked = (second_byte & 0x80) != 0;
-    uint64_t payload_len = second_byte & 0x7F;
+    uint8_t first_byte = buffer[0];
+    uint8_t second_byte = buffer[1];
+    size_t length_size = 0;
+    switch (second_byte & 0x7F) {
+        case 126: length_size = 2; break;
+        case 127: length_size = 8; break;
+        default: break;
+    }
+    bool masked = (second_byte & 0x80) != 0;
+    size_t header_size = 2 + length_size + (masked ? 4 : 0);
+    if (buffer.size() < header_size) {
+        return Status::INCOMPLETE;
+    }
     
-    // Parse extended payload length
-    if (payload_len == 126) {
-        if (data.size() < offset + 2) {
-            throw std::runtime_error("Insufficient data for 16-bit payload length");
+    uint64_t payload_length = second_byte & 0x7F;
+    if (length_size > 0) {
+        payload_length = 0;
+        for (size_t i = 0; i < length_size; ++i) {
+            payload_length = (payload_length << 8) | buffer[2 + i];
         }
-        payload_len = (static_cast<uint64_t>(data[offset]) << 8) | data[offset + 1];
-        offset += 2;
-    } else if (payload_len == 127) {
-        if (data.size() < offset + 8) {
-            throw std::runtime_error("Insufficient data for 64-bit payload length");
+        // The most significant bit must be 0, and lengths use the shortest form
+        if ((payload_length >> 63) != 0 || (length_size == 2 && payload_length < 126) ||
+            (length_size == 8 && payload_length <= 0xFFFF)) {
+            return Status::INVALID;
         }
-        payload_len = 0;
-        for (int i = 0; i < 8; ++i) {
-            payload_len = (payload_len << 8) | data[offset + i];
-        }
-        offset += 8;
     }
     
-    frame.payload_length = payload_len;
+    auto opcode = static_cast<WebSocketOpcode>(first_byte & 0x0F);
+    switch (opcode) {
+        case WebSocketOpcode::CONTINUATION:
+        case WebSocketOpcode::TEXT:
+        case WebSocketOpcode::BINARY:
+            break;
+        case WebSocketOpcode::CLOSE:
+        case WebSocketOpcode::PING:
+        case WebSocketOpcode::PONG:
+            // Control frames are never fragmented and carry at most 125 bytes
+            if (!(first_byte & 0x80) || payload_length > 125) {
+                return Status::INVALID;
+            }
+            break;
+        default:
+            return Status::INVALID;  // Reserved opcode
+    }
+    if (payload_length > max_payload_size_) {
+        return Status::TOO_LARGE;
+    }
     
-    // Parse masking key
-    if (frame.masked) {
-        if (data.size() < offset + 4) {
-            throw std::runtime_error("Insufficient data for masking key");
+    frame_.fin = (first_byte & 0x80) != 0;
+    frame_.rsv1 = (first_byte & 0x40) != 0;
+    frame_.rsv2 = (first_byte & 0x20) != 0;
+    frame_.rsv3 = (first_byte & 0x10) != 0;
+    frame_.opcode = opcode;
+    frame_.masked = masked;
+    frame_.masking_key = 0;
+    if (masked) {
+        const uint8_t* key = buffer.data() + 2 + length_size;
+        frame_.masking_key = (static_cast<uint32_t>(key[0]) << 24) |
+                             (static_cast<uint32_t>(key[1]) << 16) |
+                             (static_cast<uint32_t>(key[2]) << 8) |
+                             static_cast<uint32_t>(key[3]);
+    }
+    header_size_ = header_size;
+    payload_length_ = payload_length;
+    return Status::COMPLETE;
+}
+
+WebSocketFrameParser::Status WebSocketFrameParser::feed(std::span<uint8_t> buffer) {
+    if (header_size_ == 0) {
+        Status status = parse_header(buffer);
+        if (status != Status::COMPLETE) {
+            return status;
         }
-        frame.masking_key = (static_cast<uint32_t>(data[offset]) << 24) |
-                           (static_cast<uint32_t>(data[offset + 1]) << 16) |
-                           (static_cast<uint32_t>(data[offset + 2]) << 8) |
-                           static_cast<uint32_t>(data[offset + 3]);
-        offset += 4;
     }
     
-    // Parse payload
-    if (data.size() < offset + payload_len) {
-        throw std::runtime_error("Insufficient data for payload");
+    if (buffer.size() < header_size_ + payload_length_) {
+        return Status::INCOMPLETE;
     }
     
-    frame.payload.assign(data.begin() + offset, data.begin() + offset + payload_len);
-    
-    // Unmask payload if necessary
-    if (frame.masked) {
-        for (size_t i = 0; i < frame.payload.size(); ++i) {
-            frame.payload[i] ^= static_cast<uint8_t>((frame.masking_key >> ((3 - (i % 4)) * 8)) & 0xFF);
-        }
+    frame_.payload = buffer.subspan(header_size_, static_cast<size_t>(payload_length_));
+    if (frame_.masked) {
+        WebSocketUtils::apply_mask(frame_.payload, frame_.masking_key);
     }
-    
-    bytes_consumed = offset + payload_len;
-    return frame;
+    return Status::COMPLETE;
 }
 
 // WebSocketConnection implementation
-WebSocketConnection::WebSocketConnection(boost::asio::ip::tcp::socket socket)
+WebSocketConnection::WebSocketConnection(boost::asio::ip::tcp::socket socket,
+                                         std::function<void()> cleanup_callback)
     : socket_(std::move(socket))
     , state_(WebSocketState::CONNECTING)
-    , creation_time_(std::chrono::steady_clock::now())
-    , ping_timer_(socket_.get_executor())
-    , timeout_timer_(socket_.get_executor()) {
+    , cleanup_callback_(std::move(cleanup_callback))
+    , parser_(MAX_MESSAGE_SIZE)
+    , creation_time_(std::chrono::steady_clock::now()) {
 }
 
 WebSocketConnection::~WebSocketConnection() {
@@ -201,9 +370,12 @@ WebSocketConnection::~WebSocketConnection() {
         boost::system::error_code ec;
         socket_.close(ec);
     }
+    if (cleanup_callback_) {
+        cleanup_callback_();
+    }
 }
 
-bool WebSocketConnection::handshake(const HttpRequest& request) {
+bool WebSocketConnection::handshake(const HttpRequest& request, const WebSocketDeflateOptions& deflate) {
     if (!WebSocketUtils::is_websocket_request(request)) {
         return false;
     }
@@ -213,13 +385,16 @@ bool WebSocketConnection::handshake(const HttpRequest& request) {
     }
     
     auto key_header = request.get_header("Sec-WebSocket-Key");
-    if (!key_header || !WebSocketUtils::validate_websocket_key(*key_header)) {
+    if (!key_header || !WebSocketUtils::validate_websocket_key(std::string(*key_header))) {
         return false;
     }
     
     // Generate response
-    HttpResponse response = WebSocketUtils::create_handshake_response(request);
+    HttpResponse response = WebSocketUtils::create_handshake_response(request, deflate);
     std::string response_str = response.to_http_string();
+    if (auto negotiated = WebSocketUtils::negotiate_deflate(request, deflate)) {
+        enable_deflate(*negotiated);
+    }
     
     // Send handshake response
     boost::system::error_code ec;
@@ -244,10 +419,49 @@ void WebSocketConnection::start() {
     read_frame();
 }
 
+void WebSocketConnection::start_upgraded(std::span<const uint8_t> buffered) {
+    state_ = WebSocketState::OPEN;
+    if (!buffered.empty()) {
+        frame_buffer_.assign(buffered.begin(), buffered.end());
+        frame_end_ = frame_buffer_.size();
+        bytes_received_ += buffered.size();
+    }
+    
+    setup_ping_timer();
+    setup_timeout();
+    process_frames();
+    if (state_ == WebSocketState::OPEN) {
+        read_frame();
+    }
+}
+
+void WebSocketConnection::enable_deflate(const WebSocketDeflateOptions& negotiated) {
+    deflate_ = negotiated;
+    deflater_ = compression::StreamCompressor::create_raw_deflate(negotiated.server_max_window_bits, negotiated.level);
+    inflater_ = std::make_unique<compression::RawInflater>(negotiated.client_max_window_bits);
+}
+
+void WebSocketConnection::set_timeouts(TimerWheel& timers, std::chrono::steady_clock::duration ping_interval,
+                                       std::chrono::steady_clock::duration timeout) {
+    ping_interval_ = ping_interval;
+    idle_timeout_ = timeout;
+    ping_timer_.bind(timers, weak_from_this(), socket_.get_executor(), [this] { handle_ping_timer(); });
+    timeout_.bind(timers, weak_from_this(), socket_.get_executor(), [this] { handle_timeout(); });
+}
+
 void WebSocketConnection::close(uint16_t code, const std::string& reason) {
     if (state_ == WebSocketState::CLOSED || state_ == WebSocketState::CLOSING) {
         return;
     }
+    boost::asio::dispatch(socket_.get_executor(), [self = shared_from_this(), code, reason] {
+        self->do_close(code, reason);
+    });
+}
+
+void WebSocketConnection::do_close(uint16_t code, const std::string& reason) {
+    if (state_ == WebSocketState::CLOSED || state_ == WebSocketState::CLOSING) {
+        return;
+    }
     
     state_ = WebSocketState::CLOSING;
     
@@ -266,42 +480,54 @@ void WebSocketConnection::close(uint16_t code, const std::string& reason) {
     send_frame(frame);
     
     // Close socket after a brief delay
-    auto self = shared_from_this();
-    timeout_timer_.expires_after(std::chrono::milliseconds(100));
-    timeout_timer_.async_wait([self](const boost::system::error_code&) {
-        self->socket_.close();
-        self->state_ = WebSocketState::CLOSED;
-    });
+    ping_timer_.cancel();
+    timeout_.schedule(CLOSE_LINGER);
+}
+
+bool WebSocketConnection::send_text(const std::string& message) {
+    return send_message(WebSocketOpcode::TEXT,
+                        std::span(reinterpret_cast<const uint8_t*>(message.data()), message.size()));
+}
+
+bool WebSocketConnection::send_binary(const std::vector<uint8_t>& data) {
+    return send_message(WebSocketOpcode::BINARY, data);
 }
 
-void WebSocketConnection::send_text(const std::string& message) {
+bool WebSocketConnection::send_message(WebSocketOpcode opcode, std::span<const uint8_t> payload) {
     if (state_ != WebSocketState::OPEN) {
-        return;
+        return false;
+    }
+    if (!deflater_ || payload.size() < deflate_.min_size) {
+        return submit(std::make_shared<const std::vector<uint8_t>>(WebSocketFrame::encode(opcode, payload)), true);
     }
     
-    WebSocketFrame frame;
-    frame.fin = true;
-    frame.opcode = WebSocketOpcode::TEXT;
-    frame.payload.assign(message.begin(), message.end());
-    frame.payload_length = frame.payload.size();
-    
-    send_frame(frame);
-    ++messages_sent_;
+    // Compressed on the executor, where the stream sees messages in the
+    // order they go out; the queue counts the uncompressed size until then
+    bool below_mark = count_queued(payload.size());
+    boost::asio::dispatch(socket_.get_executor(),
+        [self = shared_from_this(), opcode, message = std::vector<uint8_t>(payload.begin(), payload.end())] {
+            auto frame = self->deflate_frame(opcode, message);
+            self->queued_bytes_.fetch_add(frame->size(), std::memory_order_relaxed);
+            self->queued_bytes_.fetch_sub(message.size(), std::memory_order_relaxed);
+            self->enqueue(std::move(frame), true);
+        });
+    return below_mark;
 }
 
-void WebSocketConnection::send_binary(const std::vector<uint8_t>& data) {
-    if (state_ != WebSocketState::OPEN) {
-        return;
+WebSocketConnection::SharedFrame WebSocketConnection::deflate_frame(WebSocketOpcode opcode,
+                                                                    std::span<const uint8_t> payload) {
+    deflated_.clear();
+    if (!WebSocketUtils::deflate_message(*deflater_, payload, deflated_)) {
+        // Uncompressed messages stay out of the peer's window, so a fresh
+        // stream can pick up from here
+        deflater_->reset();
+        return std::make_shared<const std::vector<uint8_t>>(WebSocketFrame::encode(opcode, payload));
     }
-    
-    WebSocketFrame frame;
-    frame.fin = true;
-    frame.opcode = WebSocketOpcode::BINARY;
-    frame.payload = data;
-    frame.payload_length = frame.payload.size();
-    
-    send_frame(frame);
-    ++messages_sent_;
+    if (!deflate_.server_context_takeover) {
+        deflater_->reset();
+    }
+    auto compressed = std::span(reinterpret_cast<const uint8_t*>(deflated_.data()), deflated_.size());
+    return std::make_shared<const std::vector<uint8_t>>(WebSocketFrame::encode(opcode, compressed, true, true));
 }
 
 void WebSocketConnection::send_ping(const std::vector<uint8_t>& data) {
@@ -349,9 +575,24 @@ std::string WebSocketConnection::client_port() const {
 }
 
 void WebSocketConnection::read_frame() {
+    // Make room after the unconsumed bytes: move them to the front when
+    // that frees enough space, grow when a large frame needs more
+    if (frame_begin_ == frame_end_) {
+        frame_begin_ = frame_end_ = 0;
+    }
+    size_t wanted = std::max(parser_.frame_size(), frame_end_ - frame_begin_ + BUFFER_SIZE);
+    if (frame_buffer_.size() - frame_begin_ < wanted) {
+        std::memmove(frame_buffer_.data(), frame_buffer_.data() + frame_begin_, frame_end_ - frame_begin_);
+        frame_end_ -= frame_begin_;
+        frame_begin_ = 0;
+        if (frame_buffer_.size() < wanted) {
+            frame_buffer_.resize(wanted);
+        }
+    }
+    
     auto self = shared_from_this();
     socket_.async_read_some(
-        boost::asio::buffer(buffer_),
+        boost::asio::buffer(frame_buffer_.data() + frame_end_, frame_buffer_.size() - frame_end_),
         [self](const boost::system::error_code& error, size_t bytes_transferred) {
             self->handle_read(error, bytes_transferred);
         }
@@ -365,7 +606,7 @@ void WebSocketConnection::handle_read(const boost::system::error_code& error, si
     }
     
     bytes_received_ += bytes_transferred;
-    frame_buffer_.insert(frame_buffer_.end(), buffer_.begin(), buffer_.begin() + bytes_transferred);
+    frame_end_ += bytes_transferred;
     
     process_frames();
     
@@ -375,36 +616,97 @@ void WebSocketConnection::handle_read(const boost::system::error_code& error, si
 }
 
 void WebSocketConnection::process_frames() {
-    while (!frame_buffer_.empty()) {
-        try {
-            size_t bytes_consumed = 0;
-            WebSocketFrame frame = WebSocketFrame::parse(frame_buffer_, bytes_consumed);
-            
-            frame_buffer_.erase(frame_buffer_.begin(), frame_buffer_.begin() + bytes_consumed);
-            handle_frame(frame);
-            
-        } catch (const std::runtime_error&) {
-            // Incomplete frame, wait for more data
-            break;
+    while (state_ == WebSocketState::OPEN && frame_begin_ < frame_end_) {
+        std::span<uint8_t> pending(frame_buffer_.data() + frame_begin_, frame_end_ - frame_begin_);
+        switch (parser_.feed(pending)) {
+            case WebSocketFrameParser::Status::INCOMPLETE:
+                return;
+            case WebSocketFrameParser::Status::INVALID:
+                fail(1002, "Protocol error");
+                return;
+            case WebSocketFrameParser::Status::TOO_LARGE:
+                fail(1009, "Message too big");
+                return;
+            case WebSocketFrameParser::Status::COMPLETE:
+                break;
         }
+        
+        // The payload stays valid while handlers run: nothing touches the
+        // buffer until the next read
+        frame_begin_ += parser_.consumed();
+        WebSocketFrameParser::Frame frame = parser_.frame();
+        parser_.reset();
+        handle_frame(frame);
     }
 }
 
-void WebSocketConnection::handle_frame(const WebSocketFrame& frame) {
+void WebSocketConnection::handle_frame(const WebSocketFrameParser::Frame& frame) {
+    // Clients must mask. RSV1 marks the first frame of a compressed message
+    // once permessage-deflate is on; nothing uses RSV2 or RSV3.
+    bool rsv1_allowed = inflater_ && (frame.opcode == WebSocketOpcode::TEXT || frame.opcode == WebSocketOpcode::BINARY);
+    if (!frame.masked || (frame.rsv1 && !rsv1_allowed) || frame.rsv2 || frame.rsv3) {
+        fail(1002, "Protocol error");
+        return;
+    }
+    
     switch (frame.opcode) {
         case WebSocketOpcode::TEXT:
-            if (text_handler_) {
-                std::string message(frame.payload.begin(), frame.payload.end());
-                text_handler_(message);
+        case WebSocketOpcode::BINARY:
+            if (message_opcode_ != WebSocketOpcode::CONTINUATION) {
+                fail(1002, "Expected a continuation frame");
+                return;
+            }
+            if (frame.rsv1) {
+                inflated_.clear();
+                if (!inflate(frame.payload)) {
+                    return;
+                }
+                if (!frame.fin) {
+                    message_opcode_ = frame.opcode;
+                    message_compressed_ = true;
+                } else if (inflate(DEFLATE_TAIL)) {
+                    deliver_message(frame.opcode, std::span(reinterpret_cast<const uint8_t*>(inflated_.data()),
+                                                            inflated_.size()));
+                }
+            } else if (frame.fin) {
+                deliver_message(frame.opcode, frame.payload);
+            } else {
+                message_opcode_ = frame.opcode;
+                message_buffer_.assign(frame.payload.begin(), frame.payload.end());
             }
-            ++messages_received_;
             break;
             
-        case WebSocketOpcode::BINARY:
-            if (binary_handler_) {
-                binary_handler_(frame.payload);
+        case WebSocketOpcode::CONTINUATION:
+            if (message_opcode_ == WebSocketOpcode::CONTINUATION) {
+                fail(1002, "Unexpected continuation frame");
+                return;
+            }
+            if (message_compressed_) {
+                if (!inflate(frame.payload)) {
+                    return;
+                }
+                if (frame.fin) {
+                    WebSocketOpcode opcode = message_opcode_;
+                    message_opcode_ = WebSocketOpcode::CONTINUATION;
+                    message_compressed_ = false;
+                    if (inflate(DEFLATE_TAIL)) {
+                        deliver_message(opcode, std::span(reinterpret_cast<const uint8_t*>(inflated_.data()),
+                                                          inflated_.size()));
+                    }
+                }
+                break;
+            }
+            if (message_buffer_.size() + frame.payload.size() > MAX_MESSAGE_SIZE) {
+                fail(1009, "Message too big");
+                return;
+            }
+            message_buffer_.insert(message_buffer_.end(), frame.payload.begin(), frame.payload.end());
+            if (frame.fin) {
+                WebSocketOpcode opcode = message_opcode_;
+                message_opcode_ = WebSocketOpcode::CONTINUATION;
+                deliver_message(opcode, message_buffer_);
+                message_buffer_.clear();
             }
-            ++messages_received_;
             break;
             
         case WebSocketOpcode::CLOSE:
@@ -418,46 +720,189 @@ void WebSocketConnection::handle_frame(const WebSocketFrame& frame) {
         case WebSocketOpcode::PONG:
             handle_pong(frame.payload);
             break;
-            
-        default:
-            // Handle other opcodes as needed
-            break;
     }
 }
 
+void WebSocketConnection::deliver_message(WebSocketOpcode opcode, std::span<const uint8_t> payload) {
+    ++messages_received_;
+    if (view_handler_) {
+        view_handler_(opcode, payload);
+    } else if (opcode == WebSocketOpcode::TEXT) {
+        if (text_handler_) {
+            text_handler_(std::string(payload.begin(), payload.end()));
+        }
+    } else if (binary_handler_) {
+        binary_handler_(std::vector<uint8_t>(payload.begin(), payload.end()));
+    }
+}
+
+bool WebSocketConnection::inflate(std::span<const uint8_t> data) {
+    auto status = inflater_->write(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()),
+                                   inflated_, MAX_MESSAGE_SIZE);
+    if (status == compression::RawInflater::Status::TOO_LARGE) {
+        fail(1009, "Message too big");
+    } else if (status == compression::RawInflater::Status::CORRUPT) {
+        fail(1007, "Invalid compressed data");
+    }
+    return status == compression::RawInflater::Status::OK;
+}
+
+bool WebSocketConnection::send_shared(SharedFrame frame) {
+    if (state_ != WebSocketState::OPEN) {
+        return false;
+    }
+    return submit(std::move(frame), true);
+}
+
+int WebSocketConnection::shared_deflate_window_bits() const noexcept {
+    return deflater_ && !deflate_.server_context_takeover ? deflate_.server_max_window_bits : 0;
+}
+
 void WebSocketConnection::send_frame(const WebSocketFrame& frame) {
-    auto data = std::make_shared<std::vector<uint8_t>>(frame.serialize());
+    submit(std::make_shared<const std::vector<uint8_t>>(frame.serialize()), false);
+}
+
+bool WebSocketConnection::count_queued(size_t bytes) noexcept {
+    size_t queued = queued_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    bool below_mark = queued < high_water_mark();
+    if (!below_mark) {
+        drain_pending_.store(true, std::memory_order_relaxed);
+    }
+    return below_mark;
+}
+
+bool WebSocketConnection::submit(SharedFrame frame, bool is_message) {
+    bool below_mark = count_queued(frame->size());
+    
+    // Inline when already on the connection's executor, so frames sent from
+    // its own handlers keep their order without a round trip
+    boost::asio::dispatch(socket_.get_executor(),
+        [self = shared_from_this(), frame = std::move(frame), is_message]() mutable {
+            self->enqueue(std::move(frame), is_message);
+        });
+    return below_mark;
+}
+
+void WebSocketConnection::enqueue(SharedFrame frame, bool is_message) {
+    if (state_ == WebSocketState::CLOSED) {
+        queued_bytes_.fetch_sub(frame->size(), std::memory_order_relaxed);
+        return;
+    }
+    if (is_message) {
+        ++messages_sent_;
+    }
+    send_queue_.push_back(std::move(frame));
+    if (!writing_) {
+        writing_ = true;
+        // Let the rest of the current handler queue its frames first
+        boost::asio::post(socket_.get_executor(), [self = shared_from_this()] {
+            self->write_queued();
+        });
+    }
+}
+
+void WebSocketConnection::write_queued() {
+    if (send_queue_.empty() || state_ == WebSocketState::CLOSED) {
+        writing_ = false;
+        return;
+    }
+    
+    // Runs of small frames are copied into one buffer, larger frames are
+    // referenced where they are. Offsets first: batch_buffer_ may still move.
+    struct Piece {
+        const std::vector<uint8_t>* frame;  // nullptr: a run in batch_buffer_
+        size_t offset;
+        size_t size;
+    };
+    Piece pieces[MAX_WRITE_BUFFERS];
+    size_t piece_count = 0;
+    batch_buffer_.clear();
+    frames_in_flight_ = 0;
+    
+    for (const auto& frame : send_queue_) {
+        bool small = frame->size() <= SMALL_FRAME_SIZE;
+        if (small && batch_buffer_.size() + frame->size() > MAX_BATCH_SIZE) {
+            break;
+        }
+        bool extends_run = small && piece_count > 0 && !pieces[piece_count - 1].frame;
+        if (!extends_run && piece_count == MAX_WRITE_BUFFERS) {
+            break;
+        }
+        if (extends_run) {
+            pieces[piece_count - 1].size += frame->size();
+        } else if (small) {
+            pieces[piece_count++] = {nullptr, batch_buffer_.size(), frame->size()};
+        } else {
+            pieces[piece_count++] = {frame.get(), 0, frame->size()};
+        }
+        if (small) {
+            batch_buffer_.insert(batch_buffer_.end(), frame->begin(), frame->end());
+        }
+        ++frames_in_flight_;
+    }
+    
+    write_buffers_.clear();
+    for (size_t i = 0; i < piece_count; ++i) {
+        const auto& piece = pieces[i];
+        write_buffers_.emplace_back(piece.frame ? piece.frame->data() : batch_buffer_.data() + piece.offset,
+                                    piece.size);
+    }
     
     auto self = shared_from_this();
     boost::asio::async_write(
         socket_,
-        boost::asio::buffer(*data),
-        [self, data](const boost::system::error_code& error, size_t bytes_transferred) {
-            self->handle_write(error, bytes_transferred, data);
+        write_buffers_,
+        [self](const boost::system::error_code& error, size_t bytes_transferred) {
+            self->handle_write(error, bytes_transferred);
         }
     );
 }
 
-void WebSocketConnection::handle_write(const boost::system::error_code& error, size_t bytes_transferred,
-                                     std::shared_ptr<std::vector<uint8_t>>) {
+void WebSocketConnection::handle_write(const boost::system::error_code& error, size_t bytes_transferred) {
+    bytes_sent_ += bytes_transferred;
+    
+    // Error or not, the frames of this write are done with; on error the
+    // rest of the queue goes as well
+    size_t frames = error ? send_queue_.size() : frames_in_flight_;
+    size_t released = 0;
+    for (size_t i = 0; i < frames; ++i) {
+        released += send_queue_.front()->size();
+        send_queue_.pop_front();
+    }
+    queued_bytes_.fetch_sub(released, std::memory_order_relaxed);
+    frames_in_flight_ = 0;
+    
     if (error) {
+        writing_ = false;
         handle_error("Write error: " + error.message());
         return;
     }
     
-    bytes_sent_ += bytes_transferred;
+    if (!send_queue_.empty()) {
+        // Everything queued during the write goes out together now
+        write_queued();
+        return;
+    }
+    
+    writing_ = false;
+    if (drain_pending_.exchange(false, std::memory_order_relaxed) && drain_handler_ &&
+        state_ == WebSocketState::OPEN) {
+        drain_handler_();
+    }
 }
 
-void WebSocketConnection::handle_ping(const std::vector<uint8_t>& data) {
-    send_pong(data);
+void WebSocketConnection::handle_ping(std::span<const uint8_t> data) {
+    send_pong(std::vector<uint8_t>(data.begin(), data.end()));
 }
 
-void WebSocketConnection::handle_pong(const std::vector<uint8_t>&) {
-    // Reset timeout on pong
-    setup_timeout();
+void WebSocketConnection::handle_pong(std::span<const uint8_t>) {
+    // Reset timeout on pong; once closing, it times the close instead
+    if (state_ == WebSocketState::OPEN) {
+        setup_timeout();
+    }
 }
 
-void WebSocketConnection::handle_close_frame(const std::vector<uint8_t>& data) {
+void WebSocketConnection::handle_close_frame(std::span<const uint8_t> data) {
     uint16_t code = 1000;
     std::string reason;
     
@@ -473,19 +918,17 @@ void WebSocketConnection::handle_close_frame(const std::vector<uint8_t>& data) {
     }
     
     state_ = WebSocketState::CLOSED;
-    socket_.close();
+    close_socket();
 }
 
 void WebSocketConnection::setup_ping_timer() {
-    auto self = shared_from_this();
-    ping_timer_.expires_after(PING_INTERVAL);
-    ping_timer_.async_wait([self](const boost::system::error_code& error) {
-        self->handle_ping_timer(error);
-    });
+    if (ping_interval_ > std::chrono::steady_clock::duration::zero()) {
+        ping_timer_.schedule(ping_interval_);
+    }
 }
 
-void WebSocketConnection::handle_ping_timer(const boost::system::error_code& error) {
-    if (error || state_ != WebSocketState::OPEN) {
+void WebSocketConnection::handle_ping_timer() {
+    if (state_ != WebSocketState::OPEN) {
         return;
     }
     
@@ -494,28 +937,45 @@ void WebSocketConnection::handle_ping_timer(const boost::system::error_code& err
 }
 
 void WebSocketConnection::setup_timeout() {
-    auto self = shared_from_this();
-    timeout_timer_.expires_after(TIMEOUT);
-    timeout_timer_.async_wait([self](const boost::system::error_code& error) {
-        self->handle_timeout(error);
-    });
+    timeout_.schedule(idle_timeout_);
 }
 
-void WebSocketConnection::handle_timeout(const boost::system::error_code& error) {
-    if (error || state_ != WebSocketState::OPEN) {
+void WebSocketConnection::handle_timeout() {
+    if (state_ == WebSocketState::CLOSING) {
+        state_ = WebSocketState::CLOSED;
+        close_socket();
+        return;
+    }
+    if (state_ != WebSocketState::OPEN) {
         return;
     }
     
     handle_error("Connection timeout");
 }
 
+void WebSocketConnection::fail(uint16_t code, const std::string& reason) {
+    if (error_handler_) {
+        error_handler_(reason);
+    }
+    close(code, reason);
+}
+
 void WebSocketConnection::handle_error(const std::string& error) {
     if (error_handler_) {
         error_handler_(error);
     }
     
     state_ = WebSocketState::CLOSED;
-    socket_.close();
+    close_socket();
+}
+
+void WebSocketConnection::close_socket() {
+    // Pending reads and writes are all that keep the connection alive, so
+    // it goes away as soon as they complete
+    ping_timer_.cancel();
+    timeout_.cancel();
+    boost::system::error_code ec;
+    socket_.close(ec);
 }
 
 std::string WebSocketConnection::generate_accept_key(const std::string& key) {
@@ -566,19 +1026,155 @@ bool WebSocketUtils::validate_websocket_key(const std::string& key) {
     }
 }
 
-HttpResponse WebSocketUtils::create_handshake_response(const HttpRequest& request) {
+namespace {
+    std::string_view trim(std::string_view value) {
+        size_t begin = value.find_first_not_of(" \t");
+        if (begin == std::string_view::npos) {
+            return {};
+        }
+        size_t end = value.find_last_not_of(" \t");
+        return value.substr(begin, end - begin + 1);
+    }
+    
+    // A max_window_bits value, 8-15 and possibly quoted; 0 if malformed
+    int parse_window_bits(std::string_view value) {
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value = value.substr(1, value.size() - 2);
+        }
+        int bits = 0;
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), bits);
+        if (error != std::errc() || end != value.data() + value.size() || value.front() == '0' ||
+            bits < 8 || bits > 15) {
+            return 0;
+        }
+        return bits;
+    }
+    
+    // Splits off the text up to the next delimiter
+    std::string_view next_token(std::string_view& list, char delimiter) {
+        size_t position = list.find(delimiter);
+        std::string_view token = list.substr(0, position);
+        list = position == std::string_view::npos ? std::string_view{} : list.substr(position + 1);
+        return trim(token);
+    }
+}
+
+std::optional<WebSocketDeflateOptions> WebSocketUtils::negotiate_deflate(const HttpRequest& request,
+                                                                        const WebSocketDeflateOptions& server,
+                                                                        std::string* response_header) {
+    auto header = request.get_header("Sec-WebSocket-Extensions");
+    if (!server.enabled || !header) {
+        return std::nullopt;
+    }
+    
+    // Offers are listed in the client's order of preference
+    std::string_view offers = *header;
+    while (!offers.empty()) {
+        std::string_view params = next_token(offers, ',');
+        if (next_token(params, ';') != "permessage-deflate") {
+            continue;
+        }
+        
+        bool server_no_context = false;
+        bool client_no_context = false;
+        bool server_bits_offered = false;
+        bool client_bits_offered = false;
+        int server_bits = 15;
+        int client_bits = 15;
+        bool valid = true;
+        while (valid && !params.empty()) {
+            std::string_view param = next_token(params, ';');
+            size_t equals = param.find('=');
+            std::string_view name = trim(param.substr(0, equals));
+            bool has_value = equals != std::string_view::npos;
+            std::string_view value = has_value ? trim(param.substr(equals + 1)) : std::string_view{};
+            
+            // Unknown, repeated or malformed parameters decline the offer
+            if (name == "server_no_context_takeover" && !has_value && !server_no_context) {
+                server_no_context = true;
+            } else if (name == "client_no_context_takeover" && !has_value && !client_no_context) {
+                client_no_context = true;
+            } else if (name == "server_max_window_bits" && has_value && !server_bits_offered) {
+                server_bits_offered = true;
+                server_bits = parse_window_bits(value);
+                valid = server_bits != 0;
+            } else if (name == "client_max_window_bits" && !client_bits_offered) {
+                client_bits_offered = true;
+                if (has_value) {
+                    client_bits = parse_window_bits(value);
+                    valid = client_bits != 0;
+                }
+            } else {
+                valid = false;
+            }
+        }
+        
+        WebSocketDeflateOptions agreed = server;
+        agreed.server_max_window_bits = std::min(server.server_max_window_bits, server_bits);
+        // zlib cannot compress within a 256-byte window
+        if (!valid || agreed.server_max_window_bits < 9) {
+            continue;
+        }
+        agreed.server_context_takeover = server.server_context_takeover && !server_no_context;
+        agreed.client_context_takeover = server.client_context_takeover && !client_no_context;
+        // The client's window can only be limited if it said it supports that
+        agreed.client_max_window_bits = client_bits_offered ? std::min(server.client_max_window_bits, client_bits) : 15;
+        
+        if (response_header) {
+            std::string& response = *response_header;
+            response = "permessage-deflate";
+            if (!agreed.server_context_takeover) {
+                response += "; server_no_context_takeover";
+            }
+            if (!agreed.client_context_takeover) {
+                response += "; client_no_context_takeover";
+            }
+            if (server_bits_offered || agreed.server_max_window_bits < 15) {
+                response += "; server_max_window_bits=" + std::to_string(agreed.server_max_window_bits);
+            }
+            if (client_bits_offered && agreed.client_max_window_bits < 15) {
+                response += "; client_max_window_bits=" + std::to_string(agreed.client_max_window_bits);
+            }
+        }
+        return agreed;
+    }
+    return std::nullopt;
+}
+
+bool WebSocketUtils::deflate_message(compression::StreamCompressor& deflater, std::span<const uint8_t> payload,
+                                     std::string& out) {
+    size_t start = out.size();
+    if (!deflater.write(std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size()), out) ||
+        !deflater.flush(out)) {
+        return false;
+    }
+    // The sync flush ends in an empty stored block, which the receiver puts back
+    if (out.size() - start < 4 || out.compare(out.size() - 4, 4, "\x00\x00\xff\xff", 4) != 0) {
+        return false;
+    }
+    out.resize(out.size() - 4);
+    return true;
+}
+
+HttpResponse WebSocketUtils::create_handshake_response(const HttpRequest& request,
+                                                       const WebSocketDeflateOptions& deflate) {
     auto key = request.get_header("Sec-WebSocket-Key");
     if (!key) {
         return create_handshake_rejection("Missing Sec-WebSocket-Key");
     }
     
-    std::string accept_key = compute_accept_key(*key);
+    std::string accept_key = compute_accept_key(std::string(*key));
     
     HttpResponse response(HttpStatus::SWITCHING_PROTOCOLS);
     response.set_header("Upgrade", "websocket");
     response.set_header("Connection", "Upgrade");
     response.set_header("Sec-WebSocket-Accept", accept_key);
     
+    std::string extensions;
+    if (negotiate_deflate(request, deflate, &extensions)) {
+        response.set_header("Sec-WebSocket-Extensions", extensions);
+    }
+    
     return response;
 }
 
@@ -591,4 +1187,29 @@ HttpResponse WebSocketUtils::create_handshake_rejection(const std::string& reaso
     return response;
 }
 
+void WebSocketUtils::apply_mask(std::span<uint8_t> data, uint32_t masking_key) noexcept {
+    // The key as it repeats in memory: first key byte first
+    const uint8_t key_bytes[4] = {
+        static_cast<uint8_t>(masking_key >> 24), static_cast<uint8_t>(masking_key >> 16),
+        static_cast<uint8_t>(masking_key >> 8), static_cast<uint8_t>(masking_key)
+    };
+    uint32_t key;
+    std::memcpy(&key, key_bytes, sizeof(key));
+    
+    uint8_t* p = data.data();
+    size_t size = data.size();
+    size_t done = 0;
+#if HTTP_SERVER_WS_AVX2
+    if (size >= 64 && cpu_has_avx2()) {
+        done = mask_avx2(p, size, key);
+    }
+#endif
+#if HTTP_SERVER_WS_SSE2
+    done += mask_sse2(p + done, size - done, key);
+#elif HTTP_SERVER_WS_NEON
+    done += mask_neon(p + done, size - done, key);
+#endif
+    mask_scalar(p + done, size - done, key);
+}
+
 } // namespace http_server
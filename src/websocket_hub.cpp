@@ -0,0 +1,208 @@
+/**
+ * @file websocket_hub.cpp
+ * @brief Implementation of the WebSocketHub class for broadcasting to topic subscribers.
+ */
+#include "websocket_hub.hpp"
+#include <algorithm>
+#include <mutex>
+
+namespace http_server {
+
+namespace {
+
+// The event loop behind an executor; for a strand, the loop the strand runs on
+const boost::asio::execution_context* loop_of(const boost::asio::any_io_executor& executor) {
+    return &boost::asio::query(executor, boost::asio::execution::context);
+}
+
+// Compares ownership, which needs no reference count traffic
+bool same_connection(const std::weak_ptr<WebSocketConnection>& subscriber,
+                     const std::shared_ptr<WebSocketConnection>& connection) {
+    return !subscriber.owner_before(connection) && !connection.owner_before(subscriber);
+}
+
+} // namespace
+
+WebSocketHub::WebSocketHub(size_t high_water_mark, SlowConsumerPolicy policy, const WebSocketDeflateOptions& deflate)
+    : high_water_mark_(high_water_mark)
+    , policy_(policy)
+    , deflate_(deflate) {
+    // Under context takeover every connection's stream has its own history,
+    // so there is nothing to share
+    if (deflate_.enabled && !deflate_.server_context_takeover) {
+        deflater_ = compression::StreamCompressor::create_raw_deflate(deflate_.server_max_window_bits, deflate_.level);
+    }
+}
+
+template <typename Predicate>
+void WebSocketHub::remove_subscribers(const std::string& topic, const boost::asio::execution_context* context,
+                                      Predicate predicate) {
+    std::unique_lock lock(mutex_);
+    auto topic_it = topics_.find(topic);
+    if (topic_it == topics_.end()) {
+        return;
+    }
+    auto group_it = topic_it->second.find(context);
+    if (group_it == topic_it->second.end()) {
+        return;
+    }
+    auto& subscribers = group_it->second.subscribers;
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), predicate), subscribers.end());
+    if (subscribers.empty()) {
+        topic_it->second.erase(group_it);
+        if (topic_it->second.empty()) {
+            topics_.erase(topic_it);
+        }
+    }
+}
+
+void WebSocketHub::subscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection) {
+    auto executor = connection->get_executor();
+    auto* context = loop_of(executor);
+
+    std::unique_lock lock(mutex_);
+    auto& group = topics_[topic][context];
+    if (!group.executor) {
+        // Every socket here comes from an io_context. One task serves the
+        // whole group; the strand keeps one publisher's messages in order.
+        auto& io_context = static_cast<boost::asio::io_context&>(
+            const_cast<boost::asio::execution_context&>(*context));
+        group.executor = boost::asio::make_strand(io_context);
+    }
+    for (const auto& subscriber : group.subscribers) {
+        if (same_connection(subscriber, connection)) {
+            return;
+        }
+    }
+    group.subscribers.push_back(connection);
+}
+
+void WebSocketHub::unsubscribe(const std::string& topic, const std::shared_ptr<WebSocketConnection>& connection) {
+    remove_subscribers(topic, loop_of(connection->get_executor()),
+        [&connection](const std::weak_ptr<WebSocketConnection>& subscriber) {
+            return subscriber.expired() || same_connection(subscriber, connection);
+        });
+}
+
+size_t WebSocketHub::publish(const std::string& topic, std::span<const uint8_t> payload, WebSocketOpcode opcode) {
+    WebSocketConnection::SharedFrame frame;
+    WebSocketConnection::SharedFrame deflated;
+    size_t count = 0;
+
+    std::shared_lock lock(mutex_);
+    auto topic_it = topics_.find(topic);
+    if (topic_it == topics_.end()) {
+        return 0;
+    }
+    for (const auto& [context, group] : topic_it->second) {
+        if (!frame) {
+            frame = std::make_shared<const std::vector<uint8_t>>(WebSocketFrame::encode(opcode, payload));
+            deflated = deflate_frame(opcode, payload);
+        }
+        count += group.subscribers.size();
+        boost::asio::post(group.executor, [this, topic, context = context, frame, deflated] {
+            deliver(topic, context, frame, deflated);
+        });
+    }
+    return count;
+}
+
+size_t WebSocketHub::publish(const std::string& topic, std::string_view message) {
+    return publish(topic, std::span(reinterpret_cast<const uint8_t*>(message.data()), message.size()),
+                   WebSocketOpcode::TEXT);
+}
+
+size_t WebSocketHub::subscriber_count(const std::string& topic) const {
+    std::shared_lock lock(mutex_);
+    auto topic_it = topics_.find(topic);
+    if (topic_it == topics_.end()) {
+        return 0;
+    }
+    size_t count = 0;
+    for (const auto& [context, group] : topic_it->second) {
+        count += group.subscribers.size();
+    }
+    return count;
+}
+
+void WebSocketHub::clear() {
+    std::unique_lock lock(mutex_);
+    topics_.clear();
+}
+
+WebSocketConnection::SharedFrame WebSocketHub::deflate_frame(WebSocketOpcode opcode, std::span<const uint8_t> payload) {
+    if (!deflater_ || payload.size() < deflate_.min_size) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(deflate_mutex_);
+    deflated_.clear();
+    bool deflated = WebSocketUtils::deflate_message(*deflater_, payload, deflated_);
+    if (!deflater_->reset() || !deflated) {
+        return nullptr;
+    }
+    auto compressed = std::span(reinterpret_cast<const uint8_t*>(deflated_.data()), deflated_.size());
+    return std::make_shared<const std::vector<uint8_t>>(WebSocketFrame::encode(opcode, compressed, true, true));
+}
+
+void WebSocketHub::deliver(const std::string& topic, const boost::asio::execution_context* context,
+                           const WebSocketConnection::SharedFrame& frame,
+                           const WebSocketConnection::SharedFrame& deflated) {
+    // Take the live subscribers out under the lock and send without it:
+    // sending may close a connection, whose handlers may unsubscribe
+    std::vector<std::shared_ptr<WebSocketConnection>> targets;
+    bool expired = false;
+    {
+        std::shared_lock lock(mutex_);
+        auto topic_it = topics_.find(topic);
+        if (topic_it == topics_.end()) {
+            return;
+        }
+        auto group_it = topic_it->second.find(context);
+        if (group_it == topic_it->second.end()) {
+            return;
+        }
+        targets.reserve(group_it->second.subscribers.size());
+        for (const auto& subscriber : group_it->second.subscribers) {
+            if (auto connection = subscriber.lock()) {
+                targets.push_back(std::move(connection));
+            } else {
+                expired = true;
+            }
+        }
+    }
+
+    for (auto& connection : targets) {
+        // Runs inline unless the connection sits on a strand of its own
+        auto executor = connection->get_executor();
+        boost::asio::dispatch(executor, [this, connection = std::move(connection), frame, deflated] {
+            if (!connection->is_open()) {
+                return;
+            }
+            // The deflated copy needs a peer that accepts our full window
+            const auto& chosen = deflated && connection->shared_deflate_window_bits() >= deflate_.server_max_window_bits
+                ? deflated : frame;
+            if (connection->queued_bytes() + chosen->size() > high_water_mark_) {
+                if (policy_ == SlowConsumerPolicy::DISCONNECT) {
+                    disconnected_.fetch_add(1, std::memory_order_relaxed);
+                    connection->close(1008, "Subscriber too slow");
+                } else {
+                    skipped_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return;
+            }
+            connection->send_shared(chosen);
+        });
+    }
+
+    if (expired) {
+        prune(topic, context);
+    }
+}
+
+void WebSocketHub::prune(const std::string& topic, const boost::asio::execution_context* context) {
+    remove_subscribers(topic, context, [](const std::weak_ptr<WebSocketConnection>& subscriber) {
+        return subscriber.expired();
+    });
+}
+
+} // namespace http_server